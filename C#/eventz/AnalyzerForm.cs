@@ -51,7 +51,7 @@ The second option is to start the live capture of the events right now (admin ri
         private void RunDriver() { }
         private void RunDcomm() 
         {
-            System.Diagnostics.Process.Start(@"C:\Users\andre_000\OneDrive\Documents\Visual Studio 2013\Projects\dmark\C++\Debug\dcomm.exe");
+            System.Diagnostics.Process.Start(@"C:\Users\andre_000\OneDrive\Documents\Visual Studio 2013\Projects\dmark\C++\Debug\dcomm.exe", "-analyzer");
         }
 
         private Event EventFromProcMonString(string line)
@@ -205,9 +205,11 @@ The second option is to start the live capture of the events right now (admin ri
                         }
                         RunDriver();
                     }
-                    RunDcomm();
-
+                    // Listen before dcomm starts so its first connect works
                     NamedPipe pipe = new NamedPipe(@"\\.\pipe\dcommconnection", 0, this);
+                    pipe.Start();
+
+                    RunDcomm();
                 }
             }
             else
@@ -298,6 +300,8 @@ The second option is to start the live capture of the events right now (admin ri
         }
 
         private List<IAnalyzer> analyzis = new List<IAnalyzer>();
+        // The modules that asked for events, see IAnalyzer.GetInformation.
+        private List<IAnalyzer> subscribers = new List<IAnalyzer>();
 
         public delegate void ProcessResultDelegate(Result res);
 
@@ -327,21 +331,21 @@ The second option is to start the live capture of the events right now (admin ri
             {
                 i.Initialize();
                 string useless = null;
-                bool delete = false;
-                i.GetInformation(out useless, out useless, out useless, out delete);
-                if (delete) ;
-                    //analyzis[analyzis.IndexOf(i)] = null;
+                bool noSubscription = false;
+                i.GetInformation(out useless, out useless, out useless, out noSubscription);
+                // Modules that do all their work in Initialize never see events.
+                if (!noSubscription)
+                {
+                    subscribers.Add(i);
+                }
             }
         }
 
         public void ProcessEvent(Event evt)
         {
-            foreach(var i in analyzis)
+            foreach (var i in subscribers)
             {
-                if (i != null)
-                {
-                    i.ProcessEvent(evt);
-                }
+                i.ProcessEvent(evt);
             }
 
             AddEventToEventList(evt);
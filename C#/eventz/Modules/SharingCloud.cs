@@ -22,6 +22,11 @@ namespace eventz.Modules
             noSubscription = false;
         }
 
+        // Matched with their subdomains against the server name of a flow's TLS
+        // ClientHello, which the collector appends to the path as "sni <name>",
+        // so that the services are found in a browser as well.
+        private string[] CloudHosts = { "dropbox.com", "dropboxapi.com", "dropboxusercontent.com", "drive.google.com", "drive.usercontent.google.com" };
+
         private bool RunningReported = false;
         private bool TransferReported = false;
 
@@ -43,6 +48,23 @@ namespace eventz.Modules
                 RunningReported = TransferReported = true;
             }
 
+            if (!TransferReported && evt.OpClass == OperationClass.Packet)
+            {
+                string serverName = GetServerName(evt.OperationPath);
+                if (serverName != null)
+                {
+                    foreach (var h in CloudHosts)
+                    {
+                        if (serverName == h || serverName.EndsWith("." + h))
+                        {
+                            resultDelegate(new Result("Sharing service", "\"" + evt.ProcessName + "\" transmits data to the sharing service " + serverName + ". Please stop using it", 0, 90, evt.id));
+                            TransferReported = true;
+                            break;
+                        }
+                    }
+                }
+            }
+
             if (RunningReported)
             {
                 return;
@@ -54,5 +76,18 @@ namespace eventz.Modules
                 RunningReported = true;
             }
         }
+
+        private static string GetServerName(string path)
+        {
+            int start = path.IndexOf(" sni ");
+            if (start < 0)
+            {
+                return null;
+            }
+
+            string serverName = path.Substring(start + 5);
+            int end = serverName.IndexOf(' ');
+            return end < 0 ? serverName : serverName.Substring(0, end);
+        }
     }
 }
@@ -13,6 +13,11 @@ namespace eventz.Modules
             resultDelegate = callback;
         }
 
+        // The collector appends what the payload scanner found to the path as
+        // "proto <name>"; bittorrent, bittorrent-dht and bittorrent-tracker all
+        // match, whatever the client is called.
+        private const string TorrentProtocol = " proto bittorrent";
+
         private AnalyzerForm.ProcessResultDelegate resultDelegate;
         private bool TorrentRunningReported = false;
         private bool TorrentTransferReported = false;
@@ -37,6 +42,12 @@ namespace eventz.Modules
                 TorrentRunningReported = TorrentTransferReported = true;
             }
 
+            if (!TorrentTransferReported && evt.OpClass == OperationClass.Packet && evt.OperationPath.Contains(TorrentProtocol))
+            {
+                resultDelegate(new Result("Torrent traffic", "\"" + evt.ProcessName + "\" transmits data over the BitTorrent protocol. Please disable it immediately", 0, 100, evt.id));
+                TorrentTransferReported = true;
+            }
+
             if (TorrentRunningReported)
             {
                 return;
@@ -59,7 +59,7 @@ namespace eventz.Modules
 
             if (evt.OpClass == OperationClass.Packet)
             {
-                AddOneToDict(evt.ProcessName, evt.OperationPath.Contains("[icmp]"));
+                AddOneToDict(evt.ProcessName, evt.OperationPath.Contains("[icmp]") || evt.OperationPath.StartsWith("ICMP "));
             }
             
             foreach (var i in total.Keys)
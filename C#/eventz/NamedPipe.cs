@@ -1,5 +1,6 @@
 ﻿using Microsoft.Win32.SafeHandles;
 using System;
+using System.Diagnostics;
 using System.IO;
 using System.Runtime.InteropServices;
 using System.Text;
@@ -38,7 +39,7 @@ namespace eventz
             public FileStream stream;
         }
 
-        public const int BUFFER_SIZE = 100;
+        public const int BUFFER_SIZE = 256 * 1024;
         public Client clientse = null;
 
         public string pipeName;
@@ -85,49 +86,120 @@ namespace eventz
                 }
             }
         }
-        private void Read()
+        // dcomm's event stream, see C++/dcomm/eventstream.h: a hello, then
+        // frames of whole MARK_EVENT records.
+        const uint STREAM_MAGIC = 0x50544B4D;
+        const ushort STREAM_VERSION = 1;
+        const int STREAM_HELLO_SIZE = 16;
+        const int STREAM_FRAME_SIZE = 16;
+        const ushort STREAM_FRAME_EVENTS = 1;
+        const int STREAM_MAX_FRAME = 16 * 1024 * 1024;
+
+        const int MARK_EVENT_SIZE = 1056;
+        const int TIME_OFFSET = 992;
+
+        private static bool ReadExactly(Stream stream, byte[] buffer, int count)
         {
-            byte[] buffer = null;
-            ASCIIEncoding encoder = new ASCIIEncoding();
+            int done = 0;
 
-            while (true)
+            while (done < count)
             {
+                int read = stream.Read(buffer, done, count - done);
+                if (read == 0)
+                    return false;
+                done += read;
+            }
+            return true;
+        }
 
-                int bytesRead = 0;
+        private static string ReadString(byte[] buffer, int offset, int size)
+        {
+            string str = Encoding.Unicode.GetString(buffer, offset, size);
+            int end = str.IndexOf('\0');
 
-                try
-                {
-                    buffer = new byte[BUFFER_SIZE];
-                    bytesRead = clientse.stream.Read(buffer, 0, BUFFER_SIZE);
-                }
-                catch
-                {
-                    break;
-                }
+            return end < 0 ? str : str.Substring(0, end);
+        }
 
-                if (bytesRead == 0)
-                    break;
+        // Event times come from the collector's monotonic clock in 100 ns
+        // units, the same performance counter the Stopwatch reads.
+        private static DateTime EventTime(long time)
+        {
+            long now = (long)(Stopwatch.GetTimestamp() * (10000000.0 / Stopwatch.Frequency));
 
-                int ReadLength = 0;
-                for (int i = 0; i < BUFFER_SIZE; i++)
-                {
-                    if (buffer[i].ToString("x2") != "cc")
-                    {
-                        ReadLength++;
-                    }
-                    else
-                        break;
-                }
-                if (ReadLength > 0)
-                {
-                    byte[] Rc = new byte[ReadLength];
-                    Buffer.BlockCopy(buffer, 0, Rc, 0, ReadLength);
+            return DateTime.Now.AddTicks(Math.Min(0, time - now));
+        }
+
+        private static Event ParseEvent(byte[] buffer, int offset)
+        {
+            int opclass = BitConverter.ToInt32(buffer, offset + TIME_OFFSET + 24);
+            int optype = BitConverter.ToInt32(buffer, offset + TIME_OFFSET + 28);
+
+            return new Event(
+                ReadString(buffer, offset, 64),
+                ReadString(buffer, offset + 64, 64),
+                ReadString(buffer, offset + 128, 352),
+                ReadString(buffer, offset + 480, 512),
+                EventTime(BitConverter.ToInt64(buffer, offset + TIME_OFFSET)),
+                BitConverter.ToInt32(buffer, offset + TIME_OFFSET + 8),
+                BitConverter.ToInt32(buffer, offset + TIME_OFFSET + 12),
+                BitConverter.ToInt32(buffer, offset + TIME_OFFSET + 16),
+                BitConverter.ToInt32(buffer, offset + TIME_OFFSET + 20),
+                (OperationClass)(opclass - 1),
+                (OperationType)(optype - 1));
+        }
 
-                    Event evt = new Event("1", "2", "3", "4", DateTime.Now, 0, 0, 0, 0, OperationClass.File, OperationType.Write);
+        private bool ReadStream(Stream stream)
+        {
+            byte[] header = new byte[STREAM_FRAME_SIZE];
+            byte[] buffer = new byte[BUFFER_SIZE];
+
+            if (!ReadExactly(stream, header, STREAM_HELLO_SIZE))
+                return false;
+
+            if (BitConverter.ToUInt32(header, 0) != STREAM_MAGIC ||
+                BitConverter.ToUInt16(header, 4) != STREAM_VERSION ||
+                BitConverter.ToUInt16(header, 6) != STREAM_FRAME_SIZE ||
+                BitConverter.ToUInt32(header, 8) != MARK_EVENT_SIZE)
+                return false;
+
+            while (ReadExactly(stream, header, STREAM_FRAME_SIZE))
+            {
+                int length = BitConverter.ToInt32(header, 0);
+                ushort type = BitConverter.ToUInt16(header, 4);
+                int count = BitConverter.ToUInt16(header, 6);
+
+                if (length < 0 || length > STREAM_MAX_FRAME)
+                    return false;
+
+                if (length > buffer.Length)
+                    buffer = new byte[length];
+
+                if (!ReadExactly(stream, buffer, length))
+                    return false;
+
+                // Unknown frame types are skipped, see eventstream.h
+                if (type != STREAM_FRAME_EVENTS)
+                    continue;
 
-                    form.ProcessEvent(evt);
+                if (length != count * MARK_EVENT_SIZE)
+                    return false;
+
+                for (int i = 0; i < count; i++)
+                {
+                    form.ProcessEvent(ParseEvent(buffer, i * MARK_EVENT_SIZE));
                 }
+            }
+            return true;
+        }
 
+        private void Read()
+        {
+            try
+            {
+                ReadStream(clientse.stream);
+            }
+            catch
+            {
             }
 
             clientse.stream.Close();
@@ -0,0 +1,179 @@
+#include "bench.h"
+#include "../dcomm/platform.h"
+#include "../sys/core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+BENCH_OPTIONS g_BenchOptions = { NULL, BENCH_DEFAULT_RUNS };
+volatile unsigned long long g_BenchSink = 0;
+
+int BenchSelected(const char* name)
+{
+    return !g_BenchOptions.filter || strstr(name, g_BenchOptions.filter) != NULL;
+}
+
+static unsigned long long TimeRun(BENCH_ROUTINE routine, void* context, unsigned long long operations)
+{
+    unsigned long long start = MarkClockNanoseconds();
+    routine(context, operations);
+    return MarkClockNanoseconds() - start;
+}
+
+static int CompareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+void PrintBenchmarkHeader()
+{
+    printf("name,ns_per_op,min_ns_per_op,mb_per_s,ops\n");
+}
+
+void RunBenchmark(const char* name, BENCH_ROUTINE routine, void* context, unsigned long long bytesPerOp)
+{
+    double samples[64];
+    unsigned long long operations = 1;
+    unsigned long long elapsed;
+    int runs = MIN(MAX(g_BenchOptions.runs, 1), 64);
+    int i;
+
+    if (!BenchSelected(name))
+    {
+        return;
+    }
+
+    // Warm up and grow the batch until one run takes long enough to time.
+    while ((elapsed = TimeRun(routine, context, operations)) < BENCH_TARGET_NS / 10 && operations < (1ULL << 40))
+    {
+        operations *= 10;
+    }
+    if (elapsed < BENCH_TARGET_NS)
+    {
+        operations = (unsigned long long)((double)operations * BENCH_TARGET_NS / MAX(elapsed, 1));
+    }
+
+    for (i = 0; i < runs; i++)
+    {
+        samples[i] = (double)TimeRun(routine, context, operations) / operations;
+    }
+    qsort(samples, runs, sizeof(double), CompareDoubles);
+
+    double median = samples[runs / 2];
+    printf("%s,%.2f,%.2f,%.1f,%llu\n",
+        name,
+        median,
+        samples[0],
+        bytesPerOp ? bytesPerOp / median * 1000000000.0 / (1024 * 1024) : 0.0,
+        operations);
+    fflush(stdout);
+}
+
+static int LoadResults(const char* path, PBENCH_RESULT results, int capacity)
+{
+    char line[512];
+    int count = 0;
+
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        printf("Cannot open %s\n", path);
+        return -1;
+    }
+
+    while (count < capacity && fgets(line, sizeof(line), file))
+    {
+        PBENCH_RESULT result = &results[count];
+        char* comma = strchr(line, ',');
+
+        if (!comma || comma - line >= BENCH_NAME_SIZE || !strncmp(line, "name,", 5))
+        {
+            continue;
+        }
+
+        memcpy(result->name, line, comma - line);
+        result->name[comma - line] = 0;
+
+        if (sscanf(comma + 1, "%lf,%lf,%lf,%llu", &result->nsPerOp, &result->minNsPerOp,
+            &result->mbPerSecond, &result->operations) == 4)
+        {
+            count++;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+static PBENCH_RESULT FindResult(PBENCH_RESULT results, int count, const char* name)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!strcmp(results[i].name, name))
+        {
+            return &results[i];
+        }
+    }
+
+    return NULL;
+}
+
+int CompareBenchmarks(const char* baseline, const char* current, double threshold)
+{
+    static BENCH_RESULT before[BENCH_MAX_RESULTS], after[BENCH_MAX_RESULTS];
+    int regressions = 0;
+    int i;
+
+    int beforeCount = LoadResults(baseline, before, BENCH_MAX_RESULTS);
+    int afterCount = LoadResults(current, after, BENCH_MAX_RESULTS);
+    if (beforeCount < 0 || afterCount < 0)
+    {
+        return -1;
+    }
+
+    printf("%-40s %12s %12s %8s\n", "name", "baseline ns", "current ns", "change");
+
+    for (i = 0; i < afterCount; i++)
+    {
+        PBENCH_RESULT old = FindResult(before, beforeCount, after[i].name);
+
+        if (!old)
+        {
+            printf("%-40s %12s %12.2f %8s  new\n", after[i].name, "-", after[i].nsPerOp, "-");
+            continue;
+        }
+
+        // The best run is the least noisy figure, so both must be slower.
+        double change = (after[i].nsPerOp - old->nsPerOp) * 100.0 / old->nsPerOp;
+        double bestChange = (after[i].minNsPerOp - old->minNsPerOp) * 100.0 / old->minNsPerOp;
+        const char* verdict = "";
+
+        if (change > threshold && bestChange > threshold)
+        {
+            verdict = "  REGRESSION";
+            regressions++;
+        }
+        else if (change < -threshold && bestChange < -threshold)
+        {
+            verdict = "  improved";
+        }
+
+        printf("%-40s %12.2f %12.2f %+7.1f%%%s\n", after[i].name, old->nsPerOp, after[i].nsPerOp, change, verdict);
+    }
+
+    for (i = 0; i < beforeCount; i++)
+    {
+        if (!FindResult(after, afterCount, before[i].name))
+        {
+            printf("%-40s %12.2f %12s %8s  missing\n", before[i].name, before[i].nsPerOp, "-", "-");
+        }
+    }
+
+    printf("%d regression(s) over %.1f%%\n", regressions, threshold);
+
+    return regressions;
+}
\ No newline at end of file
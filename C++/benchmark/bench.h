@@ -0,0 +1,52 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+// Minimal benchmark harness. Each case runs a routine for a calibrated
+// number of operations, repeats it and reports the median and the best
+// time per operation as one CSV line:
+//
+//   name,ns_per_op,min_ns_per_op,mb_per_s,ops
+//
+// mb_per_s is 0 for cases that do not declare a byte count per operation.
+
+#define BENCH_NAME_SIZE 64
+#define BENCH_MAX_RESULTS 256
+#define BENCH_DEFAULT_RUNS 5
+#define BENCH_TARGET_NS 50000000ULL // per run
+#define BENCH_DEFAULT_THRESHOLD 10.0 // percent
+
+typedef void (*BENCH_ROUTINE)(void* context, unsigned long long operations);
+
+typedef struct _BENCH_RESULT
+{
+    char name[BENCH_NAME_SIZE];
+    double nsPerOp;
+    double minNsPerOp;
+    double mbPerSecond;
+    unsigned long long operations;
+} BENCH_RESULT, *PBENCH_RESULT;
+
+typedef struct _BENCH_OPTIONS
+{
+    const char* filter; // substring of the case names to run, NULL for all
+    int runs;
+} BENCH_OPTIONS, *PBENCH_OPTIONS;
+
+extern BENCH_OPTIONS g_BenchOptions;
+
+// Results accumulate into a sink the optimizer cannot see through.
+extern volatile unsigned long long g_BenchSink;
+
+int BenchSelected(const char* name);
+// bytesPerOp may be 0. Prints the CSV line to stdout.
+void RunBenchmark(const char* name, BENCH_ROUTINE routine, void* context, unsigned long long bytesPerOp);
+
+void PrintBenchmarkHeader();
+
+// Compares two result files and prints one line per case. Returns the
+// number of cases slower than baseline by more than threshold percent.
+int CompareBenchmarks(const char* baseline, const char* current, double threshold);
+
+void RunAllCases();
+
+#endif
\ No newline at end of file
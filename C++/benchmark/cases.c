@@ -0,0 +1,1050 @@
+#include "bench.h"
+#include "../dcomm/communicator.h"
+#include "../dcomm/dnscache.h"
+#include "../dcomm/eventstream.h"
+#include "../dcomm/lz.h"
+#include "../dcomm/packetdecode.h"
+#include "../dcomm/payloadscan.h"
+#include "../dcomm/segment.h"
+#include "../dcomm/subscription.h"
+#include "../dcomm/tlshello.h"
+#include "../sys/core.h"
+#include "../sys/processtable.h"
+#include "../usermodesimulation/umimpl.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_COUNT 65536
+#define FIRST_PID 1000
+#define MISS_OFFSET 0x100000
+
+// Keys in the order they are looked up: a fixed shuffle so that probes do
+// not walk the table sequentially.
+static int s_keys[KEY_COUNT];
+
+static void FillProcess(PMARK_PROCESS process, int pid)
+{
+    memset(process, 0, sizeof(*process));
+    MARK_SET_TEXT(process->szImagePath, "\\Device\\HarddiskVolume2\\Windows\\System32\\svchost.exe");
+    MARK_SET_TEXT(process->szProcessName, "svchost.exe -k netsvcs");
+    MARK_SET_TEXT(process->szUserName, "Unknown");
+    process->pid = pid;
+    process->ppid = 4;
+}
+
+static void FillEvent(PMARK_EVENT evt, int i)
+{
+    char path[128];
+
+    memset(evt, 0, sizeof(*evt));
+    MARK_SET_TEXT(evt->szImagePath, "\\Device\\HarddiskVolume2\\Program Files (x86)\\Google\\Chrome\\Application\\chrome.exe");
+    MARK_SET_TEXT(evt->szProcessName, "chrome.exe --type=renderer");
+    MARK_SET_TEXT(evt->szUserName, "Unknown");
+    sprintf(path, "\\Users\\user\\AppData\\Local\\Google\\Chrome\\User Data\\Default\\Cache\\f_%06x", i * 7919 % 100000);
+    MARK_SET_TEXT(evt->szOperationPath, path);
+
+    evt->time = 1000 + i * 250;
+    evt->pid = FIRST_PID + (i % 37) * 4;
+    evt->ppid = 4;
+    evt->tid = evt->pid * 16 + (i % 5) * 4;
+    evt->opclass = MARK_OPCLASS_FILE;
+    evt->optype = MARK_OPTYPE_WRITE;
+}
+
+// Process table
+
+typedef struct _TABLE_CONTEXT
+{
+    int load;
+    int next; // churn: next key to insert, keys[next - load] is the oldest
+} TABLE_CONTEXT, *PTABLE_CONTEXT;
+
+static void PrepareTable(PTABLE_CONTEXT context, int load)
+{
+    MARK_PROCESS process;
+    int i;
+
+    ClearProcessTable();
+    for (i = 0; i < load; i++)
+    {
+        FillProcess(&process, s_keys[i]);
+        InsertValue(s_keys[i], &process);
+    }
+
+    context->load = load;
+    context->next = load;
+}
+
+static void FindHit(void* parameter, unsigned long long operations)
+{
+    PTABLE_CONTEXT context = (PTABLE_CONTEXT)parameter;
+    unsigned long long i;
+    unsigned long long found = 0;
+
+    for (i = 0; i < operations; i++)
+    {
+        found += FindKey(s_keys[(i * 40503) % context->load]) != NULL;
+    }
+    g_BenchSink += found;
+}
+
+static void FindMiss(void* parameter, unsigned long long operations)
+{
+    PTABLE_CONTEXT context = (PTABLE_CONTEXT)parameter;
+    unsigned long long i;
+    unsigned long long found = 0;
+
+    // Absent pids that hash onto the same cells as the live ones.
+    for (i = 0; i < operations; i++)
+    {
+        found += FindKey(s_keys[(context->next + i * 40503) % KEY_COUNT] + MISS_OFFSET) != NULL;
+    }
+    g_BenchSink += found;
+}
+
+// Start one process and retire the oldest, the way churn looks to the table.
+static void Churn(void* parameter, unsigned long long operations)
+{
+    PTABLE_CONTEXT context = (PTABLE_CONTEXT)parameter;
+    MARK_PROCESS process;
+    unsigned long long i;
+
+    FillProcess(&process, 0);
+    for (i = 0; i < operations; i++)
+    {
+        int key = s_keys[context->next % KEY_COUNT];
+        int oldest = s_keys[(context->next - context->load) % KEY_COUNT];
+
+        process.pid = key;
+        InsertValue(key, &process);
+        DeleteKey(oldest);
+        context->next++;
+    }
+}
+
+static void ProcessTableCases()
+{
+    static const int loads[] = { 1024, 16384, 49152 };
+    TABLE_CONTEXT context;
+    char name[BENCH_NAME_SIZE];
+    int i;
+
+    for (i = 0; i < KEY_COUNT; i++)
+    {
+        s_keys[i] = FIRST_PID + i * 4;
+    }
+    for (i = KEY_COUNT - 1; i > 0; i--)
+    {
+        int j = (int)((unsigned long long)i * 2654435761U % (i + 1));
+        int key = s_keys[i];
+        s_keys[i] = s_keys[j];
+        s_keys[j] = key;
+    }
+
+    for (i = 0; i < (int)(sizeof(loads) / sizeof(loads[0])); i++)
+    {
+        sprintf(name, "proctable.find_hit/load=%d", loads[i]);
+        if (BenchSelected(name))
+        {
+            PrepareTable(&context, loads[i]);
+            RunBenchmark(name, FindHit, &context, 0);
+        }
+
+        sprintf(name, "proctable.find_miss/load=%d", loads[i]);
+        if (BenchSelected(name))
+        {
+            PrepareTable(&context, loads[i]);
+            RunBenchmark(name, FindMiss, &context, 0);
+        }
+
+        sprintf(name, "proctable.churn/load=%d", loads[i]);
+        if (BenchSelected(name))
+        {
+            PrepareTable(&context, loads[i]);
+            RunBenchmark(name, Churn, &context, 0);
+        }
+    }
+
+    // Deleted cells are never reclaimed, so lookups after a long run of
+    // churn keep probing tombstones.
+    sprintf(name, "proctable.find_miss/churned");
+    if (BenchSelected(name))
+    {
+        PrepareTable(&context, 1024);
+        Churn(&context, KEY_COUNT * 4);
+        RunBenchmark(name, FindMiss, &context, 0);
+    }
+
+    ClearProcessTable();
+}
+
+// Event construction
+
+static void BuildEvent(void* parameter, unsigned long long operations)
+{
+    static unsigned short unknown[256] = { 'U', 'n', 'k', 'n', 'o', 'w', 'n', 0 };
+    MARK_EVENT NewEvent;
+    unsigned long long i;
+
+    UNREFERENCED_PARAMETER(parameter);
+
+    // Mirrors the file write callback in the driver.
+    for (i = 0; i < operations; i++)
+    {
+        int pid = s_keys[i % 512];
+        PMARK_PROCESS pProc = FindLoadProcess(pid);
+
+        memset(&NewEvent, 0, sizeof(NewEvent));
+        MarkCopyMemory(NewEvent.szImagePath, pProc ? pProc->szImagePath : unknown, sizeof(NewEvent.szImagePath));
+        MarkCopyMemory(NewEvent.szOperationPath, pProc ? pProc->szImagePath : unknown, sizeof(NewEvent.szImagePath));
+        MarkCopyMemory(NewEvent.szProcessName, pProc ? pProc->szProcessName : unknown, sizeof(NewEvent.szProcessName));
+        MarkCopyMemory(NewEvent.szUserName, pProc ? pProc->szUserName : unknown, sizeof(NewEvent.szUserName));
+
+        NewEvent.flags = 0;
+        NewEvent.time = (long long)i;
+        NewEvent.pid = pid;
+        NewEvent.ppid = pProc ? pProc->ppid : 0;
+        NewEvent.tid = -1;
+        NewEvent.opclass = MARK_OPCLASS_FILE;
+        NewEvent.optype = MARK_OPTYPE_WRITE;
+
+        g_BenchSink += NewEvent.ppid;
+    }
+}
+
+static void Generate(void* parameter, unsigned long long operations)
+{
+    PGENERATOR_OPTIONS options = (PGENERATOR_OPTIONS)parameter;
+    GENERATOR_STATS stats;
+    unsigned long long done = 0;
+
+    while (done < operations)
+    {
+        RunGenerator(options, &stats);
+        done += MAX(stats.events, 1);
+    }
+    g_BenchSink += done;
+}
+
+static void EventCases()
+{
+    GENERATOR_OPTIONS options;
+    TABLE_CONTEXT context;
+
+    if (BenchSelected("event.build"))
+    {
+        PrepareTable(&context, 512);
+        RunBenchmark("event.build", BuildEvent, NULL, sizeof(MARK_EVENT));
+        ClearProcessTable();
+    }
+
+    // ns per generated event; the generator runs whole workloads, so the
+    // operation count is rounded up to complete runs.
+    GetDefaultGeneratorOptions(&options);
+    options.duration = 0.1;
+    RunBenchmark("event.generate", Generate, &options, sizeof(MARK_EVENT));
+}
+
+// Text log formatting
+
+static void FormatMessages(void* parameter, unsigned long long operations)
+{
+    PMARK_EVENT events = (PMARK_EVENT)parameter;
+    char buffer[LOG_MESSAGE_SIZE];
+    unsigned long long i;
+    unsigned long long length = 0;
+
+    for (i = 0; i < operations; i++)
+    {
+        length += FormatLogMessage(&events[i % 64], buffer, sizeof(buffer));
+    }
+    g_BenchSink += length;
+}
+
+static void LoggerCases()
+{
+    static MARK_EVENT events[64];
+    int i;
+
+    for (i = 0; i < 64; i++)
+    {
+        FillEvent(&events[i], i);
+    }
+
+    RunBenchmark("logger.format", FormatMessages, events, 0);
+}
+
+// Packet parsing
+
+#define FRAME_SIZE 74
+
+typedef struct _FRAMES
+{
+    unsigned char data[64][FRAME_SIZE];
+} FRAMES, *PFRAMES;
+
+static void BuildFrames(PFRAMES frames, unsigned char protocol, int ipv4)
+{
+    int i;
+
+    memset(frames, 0, sizeof(*frames));
+    for (i = 0; i < 64; i++)
+    {
+        unsigned char* frame = frames->data[i];
+
+        frame[12] = 0x08;
+        frame[13] = ipv4 ? 0x00 : 0x06; // IPv4 or ARP
+        frame[14] = 0x45;
+        frame[23] = protocol;
+        frame[26] = 10;
+        frame[29] = (unsigned char)i;
+        frame[30] = 93;
+        frame[33] = (unsigned char)(i * 7);
+        frame[34] = (unsigned char)(i + 1);
+        frame[36] = 0x01;
+        frame[37] = 0xBB;
+    }
+}
+
+static void Decode(void* parameter, unsigned long long operations)
+{
+    PFRAMES frames = (PFRAMES)parameter;
+    MARK_EVENT evt;
+    unsigned long long i;
+    unsigned long long decoded = 0;
+
+    for (i = 0; i < operations; i++)
+    {
+        decoded += DecodePacket(frames->data[i % 64], FRAME_SIZE, &evt);
+    }
+    g_BenchSink += decoded;
+}
+
+// Frames of every layout the batch decoder reads, for it and for the per
+// packet decoder it replaced.
+
+#define FRAME_KIND_TCP 0     // IPv4 TCP, as BuildFrames
+#define FRAME_KIND_OPTIONS 1 // IPv4 with 4 or 8 bytes of options
+#define FRAME_KIND_IPV6 2    // IPv6 TCP, every other one behind a hop-by-hop header
+#define FRAME_KIND_VLAN 3    // 802.1Q tagged IPv4 UDP
+#define FRAME_KIND_MIXED 4   // all of the above and ARP, in turn
+#define FRAME_CAPACITY 128
+#define FRAME_COLD_STRIDE 2048  // a TPACKET ring frame
+#define FRAME_COLD_COUNT 32768  // 64 MB of ring, well past the last level cache
+
+// count is a power of two, at least 64.
+typedef struct _BATCH_FRAMES
+{
+    unsigned char* data;
+    unsigned int count;
+    const unsigned char** frames;
+    unsigned int* lengths;
+} BATCH_FRAMES, *PBATCH_FRAMES;
+
+static unsigned int BuildFrame(unsigned char* frame, int kind, int i)
+{
+    unsigned int offset = 14;
+    unsigned int transport;
+
+    memset(frame, 0, FRAME_CAPACITY);
+    if (kind == FRAME_KIND_MIXED)
+    {
+        kind = i % 5;
+        if (kind == FRAME_KIND_MIXED)
+        {
+            frame[12] = 0x08;
+            frame[13] = 0x06; // ARP
+            return 60;
+        }
+    }
+
+    if (kind == FRAME_KIND_VLAN)
+    {
+        frame[12] = 0x81;
+        frame[14] = 0x00;
+        frame[15] = (unsigned char)(i + 1);
+        offset += 4;
+    }
+
+    if (kind == FRAME_KIND_IPV6)
+    {
+        frame[offset - 2] = 0x86;
+        frame[offset - 1] = 0xDD;
+        frame[offset] = 0x60;
+        frame[offset + 6] = (i & 1) ? 0 : 6;
+        frame[offset + 8] = 0x20;
+        frame[offset + 9] = 0x01;
+        frame[offset + 23] = (unsigned char)i;
+        frame[offset + 24] = 0x20;
+        frame[offset + 25] = 0x01;
+        frame[offset + 39] = (unsigned char)(i * 7);
+        transport = offset + 40;
+        if (i & 1)
+        {
+            frame[transport] = 6; // hop-by-hop, 8 bytes
+            transport += 8;
+        }
+    }
+    else
+    {
+        unsigned int options = kind == FRAME_KIND_OPTIONS ? 4 * (1 + (i & 1)) : 0;
+
+        frame[offset - 2] = 0x08;
+        frame[offset] = (unsigned char)(0x45 + options / 4);
+        frame[offset + 9] = kind == FRAME_KIND_VLAN ? 17 : 6;
+        frame[offset + 12] = 10;
+        frame[offset + 15] = (unsigned char)i;
+        frame[offset + 16] = 93;
+        frame[offset + 19] = (unsigned char)(i * 7);
+        transport = offset + 20 + options;
+    }
+
+    frame[transport] = (unsigned char)(i + 1);
+    frame[transport + 2] = 0x01;
+    frame[transport + 3] = 0xBB;
+    frame[transport + 13] = 0x10;
+
+    return transport + 20;
+}
+
+static void BuildBatchFrames(PBATCH_FRAMES frames, int kind, unsigned int count, unsigned int stride)
+{
+    unsigned int i;
+
+    frames->data = (unsigned char*)malloc((size_t)count * stride);
+    frames->frames = (const unsigned char**)malloc(count * sizeof(*frames->frames));
+    frames->lengths = (unsigned int*)malloc(count * sizeof(*frames->lengths));
+    frames->count = count;
+    for (i = 0; i < count; i++)
+    {
+        unsigned char* frame = frames->data + (size_t)i * stride;
+
+        frames->lengths[i] = BuildFrame(frame, kind, i % 64);
+        frames->frames[i] = frame;
+    }
+}
+
+static void FreeBatchFrames(PBATCH_FRAMES frames)
+{
+    free(frames->data);
+    free((void*)frames->frames);
+    free(frames->lengths);
+}
+
+static void DecodeFlow(void* parameter, unsigned long long operations)
+{
+    PBATCH_FRAMES frames = (PBATCH_FRAMES)parameter;
+    PACKET_INFO info;
+    unsigned long long i;
+    unsigned long long sum = 0;
+
+    for (i = 0; i < operations; i++)
+    {
+        unsigned int index = (unsigned int)(i & (frames->count - 1));
+
+        if (DecodePacketFlow(frames->frames[index], frames->lengths[index], &info))
+        {
+            sum += info.key.sourcePort;
+        }
+    }
+    g_BenchSink += sum;
+}
+
+// One operation per frame, 64 to a batch.
+static void DecodeBatch(void* parameter, unsigned long long operations)
+{
+    PBATCH_FRAMES frames = (PBATCH_FRAMES)parameter;
+    PACKET_BATCH batch;
+    unsigned long long i;
+    unsigned long long sum = 0;
+
+    for (i = 0; i < operations; i += 64)
+    {
+        unsigned int first = (unsigned int)(i & (frames->count - 1));
+        unsigned int count = (unsigned int)MIN(operations - i, 64);
+        unsigned int j;
+
+        DecodePacketBatch(frames->frames + first, frames->lengths + first, count, &batch);
+        for (j = 0; j < count; j++)
+        {
+            if (batch.decoded >> j & 1)
+            {
+                sum += batch.info[j].key.sourcePort;
+            }
+        }
+    }
+    g_BenchSink += sum;
+}
+
+static void PacketCases()
+{
+    static FRAMES frames;
+    BATCH_FRAMES batch;
+    static const char* kinds[] = { "tcp", "options", "ipv6", "vlan", "mixed" };
+    char name[BENCH_NAME_SIZE];
+    int kind;
+
+    BuildFrames(&frames, 6, 1);
+    RunBenchmark("packet.decode/tcp", Decode, &frames, FRAME_SIZE);
+    BuildFrames(&frames, 17, 1);
+    RunBenchmark("packet.decode/udp", Decode, &frames, FRAME_SIZE);
+    BuildFrames(&frames, 6, 0);
+    RunBenchmark("packet.decode/non_ip", Decode, &frames, FRAME_SIZE);
+
+    // The flow decoder takes IPv4 only, so it skips the IPv6 and VLAN frames.
+    for (kind = FRAME_KIND_TCP; kind <= FRAME_KIND_MIXED; kind++)
+    {
+        BuildBatchFrames(&batch, kind, 64, FRAME_CAPACITY);
+        snprintf(name, sizeof(name), "packet.flow/%s", kinds[kind]);
+        RunBenchmark(name, DecodeFlow, &batch, 0);
+        snprintf(name, sizeof(name), "packet.batch/%s", kinds[kind]);
+        RunBenchmark(name, DecodeBatch, &batch, 0);
+        FreeBatchFrames(&batch);
+    }
+
+    // Frames that have to come from memory, as they do off a busy ring.
+    BuildBatchFrames(&batch, FRAME_KIND_TCP, FRAME_COLD_COUNT, FRAME_COLD_STRIDE);
+    RunBenchmark("packet.flow/cold", DecodeFlow, &batch, 0);
+    RunBenchmark("packet.batch/cold", DecodeBatch, &batch, 0);
+    FreeBatchFrames(&batch);
+}
+
+// DNS responses as the flow tables hand them to the cache
+
+typedef struct _DNS_MESSAGE
+{
+    unsigned char data[512];
+    unsigned int length;
+} DNS_MESSAGE, *PDNS_MESSAGE;
+
+static void PutName(PDNS_MESSAGE message, const char* name)
+{
+    while (*name)
+    {
+        const char* dot = strchr(name, '.');
+        unsigned int label = dot ? (unsigned int)(dot - name) : (unsigned int)strlen(name);
+
+        message->data[message->length++] = (unsigned char)label;
+        memcpy(message->data + message->length, name, label);
+        message->length += label;
+        name += label + (dot ? 1 : 0);
+    }
+    message->data[message->length++] = 0;
+}
+
+static void Put16(PDNS_MESSAGE message, unsigned int value)
+{
+    message->data[message->length++] = (unsigned char)(value >> 8);
+    message->data[message->length++] = (unsigned char)value;
+}
+
+// The owner is a pointer to where its name is written; data is rdata of
+// size bytes, or a name when size is 0.
+static unsigned int PutRecord(PDNS_MESSAGE message, unsigned int owner, unsigned int type, const void* data,
+    unsigned int size)
+{
+    unsigned int start;
+
+    Put16(message, 0xC000 | owner);
+    Put16(message, type);
+    Put16(message, 1);
+    Put16(message, 0);
+    Put16(message, 300);
+    Put16(message, 0);
+    start = message->length;
+    if (size)
+    {
+        memcpy(message->data + start, data, size);
+        message->length += size;
+    }
+    else
+    {
+        PutName(message, (const char*)data);
+    }
+    message->data[start - 2] = (unsigned char)((message->length - start) >> 8);
+    message->data[start - 1] = (unsigned char)(message->length - start);
+
+    return start;
+}
+
+// A name straight to its address, or through a CNAME to a CDN's two IPv4
+// and one IPv6 addresses, as most answers are.
+static void BuildDnsMessage(PDNS_MESSAGE message, int cname)
+{
+    static const unsigned char ipv4[2][4] = { { 93, 184, 216, 34 }, { 93, 184, 216, 35 } };
+    static const unsigned char ipv6[16] = { 0x20, 0x01, 0x0D, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+    unsigned int owner = 12;
+
+    memset(message, 0, sizeof(*message));
+    Put16(message, 0x1234);
+    Put16(message, 0x8180);
+    Put16(message, 1);
+    Put16(message, cname ? 4 : 1);
+    Put16(message, 0);
+    Put16(message, 0);
+    PutName(message, "www.example.com");
+    Put16(message, 1);
+    Put16(message, 1);
+
+    if (cname)
+    {
+        owner = PutRecord(message, owner, 5, "www.example.com.edgekey.net", 0);
+        PutRecord(message, owner, 1, ipv4[1], 4);
+        PutRecord(message, owner, 28, ipv6, 16);
+    }
+    PutRecord(message, owner, 1, ipv4[0], 4);
+}
+
+static void ParseDns(void* parameter, unsigned long long operations)
+{
+    PDNS_MESSAGE message = (PDNS_MESSAGE)parameter;
+    DNS_RESPONSE response;
+    unsigned long long i;
+    unsigned long long sum = 0;
+
+    for (i = 0; i < operations; i++)
+    {
+        ParseDnsResponse(message->data, message->length, &response);
+        sum += response.count;
+    }
+    g_BenchSink += sum;
+}
+
+static void DnsCases()
+{
+    static DNS_MESSAGE message;
+
+    BuildDnsMessage(&message, 0);
+    RunBenchmark("dns.parse/plain", ParseDns, &message, message.length);
+    BuildDnsMessage(&message, 1);
+    RunBenchmark("dns.parse/cname", ParseDns, &message, message.length);
+}
+
+// ClientHellos as browsers send them, with the SNI and ALPN behind a dozen
+// other extensions
+
+typedef struct _TLS_MESSAGE
+{
+    unsigned char data[1024];
+    unsigned int length;
+} TLS_MESSAGE, *PTLS_MESSAGE;
+
+static void PutTls(PTLS_MESSAGE message, unsigned int size, unsigned int value)
+{
+    while (size--)
+    {
+        message->data[message->length++] = (unsigned char)(value >> (size * 8));
+    }
+}
+
+// Patches the size bytes at start with the length written after them.
+static void SetTlsLength(PTLS_MESSAGE message, unsigned int start, unsigned int size)
+{
+    unsigned int length = message->length - start - size;
+    unsigned int i;
+
+    for (i = 0; i < size; i++)
+    {
+        message->data[start + i] = (unsigned char)(length >> ((size - 1 - i) * 8));
+    }
+}
+
+static void PutExtension(PTLS_MESSAGE message, unsigned int type, unsigned int size)
+{
+    PutTls(message, 2, type);
+    PutTls(message, 2, size);
+    memset(message->data + message->length, 0x5A, size);
+    message->length += size;
+}
+
+static void BuildClientHello(PTLS_MESSAGE message, const char* serverName)
+{
+    static const char* protocols[] = { "h2", "http/1.1" };
+    unsigned int record;
+    unsigned int handshake;
+    unsigned int extensions;
+    unsigned int start;
+    unsigned int i;
+
+    memset(message, 0, sizeof(*message));
+    record = message->length;
+    PutTls(message, 1, 22);
+    PutTls(message, 2, 0x0301);
+    PutTls(message, 2, 0);
+    handshake = message->length;
+    PutTls(message, 1, 1);
+    PutTls(message, 3, 0);
+    PutTls(message, 2, 0x0303);
+    message->length += 32; // random
+    PutTls(message, 1, 32);
+    message->length += 32; // session id
+    PutTls(message, 2, 32);
+    for (i = 0; i < 16; i++)
+    {
+        PutTls(message, 2, 0x1301 + i);
+    }
+    PutTls(message, 1, 1);
+    PutTls(message, 1, 0);
+
+    extensions = message->length;
+    PutTls(message, 2, 0);
+    PutExtension(message, 0x0A0A, 0);  // GREASE
+    PutExtension(message, 23, 0);      // extended master secret
+    PutExtension(message, 65281, 1);   // renegotiation info
+    PutExtension(message, 10, 10);     // supported groups
+    PutExtension(message, 11, 2);      // point formats
+    PutExtension(message, 35, 0);      // session ticket
+    PutExtension(message, 5, 5);       // status request
+    PutExtension(message, 13, 18);     // signature algorithms
+    PutExtension(message, 18, 0);      // signed certificate timestamps
+    PutExtension(message, 51, 43);     // key share
+    PutExtension(message, 45, 2);      // PSK modes
+    PutExtension(message, 43, 7);      // supported versions
+
+    if (serverName)
+    {
+        PutTls(message, 2, 0);
+        start = message->length;
+        PutTls(message, 2, 0);
+        PutTls(message, 2, 0);
+        PutTls(message, 1, 0);
+        PutTls(message, 2, (unsigned int)strlen(serverName));
+        memcpy(message->data + message->length, serverName, strlen(serverName));
+        message->length += (unsigned int)strlen(serverName);
+        SetTlsLength(message, start + 2, 2);
+        SetTlsLength(message, start, 2);
+    }
+
+    PutTls(message, 2, 16);
+    start = message->length;
+    PutTls(message, 2, 0);
+    PutTls(message, 2, 0);
+    for (i = 0; i < sizeof(protocols) / sizeof(protocols[0]); i++)
+    {
+        PutTls(message, 1, (unsigned int)strlen(protocols[i]));
+        memcpy(message->data + message->length, protocols[i], strlen(protocols[i]));
+        message->length += (unsigned int)strlen(protocols[i]);
+    }
+    SetTlsLength(message, start + 2, 2);
+    SetTlsLength(message, start, 2);
+
+    // Padded to 512 bytes of handshake, as Chrome does.
+    PutExtension(message, 21, message->length + 4 < 517 ? 517 - message->length - 4 : 0);
+    SetTlsLength(message, extensions, 2);
+    SetTlsLength(message, handshake + 1, 3);
+    SetTlsLength(message, record + 3, 2);
+}
+
+static void ParseTls(void* parameter, unsigned long long operations)
+{
+    PTLS_MESSAGE message = (PTLS_MESSAGE)parameter;
+    TLS_HELLO hello;
+    unsigned long long i;
+    unsigned long long sum = 0;
+
+    for (i = 0; i < operations; i++)
+    {
+        sum += ParseClientHello(message->data, message->length, &hello);
+        sum += (unsigned char)hello.serverName[0];
+    }
+    g_BenchSink += sum;
+}
+
+static void TlsCases()
+{
+    static TLS_MESSAGE message;
+
+    BuildClientHello(&message, "www.example.com");
+    RunBenchmark("tls.parse/sni", ParseTls, &message, message.length);
+    BuildClientHello(&message, NULL);
+    RunBenchmark("tls.parse/nosni", ParseTls, &message, message.length);
+}
+
+// Protocol signatures in the first bytes of a flow
+
+typedef struct _SCAN_CONTEXT
+{
+    PPAYLOAD_SCANNER scanner;
+    unsigned char transport;
+    unsigned char payload[PAYLOAD_SCAN_DEFAULT_BYTES];
+    unsigned int length;
+} SCAN_CONTEXT, *PSCAN_CONTEXT;
+
+static void Scan(void* parameter, unsigned long long operations)
+{
+    PSCAN_CONTEXT context = (PSCAN_CONTEXT)parameter;
+    unsigned long long i;
+    unsigned long long sum = 0;
+
+    for (i = 0; i < operations; i++)
+    {
+        sum += ScanPayload(context->scanner, context->transport, context->payload, context->length, 0,
+            PAYLOAD_SCAN_DEFAULT_BYTES);
+    }
+    g_BenchSink += sum;
+}
+
+static void SetScanPayload(PSCAN_CONTEXT context, unsigned char transport, const char* text, unsigned int length)
+{
+    context->transport = transport;
+    context->length = length;
+    memcpy(context->payload, text, length);
+}
+
+static void ScanCases()
+{
+    static const char request[] =
+        "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\nUser-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) "
+        "AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0 Safari/537.36\r\nAccept: text/html\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\nConnection: keep-alive\r\n\r\n";
+    static const char query[] = "d1:ad2:id20:abcdefghij0123456789e1:q4:ping1:t2:aa1:y1:qe";
+    static const char response[] = "d2:ip6:abcdef1:rd2:id20:abcdefghij01234567895:nodes0:e1:t2:aa1:y1:re";
+    static SCAN_CONTEXT context;
+
+    context.scanner = CreatePayloadScanner();
+    if (!context.scanner)
+    {
+        return;
+    }
+
+    // Nothing found, so every byte scanned: the common case and the dearest.
+    SetScanPayload(&context, 6, request, sizeof(request) - 1);
+    RunBenchmark("scan.payload/miss", Scan, &context, context.length);
+    SetScanPayload(&context, 6, "\x13" "BitTorrent protocol\0\0\0\0\0\x10\0\x05", 28);
+    RunBenchmark("scan.payload/anchored", Scan, &context, context.length);
+    SetScanPayload(&context, 17, query, sizeof(query) - 1);
+    RunBenchmark("scan.payload/dht", Scan, &context, context.length);
+    SetScanPayload(&context, 17, response, sizeof(response) - 1);
+    RunBenchmark("scan.payload/floating", Scan, &context, context.length);
+
+    DestroyPayloadScanner(context.scanner);
+}
+
+// Block codec used by segments
+
+typedef struct _CODEC_CONTEXT
+{
+    unsigned char* raw;
+    unsigned char* compressed;
+    unsigned char* output;
+    int compressedSize;
+} CODEC_CONTEXT, *PCODEC_CONTEXT;
+
+static void Compress(void* parameter, unsigned long long operations)
+{
+    PCODEC_CONTEXT context = (PCODEC_CONTEXT)parameter;
+    unsigned long long i;
+
+    for (i = 0; i < operations; i++)
+    {
+        g_BenchSink += LzCompress(context->raw, SEGMENT_BLOCK_SIZE, context->compressed, LzCompressBound(SEGMENT_BLOCK_SIZE));
+    }
+}
+
+static void Decompress(void* parameter, unsigned long long operations)
+{
+    PCODEC_CONTEXT context = (PCODEC_CONTEXT)parameter;
+    unsigned long long i;
+
+    for (i = 0; i < operations; i++)
+    {
+        g_BenchSink += LzDecompress(context->compressed, context->compressedSize, context->output, SEGMENT_BLOCK_SIZE);
+    }
+}
+
+static void CodecCases()
+{
+    CODEC_CONTEXT context;
+    PMARK_EVENT events;
+    int i;
+
+    context.raw = (unsigned char*)malloc(SEGMENT_BLOCK_SIZE);
+    context.compressed = (unsigned char*)malloc(LzCompressBound(SEGMENT_BLOCK_SIZE));
+    context.output = (unsigned char*)malloc(SEGMENT_BLOCK_SIZE);
+    if (!context.raw || !context.compressed || !context.output)
+    {
+        printf("Out of memory\n");
+        return;
+    }
+
+    memset(context.raw, 0, SEGMENT_BLOCK_SIZE);
+    events = (PMARK_EVENT)context.raw;
+    for (i = 0; i < SEGMENT_BLOCK_SIZE / (int)sizeof(MARK_EVENT); i++)
+    {
+        FillEvent(&events[i], i);
+    }
+    context.compressedSize = LzCompress(context.raw, SEGMENT_BLOCK_SIZE, context.compressed, LzCompressBound(SEGMENT_BLOCK_SIZE));
+
+    RunBenchmark("lz.compress/block", Compress, &context, SEGMENT_BLOCK_SIZE);
+    RunBenchmark("lz.decompress/block", Decompress, &context, SEGMENT_BLOCK_SIZE);
+
+    free(context.raw);
+    free(context.compressed);
+    free(context.output);
+}
+
+// Event stream framing used by the analyzer link
+
+typedef struct _STREAM_CONTEXT
+{
+    MARK_EVENT events[64];
+    STREAM_WRITER writer;
+    STREAM_READER reader;
+    unsigned char* frame; // one full frame, without the hello
+    unsigned long frameSize;
+} STREAM_CONTEXT, *PSTREAM_CONTEXT;
+
+static void EncodeStream(void* parameter, unsigned long long operations)
+{
+    PSTREAM_CONTEXT context = (PSTREAM_CONTEXT)parameter;
+    unsigned long long i;
+
+    for (i = 0; i < operations; i++)
+    {
+        if (!StreamWriterAppend(&context->writer, &context->events[i % 64]))
+        {
+            g_BenchSink += StreamWriterFinish(&context->writer);
+            StreamWriterReset(&context->writer);
+            StreamWriterAppend(&context->writer, &context->events[i % 64]);
+        }
+    }
+}
+
+// Every frame is copied in first, the way a receive would.
+static void DecodeStream(void* parameter, unsigned long long operations)
+{
+    PSTREAM_CONTEXT context = (PSTREAM_CONTEXT)parameter;
+    PMARK_EVENT events;
+    unsigned long long decoded = 0;
+    unsigned long space;
+    int count;
+
+    while (decoded < operations)
+    {
+        unsigned char* buffer = StreamReaderSpace(&context->reader, &space);
+
+        memcpy(buffer, context->frame, context->frameSize);
+        StreamReaderCommit(&context->reader, context->frameSize);
+        while (StreamReaderNext(&context->reader, &events, &count) == STREAM_EVENTS)
+        {
+            decoded += count;
+            g_BenchSink += events[count - 1].pid;
+        }
+    }
+}
+
+static void StreamCases()
+{
+    static STREAM_CONTEXT context;
+    PMARK_EVENT events;
+    unsigned long size, space;
+    int count, i;
+
+    for (i = 0; i < 64; i++)
+    {
+        FillEvent(&context.events[i], i);
+    }
+    if (!StreamWriterInit(&context.writer, STREAM_DEFAULT_BATCH) || !StreamReaderInit(&context.reader, STREAM_DEFAULT_BATCH * 2))
+    {
+        printf("Out of memory\n");
+        return;
+    }
+
+    RunBenchmark("stream.encode", EncodeStream, &context, sizeof(MARK_EVENT));
+
+    // The reader takes the hello once, then the same frame over and over.
+    StreamWriterRestart(&context.writer);
+    for (i = 0; StreamWriterAppend(&context.writer, &context.events[i % 64]); i++) {}
+    size = StreamWriterFinish(&context.writer);
+    memcpy(StreamReaderSpace(&context.reader, &space), context.writer.buffer, size);
+    StreamReaderCommit(&context.reader, size);
+    StreamReaderNext(&context.reader, &events, &count);
+
+    StreamWriterReset(&context.writer);
+    for (i = 0; StreamWriterAppend(&context.writer, &context.events[i % 64]); i++) {}
+    context.frameSize = StreamWriterFinish(&context.writer);
+    context.frame = context.writer.buffer;
+
+    RunBenchmark("stream.decode", DecodeStream, &context, sizeof(MARK_EVENT));
+
+    StreamWriterFree(&context.writer);
+    StreamReaderFree(&context.reader);
+}
+
+// Broker subscription matching, once per event for all clients
+
+typedef struct _MATCH_CONTEXT
+{
+    MARK_EVENT events[64];
+    SUBSCRIPTION_MATCHER matcher;
+} MATCH_CONTEXT, *PMATCH_CONTEXT;
+
+static void Match(void* parameter, unsigned long long operations)
+{
+    PMATCH_CONTEXT context = (PMATCH_CONTEXT)parameter;
+    unsigned long long i;
+
+    for (i = 0; i < operations; i++)
+    {
+        g_BenchSink += MatcherMatch(&context->matcher, &context->events[i % 64]);
+    }
+}
+
+static void AddSubscription(PSUBSCRIPTION_MATCHER matcher, int subscriber, unsigned int opclasses, int pid,
+    const char* image, const char* path)
+{
+    STREAM_SUBSCRIPTION subscription;
+
+    memset(&subscription, 0, sizeof(subscription));
+    subscription.opclasses = opclasses;
+    subscription.pid = pid;
+    MARK_SET_TEXT(subscription.szImagePath, image);
+    MARK_SET_TEXT(subscription.szOperationPath, path);
+    MatcherAdd(matcher, subscriber, &subscription);
+}
+
+static void BrokerCases()
+{
+    static MATCH_CONTEXT context;
+    int i;
+
+    for (i = 0; i < 64; i++)
+    {
+        FillEvent(&context.events[i], i);
+        if (i % 4 == 3)
+        {
+            context.events[i].opclass = MARK_OPCLASS_REGISTRY;
+        }
+    }
+
+    // Masks only: the table lookup is all there is.
+    MatcherInit(&context.matcher);
+    AddSubscription(&context.matcher, 0, 0, 0, "", "");
+    AddSubscription(&context.matcher, 1, 1 << MARK_OPCLASS_FILE, 0, "", "");
+    AddSubscription(&context.matcher, 2, 1 << MARK_OPCLASS_PACKET, 0, "", "");
+    AddSubscription(&context.matcher, 3, (1 << MARK_OPCLASS_PROCESS) | (1 << MARK_OPCLASS_REGISTRY), 0, "", "");
+    RunBenchmark("broker.match/masks", Match, &context, 0);
+
+    // Predicates on top, some of which pass.
+    AddSubscription(&context.matcher, 4, 1 << MARK_OPCLASS_FILE, FIRST_PID, "", "");
+    AddSubscription(&context.matcher, 5, 0, 0, "*\\chrome.exe", "");
+    AddSubscription(&context.matcher, 6, 1 << MARK_OPCLASS_FILE, 0, "", "\\users\\*\\cache\\f_00*");
+    AddSubscription(&context.matcher, 7, 0, 0, "*\\program files*", "*appdata*google*");
+    RunBenchmark("broker.match/patterns", Match, &context, 0);
+}
+
+void RunAllCases()
+{
+    ProcessTableCases();
+    EventCases();
+    LoggerCases();
+    PacketCases();
+    DnsCases();
+    TlsCases();
+    ScanCases();
+    CodecCases();
+    StreamCases();
+    BrokerCases();
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+// Microbenchmarks of the hot paths, one CSV row per case.
+//
+// Linux build, from this directory:
+//   gcc -O2 -pthread -o bench main.c bench.c cases.c ../dcomm/dnscache.c ../dcomm/eventstream.c
+//       ../dcomm/logger.c ../dcomm/lz.c ../dcomm/packetdecode.c ../dcomm/payloadscan.c
+//       ../dcomm/platform.c ../dcomm/subscription.c ../dcomm/tlshello.c ../sys/core.c
+//       ../sys/processtable.c ../usermodesimulation/generator.c ../usermodesimulation/umimpl.c -lm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+static void PrintUsage()
+{
+    printf("bench [-filter text] [-runs n] > results.csv\n"
+           "bench -compare baseline.csv results.csv [-threshold percent]\n");
+}
+
+int main(int argc, char* argv[])
+{
+    const char* baseline = NULL;
+    const char* current = NULL;
+    double threshold = BENCH_DEFAULT_THRESHOLD;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-filter") && i + 1 < argc)
+        {
+            g_BenchOptions.filter = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-runs") && i + 1 < argc)
+        {
+            g_BenchOptions.runs = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-compare") && i + 2 < argc)
+        {
+            baseline = argv[++i];
+            current = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-threshold") && i + 1 < argc)
+        {
+            threshold = atof(argv[++i]);
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (baseline)
+    {
+        // Exit code 1 on any regression, so scripts can gate on it.
+        int regressions = CompareBenchmarks(baseline, current, threshold);
+        return regressions < 0 ? 2 : (regressions > 0);
+    }
+
+    PrintBenchmarkHeader();
+    RunAllCases();
+
+    return 0;
+}
\ No newline at end of file
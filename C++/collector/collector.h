@@ -0,0 +1,111 @@
+#ifndef _COLLECTOR_H_
+#define _COLLECTOR_H_
+
+#include "../dcomm/eventstream.h"
+#include "../dcomm/platform.h"
+
+#include <sys/socket.h>
+
+// Central collector for the forward sink of many dcomm instances (forward.h).
+// A few I/O threads share the listening socket, each with its own epoll set,
+// and keep every connection they accept. Event frames are handed as they
+// arrived, still compressed, to one of the shard writers, picked by a hash
+// of the endpoint name, so that one endpoint always lands in the same
+// per-shard segment log and its batches stay in order. A shard writer
+// inflates the batches into its log and, once they are flushed, has the
+// owning I/O thread acknowledge them to the endpoint.
+
+#define COLLECTOR_DEFAULT_ADDRESS "tcp::7170"
+#define COLLECTOR_DEFAULT_DIRECTORY "collected"
+#define COLLECTOR_DEFAULT_THREADS 4
+#define COLLECTOR_DEFAULT_REPORT 5     // seconds between counter lines
+#define COLLECTOR_MAX_THREADS 64
+#define COLLECTOR_MAX_SHARDS 256
+#define COLLECTOR_READ_BUFFER (32 * 1024) // per connection, grows for bigger frames
+#define COLLECTOR_SHARD_QUEUE 4096        // batches; a full queue stalls the I/O thread
+#define COLLECTOR_EPOLL_EVENTS 256
+#define COLLECTOR_ENDPOINTS_FILE "endpoints.log"
+
+#define LOADGEN_DEFAULT_ENDPOINTS 100
+#define LOADGEN_DEFAULT_RATE 100.0 // events per second and endpoint
+#define LOADGEN_DEFAULT_BATCH 512
+#define LOADGEN_DEFAULT_THREADS 2
+#define LOADGEN_WINDOW 8           // batches ahead of the acknowledgements, as FORWARD_WINDOW
+#define LOADGEN_RETRY_INTERVAL 1000 // ms
+
+typedef struct _COLLECTOR_OPTIONS
+{
+    const char* address;
+    const char* directory;
+    int threads;
+    int shards; // 0 for one per CPU
+    unsigned long long segmentSize;
+    int segments; // kept per shard, 0 keeps every segment
+} COLLECTOR_OPTIONS, *PCOLLECTOR_OPTIONS;
+
+typedef struct _COLLECTOR_STATS
+{
+    unsigned long long connections; // open now
+    unsigned long long accepted;
+    unsigned long long bytes;       // received
+    unsigned long long frames;
+    unsigned long long events;      // received
+    unsigned long long acks;
+    unsigned long long errors;      // connections dropped for a protocol or write error
+    unsigned long long written;     // events in the shard logs
+    unsigned long long blocks;
+    unsigned long long rawBytes;
+    unsigned long long logBytes;    // compressed, on disk
+    unsigned long long failures;
+    unsigned long long queued;      // batches waiting for a shard now
+    unsigned long long maxQueued;
+} COLLECTOR_STATS, *PCOLLECTOR_STATS;
+
+// A frame of events on its way from an I/O thread to a shard writer. The
+// payload is the frame's, compressed or not.
+typedef struct _COLLECTOR_BATCH
+{
+    struct _COLLECTOR_BATCH* next;
+    void* connection;
+    const char* endpoint; // owned by the connection, which outlives the batch
+    unsigned short type;
+    unsigned short count;
+    unsigned long length;
+    unsigned long long sequence;
+    int written;
+    unsigned char data[1];
+} COLLECTOR_BATCH, *PCOLLECTOR_BATCH;
+
+// server.c
+int StartCollector(PCOLLECTOR_OPTIONS options);
+void StopCollector();
+void GetCollectorStats(PCOLLECTOR_STATS stats);
+// "tcp:host:port", "tcp:[v6 address]:port" or "tcp::port" as in transport.h,
+// the prefix optional. Returns 0 if the address does not resolve.
+int ResolveCollectorAddress(const char* address, int passive, struct sockaddr_storage* result, socklen_t* length);
+// Called by the shard writers once a batch is in the log, or failed to get there.
+void CollectorBatchWritten(PCOLLECTOR_BATCH batch);
+
+// shards.c
+int StartShards(const char* directory, int count, unsigned long long segmentSize, int segments);
+void StopShards();
+int ShardOf(const char* endpoint);
+// Blocks while the shard queue is full.
+void QueueShardBatch(int shard, PCOLLECTOR_BATCH batch);
+void AddShardStats(PCOLLECTOR_STATS stats);
+void PrintShardStats();
+
+typedef struct _LOADGEN_OPTIONS
+{
+    const char* address;
+    int endpoints;
+    double rate; // 0 sends as fast as the acknowledgements allow
+    int batch;
+    int threads;
+    double duration; // seconds, 0 until interrupted
+} LOADGEN_OPTIONS, *PLOADGEN_OPTIONS;
+
+// loadgen.c
+int RunLoadGenerator(PLOADGEN_OPTIONS options, volatile int* stop);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,604 @@
+#define _GNU_SOURCE
+#include "collector.h"
+#include "../dcomm/forward.h"
+#include "../dcomm/lz.h"
+#include "../dcomm/platform.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Simulated endpoints, each a connection that talks like the forward sink:
+// a hello asking for acknowledgements, the endpoint name, then compressed
+// batches at its share of the rate, at most LOADGEN_WINDOW batches ahead of
+// the acknowledgements. A lost connection is retried and resends what was
+// not acknowledged. Every endpoint sends the same batch, compressed once, so
+// the generator spends its time on the sockets rather than on LZ.
+
+#define LOADGEN_TICK 10 // ms between rate and retry passes
+
+#define LOAD_IDLE 0
+#define LOAD_INTRO 1
+#define LOAD_BATCH 2
+
+typedef struct _LOAD_ENDPOINT
+{
+    int fd;
+    int connected;
+    int writable;
+    unsigned long long retryAt; // us
+    STREAM_ENDPOINT name;
+
+    unsigned long long sequence; // next to send
+    unsigned long long acked;
+    double credit; // batches the rate allows now
+    unsigned long long sentAt[LOADGEN_WINDOW];
+
+    int sending;
+    unsigned long sent; // bytes of what is being sent
+    STREAM_WRITER intro;
+    unsigned long introSize;
+    STREAM_FRAME frame;
+    STREAM_READER acks;
+} LOAD_ENDPOINT, *PLOAD_ENDPOINT;
+
+typedef struct _LOAD_STATS
+{
+    unsigned long long connected;
+    unsigned long long connects;
+    unsigned long long failures;
+    unsigned long long frames;
+    unsigned long long events;
+    unsigned long long bytes;
+    unsigned long long acks;
+    unsigned long long acked; // events
+    unsigned long long latency; // us, summed over the acknowledged batches
+    unsigned long long batches; // acknowledged
+    unsigned long long maxLatency;
+} LOAD_STATS, *PLOAD_STATS;
+
+typedef struct _LOAD_THREAD
+{
+    MARK_THREAD thread;
+    int epoll;
+    PLOAD_ENDPOINT endpoints;
+    int count;
+    LOAD_STATS stats; // written by the thread only
+} LOAD_THREAD, *PLOAD_THREAD;
+
+static PLOADGEN_OPTIONS s_options = NULL;
+static volatile int* s_stop = NULL;
+static struct sockaddr_storage s_address;
+static socklen_t s_addressLength = 0;
+static unsigned char* s_payload = NULL;
+static unsigned long s_payloadSize = 0;
+
+// File and registry writes from a handful of processes, compressing about
+// as well as the synthetic source does.
+static int BuildPayload(int count)
+{
+    static const char* images[] = { "explorer.exe", "svchost.exe", "chrome.exe", "outlook.exe" };
+    unsigned long size = count * sizeof(MARK_EVENT);
+    PMARK_EVENT events = (PMARK_EVENT)calloc(count, sizeof(MARK_EVENT));
+    char text[256];
+    int i;
+
+    s_payload = (unsigned char*)malloc(LzCompressBound(size));
+    if (!events || !s_payload)
+    {
+        free(events);
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        PMARK_EVENT evt = &events[i];
+        const char* image = images[i % 4];
+
+        MARK_SET_TEXT(evt->szProcessName, image);
+        MARK_SET_TEXT(evt->szUserName, "load");
+        snprintf(text, sizeof(text), "\\Device\\HarddiskVolume2\\Program Files\\Load\\%s", image);
+        MARK_SET_TEXT(evt->szImagePath, text);
+
+        if (i % 3)
+        {
+            snprintf(text, sizeof(text), "C:\\Users\\load\\data\\file-%d.tmp", i % 1024);
+            evt->opclass = MARK_OPCLASS_FILE;
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "\\REGISTRY\\MACHINE\\SOFTWARE\\Load\\Key%d", i % 64);
+            evt->opclass = MARK_OPCLASS_REGISTRY;
+        }
+        MARK_SET_TEXT(evt->szOperationPath, text);
+        evt->optype = MARK_OPTYPE_WRITE;
+
+        evt->time = (long long)MarkClockMicroseconds() * 10 + i;
+        evt->pid = 4000 + (i % 16) * 4;
+        evt->ppid = 4000;
+        evt->tid = evt->pid + 1;
+    }
+
+    s_payloadSize = LzCompress((unsigned char*)events, size, s_payload, LzCompressBound(size));
+    free(events);
+
+    return s_payloadSize > 0;
+}
+
+static void Arm(PLOAD_THREAD thread, PLOAD_ENDPOINT endpoint, int writable)
+{
+    struct epoll_event event;
+
+    if (endpoint->writable == writable)
+    {
+        return;
+    }
+
+    event.events = EPOLLIN | (writable ? EPOLLOUT : 0);
+    event.data.ptr = endpoint;
+    epoll_ctl(thread->epoll, EPOLL_CTL_MOD, endpoint->fd, &event);
+    endpoint->writable = writable;
+}
+
+static void Disconnect(PLOAD_THREAD thread, PLOAD_ENDPOINT endpoint)
+{
+    epoll_ctl(thread->epoll, EPOLL_CTL_DEL, endpoint->fd, NULL);
+    close(endpoint->fd);
+    endpoint->fd = -1;
+
+    if (endpoint->connected)
+    {
+        thread->stats.connected--;
+    }
+    thread->stats.failures++;
+    endpoint->connected = 0;
+    endpoint->sending = LOAD_IDLE;
+    endpoint->retryAt = MarkClockMicroseconds() + LOADGEN_RETRY_INTERVAL * 1000ULL;
+}
+
+static void Connect(PLOAD_THREAD thread, PLOAD_ENDPOINT endpoint)
+{
+    struct epoll_event event;
+    int on = 1;
+
+    endpoint->fd = socket(s_address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (endpoint->fd < 0)
+    {
+        if (errno == EMFILE || errno == ENFILE)
+        {
+            printf("Out of file descriptors, raise the limit with ulimit -n\n");
+        }
+        endpoint->retryAt = MarkClockMicroseconds() + LOADGEN_RETRY_INTERVAL * 1000ULL;
+        return;
+    }
+    setsockopt(endpoint->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    if (connect(endpoint->fd, (struct sockaddr*)&s_address, s_addressLength) && errno != EINPROGRESS)
+    {
+        close(endpoint->fd);
+        endpoint->fd = -1;
+        thread->stats.failures++;
+        endpoint->retryAt = MarkClockMicroseconds() + LOADGEN_RETRY_INTERVAL * 1000ULL;
+        return;
+    }
+
+    // Writable once connected.
+    event.events = EPOLLIN | EPOLLOUT;
+    event.data.ptr = endpoint;
+    epoll_ctl(thread->epoll, EPOLL_CTL_ADD, endpoint->fd, &event);
+    endpoint->writable = 1;
+    thread->stats.connects++;
+}
+
+static int MaySend(PLOAD_ENDPOINT endpoint)
+{
+    return endpoint->connected &&
+        endpoint->sequence - endpoint->acked < (unsigned long long)LOADGEN_WINDOW * s_options->batch &&
+        (s_options->rate <= 0 || endpoint->credit >= 1.0);
+}
+
+// Sends until the socket is full or the window or rate say stop. Returns 0
+// if the connection broke.
+static int Send(PLOAD_THREAD thread, PLOAD_ENDPOINT endpoint)
+{
+    while (1)
+    {
+        struct msghdr message;
+        struct iovec parts[2];
+        ssize_t sent;
+
+        if (endpoint->sending == LOAD_IDLE)
+        {
+            if (!MaySend(endpoint))
+            {
+                Arm(thread, endpoint, 0);
+                return 1;
+            }
+
+            endpoint->frame.length = s_payloadSize;
+            endpoint->frame.type = STREAM_FRAME_COMPRESSED;
+            endpoint->frame.count = (unsigned short)s_options->batch;
+            endpoint->frame.sequence = endpoint->sequence;
+            endpoint->sending = LOAD_BATCH;
+            endpoint->sent = 0;
+            endpoint->credit -= 1.0;
+        }
+
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = parts;
+        if (endpoint->sending == LOAD_INTRO)
+        {
+            parts[0].iov_base = endpoint->intro.buffer + endpoint->sent;
+            parts[0].iov_len = endpoint->introSize - endpoint->sent;
+            message.msg_iovlen = 1;
+        }
+        else if (endpoint->sent < sizeof(STREAM_FRAME))
+        {
+            parts[0].iov_base = (unsigned char*)&endpoint->frame + endpoint->sent;
+            parts[0].iov_len = sizeof(STREAM_FRAME) - endpoint->sent;
+            parts[1].iov_base = s_payload;
+            parts[1].iov_len = s_payloadSize;
+            message.msg_iovlen = 2;
+        }
+        else
+        {
+            parts[0].iov_base = s_payload + (endpoint->sent - sizeof(STREAM_FRAME));
+            parts[0].iov_len = s_payloadSize - (endpoint->sent - sizeof(STREAM_FRAME));
+            message.msg_iovlen = 1;
+        }
+
+        sent = sendmsg(endpoint->fd, &message, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                Arm(thread, endpoint, 1);
+                return 1;
+            }
+            return errno == EINTR;
+        }
+
+        endpoint->sent += (unsigned long)sent;
+        thread->stats.bytes += sent;
+
+        if (endpoint->sending == LOAD_INTRO && endpoint->sent == endpoint->introSize)
+        {
+            endpoint->sending = LOAD_IDLE;
+        }
+        else if (endpoint->sending == LOAD_BATCH && endpoint->sent == sizeof(STREAM_FRAME) + s_payloadSize)
+        {
+            endpoint->sentAt[endpoint->sequence / s_options->batch % LOADGEN_WINDOW] = MarkClockMicroseconds();
+            endpoint->sequence += s_options->batch;
+            endpoint->sending = LOAD_IDLE;
+            thread->stats.frames++;
+            thread->stats.events += s_options->batch;
+        }
+    }
+}
+
+static int Connected(PLOAD_THREAD thread, PLOAD_ENDPOINT endpoint)
+{
+    int error = 0;
+    socklen_t length = sizeof(error);
+
+    if (getsockopt(endpoint->fd, SOL_SOCKET, SO_ERROR, &error, &length) || error)
+    {
+        return 0;
+    }
+
+    StreamReaderFree(&endpoint->acks);
+    if (!StreamReaderInit(&endpoint->acks, sizeof(STREAM_HELLO) + 16 * sizeof(STREAM_FRAME)))
+    {
+        return 0;
+    }
+
+    // A new connection starts over at the oldest unacknowledged batch.
+    StreamWriterRestart(&endpoint->intro);
+    endpoint->introSize = StreamWriterControl(&endpoint->intro, STREAM_FRAME_ENDPOINT, &endpoint->name, sizeof(endpoint->name));
+    endpoint->sending = LOAD_INTRO;
+    endpoint->sent = 0;
+    endpoint->sequence = endpoint->acked;
+    endpoint->connected = 1;
+    thread->stats.connected++;
+
+    return 1;
+}
+
+static int ReadAcks(PLOAD_THREAD thread, PLOAD_ENDPOINT endpoint)
+{
+    unsigned long space;
+    unsigned char* buffer = StreamReaderSpace(&endpoint->acks, &space);
+    ssize_t received = recv(endpoint->fd, buffer, space, 0);
+    PSTREAM_FRAME frame;
+    int result;
+
+    if (received <= 0)
+    {
+        return received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+    }
+    StreamReaderCommit(&endpoint->acks, (unsigned long)received);
+
+    while ((result = StreamReaderNextFrame(&endpoint->acks, &frame)) == STREAM_FRAME_READY)
+    {
+        unsigned long long now = MarkClockMicroseconds();
+        unsigned long long sequence;
+
+        if (frame->type != STREAM_FRAME_ACK || frame->sequence <= endpoint->acked)
+        {
+            continue;
+        }
+
+        for (sequence = endpoint->acked; sequence < frame->sequence && sequence < endpoint->sequence; sequence += s_options->batch)
+        {
+            unsigned long long latency = now - endpoint->sentAt[sequence / s_options->batch % LOADGEN_WINDOW];
+
+            thread->stats.latency += latency;
+            thread->stats.maxLatency = MAX(thread->stats.maxLatency, latency);
+            thread->stats.batches++;
+        }
+
+        thread->stats.acks++;
+        thread->stats.acked += frame->sequence - endpoint->acked;
+        endpoint->acked = frame->sequence;
+    }
+
+    return result != STREAM_ERROR;
+}
+
+static MARK_THREAD_PROC(LoadThread, parameter)
+{
+    PLOAD_THREAD thread = (PLOAD_THREAD)parameter;
+    struct epoll_event events[COLLECTOR_EPOLL_EVENTS];
+    double batchesPerSecond = s_options->rate / s_options->batch;
+    unsigned long long last = MarkClockMicroseconds();
+    int i;
+
+    while (!*s_stop)
+    {
+        int count = epoll_wait(thread->epoll, events, COLLECTOR_EPOLL_EVENTS, LOADGEN_TICK);
+        unsigned long long now = MarkClockMicroseconds();
+
+        for (i = 0; i < count; i++)
+        {
+            PLOAD_ENDPOINT endpoint = (PLOAD_ENDPOINT)events[i].data.ptr;
+            int ok = endpoint->fd >= 0;
+
+            if (!ok)
+            {
+                continue;
+            }
+            if (!endpoint->connected)
+            {
+                ok = Connected(thread, endpoint);
+            }
+            else if (events[i].events & EPOLLIN)
+            {
+                ok = ReadAcks(thread, endpoint);
+            }
+            else if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                ok = 0;
+            }
+            if (ok && endpoint->connected)
+            {
+                ok = Send(thread, endpoint);
+            }
+            if (!ok && endpoint->fd >= 0)
+            {
+                Disconnect(thread, endpoint);
+            }
+        }
+
+        if (now - last < LOADGEN_TICK * 1000ULL)
+        {
+            continue;
+        }
+
+        // Hand out the rate, retry lost connections and start sending where
+        // the new credit allows it.
+        for (i = 0; i < thread->count; i++)
+        {
+            PLOAD_ENDPOINT endpoint = &thread->endpoints[i];
+
+            if (endpoint->fd < 0)
+            {
+                if (now >= endpoint->retryAt)
+                {
+                    Connect(thread, endpoint);
+                }
+                continue;
+            }
+            if (!endpoint->connected)
+            {
+                continue;
+            }
+
+            if (batchesPerSecond > 0)
+            {
+                endpoint->credit = MIN(endpoint->credit + batchesPerSecond * (now - last) / 1e6, (double)LOADGEN_WINDOW);
+            }
+            if (endpoint->sending == LOAD_IDLE && MaySend(endpoint) && !Send(thread, endpoint))
+            {
+                Disconnect(thread, endpoint);
+            }
+        }
+        last = now;
+    }
+
+    for (i = 0; i < thread->count; i++)
+    {
+        PLOAD_ENDPOINT endpoint = &thread->endpoints[i];
+
+        if (endpoint->fd >= 0)
+        {
+            close(endpoint->fd);
+        }
+        StreamReaderFree(&endpoint->acks);
+        StreamWriterFree(&endpoint->intro);
+    }
+
+    return 0;
+}
+
+static void SumStats(PLOAD_THREAD threads, int count, PLOAD_STATS total)
+{
+    int i;
+
+    memset(total, 0, sizeof(*total));
+    for (i = 0; i < count; i++)
+    {
+        PLOAD_STATS stats = &threads[i].stats;
+
+        total->connected += stats->connected;
+        total->connects += stats->connects;
+        total->failures += stats->failures;
+        total->frames += stats->frames;
+        total->events += stats->events;
+        total->bytes += stats->bytes;
+        total->acks += stats->acks;
+        total->acked += stats->acked;
+        total->latency += stats->latency;
+        total->batches += stats->batches;
+        total->maxLatency = MAX(total->maxLatency, stats->maxLatency);
+    }
+}
+
+static int StartLoadThread(PLOAD_THREAD thread, int first, int step)
+{
+    int i;
+
+    thread->epoll = epoll_create1(EPOLL_CLOEXEC);
+    if (thread->epoll < 0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < thread->count; i++)
+    {
+        PLOAD_ENDPOINT endpoint = &thread->endpoints[i];
+
+        endpoint->fd = -1;
+        snprintf(endpoint->name.name, sizeof(endpoint->name.name), "load-%06d", first + i * step);
+        if (!StreamWriterInit(&endpoint->intro, sizeof(STREAM_HELLO) + sizeof(STREAM_FRAME) + sizeof(STREAM_ENDPOINT)))
+        {
+            return 0;
+        }
+        endpoint->intro.flags = STREAM_HELLO_ACKS;
+        // Spread the first batches over one interval.
+        endpoint->credit = (double)(first + i * step) / s_options->endpoints;
+    }
+
+    return MarkThreadStart(&thread->thread, LoadThread, thread);
+}
+
+int RunLoadGenerator(PLOADGEN_OPTIONS options, volatile int* stop)
+{
+    LOAD_STATS total;
+    LOAD_STATS previous;
+    PLOAD_THREAD threads;
+    unsigned long long start;
+    unsigned long long lastReport;
+    int threadCount = MAX(1, MIN(options->threads, options->endpoints));
+    int started = 0;
+    double seconds;
+    int i;
+
+    if (options->endpoints <= 0 || options->batch <= 0)
+    {
+        printf("Need at least one endpoint and a batch of at least one event\n");
+        return 0;
+    }
+    // As the forward sink does, so a batch fits one frame.
+    options->batch = MIN(options->batch, FORWARD_MAX_BATCH);
+
+    s_options = options;
+    s_stop = stop;
+    if (!ResolveCollectorAddress(options->address, 0, &s_address, &s_addressLength) || !BuildPayload(options->batch))
+    {
+        return 0;
+    }
+
+    threads = (PLOAD_THREAD)calloc(threadCount, sizeof(LOAD_THREAD));
+    if (!threads)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < threadCount; i++)
+    {
+        threads[i].count = options->endpoints / threadCount + (i < options->endpoints % threadCount);
+        threads[i].endpoints = (PLOAD_ENDPOINT)calloc(threads[i].count, sizeof(LOAD_ENDPOINT));
+        if (!threads[i].endpoints || !StartLoadThread(&threads[i], i, threadCount))
+        {
+            printf("Cannot start load thread %d\n", i);
+            *stop = 1;
+            break;
+        }
+        started++;
+    }
+
+    printf("Simulating %d endpoints against %s, %d threads, batches of %d events (%lu bytes compressed), %.0f events/s each\n",
+        options->endpoints, options->address, threadCount, options->batch, s_payloadSize, options->rate);
+    fflush(stdout);
+
+    start = lastReport = MarkClockMicroseconds();
+    memset(&previous, 0, sizeof(previous));
+    while (!*stop)
+    {
+        unsigned long long now;
+
+        MarkSleep(100);
+        now = MarkClockMicroseconds();
+        if (options->duration > 0 && now - start >= options->duration * 1e6)
+        {
+            break;
+        }
+        if (now - lastReport < 1000000)
+        {
+            continue;
+        }
+
+        SumStats(threads, started, &total);
+        seconds = (now - lastReport) / 1e6;
+        printf("Load: %llu of %d connected, %.0f events/s, %.1f MB/s, %.0f acks/s, %llu events unacknowledged\n",
+            total.connected, options->endpoints, (total.events - previous.events) / seconds,
+            (total.bytes - previous.bytes) / seconds / (1024 * 1024), (total.acks - previous.acks) / seconds,
+            total.events - total.acked);
+        fflush(stdout);
+        previous = total;
+        lastReport = now;
+    }
+
+    *stop = 1;
+    for (i = 0; i < started; i++)
+    {
+        MarkThreadJoin(threads[i].thread);
+    }
+
+    SumStats(threads, started, &total);
+    seconds = (MarkClockMicroseconds() - start) / 1e6;
+    printf("Load: %llu events in %llu frames, %.0f events/s, %llu acknowledged, %llu connects, %llu failures\n",
+        total.events, total.frames, seconds > 0 ? total.events / seconds : 0.0, total.acked, total.connects, total.failures);
+    printf("Ack latency: avg %.1f ms, max %.1f ms over %llu batches\n",
+        total.batches ? total.latency / 1000.0 / total.batches : 0.0, total.maxLatency / 1000.0, total.batches);
+
+    for (i = 0; i < threadCount; i++)
+    {
+        if (threads[i].epoll > 0)
+        {
+            close(threads[i].epoll);
+        }
+        free(threads[i].endpoints);
+    }
+    free(threads);
+    free(s_payload);
+    s_payload = NULL;
+
+    return 1;
+}
\ No newline at end of file
@@ -0,0 +1,196 @@
+// Central collector: takes the event streams of many dcomm instances
+// (dcomm -forward tcp:host:port) and writes them to per-shard segment logs
+// that dcomm -replay reads. Linux only. With -load it is instead a load
+// generator that simulates endpoints against a running collector; past
+// about 28000 endpoints per generator box the ephemeral ports run out, run
+// more generators or widen net.ipv4.ip_local_port_range.
+//
+//   collector [-address tcp:host:port] [-directory dir] [-threads n] [-shards n]
+//             [-segmentsize MB] [-segments n] [-report seconds] [-seconds n]
+//   collector -load endpoints [-address tcp:host:port] [-rate events/s]
+//             [-batch n] [-threads n] [-seconds n]
+//
+// Build, from this directory:
+//   gcc -O2 -pthread -o collector main.c server.c shards.c loadgen.c ../dcomm/eventstream.c
+//       ../dcomm/segment.c ../dcomm/logio.c ../dcomm/lz.c ../dcomm/platform.c
+
+#include "collector.h"
+#include "../dcomm/segment.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static volatile int s_shutdown = 0;
+
+static void ShutdownHandler(int signal)
+{
+    UNREFERENCED_PARAMETER(signal);
+
+    s_shutdown = 1;
+}
+
+static void PrintUsage()
+{
+    printf("collector [-address tcp:host:port] [-directory dir] [-threads n] [-shards n]\n"
+           "          [-segmentsize MB] [-segments n] [-report seconds] [-seconds n]\n"
+           "collector -load endpoints [-address tcp:host:port] [-rate events/s]\n"
+           "          [-batch n] [-threads n] [-seconds n]\n");
+}
+
+static void PrintStats(PCOLLECTOR_STATS stats, PCOLLECTOR_STATS previous, double seconds)
+{
+    printf("Collector: %llu connections, %.0f events/s in, %.1f MB/s in, %.0f events/s written, %.1f MB/s to disk, "
+           "%.0f acks/s, %llu batches queued\n",
+        stats->connections, (stats->events - previous->events) / seconds,
+        (stats->bytes - previous->bytes) / seconds / (1024 * 1024),
+        (stats->written - previous->written) / seconds,
+        (stats->logBytes - previous->logBytes) / seconds / (1024 * 1024),
+        (stats->acks - previous->acks) / seconds, stats->queued);
+    fflush(stdout);
+}
+
+static int RunCollector(PCOLLECTOR_OPTIONS options, int report, double duration)
+{
+    COLLECTOR_STATS stats;
+    COLLECTOR_STATS previous;
+    unsigned long long start = MarkClockMicroseconds();
+    unsigned long long lastReport = start;
+    double seconds;
+
+    if (!StartCollector(options))
+    {
+        return 1;
+    }
+
+    memset(&previous, 0, sizeof(previous));
+    while (!s_shutdown)
+    {
+        unsigned long long now;
+
+        MarkSleep(100);
+        now = MarkClockMicroseconds();
+        if (duration > 0 && now - start >= duration * 1e6)
+        {
+            break;
+        }
+        if (report <= 0 || now - lastReport < report * 1000000ULL)
+        {
+            continue;
+        }
+
+        GetCollectorStats(&stats);
+        PrintStats(&stats, &previous, (now - lastReport) / 1e6);
+        previous = stats;
+        lastReport = now;
+    }
+
+    StopCollector();
+
+    GetCollectorStats(&stats);
+    seconds = (MarkClockMicroseconds() - start) / 1e6;
+    printf("Collector: %llu connections accepted, %llu dropped on errors, %llu events in %llu frames (%llu bytes), "
+           "%.0f events/s, %llu acks\n",
+        stats.accepted, stats.errors, stats.events, stats.frames, stats.bytes,
+        seconds > 0 ? stats.events / seconds : 0.0, stats.acks);
+    printf("Logs: %llu events in %llu blocks, %.1f:1 compression, max queue %llu batches, %llu failures\n",
+        stats.written, stats.blocks, stats.logBytes ? (double)stats.rawBytes / stats.logBytes : 0.0,
+        stats.maxQueued, stats.failures);
+    PrintShardStats();
+
+    return stats.failures ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    COLLECTOR_OPTIONS options;
+    LOADGEN_OPTIONS load;
+    int report = COLLECTOR_DEFAULT_REPORT;
+    double duration = 0;
+    int threads = 0;
+    int i;
+
+    memset(&options, 0, sizeof(options));
+    options.address = COLLECTOR_DEFAULT_ADDRESS;
+    options.directory = COLLECTOR_DEFAULT_DIRECTORY;
+    options.threads = COLLECTOR_DEFAULT_THREADS;
+    options.segmentSize = SEGMENT_DEFAULT_SIZE;
+    options.segments = 0;
+
+    memset(&load, 0, sizeof(load));
+    load.rate = LOADGEN_DEFAULT_RATE;
+    load.batch = LOADGEN_DEFAULT_BATCH;
+    load.threads = LOADGEN_DEFAULT_THREADS;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-address") && i + 1 < argc)
+        {
+            options.address = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-directory") && i + 1 < argc)
+        {
+            options.directory = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-shards") && i + 1 < argc)
+        {
+            options.shards = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-segmentsize") && i + 1 < argc)
+        {
+            options.segmentSize = strtoull(argv[++i], NULL, 10) * 1024 * 1024;
+        }
+        else if (!strcmp(argv[i], "-segments") && i + 1 < argc)
+        {
+            options.segments = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-report") && i + 1 < argc)
+        {
+            report = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-seconds") && i + 1 < argc)
+        {
+            duration = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-load") && i + 1 < argc)
+        {
+            load.endpoints = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-rate") && i + 1 < argc)
+        {
+            load.rate = atof(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-batch") && i + 1 < argc)
+        {
+            load.batch = atoi(argv[++i]);
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    signal(SIGINT, ShutdownHandler);
+    signal(SIGTERM, ShutdownHandler);
+
+    if (load.endpoints)
+    {
+        load.address = !strcmp(options.address, COLLECTOR_DEFAULT_ADDRESS) ? "tcp:127.0.0.1:7170" : options.address;
+        load.threads = threads ? threads : LOADGEN_DEFAULT_THREADS;
+        load.duration = duration;
+        return RunLoadGenerator(&load, &s_shutdown) ? 0 : 1;
+    }
+
+    if (threads)
+    {
+        options.threads = threads;
+    }
+
+    return RunCollector(&options, report, duration);
+}
\ No newline at end of file
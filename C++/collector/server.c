@@ -0,0 +1,769 @@
+#define _GNU_SOURCE
+#include "collector.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE 0
+#endif
+
+#define COLLECTOR_BACKLOG 1024
+#define COLLECTOR_ACCEPTS_PER_WAKE 64
+
+typedef struct _IO_THREAD IO_THREAD, *PIO_THREAD;
+
+// Owned by its I/O thread. Batches queued to the shard and a pending ack
+// each hold a reference, so a connection closed meanwhile stays readable
+// by the shard writer until the last one is released.
+typedef struct _CONNECTION
+{
+    int fd;
+    PIO_THREAD thread;
+    struct _CONNECTION* previous;
+    struct _CONNECTION* next;
+    volatile long long references;
+    int closed;
+
+    STREAM_READER reader;
+    STREAM_ENDPOINT endpoint;
+    int shard;
+    unsigned long long queued; // batches handed to the shard
+
+    // Acknowledgements. written is set by the shard writer, the rest is the
+    // I/O thread's. An ack is built only when the previous one is out.
+    volatile long long written;
+    volatile long long failed;
+    volatile long long ackPending;
+    struct _CONNECTION* nextAck;
+    STREAM_WRITER acks;
+    unsigned long long acked;
+    unsigned long outStart;
+    unsigned long outEnd;
+    int writable; // EPOLLOUT is armed
+} CONNECTION, *PCONNECTION;
+
+struct _IO_THREAD
+{
+    int index;
+    int epoll;
+    int wake; // eventfd, for acks and for the stop
+    MARK_THREAD thread;
+    MARK_LOCK lock;
+    PCONNECTION acks; // under lock, pushed by the shard writers
+    PCONNECTION connections;
+    PCONNECTION closing; // released after the epoll round that closed them
+    COLLECTOR_STATS stats; // written by the thread only
+};
+
+static PIO_THREAD s_threads = NULL;
+static int s_threadCount = 0;
+static int s_listener = -1;
+static volatile int s_stopping = 0;
+static COLLECTOR_STATS s_closed; // of threads and connections gone
+
+// Tags in epoll_data for the two descriptors that are not connections.
+static int s_listenerTag;
+static int s_wakeTag;
+
+int ResolveCollectorAddress(const char* address, int passive, struct sockaddr_storage* result, socklen_t* length)
+{
+    const char* name = address;
+    const char* port;
+    struct addrinfo hints;
+    struct addrinfo* found = NULL;
+    char host[256];
+    size_t size;
+    int error;
+
+    if (!strncmp(name, "tcp:", 4))
+    {
+        name += 4;
+    }
+
+    port = strrchr(name, ':');
+    if (!port || (size_t)(port - name) >= sizeof(host))
+    {
+        printf("Bad TCP address %s, expected tcp:host:port\n", address);
+        return 0;
+    }
+
+    size = port - name;
+    if (size >= 2 && name[0] == '[' && name[size - 1] == ']')
+    {
+        name++;
+        size -= 2;
+    }
+    memcpy(host, name, size);
+    host[size] = 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    error = getaddrinfo(size ? host : NULL, port + 1, &hints, &found);
+    if (error)
+    {
+        printf("Cannot resolve %s: %s\n", address, gai_strerror(error));
+        return 0;
+    }
+
+    memcpy(result, found->ai_addr, found->ai_addrlen);
+    *length = found->ai_addrlen;
+    freeaddrinfo(found);
+
+    return 1;
+}
+
+static void Release(PCONNECTION connection)
+{
+    if (MarkAtomicAdd64(&connection->references, -1) == 1)
+    {
+        StreamReaderFree(&connection->reader);
+        StreamWriterFree(&connection->acks);
+        free(connection);
+    }
+}
+
+static void CloseConnection(PCONNECTION connection, int error)
+{
+    PIO_THREAD thread = connection->thread;
+
+    epoll_ctl(thread->epoll, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->closed = 1;
+
+    if (connection->previous)
+    {
+        connection->previous->next = connection->next;
+    }
+    else
+    {
+        thread->connections = connection->next;
+    }
+    if (connection->next)
+    {
+        connection->next->previous = connection->previous;
+    }
+
+    thread->stats.connections--;
+    thread->stats.errors += error;
+
+    // A later event of the same epoll round may still point here.
+    connection->next = thread->closing;
+    thread->closing = connection;
+}
+
+static void ReleaseClosed(PIO_THREAD thread)
+{
+    while (thread->closing)
+    {
+        PCONNECTION connection = thread->closing;
+
+        thread->closing = connection->next;
+        Release(connection);
+    }
+}
+
+static void Arm(PCONNECTION connection, int writable)
+{
+    struct epoll_event event;
+
+    if (connection->writable == writable)
+    {
+        return;
+    }
+
+    event.events = EPOLLIN | (writable ? EPOLLOUT : 0);
+    event.data.ptr = connection;
+    epoll_ctl(connection->thread->epoll, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->writable = writable;
+}
+
+// Returns 0 if the connection broke.
+static int SendPending(PCONNECTION connection)
+{
+    while (connection->outStart < connection->outEnd)
+    {
+        ssize_t sent = send(connection->fd, connection->acks.buffer + connection->outStart,
+            connection->outEnd - connection->outStart, MSG_NOSIGNAL);
+
+        if (sent < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                Arm(connection, 1);
+                return 1;
+            }
+            return errno == EINTR;
+        }
+        connection->outStart += (unsigned long)sent;
+    }
+
+    connection->outStart = connection->outEnd = 0;
+    Arm(connection, 0);
+
+    return 1;
+}
+
+static int SendAck(PCONNECTION connection)
+{
+    unsigned long long written = (unsigned long long)MarkAtomicLoad64(&connection->written);
+
+    // Read after written: a batch may have failed since the caller looked,
+    // and written must not be acknowledged past it.
+    if (MarkAtomicLoad64(&connection->failed))
+    {
+        return 0;
+    }
+
+    if (connection->outEnd)
+    {
+        if (!SendPending(connection))
+        {
+            return 0;
+        }
+        if (connection->outEnd)
+        {
+            return 1;
+        }
+    }
+    if (written <= connection->acked)
+    {
+        return 1;
+    }
+
+    StreamWriterReset(&connection->acks);
+    connection->outStart = 0;
+    connection->outEnd = StreamWriterFrame(&connection->acks, STREAM_FRAME_ACK, 0, written, NULL, 0);
+    connection->acked = written;
+    connection->thread->stats.acks++;
+
+    return SendPending(connection);
+}
+
+void CollectorBatchWritten(PCOLLECTOR_BATCH batch)
+{
+    PCONNECTION connection = (PCONNECTION)batch->connection;
+    PIO_THREAD thread = connection->thread;
+    unsigned long long one = 1;
+
+    // The batches of a connection finish in order on one shard; after a
+    // failure written stays where it was, short of the failed batch.
+    if (batch->written && !MarkAtomicLoad64(&connection->failed))
+    {
+        MarkAtomicStore64(&connection->written, (long long)(batch->sequence + batch->count));
+    }
+    else if (!batch->written)
+    {
+        MarkAtomicStore64(&connection->failed, 1);
+    }
+
+    // The I/O thread clears ackPending before it looks at written, so a
+    // batch finishing meanwhile queues the connection again.
+    if (!connection->closed && (connection->reader.header.flags & STREAM_HELLO_ACKS || !batch->written) &&
+        !MarkAtomicCas64(&connection->ackPending, 1, 0))
+    {
+        MarkAtomicAdd64(&connection->references, 1);
+
+        MarkLockAcquire(&thread->lock);
+        connection->nextAck = thread->acks;
+        thread->acks = connection;
+        MarkLockRelease(&thread->lock);
+
+        if (write(thread->wake, &one, sizeof(one)) < 0)
+        {
+            // The counter is saturated, the thread is awake anyway.
+        }
+    }
+
+    Release(connection);
+}
+
+static void TakeAcks(PIO_THREAD thread)
+{
+    PCONNECTION connection;
+    unsigned long long value;
+
+    if (read(thread->wake, &value, sizeof(value)) < 0)
+    {
+        // Woken for the stop or already drained.
+    }
+
+    MarkLockAcquire(&thread->lock);
+    connection = thread->acks;
+    thread->acks = NULL;
+    MarkLockRelease(&thread->lock);
+
+    while (connection)
+    {
+        PCONNECTION next = connection->nextAck;
+
+        MarkAtomicStore64(&connection->ackPending, 0);
+        if (!connection->closed)
+        {
+            // A batch that did not make it to the log is not acknowledged;
+            // dropping the connection has the endpoint send it again.
+            if (MarkAtomicLoad64(&connection->failed) || !SendAck(connection))
+            {
+                CloseConnection(connection, 1);
+            }
+        }
+        Release(connection);
+
+        connection = next;
+    }
+}
+
+static PCOLLECTOR_BATCH NewBatch(PCONNECTION connection, PSTREAM_FRAME frame)
+{
+    PCOLLECTOR_BATCH batch = (PCOLLECTOR_BATCH)malloc(offsetof(COLLECTOR_BATCH, data) + frame->length);
+
+    if (!batch)
+    {
+        return NULL;
+    }
+
+    batch->next = NULL;
+    batch->connection = connection;
+    batch->endpoint = connection->endpoint.name;
+    batch->type = frame->type;
+    batch->count = frame->count;
+    batch->length = frame->length;
+    batch->sequence = frame->sequence;
+    batch->written = 0;
+    memcpy(batch->data, frame + 1, frame->length);
+
+    return batch;
+}
+
+// Returns 0 on a protocol error.
+static int TakeFrames(PCONNECTION connection)
+{
+    PIO_THREAD thread = connection->thread;
+    PSTREAM_FRAME frame;
+    int result;
+
+    while ((result = StreamReaderNextFrame(&connection->reader, &frame)) == STREAM_FRAME_READY)
+    {
+        PCOLLECTOR_BATCH batch;
+
+        thread->stats.frames++;
+
+        if (frame->type == STREAM_FRAME_ENDPOINT)
+        {
+            // Named before the first batch as the forward sink does, else
+            // the endpoint keeps the peer address it was given at accept.
+            if (frame->length >= sizeof(STREAM_ENDPOINT) && !connection->queued)
+            {
+                memcpy(&connection->endpoint, frame + 1, sizeof(STREAM_ENDPOINT));
+                connection->endpoint.name[sizeof(connection->endpoint.name) - 1] = 0;
+                connection->shard = ShardOf(connection->endpoint.name);
+            }
+            continue;
+        }
+
+        if (frame->type != STREAM_FRAME_EVENTS && frame->type != STREAM_FRAME_COMPRESSED)
+        {
+            continue;
+        }
+        if (frame->type == STREAM_FRAME_EVENTS && frame->length != frame->count * sizeof(MARK_EVENT))
+        {
+            return 0;
+        }
+        if (!frame->count)
+        {
+            continue;
+        }
+
+        batch = NewBatch(connection, frame);
+        if (!batch)
+        {
+            return 0;
+        }
+
+        MarkAtomicAdd64(&connection->references, 1);
+        connection->queued++;
+        thread->stats.events += frame->count;
+
+        QueueShardBatch(connection->shard, batch);
+    }
+
+    return result != STREAM_ERROR;
+}
+
+// One read per wake keeps the connections of a thread taking turns.
+static void Receive(PCONNECTION connection)
+{
+    unsigned long space;
+    unsigned char* buffer = StreamReaderSpace(&connection->reader, &space);
+    ssize_t received = recv(connection->fd, buffer, space, 0);
+
+    if (received > 0)
+    {
+        StreamReaderCommit(&connection->reader, (unsigned long)received);
+        connection->thread->stats.bytes += received;
+
+        if (!TakeFrames(connection))
+        {
+            printf("Dropping %s: bad stream\n", connection->endpoint.name);
+            CloseConnection(connection, 1);
+        }
+    }
+    else if (!received || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+    {
+        CloseConnection(connection, 0);
+    }
+}
+
+static void NamePeer(PCONNECTION connection)
+{
+    struct sockaddr_storage peer;
+    socklen_t length = sizeof(peer);
+    char host[INET6_ADDRSTRLEN] = "unknown";
+    int port = 0;
+
+    if (!getpeername(connection->fd, (struct sockaddr*)&peer, &length))
+    {
+        if (peer.ss_family == AF_INET)
+        {
+            struct sockaddr_in* v4 = (struct sockaddr_in*)&peer;
+            inet_ntop(AF_INET, &v4->sin_addr, host, sizeof(host));
+            port = ntohs(v4->sin_port);
+        }
+        else if (peer.ss_family == AF_INET6)
+        {
+            struct sockaddr_in6* v6 = (struct sockaddr_in6*)&peer;
+            inet_ntop(AF_INET6, &v6->sin6_addr, host, sizeof(host));
+            port = ntohs(v6->sin6_port);
+        }
+    }
+
+    snprintf(connection->endpoint.name, sizeof(connection->endpoint.name), "%s:%d", host, port);
+}
+
+static void Accept(PIO_THREAD thread)
+{
+    int i;
+
+    for (i = 0; i < COLLECTOR_ACCEPTS_PER_WAKE; i++)
+    {
+        struct epoll_event event;
+        PCONNECTION connection;
+        int on = 1;
+        int fd = accept4(s_listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (fd < 0)
+        {
+            if (errno == EMFILE || errno == ENFILE)
+            {
+                printf("Out of file descriptors, raise the limit with ulimit -n\n");
+            }
+            return;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        connection = (PCONNECTION)calloc(1, sizeof(CONNECTION));
+        if (!connection)
+        {
+            close(fd);
+            return;
+        }
+        if (!StreamReaderInit(&connection->reader, COLLECTOR_READ_BUFFER) ||
+            !StreamWriterInit(&connection->acks, sizeof(STREAM_HELLO) + sizeof(STREAM_FRAME)))
+        {
+            StreamReaderFree(&connection->reader);
+            free(connection);
+            close(fd);
+            return;
+        }
+
+        connection->fd = fd;
+        connection->thread = thread;
+        connection->references = 1;
+        NamePeer(connection);
+        connection->shard = ShardOf(connection->endpoint.name);
+
+        event.events = EPOLLIN;
+        event.data.ptr = connection;
+        if (epoll_ctl(thread->epoll, EPOLL_CTL_ADD, fd, &event))
+        {
+            Release(connection);
+            close(fd);
+            continue;
+        }
+
+        connection->next = thread->connections;
+        if (thread->connections)
+        {
+            thread->connections->previous = connection;
+        }
+        thread->connections = connection;
+
+        thread->stats.accepted++;
+        thread->stats.connections++;
+    }
+}
+
+static MARK_THREAD_PROC(IoThread, parameter)
+{
+    PIO_THREAD thread = (PIO_THREAD)parameter;
+    struct epoll_event events[COLLECTOR_EPOLL_EVENTS];
+
+    while (!s_stopping)
+    {
+        int count = epoll_wait(thread->epoll, events, COLLECTOR_EPOLL_EVENTS, -1);
+        int i;
+
+        for (i = 0; i < count && !s_stopping; i++)
+        {
+            if (events[i].data.ptr == &s_listenerTag)
+            {
+                Accept(thread);
+            }
+            else if (events[i].data.ptr == &s_wakeTag)
+            {
+                TakeAcks(thread);
+            }
+            else
+            {
+                PCONNECTION connection = (PCONNECTION)events[i].data.ptr;
+
+                if (connection->closed)
+                {
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT)
+                {
+                    if (!SendAck(connection))
+                    {
+                        CloseConnection(connection, 1);
+                        continue;
+                    }
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                {
+                    Receive(connection);
+                }
+            }
+        }
+
+        ReleaseClosed(thread);
+    }
+
+    while (thread->connections)
+    {
+        CloseConnection(thread->connections, 0);
+    }
+    ReleaseClosed(thread);
+
+    return 0;
+}
+
+static int OpenListener(const char* address)
+{
+    struct sockaddr_storage local;
+    socklen_t length;
+    int on = 1;
+
+    if (!ResolveCollectorAddress(address, 1, &local, &length))
+    {
+        return 0;
+    }
+
+    s_listener = socket(local.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s_listener < 0)
+    {
+        printf("Cannot create a socket: %s\n", strerror(errno));
+        return 0;
+    }
+    setsockopt(s_listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(s_listener, (struct sockaddr*)&local, length) || listen(s_listener, COLLECTOR_BACKLOG))
+    {
+        printf("Cannot listen on %s: %s\n", address, strerror(errno));
+        close(s_listener);
+        s_listener = -1;
+        return 0;
+    }
+
+    return 1;
+}
+
+static int StartIoThread(PIO_THREAD thread, int index)
+{
+    struct epoll_event event;
+
+    thread->index = index;
+    thread->epoll = epoll_create1(EPOLL_CLOEXEC);
+    thread->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    MarkLockInit(&thread->lock);
+    if (thread->epoll < 0 || thread->wake < 0)
+    {
+        return 0;
+    }
+
+    // Every thread waits on the listener; EPOLLEXCLUSIVE wakes one of them
+    // per connection instead of all.
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.ptr = &s_listenerTag;
+    if (epoll_ctl(thread->epoll, EPOLL_CTL_ADD, s_listener, &event))
+    {
+        return 0;
+    }
+
+    event.events = EPOLLIN;
+    event.data.ptr = &s_wakeTag;
+    if (epoll_ctl(thread->epoll, EPOLL_CTL_ADD, thread->wake, &event))
+    {
+        return 0;
+    }
+
+    return MarkThreadStart(&thread->thread, IoThread, thread);
+}
+
+int StartCollector(PCOLLECTOR_OPTIONS options)
+{
+    int shards = options->shards;
+    int i;
+
+    if (shards <= 0)
+    {
+        shards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    shards = MAX(1, MIN(shards, COLLECTOR_MAX_SHARDS));
+    s_threadCount = MAX(1, MIN(options->threads, COLLECTOR_MAX_THREADS));
+    s_stopping = 0;
+    memset(&s_closed, 0, sizeof(s_closed));
+
+    if (!OpenListener(options->address))
+    {
+        return 0;
+    }
+
+    if (!StartShards(options->directory, shards, options->segmentSize, options->segments))
+    {
+        close(s_listener);
+        s_listener = -1;
+        return 0;
+    }
+
+    s_threads = (PIO_THREAD)calloc(s_threadCount, sizeof(IO_THREAD));
+    if (!s_threads)
+    {
+        s_threadCount = 0;
+        StopCollector();
+        return 0;
+    }
+
+    for (i = 0; i < s_threadCount; i++)
+    {
+        if (!StartIoThread(&s_threads[i], i))
+        {
+            printf("Cannot start I/O thread %d: %s\n", i, strerror(errno));
+            if (s_threads[i].epoll >= 0)
+            {
+                close(s_threads[i].epoll);
+            }
+            if (s_threads[i].wake >= 0)
+            {
+                close(s_threads[i].wake);
+            }
+            MarkLockDelete(&s_threads[i].lock);
+            s_threadCount = i;
+            StopCollector();
+            return 0;
+        }
+    }
+
+    printf("Collecting on %s into %s, %d I/O threads, %d shards\n",
+        options->address, options->directory, s_threadCount, shards);
+
+    return 1;
+}
+
+static void AddStats(PCOLLECTOR_STATS total, PCOLLECTOR_STATS stats)
+{
+    total->connections += stats->connections;
+    total->accepted += stats->accepted;
+    total->bytes += stats->bytes;
+    total->frames += stats->frames;
+    total->events += stats->events;
+    total->acks += stats->acks;
+    total->errors += stats->errors;
+}
+
+// The I/O threads go first and close their connections, then the shard
+// writers flush what was queued. Nothing is acknowledged after the stop;
+// the endpoints send it again to the next collector run.
+void StopCollector()
+{
+    unsigned long long one = 1;
+    int i;
+
+    s_stopping = 1;
+    for (i = 0; i < s_threadCount; i++)
+    {
+        if (write(s_threads[i].wake, &one, sizeof(one)) < 0)
+        {
+            // Already awake.
+        }
+    }
+    for (i = 0; i < s_threadCount; i++)
+    {
+        MarkThreadJoin(s_threads[i].thread);
+    }
+
+    StopShards();
+
+    for (i = 0; i < s_threadCount; i++)
+    {
+        PIO_THREAD thread = &s_threads[i];
+        PCONNECTION connection = thread->acks;
+
+        while (connection)
+        {
+            PCONNECTION next = connection->nextAck;
+            Release(connection);
+            connection = next;
+        }
+
+        AddStats(&s_closed, &thread->stats);
+        close(thread->epoll);
+        close(thread->wake);
+        MarkLockDelete(&thread->lock);
+    }
+
+    free(s_threads);
+    s_threads = NULL;
+    s_threadCount = 0;
+
+    if (s_listener >= 0)
+    {
+        close(s_listener);
+        s_listener = -1;
+    }
+}
+
+void GetCollectorStats(PCOLLECTOR_STATS stats)
+{
+    int i;
+
+    memcpy(stats, &s_closed, sizeof(*stats));
+    for (i = 0; i < s_threadCount; i++)
+    {
+        AddStats(stats, &s_threads[i].stats);
+    }
+    AddShardStats(stats);
+}
\ No newline at end of file
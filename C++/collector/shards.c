@@ -0,0 +1,350 @@
+#include "collector.h"
+#include "../dcomm/lz.h"
+#include "../dcomm/segment.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// One writer thread per shard, each with its own segment log under
+// directory/shard-NNN. Batches are taken off the queue a round at a time;
+// the log is flushed once per round and only then are the batches of the
+// round acknowledged, so a busy shard writes full blocks and acknowledges
+// in groups. Every batch also gets a line in the shard's endpoint journal,
+//   <first log sequence> <count> <endpoint> <endpoint sequence>
+// which tells where the events of an endpoint are in the log.
+
+typedef struct _SHARD_STATS
+{
+    SEGMENT_STATS log; // copied from the log after every round
+    int maxDepth;
+} SHARD_STATS, *PSHARD_STATS;
+
+typedef struct _SHARD
+{
+    int index;
+    MARK_THREAD thread;
+    MARK_LOCK lock;
+    MARK_COND ready;
+    MARK_COND space;
+    PCOLLECTOR_BATCH head;
+    PCOLLECTOR_BATCH tail;
+    int depth;
+
+    PSEGMENT_LOG log;
+    FILE* journal;
+    PMARK_EVENT inflated;
+    unsigned long inflatedCount;
+
+    PSHARD_STATS stats; // under lock while the shard runs
+} SHARD, *PSHARD;
+
+static PSHARD s_shards = NULL;
+static PSHARD_STATS s_stats = NULL; // kept after StopShards for the final report
+static int s_count = 0;
+static volatile int s_stopping = 0;
+
+int ShardOf(const char* endpoint)
+{
+    unsigned int hash = 2166136261u;
+
+    while (*endpoint)
+    {
+        hash = (hash ^ (unsigned char)*endpoint++) * 16777619u;
+    }
+
+    return (int)(hash % s_count);
+}
+
+void QueueShardBatch(int shard, PCOLLECTOR_BATCH batch)
+{
+    PSHARD s = &s_shards[shard];
+
+    batch->next = NULL;
+
+    MarkLockAcquire(&s->lock);
+    while (s->depth >= COLLECTOR_SHARD_QUEUE && !s_stopping)
+    {
+        MarkCondWait(&s->space, &s->lock, -1);
+    }
+
+    if (s->tail)
+    {
+        s->tail->next = batch;
+    }
+    else
+    {
+        s->head = batch;
+    }
+    s->tail = batch;
+    s->depth++;
+    s->stats->maxDepth = MAX(s->stats->maxDepth, s->depth);
+
+    MarkCondWake(&s->ready);
+    MarkLockRelease(&s->lock);
+}
+
+static PMARK_EVENT Inflate(PSHARD shard, PCOLLECTOR_BATCH batch)
+{
+    unsigned long size = batch->count * sizeof(MARK_EVENT);
+
+    if (batch->type == STREAM_FRAME_EVENTS)
+    {
+        return (PMARK_EVENT)batch->data;
+    }
+
+    if (batch->count > shard->inflatedCount)
+    {
+        PMARK_EVENT inflated = (PMARK_EVENT)realloc(shard->inflated, size);
+
+        if (!inflated)
+        {
+            return NULL;
+        }
+        shard->inflated = inflated;
+        shard->inflatedCount = batch->count;
+    }
+
+    if (LzDecompress(batch->data, batch->length, (unsigned char*)shard->inflated, size) != (int)size)
+    {
+        return NULL;
+    }
+
+    return shard->inflated;
+}
+
+static int WriteBatch(PSHARD shard, PCOLLECTOR_BATCH batch)
+{
+    PMARK_EVENT events = Inflate(shard, batch);
+    unsigned long long first = SegmentLogSequence(shard->log);
+
+    if (!events)
+    {
+        printf("Shard %d: bad batch from %s at %llu\n", shard->index, batch->endpoint, batch->sequence);
+        return 0;
+    }
+
+    if (!SegmentLogAppend(shard->log, events, batch->count))
+    {
+        return 0;
+    }
+
+    if (shard->journal)
+    {
+        fprintf(shard->journal, "%llu %u %s %llu\n", first, batch->count, batch->endpoint, batch->sequence);
+    }
+
+    return 1;
+}
+
+static MARK_THREAD_PROC(ShardThread, parameter)
+{
+    PSHARD shard = (PSHARD)parameter;
+
+    while (1)
+    {
+        PCOLLECTOR_BATCH batch;
+        PCOLLECTOR_BATCH next;
+        int flushed;
+
+        MarkLockAcquire(&shard->lock);
+        while (!shard->head && !s_stopping)
+        {
+            MarkCondWait(&shard->ready, &shard->lock, -1);
+        }
+        batch = shard->head;
+        shard->head = shard->tail = NULL;
+        shard->depth = 0;
+        MarkCondWakeAll(&shard->space);
+        MarkLockRelease(&shard->lock);
+
+        if (!batch)
+        {
+            break;
+        }
+
+        for (next = batch; next; next = next->next)
+        {
+            next->written = WriteBatch(shard, next);
+        }
+
+        flushed = SegmentLogFlush(shard->log);
+        if (shard->journal)
+        {
+            fflush(shard->journal);
+        }
+
+        MarkLockAcquire(&shard->lock);
+        GetSegmentLogStats(shard->log, &shard->stats->log);
+        MarkLockRelease(&shard->lock);
+
+        while (batch)
+        {
+            next = batch->next;
+            batch->written &= flushed;
+            CollectorBatchWritten(batch);
+            free(batch);
+            batch = next;
+        }
+    }
+
+    return 0;
+}
+
+// Closes a shard whose thread is not running, or never started.
+static void CloseShard(PSHARD shard)
+{
+    SegmentLogClose(shard->log);
+    shard->log = NULL;
+    if (shard->journal)
+    {
+        fclose(shard->journal);
+        shard->journal = NULL;
+    }
+    free(shard->inflated);
+    shard->inflated = NULL;
+    MarkCondDelete(&shard->space);
+    MarkCondDelete(&shard->ready);
+    MarkLockDelete(&shard->lock);
+}
+
+int StartShards(const char* directory, int count, unsigned long long segmentSize, int segments)
+{
+    char path[MARK_MAX_PATH];
+    int i;
+
+    if (!MarkCreateDirectory(directory))
+    {
+        printf("Cannot create the directory %s\n", directory);
+        return 0;
+    }
+
+    free(s_stats);
+    s_shards = (PSHARD)calloc(count, sizeof(SHARD));
+    s_stats = (PSHARD_STATS)calloc(count, sizeof(SHARD_STATS));
+    s_count = 0;
+    if (!s_shards || !s_stats)
+    {
+        free(s_shards);
+        s_shards = NULL;
+        return 0;
+    }
+    s_stopping = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        PSHARD shard = &s_shards[i];
+
+        shard->index = i;
+        shard->stats = &s_stats[i];
+        MarkLockInit(&shard->lock);
+        MarkCondInit(&shard->ready);
+        MarkCondInit(&shard->space);
+
+        snprintf(path, sizeof(path), "%s" MARK_PATH_SEPARATOR "shard-%03d", directory, i);
+        shard->log = SegmentLogOpen(path, segmentSize, segments);
+        if (!shard->log)
+        {
+            break;
+        }
+
+        snprintf(path, sizeof(path), "%s" MARK_PATH_SEPARATOR "shard-%03d" MARK_PATH_SEPARATOR COLLECTOR_ENDPOINTS_FILE,
+            directory, i);
+        shard->journal = fopen(path, "a");
+        if (!shard->journal)
+        {
+            printf("Cannot open %s, shard %d keeps no endpoint journal\n", path, i);
+        }
+
+        if (!MarkThreadStart(&shard->thread, ShardThread, shard))
+        {
+            break;
+        }
+        s_count++;
+    }
+
+    if (s_count < count)
+    {
+        // The shards before this one are running: stop them as well.
+        CloseShard(&s_shards[s_count]);
+        StopShards();
+        return 0;
+    }
+
+    return 1;
+}
+
+// After the I/O threads are gone: writes out what is queued. The stats
+// stay for AddShardStats and PrintShardStats.
+void StopShards()
+{
+    int i;
+
+    if (!s_shards)
+    {
+        return;
+    }
+
+    s_stopping = 1;
+    for (i = 0; i < s_count; i++)
+    {
+        MarkLockAcquire(&s_shards[i].lock);
+        MarkCondWakeAll(&s_shards[i].ready);
+        MarkCondWakeAll(&s_shards[i].space);
+        MarkLockRelease(&s_shards[i].lock);
+    }
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSHARD shard = &s_shards[i];
+
+        MarkThreadJoin(shard->thread);
+        GetSegmentLogStats(shard->log, &shard->stats->log);
+        CloseShard(shard);
+    }
+
+    free(s_shards);
+    s_shards = NULL;
+}
+
+void AddShardStats(PCOLLECTOR_STATS stats)
+{
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSHARD_STATS shard = &s_stats[i];
+
+        // Stopped shards are gone, their queues empty.
+        if (s_shards)
+        {
+            MarkLockAcquire(&s_shards[i].lock);
+            stats->queued += s_shards[i].depth;
+        }
+        stats->written += shard->log.events;
+        stats->blocks += shard->log.blocks;
+        stats->rawBytes += shard->log.rawBytes;
+        stats->logBytes += shard->log.compressedBytes;
+        stats->failures += shard->log.failures;
+        stats->maxQueued = MAX(stats->maxQueued, (unsigned long long)shard->maxDepth);
+        if (s_shards)
+        {
+            MarkLockRelease(&s_shards[i].lock);
+        }
+    }
+}
+
+void PrintShardStats()
+{
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSHARD_STATS shard = &s_stats[i];
+
+        printf("Shard %d: %llu events in %llu blocks, %llu segments, %.1f:1 compression, max queue %d, %llu failures\n",
+            i, shard->log.events, shard->log.blocks, shard->log.segments,
+            shard->log.compressedBytes ? (double)shard->log.rawBytes / shard->log.compressedBytes : 0.0,
+            shard->maxDepth, shard->log.failures);
+    }
+}
\ No newline at end of file
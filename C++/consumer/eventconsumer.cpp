@@ -0,0 +1,333 @@
+#include "eventconsumer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace mark
+{
+    EventConsumer::EventConsumer()
+        : listener(NULL), transport(NULL), reading(false), stopped(false)
+    {
+        memset(&reader, 0, sizeof(reader));
+        memset(&acks, 0, sizeof(acks));
+        memset(&stats, 0, sizeof(stats));
+    }
+
+    EventConsumer::~EventConsumer()
+    {
+        Disconnect();
+        if (listener)
+        {
+            TransportListenerClose(listener);
+        }
+    }
+
+    bool EventConsumer::Listen(const char* address)
+    {
+        listener = TransportListen(address);
+        return listener != NULL;
+    }
+
+    bool EventConsumer::Accept()
+    {
+        Disconnect();
+
+        if (!listener || stopped)
+        {
+            return false;
+        }
+
+        PTRANSPORT accepted = TransportAccept(listener);
+        if (!accepted)
+        {
+            return false;
+        }
+
+        if (!StreamReaderInit(&reader, STREAM_DEFAULT_BATCH * 2))
+        {
+            TransportClose(accepted);
+            return false;
+        }
+        if (!StreamWriterInit(&acks, sizeof(STREAM_HELLO) + sizeof(STREAM_FRAME)))
+        {
+            StreamReaderFree(&reader);
+            TransportClose(accepted);
+            return false;
+        }
+
+        acked = 0;
+        reading = true;
+        transport = accepted;
+        stats.connections++;
+
+        return true;
+    }
+
+    bool EventConsumer::Subscribe(const char* address, const STREAM_SUBSCRIPTION& subscription)
+    {
+        Disconnect();
+
+        if (stopped)
+        {
+            return false;
+        }
+
+        PTRANSPORT connected = TransportConnect(address);
+        if (!connected)
+        {
+            return false;
+        }
+
+        STREAM_WRITER writer;
+        if (!StreamWriterInit(&writer, sizeof(STREAM_HELLO) + sizeof(STREAM_FRAME) + sizeof(subscription)))
+        {
+            TransportClose(connected);
+            return false;
+        }
+
+        unsigned long size = StreamWriterControl(&writer, STREAM_FRAME_SUBSCRIBE, &subscription, sizeof(subscription));
+        bool sent = size && TransportSend(connected, writer.buffer, size);
+        StreamWriterFree(&writer);
+
+        if (!sent || !StreamReaderInit(&reader, STREAM_DEFAULT_BATCH * 2))
+        {
+            TransportClose(connected);
+            return false;
+        }
+
+        reading = true;
+        transport = connected;
+        stats.connections++;
+
+        return true;
+    }
+
+    void EventConsumer::Disconnect()
+    {
+        if (transport)
+        {
+            TRANSPORT_STATS current;
+
+            GetTransportStats(transport, &current);
+            stats.receives += current.receives;
+            stats.bytes += current.bytesReceived;
+
+            TransportClose(transport);
+            transport = NULL;
+        }
+
+        if (reading)
+        {
+            stats.frames += reader.frames;
+            stats.skipped += reader.skipped;
+            StreamReaderFree(&reader);
+            StreamWriterFree(&acks);
+            reading = false;
+        }
+    }
+
+    // Tells a producer that waits for it what has been handled so far. One
+    // ack covers every frame that arrived in the same read.
+    bool EventConsumer::Acknowledge()
+    {
+        if (!(reader.header.flags & STREAM_HELLO_ACKS) || reader.sequence <= acked)
+        {
+            return true;
+        }
+
+        StreamWriterReset(&acks);
+        unsigned long size = StreamWriterFrame(&acks, STREAM_FRAME_ACK, 0, reader.sequence, NULL, 0);
+        if (!size || !TransportSend(transport, acks.buffer, size))
+        {
+            return false;
+        }
+
+        acked = reader.sequence;
+        stats.acks++;
+
+        return true;
+    }
+
+    bool EventConsumer::ReadBatch(const MARK_EVENT** events, int* count)
+    {
+        if (!transport)
+        {
+            return false;
+        }
+
+        while (true)
+        {
+            PMARK_EVENT batch;
+            int result = StreamReaderNext(&reader, &batch, count);
+
+            if (result == STREAM_EVENTS)
+            {
+                *events = batch;
+                stats.events += *count;
+                return true;
+            }
+            if (result == STREAM_ERROR)
+            {
+                printf("Invalid event stream, dropping the producer\n");
+                stats.errors++;
+                return false;
+            }
+
+            if (!Acknowledge())
+            {
+                return false;
+            }
+
+            unsigned long space;
+            unsigned char* buffer = StreamReaderSpace(&reader, &space);
+
+            long received = TransportReceive(transport, buffer, space);
+            if (received <= 0 || stopped)
+            {
+                return false;
+            }
+            StreamReaderCommit(&reader, (unsigned long)received);
+        }
+    }
+
+    unsigned long long EventConsumer::Run(const EventHandler& handler)
+    {
+        const MARK_EVENT* events;
+        unsigned long long handled = 0;
+        int count;
+
+        while (ReadBatch(&events, &count))
+        {
+            for (int i = 0; i < count; i++)
+            {
+                handler(events[i]);
+            }
+            handled += count;
+        }
+
+        return handled;
+    }
+
+    void EventConsumer::Stop()
+    {
+        stopped = true;
+
+        if (listener)
+        {
+            TransportListenerStop(listener);
+        }
+
+        PTRANSPORT current = transport;
+        if (current)
+        {
+            TransportShutdown(current);
+        }
+    }
+
+    ConsumerStats EventConsumer::GetStats() const
+    {
+        ConsumerStats result = stats;
+
+        if (transport)
+        {
+            TRANSPORT_STATS current;
+
+            GetTransportStats(transport, &current);
+            result.receives += current.receives;
+            result.bytes += current.bytesReceived;
+        }
+        if (reading)
+        {
+            result.frames += reader.frames;
+            result.skipped += reader.skipped;
+        }
+
+        return result;
+    }
+
+    RingConsumer::RingConsumer()
+        : reader(NULL), pending(0), stopped(false)
+    {
+    }
+
+    RingConsumer::~RingConsumer()
+    {
+        ShmReaderClose(reader);
+    }
+
+    bool RingConsumer::Open(const char* name, bool oldest)
+    {
+        reader = ShmReaderOpen(name, oldest ? 1 : 0);
+        return reader != NULL;
+    }
+
+    bool RingConsumer::ReadBatch(const MARK_EVENT** events, int* count)
+    {
+        if (!reader)
+        {
+            return false;
+        }
+
+        if (pending)
+        {
+            ShmReaderRelease(reader);
+            pending = 0;
+        }
+
+        while (!stopped)
+        {
+            PMARK_EVENT batch;
+
+            pending = ShmReaderPeek(reader, &batch, SHMRING_PUBLISH_BATCH);
+            if (pending)
+            {
+                *events = batch;
+                *count = pending;
+                return true;
+            }
+            if (ShmReaderClosed(reader))
+            {
+                break;
+            }
+            ShmReaderWait(reader, SHMRING_WAIT_INTERVAL);
+        }
+
+        return false;
+    }
+
+    unsigned long long RingConsumer::Run(const EventHandler& handler)
+    {
+        const MARK_EVENT* events;
+        unsigned long long handled = 0;
+        int count;
+
+        while (ReadBatch(&events, &count))
+        {
+            for (int i = 0; i < count; i++)
+            {
+                handler(events[i]);
+            }
+            handled += count;
+        }
+
+        return handled;
+    }
+
+    void RingConsumer::Stop()
+    {
+        stopped = true;
+    }
+
+    SHMRING_READER_STATS RingConsumer::GetStats() const
+    {
+        SHMRING_READER_STATS stats;
+
+        memset(&stats, 0, sizeof(stats));
+        if (reader)
+        {
+            GetShmReaderStats(reader, &stats);
+        }
+
+        return stats;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,140 @@
+#ifndef _EVENTCONSUMER_H_
+#define _EVENTCONSUMER_H_
+
+// Reference consumers for dcomm's event channels.
+//
+// EventConsumer listens where the analyzer sink connects (-analyzer
+// [address]), accepts one producer at a time and hands out its events a
+// frame at a time, straight from the receive buffer. Listening on a
+// tcp:host:port address it also stands in for a collector of the forward
+// sink (-forward): compressed frames are inflated and, as the producer
+// asks for it, acknowledged once the handler has seen them.
+//
+//   mark::EventConsumer consumer;
+//   consumer.Listen(TRANSPORT_DEFAULT_ADDRESS);
+//   while (consumer.Accept())
+//   {
+//       consumer.Run([](const MARK_EVENT& event) { ... });
+//   }
+//
+// With a dcomm started with -broker [address], Subscribe connects to the
+// broker instead and only receives the events the subscription selects.
+//
+//   STREAM_SUBSCRIPTION subscription = {};
+//   subscription.opclasses = 1 << MARK_OPCLASS_PACKET;
+//   if (consumer.Subscribe(BROKER_DEFAULT_ADDRESS, subscription))
+//   {
+//       consumer.Run([](const MARK_EVENT& event) { ... });
+//   }
+//
+// RingConsumer attaches to the shared memory ring of a dcomm on the same
+// host (-shm [name]) and hands out events in place.
+//
+//   mark::RingConsumer consumer;
+//   if (consumer.Open(SHMRING_DEFAULT_NAME, false))
+//   {
+//       consumer.Run([](const MARK_EVENT& event) { ... });
+//   }
+
+extern "C"
+{
+#include "../dcomm/broker.h"
+#include "../dcomm/eventstream.h"
+#include "../dcomm/shmring.h"
+#include "../dcomm/transport.h"
+}
+
+#include <functional>
+
+namespace mark
+{
+    struct ConsumerStats
+    {
+        unsigned long long connections;
+        unsigned long long events;
+        unsigned long long frames;
+        unsigned long long skipped;  // frames of unknown type
+        unsigned long long receives; // read calls
+        unsigned long long bytes;
+        unsigned long long errors;   // streams dropped for a protocol error
+        unsigned long long acks;
+    };
+
+    class EventConsumer
+    {
+    public:
+        typedef std::function<void(const MARK_EVENT& event)> EventHandler;
+
+        EventConsumer();
+        ~EventConsumer();
+
+        bool Listen(const char* address);
+        // Waits for the next producer. False once stopped or on error.
+        bool Accept();
+        // Connects to dcomm's broker and registers subscription; the
+        // broker is then read like an accepted producer.
+        bool Subscribe(const char* address, const STREAM_SUBSCRIPTION& subscription);
+
+        // Next batch of the current producer, valid until the next call.
+        // False when the producer disconnected or sent something invalid.
+        bool ReadBatch(const MARK_EVENT** events, int* count);
+        // Calls handler for every event until the producer goes away.
+        // Returns the number of events handled.
+        unsigned long long Run(const EventHandler& handler);
+
+        // Ends Accept and Run/ReadBatch from another thread.
+        void Stop();
+
+        ConsumerStats GetStats() const;
+
+    private:
+        EventConsumer(const EventConsumer&);
+        EventConsumer& operator=(const EventConsumer&);
+
+        void Disconnect();
+        bool Acknowledge();
+
+        PTRANSPORT_LISTENER listener;
+        PTRANSPORT volatile transport;
+        STREAM_READER reader;
+        STREAM_WRITER acks;
+        unsigned long long acked;
+        bool reading;
+        volatile bool stopped;
+        ConsumerStats stats;
+    };
+
+    class RingConsumer
+    {
+    public:
+        typedef EventConsumer::EventHandler EventHandler;
+
+        RingConsumer();
+        ~RingConsumer();
+
+        // With oldest, starts with what is still in the ring instead of
+        // the next event dcomm publishes.
+        bool Open(const char* name, bool oldest);
+
+        // Waits for the next batch, valid until the next call. False once
+        // dcomm closed the ring and everything was taken, or once stopped.
+        bool ReadBatch(const MARK_EVENT** events, int* count);
+        // Calls handler for every event until the ring is closed. Events
+        // that dcomm overwrote while the handler ran are counted as lost.
+        unsigned long long Run(const EventHandler& handler);
+
+        void Stop();
+
+        SHMRING_READER_STATS GetStats() const;
+
+    private:
+        RingConsumer(const RingConsumer&);
+        RingConsumer& operator=(const RingConsumer&);
+
+        PSHMRING_READER reader;
+        int pending;
+        volatile bool stopped;
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,219 @@
+// Sample consumer: counts what dcomm sends and prints one line per producer.
+//
+//   consumer [-address pipe name or socket path] [-print]
+//   consumer -address tcp::7170      stand-in collector for dcomm -forward
+//   consumer -shm [ring name] [-oldest] [-print]
+//   consumer -subscribe [address] [-opclass mask] [-optype mask] [-pid n]
+//            [-image pattern] [-path pattern] [-print]
+//
+// Linux build, from this directory:
+//   gcc -O2 -c ../dcomm/eventstream.c ../dcomm/transport.c ../dcomm/shmring.c ../dcomm/platform.c ../dcomm/lz.c
+//   g++ -O2 -pthread -o consumer main.cpp eventconsumer.cpp eventstream.o transport.o shmring.o platform.o lz.o
+
+#include "eventconsumer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C"
+{
+#include "../dcomm/platform.h"
+}
+
+static void PrintUsage()
+{
+    printf("consumer [-address pipe name, socket path or tcp:host:port] [-print]\n"
+           "consumer -shm [ring name] [-oldest] [-print]\n"
+           "consumer -subscribe [address] [-opclass mask] [-optype mask] [-pid n]\n"
+           "         [-image pattern] [-path pattern] [-print]\n");
+}
+
+static void PrintEvent(const MARK_EVENT& event)
+{
+    printf("%lld pid %u class %u type %u\n", event.time, event.pid, event.opclass, event.optype);
+}
+
+static int RunRing(const char* name, bool oldest, bool print)
+{
+    mark::RingConsumer consumer;
+
+    if (!consumer.Open(name, oldest))
+    {
+        printf("No event ring %s, start dcomm with -shm first\n", name);
+        return 1;
+    }
+
+    unsigned long long start = MarkClockMicroseconds();
+    unsigned long long events = consumer.Run([print](const MARK_EVENT& event)
+    {
+        if (print)
+        {
+            PrintEvent(event);
+        }
+    });
+
+    SHMRING_READER_STATS stats = consumer.GetStats();
+    double seconds = (MarkClockMicroseconds() - start) / 1e6;
+
+    printf("%llu events, %llu lost, max lag %llu, %llu waits, %.0f events/s\n",
+        events, stats.lost, stats.maxLag, stats.waits, seconds > 0 ? events / seconds : 0.0);
+
+    return 0;
+}
+
+// Patterns come from the command line as ASCII.
+static void CopyPattern(unsigned short* target, int size, const char* pattern)
+{
+    int i;
+
+    for (i = 0; i < size - 1 && pattern[i]; i++)
+    {
+        target[i] = (unsigned char)pattern[i];
+    }
+    target[i] = 0;
+}
+
+static int RunSubscription(const char* address, const STREAM_SUBSCRIPTION& subscription, bool print)
+{
+    mark::EventConsumer consumer;
+
+    if (!consumer.Subscribe(address, subscription))
+    {
+        printf("Cannot subscribe at %s, start dcomm with -broker first\n", address);
+        return 1;
+    }
+
+    unsigned long long start = MarkClockMicroseconds();
+    unsigned long long events = consumer.Run([print](const MARK_EVENT& event)
+    {
+        if (print)
+        {
+            PrintEvent(event);
+        }
+    });
+
+    mark::ConsumerStats stats = consumer.GetStats();
+    double seconds = (MarkClockMicroseconds() - start) / 1e6;
+
+    printf("%llu events in %llu frames, %.0f events/s\n",
+        events, stats.frames, seconds > 0 ? events / seconds : 0.0);
+
+    return stats.errors ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* address = TRANSPORT_DEFAULT_ADDRESS;
+    const char* ring = NULL;
+    const char* broker = NULL;
+    STREAM_SUBSCRIPTION subscription;
+    bool oldest = false;
+    bool print = false;
+
+    memset(&subscription, 0, sizeof(subscription));
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-address") && i + 1 < argc)
+        {
+            address = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-shm"))
+        {
+            ring = SHMRING_DEFAULT_NAME;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                ring = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-subscribe"))
+        {
+            broker = BROKER_DEFAULT_ADDRESS;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+            {
+                broker = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], "-opclass") && i + 1 < argc)
+        {
+            subscription.opclasses = strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "-optype") && i + 1 < argc)
+        {
+            subscription.optypes = strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "-pid") && i + 1 < argc)
+        {
+            subscription.pid = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-image") && i + 1 < argc)
+        {
+            CopyPattern(subscription.szImagePath, 176, argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-path") && i + 1 < argc)
+        {
+            CopyPattern(subscription.szOperationPath, 256, argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-oldest"))
+        {
+            oldest = true;
+        }
+        else if (!strcmp(argv[i], "-print"))
+        {
+            print = true;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (ring)
+    {
+        return RunRing(ring, oldest, print);
+    }
+    if (broker)
+    {
+        return RunSubscription(broker, subscription, print);
+    }
+
+    mark::EventConsumer consumer;
+    if (!consumer.Listen(address))
+    {
+        printf("Cannot listen on %s\n", address);
+        return 1;
+    }
+    printf("Waiting for dcomm on %s\n", address);
+
+    while (consumer.Accept())
+    {
+        mark::ConsumerStats before = consumer.GetStats();
+        unsigned long long start = MarkClockMicroseconds();
+
+        unsigned long long events = consumer.Run([print](const MARK_EVENT& event)
+        {
+            if (print)
+            {
+                PrintEvent(event);
+            }
+        });
+
+        mark::ConsumerStats after = consumer.GetStats();
+        double seconds = (MarkClockMicroseconds() - start) / 1e6;
+        unsigned long long receives = after.receives - before.receives;
+
+        printf("%llu events in %llu frames, %llu reads (%.1f events per read), %.0f events/s\n",
+            events, after.frames - before.frames, receives,
+            receives ? (double)events / receives : 0.0,
+            seconds > 0 ? events / seconds : 0.0);
+        if (after.acks > before.acks)
+        {
+            printf("%llu acknowledgements sent\n", after.acks - before.acks);
+        }
+        fflush(stdout);
+    }
+
+    return 0;
+}
\ No newline at end of file
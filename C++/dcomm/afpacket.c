@@ -0,0 +1,538 @@
+#include "afpacket.h"
+#include "capturefilter.h"
+#include "flowtable.h"
+#include "packetdecode.h"
+#include "platform.h"
+#include "sources.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef struct _AFPACKET_SOCKET
+{
+    char name[IF_NAMESIZE + 8]; // interface, and /n for fanout members
+    int fd;
+    int cpu;
+    unsigned char* ring;
+    unsigned int blockSize;
+    unsigned int blockCount;
+    unsigned int block; // the next one to look at
+    volatile int stop;
+    PFLOW_TABLE flows;
+    long long filter; // generation of the capture filter attached
+    long long failed; // generation that would not attach, tried again with the stats
+
+    unsigned long long packets;
+    unsigned long long decoded;
+    unsigned long long events; // flow events
+    unsigned long long blocks;
+    unsigned long long bytes;
+    // PACKET_STATISTICS, which the kernel resets on every read
+    unsigned long long received;
+    unsigned long long dropped;
+    unsigned long long freezes; // times the ring was full
+    unsigned long long lastPoll;
+} AFPACKET_SOCKET, *PAFPACKET_SOCKET;
+
+static AFPACKET_SOCKET s_sockets[AFPACKET_MAX_SOCKETS];
+static int s_count = 0;
+
+typedef struct _AFPACKET_INTERFACE
+{
+    char name[IF_NAMESIZE];
+    int index;
+    int cpu; // -1 to take the next one in turn
+} AFPACKET_INTERFACE, *PAFPACKET_INTERFACE;
+
+static void PollSocketStats(PAFPACKET_SOCKET capture)
+{
+    struct tpacket_stats_v3 stats;
+    socklen_t length = sizeof(stats);
+
+    if (getsockopt(capture->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &length) != 0)
+    {
+        return;
+    }
+
+    // tp_packets counts the drops as well.
+    capture->received += stats.tp_packets;
+    capture->dropped += stats.tp_drops;
+    capture->freezes += stats.tp_freeze_q_cnt;
+
+    if (stats.tp_drops)
+    {
+        printf("Capture %s: %u packets dropped, %llu in all\n", capture->name, stats.tp_drops, capture->dropped);
+    }
+}
+
+static void EmitFlow(PMARK_EVENT event, void* context)
+{
+    event->time = MarkTimestamp();
+    SubmitEvent(event);
+    ((PAFPACKET_SOCKET)context)->events++;
+}
+
+static void AddBatch(PAFPACKET_SOCKET capture, const unsigned char* const* frames, const unsigned int* lengths,
+    unsigned int count, long long now)
+{
+    PACKET_BATCH batch;
+    unsigned int i;
+
+    capture->decoded += DecodePacketBatch(frames, lengths, count, &batch);
+    for (i = 0; i < count; i++)
+    {
+        if (batch.decoded >> i & 1)
+        {
+            FlowTableAdd(capture->flows, &batch.info[i], now);
+        }
+    }
+}
+
+static void ReadBlock(PAFPACKET_SOCKET capture, struct tpacket_block_desc* block)
+{
+    struct tpacket3_hdr* frame = (struct tpacket3_hdr*)((unsigned char*)block + block->hdr.bh1.offset_to_first_pkt);
+    unsigned int count = block->hdr.bh1.num_pkts;
+    long long now = MarkTimestamp();
+    const unsigned char* frames[PACKET_BATCH_SIZE];
+    unsigned int lengths[PACKET_BATCH_SIZE];
+    unsigned int pending = 0;
+    unsigned int i;
+
+    // One clock reading per block: the kernel hands a block over within
+    // AFPACKET_BLOCK_TIMEOUT, far below the flow timeouts. The frames stay
+    // in the ring until the block is handed back, so a batch can point at
+    // them.
+    for (i = 0; i < count; i++)
+    {
+        frames[pending] = (unsigned char*)frame + frame->tp_mac;
+        lengths[pending] = frame->tp_snaplen;
+        if (++pending == PACKET_BATCH_SIZE || i + 1 == count)
+        {
+            AddBatch(capture, frames, lengths, pending, now);
+            pending = 0;
+        }
+        frame = (struct tpacket3_hdr*)((unsigned char*)frame + frame->tp_next_offset);
+    }
+
+    capture->packets += count;
+    capture->bytes += block->hdr.bh1.blk_len;
+    capture->blocks++;
+}
+
+static void CloseCaptureSocket(PAFPACKET_SOCKET capture)
+{
+    if (capture->ring)
+    {
+        munmap(capture->ring, (size_t)capture->blockSize * capture->blockCount);
+        capture->ring = NULL;
+    }
+    if (capture->fd >= 0)
+    {
+        close(capture->fd);
+        capture->fd = -1;
+    }
+}
+
+// Attaching a filter to a socket that has one replaces it in one step.
+static int AttachFilter(PAFPACKET_SOCKET capture)
+{
+    static CAPTURE_FILTER s_filters[AFPACKET_MAX_SOCKETS];
+    PCAPTURE_FILTER filter = &s_filters[capture - s_sockets];
+    struct sock_fprog program;
+
+    GetCaptureFilter(filter);
+    if (!filter->generation)
+    {
+        capture->filter = 0;
+        return 1;
+    }
+
+    program.len = (unsigned short)filter->length;
+    program.filter = (struct sock_filter*)filter->program;
+    if (setsockopt(capture->fd, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program)) != 0)
+    {
+        if (capture->failed != filter->generation)
+        {
+            printf("Cannot attach capture filter %lld to %s: %s\n", filter->generation, capture->name, strerror(errno));
+        }
+        capture->failed = filter->generation;
+        return 0;
+    }
+
+    capture->filter = filter->generation;
+    return 1;
+}
+
+static int RunAfPacketSource(void* context)
+{
+    PAFPACKET_SOCKET capture = (PAFPACKET_SOCKET)context;
+    struct pollfd wait;
+
+    if (!MarkThreadPin(capture->cpu))
+    {
+        printf("Cannot pin the capture thread of %s to CPU %d\n", capture->name, capture->cpu);
+    }
+
+    wait.fd = capture->fd;
+    wait.events = POLLIN | POLLERR;
+    capture->lastPoll = MarkClockMicroseconds();
+
+    while (!capture->stop)
+    {
+        struct tpacket_block_desc* block =
+            (struct tpacket_block_desc*)(capture->ring + (unsigned long)capture->block * capture->blockSize);
+        unsigned long long now;
+        long long generation;
+
+        generation = GetCaptureFilterGeneration();
+        if (generation != capture->filter && generation != capture->failed)
+        {
+            AttachFilter(capture);
+        }
+
+        if (*(volatile unsigned int*)&block->hdr.bh1.block_status & TP_STATUS_USER)
+        {
+            // The status is read before the frames it publishes.
+            MarkMemoryBarrier();
+            ReadBlock(capture, block);
+            MarkMemoryBarrier();
+            *(volatile unsigned int*)&block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            capture->block = (capture->block + 1) % capture->blockCount;
+        }
+        else if (poll(&wait, 1, AFPACKET_POLL_INTERVAL) < 0 && errno != EINTR)
+        {
+            printf("Capture on %s failed: %s\n", capture->name, strerror(errno));
+            CloseCaptureSocket(capture);
+            FlowTableDestroy(capture->flows);
+            capture->flows = NULL;
+            return 0;
+        }
+
+        now = MarkClockMicroseconds();
+        if (now - capture->lastPoll >= AFPACKET_STATS_INTERVAL)
+        {
+            // The socket keeps the filter it had until the new one attaches.
+            if (GetCaptureFilterGeneration() != capture->filter)
+            {
+                AttachFilter(capture);
+            }
+            PollSocketStats(capture);
+            FlowTableExpire(capture->flows, MarkTimestamp());
+            capture->lastPoll = now;
+        }
+    }
+
+    PollSocketStats(capture);
+    CloseCaptureSocket(capture);
+    FlowTableDestroy(capture->flows);
+    capture->flows = NULL;
+    return 1;
+}
+
+static void StopAfPacketSource(void* context)
+{
+    ((PAFPACKET_SOCKET)context)->stop = 1;
+}
+
+static int OpenCaptureSocket(PAFPACKET_SOCKET capture, PAFPACKET_INTERFACE device, unsigned long bufferSize, int fanout)
+{
+    int version = TPACKET_V3;
+    struct tpacket_req3 request;
+    struct sockaddr_ll address;
+    struct packet_mreq membership;
+    void* ring;
+
+    capture->blockSize = AFPACKET_BLOCK_SIZE;
+    capture->blockCount = MAX(bufferSize / AFPACKET_BLOCK_SIZE, 2);
+
+    // No protocol until the bind, so nothing arrives from other interfaces
+    // or before the filter.
+    capture->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (capture->fd < 0)
+    {
+        printf("Cannot open a packet socket: %s\n", strerror(errno));
+        return 0;
+    }
+    if (setsockopt(capture->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0)
+    {
+        printf("No TPACKET_V3 rings: %s\n", strerror(errno));
+        return 0;
+    }
+    if (!AttachFilter(capture))
+    {
+        return 0;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_ALL);
+    address.sll_ifindex = device->index;
+    if (bind(capture->fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        printf("Cannot bind to %s: %s\n", device->name, strerror(errno));
+        return 0;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.tp_block_size = capture->blockSize;
+    request.tp_block_nr = capture->blockCount;
+    request.tp_frame_size = AFPACKET_FRAME_SIZE;
+    request.tp_frame_nr = capture->blockSize / AFPACKET_FRAME_SIZE * capture->blockCount;
+    request.tp_retire_blk_tov = AFPACKET_BLOCK_TIMEOUT;
+    if (setsockopt(capture->fd, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) != 0)
+    {
+        printf("Cannot set up a %u MB ring on %s: %s\n", capture->blockCount, device->name, strerror(errno));
+        return 0;
+    }
+
+    ring = mmap(NULL, (size_t)capture->blockSize * capture->blockCount, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED,
+        capture->fd, 0);
+    if (ring == MAP_FAILED)
+    {
+        // Locked pages count against RLIMIT_MEMLOCK, try without.
+        ring = mmap(NULL, (size_t)capture->blockSize * capture->blockCount, PROT_READ | PROT_WRITE, MAP_SHARED,
+            capture->fd, 0);
+    }
+    if (ring == MAP_FAILED)
+    {
+        printf("Cannot map the ring of %s: %s\n", device->name, strerror(errno));
+        return 0;
+    }
+    capture->ring = (unsigned char*)ring;
+
+    if (fanout > 1)
+    {
+        // One group per interface and process; fragments stay together.
+        int group = ((getpid() + device->index) & 0xFFFF) | ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+
+        if (setsockopt(capture->fd, SOL_PACKET, PACKET_FANOUT, &group, sizeof(group)) != 0)
+        {
+            printf("Cannot join the fanout group of %s: %s\n", device->name, strerror(errno));
+            return 0;
+        }
+    }
+
+    // Dropped with the socket.
+    memset(&membership, 0, sizeof(membership));
+    membership.mr_ifindex = device->index;
+    membership.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(capture->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &membership, sizeof(membership)) != 0)
+    {
+        printf("Cannot put %s in promiscuous mode: %s\n", device->name, strerror(errno));
+    }
+
+    return 1;
+}
+
+static int AddInterface(PAFPACKET_INTERFACE devices, int* count, const char* name, int cpu)
+{
+    int index = (int)if_nametoindex(name);
+    int i;
+
+    if (!index)
+    {
+        // or its number
+        char byIndex[IF_NAMESIZE];
+
+        if (atoi(name) <= 0 || name[strspn(name, "0123456789")] || !if_indextoname(atoi(name), byIndex))
+        {
+            printf("No capture interface %s\n", name);
+            return 0;
+        }
+        return AddInterface(devices, count, byIndex, cpu);
+    }
+
+    for (i = 0; i < *count; i++)
+    {
+        if (devices[i].index == index)
+        {
+            return 1;
+        }
+    }
+    if (*count == AFPACKET_MAX_SOCKETS)
+    {
+        printf("Capturing on the first %d interfaces only\n", AFPACKET_MAX_SOCKETS);
+        return 1;
+    }
+
+    strncpy(devices[*count].name, name, IF_NAMESIZE - 1);
+    devices[*count].name[IF_NAMESIZE - 1] = 0;
+    devices[*count].index = index;
+    devices[*count].cpu = cpu;
+    (*count)++;
+    return 1;
+}
+
+// Same selection as SelectCaptureInterfaces in packets.c, with the kernel's
+// interface index as the number.
+static int SelectInterfaces(const char* interfaces, PAFPACKET_INTERFACE devices)
+{
+    char item[IF_NAMESIZE + 16];
+    const char* next = interfaces;
+    int count = 0;
+
+    if (!interfaces || !strcmp(interfaces, "all"))
+    {
+        struct ifaddrs* addresses;
+        struct ifaddrs* a;
+
+        if (getifaddrs(&addresses) != 0)
+        {
+            printf("Cannot list the interfaces: %s\n", strerror(errno));
+            return 0;
+        }
+        for (a = addresses; a; a = a->ifa_next)
+        {
+            if (a->ifa_addr && (a->ifa_addr->sa_family == AF_INET || a->ifa_addr->sa_family == AF_INET6) &&
+                (a->ifa_flags & IFF_UP) && !(a->ifa_flags & IFF_LOOPBACK))
+            {
+                AddInterface(devices, &count, a->ifa_name, -1);
+            }
+        }
+        freeifaddrs(addresses);
+        return count;
+    }
+
+    while (*next)
+    {
+        size_t length = strcspn(next, ",");
+        char* at;
+        int cpu = -1;
+
+        if (length >= sizeof(item))
+        {
+            length = sizeof(item) - 1;
+        }
+        memcpy(item, next, length);
+        item[length] = 0;
+        next += strcspn(next, ",");
+        if (*next)
+        {
+            next++;
+        }
+
+        at = strrchr(item, '@');
+        if (at)
+        {
+            *at = 0;
+            cpu = atoi(at + 1);
+        }
+
+        if (!AddInterface(devices, &count, item, cpu))
+        {
+            return 0;
+        }
+    }
+
+    return count;
+}
+
+int RegisterAfPacketSource(const char* interfaces, int bufferSize, int fanout)
+{
+    AFPACKET_INTERFACE devices[AFPACKET_MAX_SOCKETS];
+    int cpus = MarkCpuCount();
+    int count, i, j;
+
+    fanout = MIN(MAX(fanout, 1), AFPACKET_MAX_FANOUT);
+    count = SelectInterfaces(interfaces, devices);
+    if (!count)
+    {
+        printf("Nothing to capture on\n");
+        return 0;
+    }
+
+    s_count = 0;
+    for (i = 0; i < count; i++)
+    {
+        PAFPACKET_INTERFACE device = &devices[i];
+
+        for (j = 0; j < fanout; j++)
+        {
+            PAFPACKET_SOCKET capture;
+
+            if (s_count == AFPACKET_MAX_SOCKETS)
+            {
+                printf("Capturing with %d sockets only\n", AFPACKET_MAX_SOCKETS);
+                break;
+            }
+
+            capture = &s_sockets[s_count++];
+            memset(capture, 0, sizeof(*capture));
+            if (fanout > 1)
+            {
+                snprintf(capture->name, sizeof(capture->name), "%.16s/%d", device->name, j);
+            }
+            else
+            {
+                snprintf(capture->name, sizeof(capture->name), "%.16s", device->name);
+            }
+            capture->cpu = device->cpu >= 0 ? (device->cpu + j) % cpus : (s_count - 1) % cpus;
+
+            if (!OpenCaptureSocket(capture, device, (unsigned long)MAX(bufferSize, 1) * 1024 * 1024 / fanout, fanout))
+            {
+                for (j = 0; j < s_count; j++)
+                {
+                    CloseCaptureSocket(&s_sockets[j]);
+                }
+                s_count = 0;
+                return 0;
+            }
+        }
+    }
+
+    // Only the sockets with a flow table capture, moved to the front.
+    for (i = 0, j = 0; i < s_count; i++)
+    {
+        PAFPACKET_SOCKET capture = &s_sockets[j];
+
+        if (i != j)
+        {
+            memcpy(capture, &s_sockets[i], sizeof(*capture));
+        }
+        capture->flows = FlowTableCreate(capture->name, NULL, EmitFlow, capture);
+        if (!capture->flows)
+        {
+            CloseCaptureSocket(capture);
+            continue;
+        }
+        if (!RegisterSource(capture->name, RunAfPacketSource, StopAfPacketSource, capture, 0))
+        {
+            FlowTableDestroy(capture->flows);
+            capture->flows = NULL;
+            CloseCaptureSocket(capture);
+            continue;
+        }
+        j++;
+    }
+    s_count = j;
+
+    return s_count;
+}
+
+void PrintAfPacketStats()
+{
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PAFPACKET_SOCKET capture = &s_sockets[i];
+
+        printf("Capture %s: %llu packets, %llu decoded, %llu flow events, %llu blocks (%.1f packets per block), %llu received by the "
+               "socket, %llu dropped, %llu times full, %u MB ring on CPU %d\n",
+            capture->name, capture->packets, capture->decoded, capture->events, capture->blocks,
+            capture->blocks ? (double)capture->packets / capture->blocks : 0.0, capture->received, capture->dropped,
+            capture->freezes, capture->blockSize / 1024 * capture->blockCount / 1024, capture->cpu);
+    }
+}
\ No newline at end of file
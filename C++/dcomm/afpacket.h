@@ -0,0 +1,31 @@
+#ifndef _AFPACKET_H_
+#define _AFPACKET_H_
+
+#include "communicator.h"
+
+// Live capture on Linux without libpcap: an AF_PACKET socket per capture
+// thread with a TPACKET_V3 ring the kernel fills a block at a time. The
+// capture thread walks each block where the kernel left it, decodes the
+// frames in place a batch at a time (DecodePacketBatch) into its own flow
+// table (flowtable.h) and hands the block back, so there is neither a copy
+// nor a system call per packet.
+// With a fanout above 1 an interface gets that many sockets in one
+// PACKET_FANOUT_HASH group; the kernel keeps the packets of a flow on one
+// thread, and so in one flow table. Each socket carries the capture filter
+// (capturefilter.h), swapped as soon as its thread sees a new one.
+
+#define AFPACKET_BLOCK_SIZE (1024 * 1024)
+#define AFPACKET_FRAME_SIZE 2048    // unused by V3 but checked by the kernel
+#define AFPACKET_BLOCK_TIMEOUT 50   // ms before the kernel hands over a partly filled block
+#define AFPACKET_POLL_INTERVAL 100  // ms, how often a waiting thread looks for a stop
+#define AFPACKET_STATS_INTERVAL 1000000ULL // us between PACKET_STATISTICS reads
+#define AFPACKET_MAX_SOCKETS 12     // the rest of MAX_SOURCES for other sources
+#define AFPACKET_MAX_FANOUT 8
+
+// interfaces and bufferSize as for RegisterPacketSource, the buffer being
+// split over the fanout sockets of an interface. Opens every socket before
+// registering any, so 0 leaves nothing behind for a libpcap fallback.
+int RegisterAfPacketSource(const char* interfaces, int bufferSize, int fanout);
+void PrintAfPacketStats();
+
+#endif
\ No newline at end of file
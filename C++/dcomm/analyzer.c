@@ -1,24 +1,171 @@
+#include "analyzer.h"
 #include "communicator.h"
+#include "eventstream.h"
+#include "platform.h"
+#include "transport.h"
 
-#include <Windows.h>
+#include <stdio.h>
 
-static HANDLE pipe = NULL;
+// Events go to the analyzer as framed batches (eventstream.h): they are
+// collected in one frame and sent with a single write once the frame is
+// full, or when the sink runs idle and the oldest event has waited for the
+// linger time. While there is no analyzer to talk to, events are dropped
+// and the connection is retried every ANALYZER_RETRY_INTERVAL.
 
-void CreateNeededInfo()
+#define ANALYZER_RETRY_INTERVAL 1000 // ms
+
+static const char* s_address = TRANSPORT_DEFAULT_ADDRESS;
+static int s_linger = ANALYZER_DEFAULT_LINGER;
+
+static PTRANSPORT s_transport = NULL;
+static STREAM_WRITER s_writer;
+static int s_initialized = 0;
+static unsigned long long s_oldest = 0;
+static unsigned long long s_retry = 0;
+
+static ANALYZER_STATS s_stats;
+static TRANSPORT_STATS s_closed;
+
+void SetAnalyzerAddress(const char* address, int linger)
+{
+    s_address = address ? address : TRANSPORT_DEFAULT_ADDRESS;
+    s_linger = linger;
+}
+
+static void Disconnect()
+{
+    TRANSPORT_STATS stats;
+
+    GetTransportStats(s_transport, &stats);
+    s_closed.sends += stats.sends;
+    s_closed.bytesSent += stats.bytesSent;
+
+    TransportClose(s_transport);
+    s_transport = NULL;
+    s_retry = MarkClockMicroseconds() + ANALYZER_RETRY_INTERVAL * 1000ULL;
+}
+
+static int Connect()
+{
+    if (s_transport)
+    {
+        return 1;
+    }
+
+    if (!s_initialized)
+    {
+        if (!StreamWriterInit(&s_writer, STREAM_DEFAULT_BATCH))
+        {
+            return 0;
+        }
+        s_initialized = 1;
+    }
+
+    if (MarkClockMicroseconds() < s_retry)
+    {
+        return 0;
+    }
+
+    s_transport = TransportConnect(s_address);
+    if (!s_transport)
+    {
+        s_retry = MarkClockMicroseconds() + ANALYZER_RETRY_INTERVAL * 1000ULL;
+        return 0;
+    }
+
+    s_stats.connects++;
+    StreamWriterRestart(&s_writer);
+
+    return 1;
+}
+
+static void SendFrame()
 {
-    pipe = CreateFile("\\\\.\\pipe\\dcommconnection", GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+    unsigned long size = StreamWriterFinish(&s_writer);
+    int count = StreamWriterPending(&s_writer);
+
+    if (size)
+    {
+        if (TransportSend(s_transport, s_writer.buffer, size))
+        {
+            s_stats.frames++;
+            s_stats.events += count;
+        }
+        else
+        {
+            printf("Lost the analyzer connection, %d events dropped\n", count);
+            s_stats.dropped += count;
+            Disconnect();
+        }
+    }
+
+    StreamWriterReset(&s_writer);
 }
 
 int SendMessageToAnalyzer(PMARK_EVENT event)
 {
-    if (!pipe || INVALID_HANDLE_VALUE == pipe)
+    if (!Connect())
+    {
+        s_stats.dropped++;
+        return 0;
+    }
+
+    if (!StreamWriterPending(&s_writer))
     {
-        CreateNeededInfo();
-        if (!pipe || INVALID_HANDLE_VALUE == pipe)
+        s_oldest = MarkClockMicroseconds();
+    }
+
+    if (!StreamWriterAppend(&s_writer, event))
+    {
+        SendFrame();
+        if (!s_transport)
+        {
+            s_stats.dropped++;
             return 0;
+        }
+
+        s_oldest = MarkClockMicroseconds();
+        StreamWriterAppend(&s_writer, event);
+    }
+
+    return 1;
+}
+
+int FlushAnalyzer(int force)
+{
+    if (!s_transport || !StreamWriterPending(&s_writer))
+    {
+        return 0;
+    }
+
+    if (force || MarkClockMicroseconds() - s_oldest >= s_linger * 1000ULL)
+    {
+        SendFrame();
     }
 
-    DWORD written = 0;
+    return s_transport && StreamWriterPending(&s_writer);
+}
+
+void GetAnalyzerStats(PANALYZER_STATS stats)
+{
+    TRANSPORT_STATS current = { 0 };
 
-    WriteFile(pipe, event, sizeof(MARK_EVENT), &written, NULL);
-}
\ No newline at end of file
+    if (s_transport)
+    {
+        GetTransportStats(s_transport, &current);
+    }
+
+    *stats = s_stats;
+    stats->sends = s_closed.sends + current.sends;
+    stats->bytes = s_closed.bytesSent + current.bytesSent;
+}
+
+void PrintAnalyzerStats()
+{
+    ANALYZER_STATS stats;
+
+    GetAnalyzerStats(&stats);
+    printf("Analyzer: %llu events in %llu frames, %llu bytes, %llu writes (%.1f events per write), %llu dropped, %llu connects\n",
+        stats.events, stats.frames, stats.bytes, stats.sends,
+        stats.sends ? (double)stats.events / stats.sends : 0.0, stats.dropped, stats.connects);
+}
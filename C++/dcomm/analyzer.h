@@ -0,0 +1,27 @@
+#ifndef _ANALYZER_H_
+#define _ANALYZER_H_
+
+#include "communicator.h"
+
+// Sink that streams events to the analyzer, see analyzer.c.
+#define ANALYZER_DEFAULT_LINGER 2 // ms
+
+typedef struct _ANALYZER_STATS
+{
+    unsigned long long events;
+    unsigned long long frames;
+    unsigned long long bytes;
+    unsigned long long sends; // write calls on the connection
+    unsigned long long dropped;
+    unsigned long long connects;
+} ANALYZER_STATS, *PANALYZER_STATS;
+
+// A NULL address is the default pipe or socket, see transport.h.
+void SetAnalyzerAddress(const char* address, int linger);
+// Sends the pending frame once it is older than the linger time, or right
+// away with force. Returns 1 while events are still held back.
+int FlushAnalyzer(int force);
+void GetAnalyzerStats(PANALYZER_STATS stats);
+void PrintAnalyzerStats();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,438 @@
+#include "binlog.h"
+#include "logio.h"
+#include "platform.h"
+#include "segment.h"
+#include "stages.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Two aligned buffers: the receive thread fills the active one, the writer
+// thread drains the pending one. The receive thread never touches the disk.
+static unsigned char* s_buffers[2] = { 0 };
+static unsigned long s_used[2] = { 0 };
+static int s_active = 0;
+static int s_pending = -1;
+
+static PLOG_FILE s_file = NULL;
+static PSEGMENT_LOG s_segments = NULL;
+static MARK_THREAD s_writer;
+static int s_started = 0;
+static int s_running = 0;
+
+// Made once and kept for the life of the process: a sink still on its way
+// into WriteBinaryLog may take the lock after StopBinaryLog, and only finds
+// s_running clear under it.
+static int s_initialized = 0;
+static MARK_LOCK s_lock;
+static MARK_COND s_ready;
+static MARK_COND s_drained;
+
+static BINLOG_STATS s_stats = { 0 };
+static SEGMENT_STATS s_segmentStats = { 0 };
+static LOGIO_STATS s_ioStats = { 0 };
+static char s_backend[32] = { 0 };
+
+// Caller holds s_lock and has checked that no buffer is pending.
+static void SwapBuffers()
+{
+    s_pending = s_active;
+    s_active ^= 1;
+    s_used[s_active] = 0;
+    MarkCondWake(&s_ready);
+}
+
+static void FlushBuffer(int index, int idle)
+{
+    unsigned long written = 0;
+    int ok;
+
+    unsigned long long start = MarkClockMicroseconds();
+    if (s_segments)
+    {
+        // Compression happens here, on the writer thread. An idle flush also
+        // closes the current block so quiet periods do not hold events back.
+        ok = SegmentLogAppend(s_segments, (PMARK_EVENT)s_buffers[index], s_used[index] / sizeof(MARK_EVENT)) &&
+            (!idle || SegmentLogFlush(s_segments));
+        written = ok ? s_used[index] : 0;
+    }
+    else
+    {
+        ok = LogFileAppend(s_file, s_buffers[index], s_used[index]) && (!idle || LogFileFlush(s_file));
+        written = ok ? s_used[index] : 0;
+    }
+    unsigned long long latency = MarkClockMicroseconds() - start;
+
+    if (ok)
+    {
+        // The first buffer of a new file starts with the header, which is
+        // smaller than a record.
+        PMARK_EVENT events = (PMARK_EVENT)(s_buffers[index] + s_used[index] % sizeof(MARK_EVENT));
+        unsigned long i;
+
+        for (i = 0; i < s_used[index] / sizeof(MARK_EVENT); i++)
+        {
+            RecordStageLatency(STAGE_WRITTEN, events[i].time);
+        }
+    }
+
+    MarkLockAcquire(&s_lock);
+    if (!ok || written != s_used[index])
+    {
+        s_stats.failures++;
+    }
+    s_stats.writes++;
+    s_stats.bytes += written;
+    s_stats.latencyTotal += latency;
+    if (!s_stats.latencyMin || latency < s_stats.latencyMin)
+    {
+        s_stats.latencyMin = latency;
+    }
+    if (latency > s_stats.latencyMax)
+    {
+        s_stats.latencyMax = latency;
+    }
+    MarkLockRelease(&s_lock);
+}
+
+static MARK_THREAD_PROC(BinaryLogWriter, parameter)
+{
+    UNREFERENCED_PARAMETER(parameter);
+
+    MarkLockAcquire(&s_lock);
+    while (1)
+    {
+        int idle = 0;
+
+        while (s_pending < 0 && s_running)
+        {
+            if (!MarkCondWait(&s_ready, &s_lock, BINLOG_FLUSH_INTERVAL) && s_used[s_active])
+            {
+                // Idle for a whole interval: push out the partially filled buffer.
+                SwapBuffers();
+                idle = 1;
+            }
+        }
+
+        if (s_pending < 0)
+        {
+            if (!s_used[s_active])
+            {
+                break;
+            }
+            SwapBuffers();
+        }
+
+        int index = s_pending;
+        MarkLockRelease(&s_lock);
+
+        FlushBuffer(index, idle);
+
+        MarkLockAcquire(&s_lock);
+        s_used[index] = 0;
+        s_pending = -1;
+        MarkCondWakeAll(&s_drained);
+    }
+    MarkLockRelease(&s_lock);
+
+    return 0;
+}
+
+static int AllocateBuffers()
+{
+    s_buffers[0] = (unsigned char*)MarkAlignedAlloc(BINLOG_BUFFER_SIZE, BINLOG_ALIGNMENT);
+    s_buffers[1] = (unsigned char*)MarkAlignedAlloc(BINLOG_BUFFER_SIZE, BINLOG_ALIGNMENT);
+    if (!s_buffers[0] || !s_buffers[1])
+    {
+        printf("Cannot allocate binary log buffers.\n");
+        return 0;
+    }
+
+    s_active = 0;
+    s_pending = -1;
+    s_used[0] = s_used[1] = 0;
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(&s_segmentStats, 0, sizeof(s_segmentStats));
+    memset(&s_ioStats, 0, sizeof(s_ioStats));
+
+    return 1;
+}
+
+static int StartWriter()
+{
+    if (!s_initialized)
+    {
+        MarkLockInit(&s_lock);
+        MarkCondInit(&s_ready);
+        MarkCondInit(&s_drained);
+        s_initialized = 1;
+    }
+
+    s_running = 1;
+    if (!MarkThreadStart(&s_writer, BinaryLogWriter, NULL))
+    {
+        s_running = 0;
+        StopBinaryLog();
+        return 0;
+    }
+
+    s_started = 1;
+    return 1;
+}
+
+// Records are only appended to a file of the same layout; anything else
+// would be misread by replay from that point on.
+// O_DIRECT writes whole blocks and only a clean close cuts the zero padding
+// behind the last record, so a log left by a crash may end in up to a block
+// of zeros. Returns the size without them, at a record boundary since a
+// record may end in zeros itself.
+static unsigned long long UnpaddedSize(MARK_FILE file, unsigned long long size)
+{
+    unsigned char tail[LOGIO_BLOCK_SIZE];
+    unsigned long long start;
+    unsigned long long records;
+    unsigned long length;
+
+    if (size % LOGIO_BLOCK_SIZE || size <= sizeof(BINLOG_HEADER))
+    {
+        return size;
+    }
+
+    start = MAX(size - LOGIO_BLOCK_SIZE, sizeof(BINLOG_HEADER));
+    length = (unsigned long)(size - start);
+    if (!MarkFileReadAt(file, start, tail, length))
+    {
+        return size;
+    }
+    while (length && !tail[length - 1])
+    {
+        length--;
+    }
+
+    records = (start + length - sizeof(BINLOG_HEADER) + sizeof(MARK_EVENT) - 1) / sizeof(MARK_EVENT);
+    return MIN(size, sizeof(BINLOG_HEADER) + records * sizeof(MARK_EVENT));
+}
+
+static int CheckExistingLog(const char* path)
+{
+    BINLOG_HEADER header;
+    unsigned long long size;
+    unsigned long long used;
+    int ok;
+    MARK_FILE file = MarkFileOpenRead(path);
+
+    if (MARK_INVALID_FILE == file)
+    {
+        return 1;
+    }
+
+    size = MarkFileSize(file);
+    used = size;
+    ok = !size ||
+        (size >= sizeof(header) && MarkFileReadAt(file, 0, &header, sizeof(header)) && header.magic == BINLOG_MAGIC &&
+         header.version == BINLOG_VERSION && header.recordSize == sizeof(MARK_EVENT));
+    if (ok && size)
+    {
+        // A crash may also leave the last record half written.
+        used = UnpaddedSize(file, size);
+        used -= (used - sizeof(header)) % sizeof(MARK_EVENT);
+    }
+    MarkFileClose(file);
+
+    if (!ok)
+    {
+        printf("Cannot append to %s: not a version %d binary log.\n", path, BINLOG_VERSION);
+        return 0;
+    }
+
+    if (used < size)
+    {
+        if (!MarkFileTruncate(path, used))
+        {
+            printf("Cannot cut the unfinished end off %s.\n", path);
+            return 0;
+        }
+        printf("Cut %llu bytes of block padding or of a partial record off the end of %s.\n", size - used, path);
+    }
+
+    return 1;
+}
+
+int StartBinaryLog(const char* path)
+{
+    if (s_running)
+    {
+        return 0;
+    }
+
+    if (!CheckExistingLog(path))
+    {
+        return 0;
+    }
+
+    if (!AllocateBuffers())
+    {
+        StopBinaryLog();
+        return 0;
+    }
+
+    s_file = LogFileOpen(path, 0, NULL);
+    if (!s_file)
+    {
+        StopBinaryLog();
+        return 0;
+    }
+
+    if (!LogFileSize(s_file))
+    {
+        PBINLOG_HEADER header = (PBINLOG_HEADER)s_buffers[0];
+        header->magic = BINLOG_MAGIC;
+        header->version = BINLOG_VERSION;
+        header->recordSize = sizeof(MARK_EVENT);
+        header->reserved = 0;
+        s_used[0] = sizeof(BINLOG_HEADER);
+    }
+
+    return StartWriter();
+}
+
+int StartSegmentedLog(const char* directory, unsigned long long maxSegmentSize, int maxSegments)
+{
+    if (s_running)
+    {
+        return 0;
+    }
+
+    if (!AllocateBuffers())
+    {
+        StopBinaryLog();
+        return 0;
+    }
+
+    s_segments = SegmentLogOpen(directory, maxSegmentSize, maxSegments);
+    if (!s_segments)
+    {
+        printf("Cannot open the segmented log in %s.\n", directory);
+        StopBinaryLog();
+        return 0;
+    }
+
+    return StartWriter();
+}
+
+int WriteBinaryLog(PMARK_EVENT event)
+{
+    if (!s_initialized)
+    {
+        return 0;
+    }
+
+    MarkLockAcquire(&s_lock);
+    if (!s_running)
+    {
+        MarkLockRelease(&s_lock);
+        return 0;
+    }
+    if (s_used[s_active] + sizeof(MARK_EVENT) > BINLOG_BUFFER_SIZE)
+    {
+        if (s_pending >= 0)
+        {
+            // The writer is still busy with the other buffer.
+            s_stats.stalls++;
+            while (s_pending >= 0)
+            {
+                MarkCondWait(&s_drained, &s_lock, -1);
+            }
+        }
+        SwapBuffers();
+    }
+
+    memcpy(s_buffers[s_active] + s_used[s_active], event, sizeof(MARK_EVENT));
+    s_used[s_active] += sizeof(MARK_EVENT);
+    s_stats.events++;
+    MarkLockRelease(&s_lock);
+
+    return 1;
+}
+
+void StopBinaryLog()
+{
+    if (s_started)
+    {
+        MarkLockAcquire(&s_lock);
+        s_running = 0;
+        MarkCondWake(&s_ready);
+        MarkLockRelease(&s_lock);
+
+        MarkThreadJoin(s_writer);
+        s_started = 0;
+    }
+
+    if (s_segments)
+    {
+        SegmentLogFlush(s_segments);
+        GetSegmentLogStats(s_segments, &s_segmentStats);
+        GetSegmentLogIoStats(s_segments, &s_ioStats);
+        strncpy(s_backend, SegmentLogBackendName(s_segments), sizeof(s_backend) - 1);
+        SegmentLogClose(s_segments);
+        s_segments = NULL;
+    }
+
+    if (s_file)
+    {
+        GetLogFileStats(s_file, &s_ioStats);
+        strncpy(s_backend, LogFileBackendName(s_file), sizeof(s_backend) - 1);
+        LogFileClose(s_file);
+        s_file = NULL;
+    }
+
+    MarkAlignedFree(s_buffers[0]);
+    MarkAlignedFree(s_buffers[1]);
+    s_buffers[0] = s_buffers[1] = NULL;
+}
+
+int IsBinaryLogActive()
+{
+    return s_running;
+}
+
+void GetBinaryLogStats(PBINLOG_STATS stats)
+{
+    if (s_running)
+    {
+        MarkLockAcquire(&s_lock);
+        *stats = s_stats;
+        MarkLockRelease(&s_lock);
+    }
+    else
+    {
+        *stats = s_stats;
+    }
+}
+
+void PrintBinaryLogStats()
+{
+    BINLOG_STATS stats;
+    GetBinaryLogStats(&stats);
+
+    printf("Binary log: %llu events, %llu bytes, %llu writes, %llu failures, %llu stalls\n",
+        stats.events, stats.bytes, stats.writes, stats.failures, stats.stalls);
+    printf("Write latency (us): min %llu, avg %llu, max %llu\n",
+        stats.latencyMin,
+        stats.writes ? stats.latencyTotal / stats.writes : 0,
+        stats.latencyMax);
+
+    if (s_ioStats.writes)
+    {
+        printf("I/O (%s): %llu writes, %llu bytes, %llu syncs, %llu stalls, %llu failures\n",
+            s_backend, s_ioStats.writes, s_ioStats.bytes, s_ioStats.syncs, s_ioStats.stalls, s_ioStats.failures);
+    }
+
+    if (s_segmentStats.blocks)
+    {
+        printf("Segments: %llu segments, %llu blocks, %llu -> %llu bytes (%.1fx), %llu failures\n",
+            s_segmentStats.segments, s_segmentStats.blocks, s_segmentStats.rawBytes, s_segmentStats.compressedBytes,
+            (double)s_segmentStats.rawBytes / s_segmentStats.compressedBytes, s_segmentStats.failures);
+    }
+}
\ No newline at end of file
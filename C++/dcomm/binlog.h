@@ -0,0 +1,44 @@
+#ifndef _BINLOG_H_
+#define _BINLOG_H_
+
+#include "communicator.h"
+
+// On-disk layout: one BINLOG_HEADER followed by raw MARK_EVENT records.
+#define BINLOG_MAGIC 0x474C4B4D // "MKLG"
+#define BINLOG_VERSION 2
+
+#define BINLOG_BUFFER_SIZE (1024 * 1024)
+#define BINLOG_ALIGNMENT 4096
+#define BINLOG_FLUSH_INTERVAL 1000 // ms
+
+typedef struct _BINLOG_HEADER
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int recordSize;
+    unsigned int reserved;
+} BINLOG_HEADER, *PBINLOG_HEADER;
+
+typedef struct _BINLOG_STATS
+{
+    unsigned long long events;
+    unsigned long long bytes;
+    unsigned long long writes;
+    unsigned long long failures;
+    unsigned long long stalls;
+
+    unsigned long long latencyTotal; // microseconds
+    unsigned long long latencyMin;
+    unsigned long long latencyMax;
+} BINLOG_STATS, *PBINLOG_STATS;
+
+int StartBinaryLog(const char* path);
+int StartSegmentedLog(const char* directory, unsigned long long maxSegmentSize, int maxSegments);
+int WriteBinaryLog(PMARK_EVENT event);
+void StopBinaryLog();
+
+int IsBinaryLogActive();
+void GetBinaryLogStats(PBINLOG_STATS stats);
+void PrintBinaryLogStats();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,502 @@
+#include "broker.h"
+#include "capturefilter.h"
+#include "eventstream.h"
+#include "ingress.h"
+#include "platform.h"
+#include "subscription.h"
+#include "transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SUBSCRIBER_HANDSHAKE 0 // waiting for the subscription
+#define SUBSCRIBER_READY 1     // subscribed, not matched against yet
+#define SUBSCRIBER_ACTIVE 2
+#define SUBSCRIBER_CLOSED 3    // thread done, to be reaped
+
+#define HANDSHAKE_BUFFER (16 * 1024)
+
+typedef struct _SUBSCRIBER
+{
+    int index;
+    PTRANSPORT transport;
+    STREAM_SUBSCRIPTION subscription;
+    PINGRESS_QUEUE queue;
+    STREAM_WRITER writer;
+    MARK_THREAD thread;
+    volatile int state;
+    volatile int closing;
+    int subscribed;
+    int matched; // known to the matcher, sink worker only
+
+    unsigned long long queued;   // sink worker
+    unsigned long long overflow; // sink worker, queue full
+    unsigned long long sent;     // subscriber thread
+    unsigned long long frames;
+    unsigned long long oldest;
+} SUBSCRIBER, *PSUBSCRIBER;
+
+static PTRANSPORT_LISTENER s_listener = NULL;
+static MARK_THREAD s_acceptThread;
+static volatile int s_stopping = 0;
+
+// The accept thread fills free slots and the sink worker empties closed
+// ones, both under the lock; s_changed tells the worker to look.
+static MARK_LOCK s_lock;
+static PSUBSCRIBER s_subscribers[MAX_SUBSCRIBERS];
+static volatile int s_changed = 0;
+
+static SUBSCRIPTION_MATCHER s_matcher;
+static BROKER_STATS s_stats;
+
+static int ReadSubscription(PSUBSCRIBER subscriber)
+{
+    STREAM_READER reader;
+    PSTREAM_FRAME frame;
+    int result = 0;
+
+    if (!StreamReaderInit(&reader, HANDSHAKE_BUFFER))
+    {
+        return 0;
+    }
+
+    while (1)
+    {
+        unsigned long space;
+        unsigned char* buffer;
+        long received;
+        int next = StreamReaderNextFrame(&reader, &frame);
+
+        if (next == STREAM_FRAME_READY)
+        {
+            result = frame->type == STREAM_FRAME_SUBSCRIBE && frame->length == sizeof(STREAM_SUBSCRIPTION);
+            if (result)
+            {
+                memcpy(&subscriber->subscription, frame + 1, sizeof(STREAM_SUBSCRIPTION));
+            }
+            break;
+        }
+        if (next == STREAM_ERROR)
+        {
+            break;
+        }
+
+        buffer = StreamReaderSpace(&reader, &space);
+        received = TransportReceive(subscriber->transport, buffer, space);
+        if (received <= 0)
+        {
+            break;
+        }
+        StreamReaderCommit(&reader, (unsigned long)received);
+    }
+
+    StreamReaderFree(&reader);
+    return result;
+}
+
+static int SendFrame(PSUBSCRIBER subscriber)
+{
+    unsigned long size = StreamWriterFinish(&subscriber->writer);
+    int count = StreamWriterPending(&subscriber->writer);
+    int result = 1;
+
+    if (size)
+    {
+        result = TransportSend(subscriber->transport, subscriber->writer.buffer, size);
+        if (result)
+        {
+            subscriber->frames++;
+            subscriber->sent += count;
+        }
+    }
+
+    StreamWriterReset(&subscriber->writer);
+    return result;
+}
+
+// Batches the subscriber's events into frames, like the analyzer sink.
+static int Deliver(PSUBSCRIBER subscriber)
+{
+    PMARK_EVENT events[INGRESS_MAX_BATCH];
+    int count, i;
+
+    while (1)
+    {
+        int closing = subscriber->closing;
+
+        count = IngressDequeue(subscriber->queue, events, INGRESS_MAX_BATCH);
+        for (i = 0; i < count; i++)
+        {
+            if (!StreamWriterPending(&subscriber->writer))
+            {
+                subscriber->oldest = MarkClockMicroseconds();
+            }
+            if (!StreamWriterAppend(&subscriber->writer, events[i]))
+            {
+                if (!SendFrame(subscriber))
+                {
+                    IngressRelease(subscriber->queue, count);
+                    return 0;
+                }
+                subscriber->oldest = MarkClockMicroseconds();
+                StreamWriterAppend(&subscriber->writer, events[i]);
+            }
+        }
+        if (count)
+        {
+            IngressRelease(subscriber->queue, count);
+            continue;
+        }
+
+        if (StreamWriterPending(&subscriber->writer) &&
+            (closing || MarkClockMicroseconds() - subscriber->oldest >= BROKER_LINGER * 1000ULL))
+        {
+            if (!SendFrame(subscriber))
+            {
+                return 0;
+            }
+        }
+        if (closing)
+        {
+            return 1;
+        }
+        // Otherwise a client gone while nothing matches would hold its slot.
+        if (!StreamWriterPending(&subscriber->writer) && TransportPeerClosed(subscriber->transport))
+        {
+            return 0;
+        }
+
+        IngressWait(subscriber->queue, StreamWriterPending(&subscriber->writer) ? 1 : INGRESS_WAIT_INTERVAL);
+    }
+}
+
+static MARK_THREAD_PROC(SubscriberThread, parameter)
+{
+    PSUBSCRIBER subscriber = (PSUBSCRIBER)parameter;
+
+    if (ReadSubscription(subscriber))
+    {
+        subscriber->subscribed = 1;
+        subscriber->state = SUBSCRIBER_READY;
+        s_changed = 1;
+
+        Deliver(subscriber);
+    }
+    else
+    {
+        printf("Broker client %d sent no valid subscription\n", subscriber->index);
+        MarkLockAcquire(&s_lock);
+        s_stats.rejected++;
+        MarkLockRelease(&s_lock);
+    }
+
+    MarkMemoryBarrier();
+    subscriber->state = SUBSCRIBER_CLOSED;
+    s_changed = 1;
+
+    return 0;
+}
+
+static void FreeSubscriber(PSUBSCRIBER subscriber)
+{
+    if (subscriber->queue)
+    {
+        IngressDelete(subscriber->queue);
+    }
+    StreamWriterFree(&subscriber->writer);
+    TransportClose(subscriber->transport);
+    free(subscriber);
+}
+
+static PSUBSCRIBER NewSubscriber(int index, PTRANSPORT transport)
+{
+    PSUBSCRIBER subscriber = (PSUBSCRIBER)calloc(1, sizeof(SUBSCRIBER));
+
+    if (!subscriber)
+    {
+        TransportClose(transport);
+        return NULL;
+    }
+
+    subscriber->index = index;
+    subscriber->transport = transport;
+    subscriber->queue = IngressCreate(BROKER_QUEUE_CAPACITY);
+    if (!subscriber->queue || !StreamWriterInit(&subscriber->writer, STREAM_DEFAULT_BATCH))
+    {
+        FreeSubscriber(subscriber);
+        return NULL;
+    }
+
+    if (!MarkThreadStart(&subscriber->thread, SubscriberThread, subscriber))
+    {
+        FreeSubscriber(subscriber);
+        return NULL;
+    }
+
+    return subscriber;
+}
+
+static MARK_THREAD_PROC(AcceptThread, parameter)
+{
+    UNREFERENCED_PARAMETER(parameter);
+
+    while (!s_stopping)
+    {
+        PTRANSPORT transport = TransportAccept(s_listener);
+        int i;
+
+        if (!transport)
+        {
+            if (!s_stopping)
+            {
+                MarkSleep(INGRESS_WAIT_INTERVAL);
+            }
+            continue;
+        }
+
+        MarkLockAcquire(&s_lock);
+        for (i = 0; i < MAX_SUBSCRIBERS && s_subscribers[i]; i++) {}
+
+        if (i == MAX_SUBSCRIBERS)
+        {
+            printf("Broker is full, %d clients connected\n", MAX_SUBSCRIBERS);
+            s_stats.rejected++;
+            TransportClose(transport);
+        }
+        else
+        {
+            s_subscribers[i] = NewSubscriber(i, transport);
+            if (s_subscribers[i])
+            {
+                s_stats.accepted++;
+            }
+        }
+        MarkLockRelease(&s_lock);
+    }
+
+    return 0;
+}
+
+int StartBroker(const char* address)
+{
+    address = address ? address : BROKER_DEFAULT_ADDRESS;
+
+    MarkLockInit(&s_lock);
+    MatcherInit(&s_matcher);
+
+    s_listener = TransportListen(address);
+    if (!s_listener)
+    {
+        printf("Cannot start the broker on %s\n", address);
+        return 0;
+    }
+
+    if (!MarkThreadStart(&s_acceptThread, AcceptThread, NULL))
+    {
+        TransportListenerClose(s_listener);
+        s_listener = NULL;
+        return 0;
+    }
+
+    printf("Broker listening on %s\n", address);
+    return 1;
+}
+
+int IsBrokerActive()
+{
+    return s_listener != NULL;
+}
+
+// Joins the thread of a closed subscriber and folds in its counts.
+static void ReapSubscriber(PSUBSCRIBER subscriber)
+{
+    unsigned long long dropped;
+
+    MarkThreadJoin(subscriber->thread);
+
+    // Whatever was queued but never sent is lost along with the client.
+    dropped = subscriber->overflow + subscriber->queued - subscriber->sent;
+
+    MarkLockAcquire(&s_lock);
+    s_stats.sent += subscriber->sent;
+    s_stats.frames += subscriber->frames;
+    s_stats.dropped += dropped;
+    MarkLockRelease(&s_lock);
+
+    if (subscriber->subscribed)
+    {
+        printf("Broker client %d: %llu events in %llu frames, %llu dropped, classes 0x%x, types 0x%x, pid %d\n",
+            subscriber->index, subscriber->sent, subscriber->frames, dropped,
+            subscriber->subscription.opclasses, subscriber->subscription.optypes, subscriber->subscription.pid);
+    }
+
+    FreeSubscriber(subscriber);
+}
+
+// Sink worker only: starts matching new subscribers and lets go of closed ones.
+static void UpdateSubscribers()
+{
+    PSUBSCRIBER closed[MAX_SUBSCRIBERS];
+    int count = 0;
+    int i;
+
+    s_changed = 0;
+    MarkMemoryBarrier();
+
+    MarkLockAcquire(&s_lock);
+    for (i = 0; i < MAX_SUBSCRIBERS; i++)
+    {
+        PSUBSCRIBER subscriber = s_subscribers[i];
+
+        if (!subscriber)
+        {
+            continue;
+        }
+
+        // A client turned away stays READY until its thread ends; closing
+        // keeps it from being tried again.
+        if (subscriber->state == SUBSCRIBER_READY && !subscriber->matched && !subscriber->closing)
+        {
+            if (MatcherAdd(&s_matcher, i, &subscriber->subscription))
+            {
+                CAPTURE_RULES rules;
+
+                GetSubscriptionRules(&subscriber->subscription, &rules);
+                SetCaptureInterest(CAPTURE_OWNER_SUBSCRIBER + i, &rules);
+                subscriber->matched = 1;
+                subscriber->state = SUBSCRIBER_ACTIVE;
+            }
+            else
+            {
+                printf("Broker client %d: pattern has too many parts\n", i);
+                s_stats.rejected++;
+                TransportShutdown(subscriber->transport);
+                subscriber->closing = 1;
+                IngressClose(subscriber->queue);
+            }
+        }
+        else if (subscriber->state == SUBSCRIBER_CLOSED)
+        {
+            if (subscriber->matched)
+            {
+                MatcherRemove(&s_matcher, i);
+                SetCaptureInterest(CAPTURE_OWNER_SUBSCRIBER + i, NULL);
+            }
+            closed[count++] = subscriber;
+            s_subscribers[i] = NULL;
+        }
+    }
+    MarkLockRelease(&s_lock);
+
+    for (i = 0; i < count; i++)
+    {
+        ReapSubscriber(closed[i]);
+    }
+}
+
+int WriteBroker(PMARK_EVENT event)
+{
+    SUBSCRIBER_SET matched;
+    int i;
+
+    if (s_changed)
+    {
+        UpdateSubscribers();
+    }
+
+    matched = MatcherMatch(&s_matcher, event);
+    if (matched)
+    {
+        s_stats.matched++;
+    }
+
+    for (i = 0; matched; i++, matched >>= 1)
+    {
+        PSUBSCRIBER subscriber = s_subscribers[i];
+
+        if (!(matched & 1))
+        {
+            continue;
+        }
+
+        if (IngressEnqueue(subscriber->queue, event, 0))
+        {
+            subscriber->queued++;
+        }
+        else
+        {
+            subscriber->overflow++;
+        }
+    }
+
+    return 1;
+}
+
+// Called whenever the sink runs dry, so clients come and go even without
+// events.
+int FlushBroker(int force)
+{
+    UNREFERENCED_PARAMETER(force);
+
+    if (s_changed)
+    {
+        UpdateSubscribers();
+    }
+
+    return 0;
+}
+
+void StopBroker()
+{
+    int i;
+
+    if (!s_listener)
+    {
+        return;
+    }
+
+    s_stopping = 1;
+    TransportListenerStop(s_listener);
+    MarkThreadJoin(s_acceptThread);
+    TransportListenerClose(s_listener);
+    s_listener = NULL;
+
+    // The sink is stopped, so nothing else touches the table now.
+    for (i = 0; i < MAX_SUBSCRIBERS; i++)
+    {
+        PSUBSCRIBER subscriber = s_subscribers[i];
+
+        if (!subscriber)
+        {
+            continue;
+        }
+
+        // Also for active clients, which may have stopped reading and would
+        // keep a send blocked; what they have not been sent is lost.
+        TransportShutdown(subscriber->transport);
+        if (subscriber->matched)
+        {
+            MatcherRemove(&s_matcher, i);
+            SetCaptureInterest(CAPTURE_OWNER_SUBSCRIBER + i, NULL);
+        }
+        subscriber->closing = 1;
+        IngressClose(subscriber->queue);
+
+        ReapSubscriber(subscriber);
+        s_subscribers[i] = NULL;
+    }
+
+    MarkLockDelete(&s_lock);
+}
+
+void GetBrokerStats(PBROKER_STATS stats)
+{
+    *stats = s_stats;
+}
+
+void PrintBrokerStats()
+{
+    printf("Broker: %llu clients, %llu rejected, %llu events matched, %llu sent in %llu frames, %llu dropped\n",
+        s_stats.accepted, s_stats.rejected, s_stats.matched, s_stats.sent, s_stats.frames, s_stats.dropped);
+}
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef _BROKER_H_
+#define _BROKER_H_
+
+#include "communicator.h"
+
+// Serves several consumers at once. A client connects to the broker
+// address, sends a hello and one STREAM_FRAME_SUBSCRIBE frame, and from
+// then on receives a stream of the events that match its subscription
+// (eventstream.h). The broker sink matches every event once against all
+// subscriptions (subscription.h) and hands it to the queues of the
+// subscribers that want it; each subscriber has a thread of its own that
+// batches and sends, so a slow client only loses its own events. With a
+// capture filter on, the packets a client can match are added to it for as
+// long as the client stays (capturefilter.h).
+
+#ifdef _WIN32
+#define BROKER_DEFAULT_ADDRESS "\\\\.\\pipe\\dcommbroker"
+#else
+#define BROKER_DEFAULT_ADDRESS "/tmp/dcomm-broker.sock"
+#endif
+
+#define BROKER_QUEUE_CAPACITY 4096 // events per subscriber
+#define BROKER_LINGER 2            // ms
+
+typedef struct _BROKER_STATS
+{
+    unsigned long long accepted;
+    unsigned long long rejected; // bad subscription or no free slot
+    unsigned long long matched;  // events handed to a subscriber queue
+    unsigned long long sent;
+    unsigned long long dropped;  // subscriber queue full or connection lost
+    unsigned long long frames;
+} BROKER_STATS, *PBROKER_STATS;
+
+// Starts listening; clients are accepted from then on.
+int StartBroker(const char* address);
+int IsBrokerActive();
+// The sink, runs on the sink worker only.
+int WriteBroker(PMARK_EVENT event);
+int FlushBroker(int force);
+// After StopSinks: sends what is queued and disconnects every client.
+void StopBroker();
+void GetBrokerStats(PBROKER_STATS stats);
+void PrintBrokerStats();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,708 @@
+#include "capturefilter.h"
+#include "platform.h"
+#include "tcpip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Classic BPF opcodes, as in linux/filter.h and pcap/bpf.h.
+#define BPF_LD_W_ABS 0x20
+#define BPF_LD_H_ABS 0x28
+#define BPF_LD_B_ABS 0x30
+#define BPF_LD_H_IND 0x48
+#define BPF_LDX_B_MSH 0xB1
+#define BPF_AND_K 0x54
+#define BPF_JEQ_K 0x15
+#define BPF_JGT_K 0x25
+#define BPF_JGE_K 0x35
+#define BPF_JSET_K 0x45
+#define BPF_RET_K 0x06
+
+#define BPF_ACCEPT 0xFFFFFFFF // whole packet, cut to the snapshot length
+#define BPF_FAIL 0xFF         // jump placeholder, patched to the end of the rule
+
+// Offsets into an Ethernet frame carrying IPv4.
+#define OFFSET_ETH_TYPE 12
+#define OFFSET_IP 14
+#define OFFSET_IP_FRAGMENT 20
+#define OFFSET_IP_PROTO 23
+#define OFFSET_IP_SOURCE 26
+#define OFFSET_IP_DESTINATION 30
+
+#define MAX_RULE_PORTS 16
+
+static int s_enabled = 0;
+static MARK_LOCK s_lock;
+static CAPTURE_RULES s_interests[CAPTURE_OWNERS];
+static int s_interested[CAPTURE_OWNERS];
+static CAPTURE_FILTER s_filter;
+static volatile long long s_generation = 0;
+
+static int ParsePort(const char* text, unsigned short* port)
+{
+    char* end;
+    long value = strtol(text, &end, 10);
+
+    if (end == text || value < 1 || value > 65535)
+    {
+        return 0;
+    }
+    *port = (unsigned short)value;
+
+    return 1;
+}
+
+// "80,443,8000-8100"
+static int ParsePorts(char* text, unsigned short* low, unsigned short* high, int* count)
+{
+    char* next;
+
+    for (; text; text = next)
+    {
+        char* dash;
+
+        next = strchr(text, ',');
+        if (next)
+        {
+            *next++ = 0;
+        }
+        if (*count == MAX_RULE_PORTS)
+        {
+            printf("Too many ports in one capture rule\n");
+            return 0;
+        }
+
+        dash = strchr(text, '-');
+        if (dash)
+        {
+            *dash = 0;
+        }
+        if (!ParsePort(text, &low[*count]) || !ParsePort(dash ? dash + 1 : text, &high[*count]) ||
+            high[*count] < low[*count])
+        {
+            printf("Bad port %s in capture rule\n", text);
+            return 0;
+        }
+        (*count)++;
+    }
+
+    return 1;
+}
+
+// "10.0.0.0/8", or a single address for a /32.
+static int ParseNetwork(const char* text, unsigned int* network, unsigned int* mask)
+{
+    unsigned int a, b, c, d;
+    unsigned int prefix = 32;
+    char extra;
+    int fields = sscanf(text, "%u.%u.%u.%u/%u%c", &a, &b, &c, &d, &prefix, &extra);
+
+    if ((fields != 4 && fields != 5) || a > 255 || b > 255 || c > 255 || d > 255 || prefix > 32)
+    {
+        printf("Bad network %s in capture rule, a.b.c.d[/n] expected\n", text);
+        return 0;
+    }
+
+    *mask = prefix ? 0xFFFFFFFF << (32 - prefix) : 0;
+    *network = ((a << 24) | (b << 16) | (c << 8) | d) & *mask;
+
+    return 1;
+}
+
+static int AddRule(PCAPTURE_RULES rules, unsigned int protocols, unsigned short portLow, unsigned short portHigh,
+    unsigned int network, unsigned int mask)
+{
+    PCAPTURE_RULE rule;
+    int i;
+
+    for (i = 0; i < rules->count; i++)
+    {
+        rule = &rules->rules[i];
+        if (rule->protocols == protocols && rule->portLow == portLow && rule->portHigh == portHigh &&
+            rule->network == network && rule->mask == mask)
+        {
+            return 1;
+        }
+    }
+
+    if (rules->count == MAX_CAPTURE_RULES)
+    {
+        return 0;
+    }
+
+    rule = &rules->rules[rules->count++];
+    rule->protocols = protocols;
+    rule->portLow = portLow;
+    rule->portHigh = portHigh;
+    rule->network = network;
+    rule->mask = mask;
+
+    return 1;
+}
+
+static int ParseRule(char* text, PCAPTURE_RULES rules)
+{
+    unsigned short low[MAX_RULE_PORTS];
+    unsigned short high[MAX_RULE_PORTS];
+    unsigned int protocols = 0;
+    unsigned int network = 0;
+    unsigned int mask = 0;
+    int ports = 0;
+    int none = 0;
+    int words = 0;
+    char* word;
+    int i;
+
+    for (word = strtok(text, " \t"); word; word = strtok(NULL, " \t"), words++)
+    {
+        if (!strcmp(word, "icmp"))
+        {
+            protocols |= CAPTURE_ICMP;
+        }
+        else if (!strcmp(word, "tcp"))
+        {
+            protocols |= CAPTURE_TCP;
+        }
+        else if (!strcmp(word, "udp"))
+        {
+            protocols |= CAPTURE_UDP;
+        }
+        else if (!strcmp(word, "all"))
+        {
+            protocols |= CAPTURE_ANY;
+        }
+        else if (!strcmp(word, "none"))
+        {
+            none = 1;
+        }
+        else if (!strcmp(word, "port") || !strcmp(word, "net") || !strcmp(word, "host"))
+        {
+            char* value = strtok(NULL, " \t");
+
+            if (!value)
+            {
+                printf("Capture rule %s without a value\n", word);
+                return 0;
+            }
+            if (word[0] == 'p' ? !ParsePorts(value, low, high, &ports) : !ParseNetwork(value, &network, &mask))
+            {
+                return 0;
+            }
+        }
+        else
+        {
+            printf("Unknown capture rule word %s\n", word);
+            return 0;
+        }
+    }
+
+    if (none || !words)
+    {
+        return 1;
+    }
+
+    if (ports && (protocols & CAPTURE_ICMP))
+    {
+        printf("ICMP has no ports to capture by\n");
+        return 0;
+    }
+    if (!protocols)
+    {
+        protocols = ports ? CAPTURE_TCP | CAPTURE_UDP : CAPTURE_ANY;
+    }
+
+    for (i = 0; i < MAX(ports, 1); i++)
+    {
+        if (!AddRule(rules, protocols, ports ? low[i] : 0, ports ? high[i] : 0, network, mask))
+        {
+            printf("More than %d capture rules\n", MAX_CAPTURE_RULES);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int ParseCaptureRules(const char* text, PCAPTURE_RULES rules)
+{
+    char buffer[1024];
+    char* rule;
+    char* next;
+
+    memset(rules, 0, sizeof(*rules));
+    if (strlen(text) >= sizeof(buffer))
+    {
+        printf("Capture rules too long\n");
+        return 0;
+    }
+    strcpy(buffer, text);
+
+    for (rule = buffer; rule; rule = next)
+    {
+        next = strchr(rule, ';');
+        if (next)
+        {
+            *next++ = 0;
+        }
+        if (!ParseRule(rule, rules))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int IsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Reads a dotted quad at text, no further than end; returns its length or 0.
+static int ReadAddress(const char* text, const char* end, unsigned int* address)
+{
+    const char* position = text;
+    int part;
+
+    *address = 0;
+    for (part = 0; part < 4; part++)
+    {
+        unsigned int value = 0;
+        int digits = 0;
+
+        if (part && (position == end || *position++ != '.'))
+        {
+            return 0;
+        }
+        while (position < end && IsDigit(*position) && digits < 3)
+        {
+            value = value * 10 + (*position++ - '0');
+            digits++;
+        }
+        if (!digits || value > 255)
+        {
+            return 0;
+        }
+        *address = (*address << 8) | value;
+    }
+
+    return (int)(position - text);
+}
+
+// Reads what the literal parts of a flow event pattern (flowtable.h) pin
+// down. A port only counts as ":<digits> " and an address as " <a.b.c.d>"
+// followed by ':' or ' ', each inside one part, so that the text cannot be
+// a piece of some longer number in the path.
+void GetSubscriptionRules(PSTREAM_SUBSCRIPTION subscription, PCAPTURE_RULES rules)
+{
+    char pattern[257];
+    unsigned int protocols = CAPTURE_ANY;
+    unsigned short port = 0;
+    unsigned int address = 0;
+    unsigned int mask = 0;
+    int length;
+    int i;
+
+    memset(rules, 0, sizeof(*rules));
+    if ((subscription->opclasses && !(subscription->opclasses & (1 << MARK_OPCLASS_PACKET))) ||
+        subscription->pid)
+    {
+        return;
+    }
+
+    for (length = 0; length < 256 && subscription->szOperationPath[length]; length++)
+    {
+        unsigned short c = subscription->szOperationPath[length];
+
+        pattern[length] = c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : c < 0x80 ? (char)c : '?';
+    }
+    pattern[length] = 0;
+
+    if (!strncmp(pattern, "icmp ", 5))
+    {
+        protocols = CAPTURE_ICMP;
+    }
+    else if (!strncmp(pattern, "tcp ", 4))
+    {
+        protocols = CAPTURE_TCP;
+    }
+    else if (!strncmp(pattern, "udp ", 4))
+    {
+        protocols = CAPTURE_UDP;
+    }
+
+    for (i = 0; i < length; i++)
+    {
+        int end = i;
+
+        if (!port && pattern[i] == ':')
+        {
+            unsigned int value = 0;
+
+            for (end = i + 1; end < length && IsDigit(pattern[end]) && end - i <= 5; end++)
+            {
+                value = value * 10 + (pattern[end] - '0');
+            }
+            if (end > i + 1 && end < length && pattern[end] == ' ' && value >= 1 && value <= 65535)
+            {
+                port = (unsigned short)value;
+            }
+        }
+        else if (!mask && pattern[i] == ' ')
+        {
+            int size = ReadAddress(pattern + i + 1, pattern + length, &address);
+
+            end = i + 1 + size;
+            if (size && end < length && (pattern[end] == ':' || pattern[end] == ' '))
+            {
+                mask = 0xFFFFFFFF;
+            }
+        }
+    }
+
+    if (port)
+    {
+        protocols &= CAPTURE_TCP | CAPTURE_UDP;
+        if (!protocols)
+        {
+            return;
+        }
+    }
+
+    AddRule(rules, protocols, port, port, mask ? address : 0, mask);
+}
+
+static unsigned int ReadAddress32(const unsigned char* address)
+{
+    return ((unsigned int)address[0] << 24) | (address[1] << 16) | (address[2] << 8) | address[3];
+}
+
+static unsigned int ProtocolBit(unsigned char protocol)
+{
+    if (protocol == IP_PROTO_ICMP)
+        return CAPTURE_ICMP;
+    if (protocol == IP_PROTO_TCP)
+        return CAPTURE_TCP;
+    if (protocol == IP_PROTO_UDP)
+        return CAPTURE_UDP;
+
+    return 0;
+}
+
+static int InRange(PCAPTURE_RULE rule, unsigned short port)
+{
+    return port >= rule->portLow && port <= rule->portHigh;
+}
+
+int MatchCaptureRules(PCAPTURE_RULES rules, PPACKET_INFO info)
+{
+    unsigned int protocol;
+    unsigned int source;
+    unsigned int destination;
+    int i;
+
+    if (info->key.version != 4)
+    {
+        return 0;
+    }
+
+    protocol = ProtocolBit(info->key.protocol);
+    source = ReadAddress32(info->key.source);
+    destination = ReadAddress32(info->key.destination);
+
+    for (i = 0; i < rules->count; i++)
+    {
+        PCAPTURE_RULE rule = &rules->rules[i];
+
+        if (!(rule->protocols & protocol))
+        {
+            continue;
+        }
+        if (rule->mask && (source & rule->mask) != rule->network && (destination & rule->mask) != rule->network)
+        {
+            continue;
+        }
+        if (rule->portHigh && !InRange(rule, info->key.sourcePort) && !InRange(rule, info->key.destinationPort))
+        {
+            continue;
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+typedef struct _BPF_BUILDER
+{
+    PBPF_INSTRUCTION program;
+    int length;
+    int ruleStart;
+} BPF_BUILDER, *PBPF_BUILDER;
+
+static void Emit(PBPF_BUILDER builder, unsigned short code, unsigned int k, unsigned char jt, unsigned char jf)
+{
+    PBPF_INSTRUCTION instruction = &builder->program[builder->length++];
+
+    instruction->code = code;
+    instruction->jt = jt;
+    instruction->jf = jf;
+    instruction->k = k;
+}
+
+// One block per rule, each ending in its own accept, so a failed test only
+// ever jumps to the start of the next block and stays within the 255
+// instructions a conditional jump can reach.
+static void CompileRule(PBPF_BUILDER builder, PCAPTURE_RULE rule)
+{
+    static const unsigned char numbers[] = { IP_PROTO_ICMP, IP_PROTO_TCP, IP_PROTO_UDP };
+    static const unsigned int bits[] = { CAPTURE_ICMP, CAPTURE_TCP, CAPTURE_UDP };
+    int count = 0;
+    int taken = 0;
+    int i;
+
+    builder->ruleStart = builder->length;
+
+    for (i = 0; i < 3; i++)
+    {
+        count += (rule->protocols & bits[i]) != 0;
+    }
+    Emit(builder, BPF_LD_B_ABS, OFFSET_IP_PROTO, 0, 0);
+    for (i = 0; i < 3; i++)
+    {
+        if (rule->protocols & bits[i])
+        {
+            taken++;
+            Emit(builder, BPF_JEQ_K, numbers[i], (unsigned char)(count - taken), taken == count ? BPF_FAIL : 0);
+        }
+    }
+
+    if (rule->mask)
+    {
+        Emit(builder, BPF_LD_W_ABS, OFFSET_IP_SOURCE, 0, 0);
+        Emit(builder, BPF_AND_K, rule->mask, 0, 0);
+        Emit(builder, BPF_JEQ_K, rule->network, 3, 0);
+        Emit(builder, BPF_LD_W_ABS, OFFSET_IP_DESTINATION, 0, 0);
+        Emit(builder, BPF_AND_K, rule->mask, 0, 0);
+        Emit(builder, BPF_JEQ_K, rule->network, 0, BPF_FAIL);
+    }
+
+    if (rule->portHigh)
+    {
+        // Fragments after the first have no ports; X takes the IP header length.
+        Emit(builder, BPF_LD_H_ABS, OFFSET_IP_FRAGMENT, 0, 0);
+        Emit(builder, BPF_JSET_K, 0x1FFF, BPF_FAIL, 0);
+        Emit(builder, BPF_LDX_B_MSH, OFFSET_IP, 0, 0);
+        Emit(builder, BPF_LD_H_IND, OFFSET_IP, 0, 0);
+        Emit(builder, BPF_JGE_K, rule->portLow, 0, 1);
+        Emit(builder, BPF_JGT_K, rule->portHigh, 0, 3);
+        Emit(builder, BPF_LD_H_IND, OFFSET_IP + 2, 0, 0);
+        Emit(builder, BPF_JGE_K, rule->portLow, 0, BPF_FAIL);
+        Emit(builder, BPF_JGT_K, rule->portHigh, BPF_FAIL, 0);
+    }
+
+    Emit(builder, BPF_RET_K, BPF_ACCEPT, 0, 0);
+
+    for (i = builder->ruleStart; i < builder->length; i++)
+    {
+        PBPF_INSTRUCTION instruction = &builder->program[i];
+        unsigned char distance = (unsigned char)(builder->length - i - 1);
+
+        if ((instruction->code & 0x07) != 0x05)
+        {
+            continue;
+        }
+        if (instruction->jt == BPF_FAIL)
+        {
+            instruction->jt = distance;
+        }
+        if (instruction->jf == BPF_FAIL)
+        {
+            instruction->jf = distance;
+        }
+    }
+}
+
+static int CompileProgram(PCAPTURE_RULES rules, PBPF_INSTRUCTION program)
+{
+    BPF_BUILDER builder;
+    int i;
+
+    builder.program = program;
+    builder.length = 0;
+
+    Emit(&builder, BPF_LD_H_ABS, OFFSET_ETH_TYPE, 0, 0);
+    Emit(&builder, BPF_JEQ_K, 0x0800, 1, 0);
+    Emit(&builder, BPF_RET_K, 0, 0, 0);
+    for (i = 0; i < rules->count; i++)
+    {
+        CompileRule(&builder, &rules->rules[i]);
+    }
+    Emit(&builder, BPF_RET_K, 0, 0, 0);
+
+    return builder.length;
+}
+
+static void CompileExpression(PCAPTURE_RULES rules, char* expression, size_t size)
+{
+    static const char* names[] = { "icmp", "tcp", "udp" };
+    size_t used;
+    int i;
+
+    if (!rules->count)
+    {
+        snprintf(expression, size, "ip and not ip");
+        return;
+    }
+
+    used = snprintf(expression, size, "ip and (");
+    for (i = 0; i < rules->count && used < size; i++)
+    {
+        PCAPTURE_RULE rule = &rules->rules[i];
+        int several = rule->protocols != CAPTURE_ICMP && rule->protocols != CAPTURE_TCP && rule->protocols != CAPTURE_UDP;
+        const char* separator = several ? "(" : "";
+        int j;
+
+        used += snprintf(expression + used, size - used, "%s(", i ? " or " : "");
+        for (j = 0; j < 3 && used < size; j++)
+        {
+            if (rule->protocols & (1 << j))
+            {
+                used += snprintf(expression + used, size - used, "%s%s", separator, names[j]);
+                separator = " or ";
+            }
+        }
+        if (several && used < size)
+        {
+            used += snprintf(expression + used, size - used, ")");
+        }
+        if (rule->portHigh && used < size)
+        {
+            used += rule->portLow == rule->portHigh ?
+                snprintf(expression + used, size - used, " and port %u", rule->portLow) :
+                snprintf(expression + used, size - used, " and portrange %u-%u", rule->portLow, rule->portHigh);
+        }
+        if (rule->mask && used < size)
+        {
+            unsigned int prefix = 0;
+
+            while (prefix < 32 && (rule->mask & (0x80000000 >> prefix)))
+            {
+                prefix++;
+            }
+            used += snprintf(expression + used, size - used, " and net %u.%u.%u.%u/%u",
+                rule->network >> 24, (rule->network >> 16) & 0xFF, (rule->network >> 8) & 0xFF,
+                rule->network & 0xFF, prefix);
+        }
+        if (used < size)
+        {
+            used += snprintf(expression + used, size - used, ")");
+        }
+    }
+    if (used < size)
+    {
+        snprintf(expression + used, size - used, ")");
+    }
+}
+
+// Caller holds s_lock.
+static void Rebuild()
+{
+    PCAPTURE_RULES combined = &s_filter.rules;
+    int overflow = 0;
+    int owner;
+    int i;
+
+    memset(combined, 0, sizeof(*combined));
+    for (owner = 0; owner < CAPTURE_OWNERS; owner++)
+    {
+        for (i = 0; s_interested[owner] && i < s_interests[owner].count; i++)
+        {
+            PCAPTURE_RULE rule = &s_interests[owner].rules[i];
+
+            overflow |= !AddRule(combined, rule->protocols, rule->portLow, rule->portHigh, rule->network, rule->mask);
+        }
+    }
+
+    // A rule taking everything makes the others moot.
+    for (i = 0; i < combined->count; i++)
+    {
+        PCAPTURE_RULE rule = &combined->rules[i];
+
+        if (rule->protocols == CAPTURE_ANY && !rule->portHigh && !rule->mask)
+        {
+            break;
+        }
+    }
+    if (overflow || i < combined->count)
+    {
+        if (overflow)
+        {
+            printf("More than %d capture rules in all, capturing everything\n", MAX_CAPTURE_RULES);
+        }
+        memset(combined, 0, sizeof(*combined));
+        AddRule(combined, CAPTURE_ANY, 0, 0, 0, 0);
+    }
+
+    s_filter.length = CompileProgram(combined, s_filter.program);
+    CompileExpression(combined, s_filter.expression, sizeof(s_filter.expression));
+    s_filter.generation = MarkAtomicAdd64(&s_generation, 1) + 1;
+}
+
+int EnableCaptureFilter(const char* text)
+{
+    CAPTURE_RULES rules;
+
+    if (!ParseCaptureRules(text, &rules))
+    {
+        return 0;
+    }
+
+    MarkLockInit(&s_lock);
+    s_enabled = 1;
+    SetCaptureInterest(CAPTURE_OWNER_OPTION, &rules);
+
+    return 1;
+}
+
+void SetCaptureInterest(int owner, PCAPTURE_RULES rules)
+{
+    if (!s_enabled || owner < 0 || owner >= CAPTURE_OWNERS)
+    {
+        return;
+    }
+
+    MarkLockAcquire(&s_lock);
+    if (rules || s_interested[owner])
+    {
+        s_interested[owner] = rules != NULL;
+        if (rules)
+        {
+            s_interests[owner] = *rules;
+        }
+        Rebuild();
+        printf("Capture filter %lld: %s\n", s_filter.generation, s_filter.expression);
+    }
+    MarkLockRelease(&s_lock);
+}
+
+long long GetCaptureFilterGeneration()
+{
+    return MarkAtomicLoad64(&s_generation);
+}
+
+long long GetCaptureFilter(PCAPTURE_FILTER filter)
+{
+    if (!s_enabled)
+    {
+        filter->generation = 0;
+        return 0;
+    }
+
+    MarkLockAcquire(&s_lock);
+    memcpy(filter, &s_filter, sizeof(*filter));
+    MarkLockRelease(&s_lock);
+
+    return filter->generation;
+}
\ No newline at end of file
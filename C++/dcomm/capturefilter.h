@@ -0,0 +1,91 @@
+#ifndef _CAPTUREFILTER_H_
+#define _CAPTUREFILTER_H_
+
+#include "packetdecode.h"
+#include "subscription.h"
+
+// Keeps unwanted packets in the kernel. Each owner states the traffic it
+// is interested in as a set of rules: the -capture option, the DNS cache,
+// and every broker client whose subscription takes packet events. The union
+// of these is compiled into a classic BPF program, attached to AF_PACKET
+// sockets with SO_ATTACH_FILTER, and into a filter expression that libpcap
+// sources hand to pcap_compile and pcap_setfilter. Whenever an interest
+// changes the filter is rebuilt and its generation moves on; the capture
+// threads see that on their next poll and install the new one, which the
+// kernel swaps for the old in one step. Packets already queued under the
+// old filter are still delivered.
+//
+// Rules are separated by ';', the parts of a rule by spaces:
+//   icmp | tcp | udp      protocols, any number of them, all three if none
+//   port 80,443,8000-8100 either port, TCP and UDP only
+//   net 10.0.0.0/8        either address; host 10.0.0.1 is net 10.0.0.1/32
+//   all                   every packet, as without a filter
+//   none                  nothing of its own, broker clients only
+// A packet is kept if any rule takes it. The rules have no IPv6 form yet
+// and the program reads untagged frames, so a filter passes IPv4 without
+// VLAN tags only; IPv6 and tagged frames need the filter off.
+
+#define MAX_CAPTURE_RULES 64
+#define MAX_CAPTURE_PROGRAM 1536 // instructions, BPF_MAXINSNS is 4096
+#define MAX_CAPTURE_EXPRESSION 8192
+#define CAPTURE_OWNER_OPTION 0
+#define CAPTURE_OWNER_DNS 1        // the responses the DNS cache reads
+#define CAPTURE_OWNER_SUBSCRIBER 2 // plus the broker client index
+#define CAPTURE_OWNERS (CAPTURE_OWNER_SUBSCRIBER + MAX_SUBSCRIBERS)
+
+#define CAPTURE_ICMP 0x1
+#define CAPTURE_TCP 0x2
+#define CAPTURE_UDP 0x4
+#define CAPTURE_ANY (CAPTURE_ICMP | CAPTURE_TCP | CAPTURE_UDP)
+
+typedef struct _CAPTURE_RULE
+{
+    unsigned int protocols;
+    unsigned short portLow;
+    unsigned short portHigh; // 0 for any port
+    unsigned int network;    // host order
+    unsigned int mask;       // 0 for any address
+} CAPTURE_RULE, *PCAPTURE_RULE;
+
+typedef struct _CAPTURE_RULES
+{
+    int count;
+    CAPTURE_RULE rules[MAX_CAPTURE_RULES];
+} CAPTURE_RULES, *PCAPTURE_RULES;
+
+// Same layout as struct sock_filter and libpcap's struct bpf_insn.
+typedef struct _BPF_INSTRUCTION
+{
+    unsigned short code;
+    unsigned char jt;
+    unsigned char jf;
+    unsigned int k;
+} BPF_INSTRUCTION, *PBPF_INSTRUCTION;
+
+typedef struct _CAPTURE_FILTER
+{
+    long long generation;
+    CAPTURE_RULES rules;
+    int length;
+    BPF_INSTRUCTION program[MAX_CAPTURE_PROGRAM];
+    char expression[MAX_CAPTURE_EXPRESSION];
+} CAPTURE_FILTER, *PCAPTURE_FILTER;
+
+// Prints what is wrong and returns 0 on a bad rule.
+int ParseCaptureRules(const char* text, PCAPTURE_RULES rules);
+// What a subscription can possibly match: nothing if it leaves out packet
+// events, else whatever protocol, port and address its path pattern spells
+// out, and every packet if it spells out none.
+void GetSubscriptionRules(PSTREAM_SUBSCRIPTION subscription, PCAPTURE_RULES rules);
+int MatchCaptureRules(PCAPTURE_RULES rules, PPACKET_INFO info);
+
+// Turns filtering on with the -capture rules. Without it the generation
+// stays 0, no filter is installed and SetCaptureInterest does nothing.
+int EnableCaptureFilter(const char* text);
+// NULL rules drop the owner's interest.
+void SetCaptureInterest(int owner, PCAPTURE_RULES rules);
+long long GetCaptureFilterGeneration();
+// Copies the current filter; returns its generation.
+long long GetCaptureFilter(PCAPTURE_FILTER filter);
+
+#endif
\ No newline at end of file
@@ -1,59 +1,659 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "communicator.h"
+#include "afpacket.h"
+#include "analyzer.h"
+#include "binlog.h"
+#include "broker.h"
+#include "capturefilter.h"
+#include "dnscache.h"
+#include "flowtable.h"
+#include "forward.h"
+#include "payloadscan.h"
+#include "pcapfile.h"
+#include "platform.h"
+#include "replay.h"
+#include "segment.h"
+#include "shmring.h"
+#include "sinks.h"
+#include "socketowners.h"
+#include "sources.h"
+#include "stages.h"
+#include "synthetic.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <signal.h>
+#define _strtoui64 strtoull
+#endif
 
 #define INSTALL_KEY "-install"
 #define UNINSTALL_KEY "-uninstall"
+#define BINLOG_KEY "-binlog"
+#define SEGLOG_KEY "-seglog"
+#define LOGIO_KEY "-logio"
+#define SYNC_KEY "-sync"
+#define REPLAY_KEY "-replay"
+#define PCAP_KEY "-pcap"
+#define SYNTHETIC_KEY "-synthetic"
+#define DRIVER_KEY "-driver"
+#define PACKETS_KEY "-packets"
+#define FANOUT_KEY "-fanout"
+#define FLOWS_KEY "-flows"
+#define CAPTURE_KEY "-capture"
+#define OWNERS_KEY "-owners"
+#define DNS_KEY "-dns"
+#define TLS_KEY "-tls"
+#define INSPECT_KEY "-inspect"
+#define QUEUE_KEY "-queue"
+#define OVERFLOW_KEY "-overflow"
+#define SPILL_KEY "-spill"
+#define ANALYZER_KEY "-analyzer"
+#define LINGER_KEY "-linger"
+#define SHM_KEY "-shm"
+#define BROKER_KEY "-broker"
+#define FORWARD_KEY "-forward"
+#define FORWARD_BATCH_KEY "-forwardbatch"
+#define FORWARD_LINGER_KEY "-forwardlinger"
+#define SPOOL_LIMIT_KEY "-spoollimit"
+#define QUIET_KEY "-quiet"
 
-g_OfflineMode = 1;
-g_MonitorConnection = 0;
+int g_OfflineMode = 1;
+int g_MonitorConnection = 0;
 
-int main(int argc, char* argv[])
+// Set by the shutdown handler; main notices it, stops the sources and
+// flushes the logs on its own thread.
+static volatile int s_shutdown = 0;
+
+#ifdef _WIN32
+
+BOOL WINAPI ShutdownHandler(DWORD type)
 {
-    if (!UniqueProcess())
+    UNREFERENCED_PARAMETER(type);
+
+    s_shutdown = 1;
+
+    return TRUE;
+}
+
+static void InstallShutdownHandler()
+{
+    SetConsoleCtrlHandler(ShutdownHandler, TRUE);
+}
+
+#else
+
+static void ShutdownHandler(int signal)
+{
+    UNREFERENCED_PARAMETER(signal);
+
+    s_shutdown = 1;
+}
+
+static void InstallShutdownHandler()
+{
+    signal(SIGINT, ShutdownHandler);
+    signal(SIGTERM, ShutdownHandler);
+}
+
+#endif
+
+// -logio <write|uring|buffered>
+static void ParseLogIoOption(const char* value)
+{
+    if (!strcmp(value, "write"))
     {
-        printf("Not Unique!\n");
-        return 1;
+        g_LogIoOptions.backend = LOGIO_BACKEND_WRITE;
+    }
+    else if (!strcmp(value, "uring"))
+    {
+        g_LogIoOptions.backend = LOGIO_BACKEND_URING;
+    }
+    else if (!strcmp(value, "buffered"))
+    {
+        g_LogIoOptions.direct = 0;
     }
+}
 
-    if (argc > 1 && !strcmp(argv[1], INSTALL_KEY))
+// -replay <path> [max|original|<N>x]
+static double ParseReplaySpeed(const char* value)
+{
+    if (!strcmp(value, "max"))
     {
-        InstallDriver();
+        return REPLAY_SPEED_MAX;
     }
-    else if (argc > 1 && !strcmp(argv[1], UNINSTALL_KEY))
+    if (!strcmp(value, "original"))
     {
-        UninstallDriver();
+        return 1.0;
     }
+    return atof(value);
+}
 
-    // DIRTY HACK
-    CallbackMain();
+static int IsValue(int argc, char* argv[], int i)
+{
+    return i < argc && argv[i][0] != '-';
+}
 
-    return 0;
+// -overflow <sink> <block|drop|spill>
+static int ParseOverflowPolicy(const char* value)
+{
+    if (!strcmp(value, "drop"))
+    {
+        return SINK_DROP;
+    }
+    if (!strcmp(value, "spill"))
+    {
+        return SINK_SPILL;
+    }
+    return SINK_BLOCK;
+}
+
+// The recording must stay complete, so the binary log waits by default; the
+// console and the analyzer pipe give way instead of holding up the rest.
+static int RegisterSinks()
+{
+    if (IsBinaryLogActive())
+    {
+        RegisterSink("binlog", MARK_STAGE_BINLOG, WriteBinaryLog, NULL, SINK_BLOCK, SINK_DEFAULT_CAPACITY);
+    }
+    else if (g_OfflineMode)
+    {
+        RegisterSink("textlog", MARK_STAGE_TEXTLOG, SaveMessageToLog, NULL, SINK_BLOCK, SINK_DEFAULT_CAPACITY);
+    }
+
+    if (g_MonitorConnection)
+    {
+        RegisterSink("analyzer", MARK_STAGE_ANALYZER, SendMessageToAnalyzer, FlushAnalyzer, SINK_DROP, SINK_DEFAULT_CAPACITY);
+    }
+    if (IsSharedRingActive())
+    {
+        RegisterSink("shmring", MARK_STAGE_SHMRING, WriteSharedRing, FlushSharedRing, SINK_DROP, SINK_DEFAULT_CAPACITY);
+    }
+    if (IsBrokerActive())
+    {
+        RegisterSink("broker", MARK_STAGE_BROKER, WriteBroker, FlushBroker, SINK_DROP, SINK_DEFAULT_CAPACITY);
+    }
+    if (IsForwardActive())
+    {
+        // Only spools to disk, the network is not in the way.
+        RegisterSink("forward", MARK_STAGE_FORWARD, WriteForward, FlushForward, SINK_BLOCK, SINK_DEFAULT_CAPACITY);
+    }
+
+    return GetSinkCount();
 }
 
-DRIVER_CONNECTION connection;
+// Classic pcap files take the parallel reader, anything else libpcap.
+static int RegisterCaptureFile(const char* path, int workers)
+{
+    if (IsPcapFile(path))
+    {
+        return RegisterPcapFileSource(path, workers);
+    }
 
-int CallbackMain()
+#if defined(_WIN32) || defined(MARK_LIBPCAP)
+    return RegisterPacketFileSource(path);
+#else
+    printf("%s is not a pcap file; convert pcapng with editcap -F pcap\n", path);
+    return 0;
+#endif
+}
+
+// Without any source options the live sources run, as they always did.
+static int RegisterSources(const char* replay, double speed, const char* pcap, int pcapWorkers,
+    double rate, double duration, int synthetic, int driver, int packets, const char* interfaces, int captureBuffer,
+    int fanout)
 {
-    connection = ConnectToDriver();
-//    printf("Connection %x!\n", connection);
+    if (!replay && !pcap && !synthetic && !driver && !packets)
+    {
+        driver = packets = 1;
+    }
 
-    StartPacketCapture();
+    if (replay)
+    {
+        RegisterReplaySource(replay, speed);
+    }
+    if (pcap)
+    {
+        RegisterCaptureFile(pcap, pcapWorkers);
+    }
+    if (synthetic)
+    {
+        RegisterSyntheticSource(rate, duration);
+    }
 
-    return !IsConnectionSuccessful(connection);
+#ifdef _WIN32
+    if (driver)
+    {
+        RegisterDriverSource();
+    }
+    if (packets)
+    {
+        RegisterPacketSource(interfaces, captureBuffer);
+    }
+#else
+    if (packets && !RegisterAfPacketSource(interfaces, captureBuffer, fanout))
+    {
+#ifdef MARK_LIBPCAP
+        printf("Capturing with libpcap instead\n");
+        RegisterPacketSource(interfaces, captureBuffer);
+#endif
+    }
+    if (driver && !packets)
+    {
+        printf("No driver on this platform, use %s, %s, %s or %s\n", PACKETS_KEY, REPLAY_KEY, PCAP_KEY, SYNTHETIC_KEY);
+    }
+#endif
+
+    return GetSourceCount();
 }
 
-int ProcessMessage(PMARK_EVENT event)
+int main(int argc, char* argv[])
 {
-    if (g_OfflineMode)
+    const char* binlog = NULL;
+    const char* seglog = NULL;
+    const char* replay = NULL;
+    unsigned long long segmentSize = 0;
+    int segments = SEGMENT_DEFAULT_COUNT;
+    double speed = REPLAY_SPEED_MAX;
+    const char* pcap = NULL;
+    int pcapWorkers = 0;
+    double rate = SYNTHETIC_RATE_MAX;
+    double duration = 0;
+    int synthetic = 0, driver = 0, packets = 0;
+    const char* interfaces = NULL;
+    int captureBuffer = CAPTURE_DEFAULT_BUFFER;
+    int fanout = 1;
+    const char* captureRules = NULL;
+    int owners = 0;
+    int ownersInterval = 0;
+    int dns = 0;
+    unsigned int dnsEntries = 0;
+    unsigned long capacity = INGRESS_DEFAULT_CAPACITY;
+    const char* overflowSinks[MAX_SINKS];
+    int overflowPolicies[MAX_SINKS];
+    int overflows = 0;
+    const char* analyzer = NULL;
+    int linger = ANALYZER_DEFAULT_LINGER;
+    const char* shm = NULL;
+    unsigned long shmCapacity = SHMRING_DEFAULT_CAPACITY;
+    int shared = 0;
+    const char* brokerAddress = NULL;
+    int broker = 0;
+    const char* forwardAddress = NULL;
+    const char* spool = NULL;
+    unsigned long long spoolLimit = 0;
+    int forwardBatch = FORWARD_DEFAULT_BATCH;
+    int forwardLinger = FORWARD_DEFAULT_LINGER;
+    int forward = 0;
+    int result, i;
+
+    if (!UniqueProcess())
+    {
+        printf("Not Unique!\n");
+        return 1;
+    }
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], INSTALL_KEY))
+        {
+            return !InstallDriver();
+        }
+        else if (!strcmp(argv[i], UNINSTALL_KEY))
+        {
+            return !UninstallDriver();
+        }
+        else if (!strcmp(argv[i], BINLOG_KEY) && IsValue(argc, argv, i + 1))
+        {
+            binlog = argv[++i];
+        }
+        else if (!strcmp(argv[i], SEGLOG_KEY) && IsValue(argc, argv, i + 1))
+        {
+            // -seglog <directory> [segment size, MB] [segments to keep]
+            seglog = argv[++i];
+            if (IsValue(argc, argv, i + 1))
+            {
+                segmentSize = _strtoui64(argv[++i], NULL, 10) * 1024 * 1024;
+            }
+            if (IsValue(argc, argv, i + 1))
+            {
+                segments = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], LOGIO_KEY) && IsValue(argc, argv, i + 1))
+        {
+            ParseLogIoOption(argv[++i]);
+        }
+        else if (!strcmp(argv[i], SYNC_KEY) && i + 1 < argc)
+        {
+            g_LogIoOptions.syncInterval = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], REPLAY_KEY) && IsValue(argc, argv, i + 1))
+        {
+            replay = argv[++i];
+            if (IsValue(argc, argv, i + 1))
+            {
+                speed = ParseReplaySpeed(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], PCAP_KEY) && IsValue(argc, argv, i + 1))
+        {
+            // -pcap <capture file> [worker threads]
+            pcap = argv[++i];
+            if (IsValue(argc, argv, i + 1))
+            {
+                pcapWorkers = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], SYNTHETIC_KEY))
+        {
+            // -synthetic [events per second] [seconds]
+            synthetic = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                rate = atof(argv[++i]);
+            }
+            if (IsValue(argc, argv, i + 1))
+            {
+                duration = atof(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], DRIVER_KEY))
+        {
+            driver = 1;
+        }
+        else if (!strcmp(argv[i], PACKETS_KEY))
+        {
+            // -packets [all | interface[@cpu],...] [buffer per interface, MB]
+            packets = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                interfaces = argv[++i];
+            }
+            if (IsValue(argc, argv, i + 1))
+            {
+                captureBuffer = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], FANOUT_KEY) && IsValue(argc, argv, i + 1))
+        {
+            // -fanout <capture threads per interface>, AF_PACKET only
+            fanout = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], FLOWS_KEY) && IsValue(argc, argv, i + 1))
+        {
+            // -flows <idle seconds> [seconds between updates] [slots per capture thread]
+            g_FlowOptions.idle = atoi(argv[++i]);
+            if (IsValue(argc, argv, i + 1))
+            {
+                g_FlowOptions.active = atoi(argv[++i]);
+            }
+            if (IsValue(argc, argv, i + 1))
+            {
+                g_FlowOptions.capacity = strtoul(argv[++i], NULL, 10);
+            }
+        }
+        else if (!strcmp(argv[i], CAPTURE_KEY) && i + 1 < argc)
+        {
+            // -capture "<rule>[; <rule>...]", see capturefilter.h
+            captureRules = argv[++i];
+        }
+        else if (!strcmp(argv[i], OWNERS_KEY))
+        {
+            // -owners [ms between socket table snapshots], see socketowners.h
+            owners = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                ownersInterval = atoi(argv[++i]);
+            }
+        }
+        else if (!strcmp(argv[i], DNS_KEY))
+        {
+            // -dns [addresses named at once], see dnscache.h
+            dns = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                dnsEntries = strtoul(argv[++i], NULL, 10);
+            }
+        }
+        else if (!strcmp(argv[i], TLS_KEY))
+        {
+            // -tls, label TCP flows with their SNI and ALPN, see tlshello.h
+            g_FlowOptions.tls = 1;
+        }
+        else if (!strcmp(argv[i], INSPECT_KEY))
+        {
+            // -inspect [bytes of each flow direction], see payloadscan.h
+            g_FlowOptions.inspect = PAYLOAD_SCAN_DEFAULT_BYTES;
+            if (IsValue(argc, argv, i + 1))
+            {
+                g_FlowOptions.inspect = strtoul(argv[++i], NULL, 10);
+            }
+        }
+        else if (!strcmp(argv[i], QUEUE_KEY) && IsValue(argc, argv, i + 1))
+        {
+            // -queue <events between the sources and the pipeline>
+            capacity = strtoul(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], OVERFLOW_KEY) && IsValue(argc, argv, i + 2) && overflows < MAX_SINKS)
+        {
+            overflowSinks[overflows] = argv[++i];
+            overflowPolicies[overflows++] = ParseOverflowPolicy(argv[++i]);
+        }
+        else if (!strcmp(argv[i], SPILL_KEY) && IsValue(argc, argv, i + 1))
+        {
+            SetSinkSpillDirectory(argv[++i]);
+        }
+        else if (!strcmp(argv[i], ANALYZER_KEY))
+        {
+            // -analyzer [pipe name or socket path]
+            g_MonitorConnection = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                analyzer = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], LINGER_KEY) && IsValue(argc, argv, i + 1))
+        {
+            linger = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], SHM_KEY))
+        {
+            // -shm [ring name] [events]
+            shared = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                shm = argv[++i];
+            }
+            if (IsValue(argc, argv, i + 1))
+            {
+                shmCapacity = strtoul(argv[++i], NULL, 10);
+            }
+        }
+        else if (!strcmp(argv[i], BROKER_KEY))
+        {
+            // -broker [pipe name or socket path clients connect to]
+            broker = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                brokerAddress = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], FORWARD_KEY))
+        {
+            // -forward [tcp:host:port] [spool directory]
+            forward = 1;
+            if (IsValue(argc, argv, i + 1))
+            {
+                forwardAddress = argv[++i];
+            }
+            if (IsValue(argc, argv, i + 1))
+            {
+                spool = argv[++i];
+            }
+        }
+        else if (!strcmp(argv[i], FORWARD_BATCH_KEY) && IsValue(argc, argv, i + 1))
+        {
+            forwardBatch = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], FORWARD_LINGER_KEY) && IsValue(argc, argv, i + 1))
+        {
+            forwardLinger = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], SPOOL_LIMIT_KEY) && IsValue(argc, argv, i + 1))
+        {
+            // MB
+            spoolLimit = _strtoui64(argv[++i], NULL, 10);
+        }
+        else if (!strcmp(argv[i], QUIET_KEY))
+        {
+            // Events still go through the pipeline but are not printed.
+            g_OfflineMode = 0;
+        }
+        else
+        {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    // Both would be fed from the one binary log writer.
+    if (binlog && seglog)
+    {
+        printf("Use either %s or %s, not both\n", BINLOG_KEY, SEGLOG_KEY);
+        return 1;
+    }
+
+    // Before the sources open, so capture starts filtered.
+    if (captureRules && !EnableCaptureFilter(captureRules))
+    {
+        return 1;
+    }
+    // Without the tables flows still go out, only without their processes.
+    if (owners)
+    {
+        g_FlowOptions.owners = StartSocketOwners(ownersInterval);
+    }
+    // The responses have to get through a capture filter that leaves them out.
+    if (dns && (g_FlowOptions.dns = StartDnsCache(dnsEntries)) != 0)
+    {
+        CAPTURE_RULES rules;
+
+        if (ParseCaptureRules("udp tcp port 53", &rules))
+        {
+            SetCaptureInterest(CAPTURE_OWNER_DNS, &rules);
+        }
+    }
+
+    if (!RegisterSources(replay, speed, pcap, pcapWorkers, rate, duration, synthetic, driver, packets,
+        interfaces, captureBuffer, fanout))
+    {
+        printf("No event sources\n");
+        return 1;
+    }
+
+    if (binlog && !StartBinaryLog(binlog))
+    {
+        return 1;
+    }
+    if (seglog && !StartSegmentedLog(seglog, segmentSize, segments))
+    {
+        return 1;
+    }
+    if (shared && !StartSharedRing(shm, shmCapacity))
+    {
+        return 1;
+    }
+    if (broker && !StartBroker(brokerAddress))
+    {
+        return 1;
+    }
+    if (forward && !StartForward(forwardAddress, spool, spoolLimit, forwardBatch, forwardLinger))
+    {
+        return 1;
+    }
+
+    SetAnalyzerAddress(analyzer, linger);
+    RegisterSinks();
+    for (i = 0; i < overflows; i++)
+    {
+        if (!SetSinkPolicy(overflowSinks[i], overflowPolicies[i]))
+        {
+            printf("No sink %s\n", overflowSinks[i]);
+        }
+    }
+
+    InstallShutdownHandler();
+
+    // Sources that finish on their own (replay, a bounded synthetic run) let
+    // the collector exit once the last one is done. Shutdown goes front to
+    // back so that every queue drains into the next stage.
+    result = StartSinks() && StartSources(capacity);
+    while (result && RunningSources() && !s_shutdown)
     {
-        SaveMessageToLog(event);
+        MarkSleep(SOURCE_POLL_INTERVAL);
     }
+    StopSources();
+    StopSocketOwners();
+    StopDnsCache();
+    StopSinks();
+    StopSharedRing();
+    StopBroker();
+    StopForward();
 
+    if (IsBinaryLogActive())
+    {
+        StopBinaryLog();
+        PrintBinaryLogStats();
+    }
+    if (replay)
+    {
+        PrintReplayStats();
+    }
+    if (pcap && IsPcapFile(pcap))
+    {
+        PrintPcapFileStats();
+    }
+#ifndef _WIN32
+    PrintAfPacketStats();
+#endif
+#if defined(_WIN32) || defined(MARK_LIBPCAP)
+    PrintPacketSourceStats();
+#endif
+    PrintFlowStats();
+    PrintSocketOwnerStats();
+    PrintDnsStats();
+    PrintSourceStats();
+    PrintSinkStats();
     if (g_MonitorConnection)
     {
-        SendMessageToAnalyzer(event);
+        PrintAnalyzerStats();
+    }
+    if (shared)
+    {
+        PrintSharedRingStats();
     }
+    if (broker)
+    {
+        PrintBrokerStats();
+    }
+    if (forward)
+    {
+        PrintForwardStats();
+    }
+    PrintStageLatency();
+
+    return !result;
+}
+
+// Runs on the pipeline thread only, see sources.c. The sinks stamp their own
+// stage as their workers pick the event up, so every copy carries the stamps
+// of everything before it.
+int ProcessMessage(PMARK_EVENT event)
+{
+    StampStage(event, MARK_STAGE_PROCESS);
+    DispatchEvent(event);
 
     return 0;
 }
\ No newline at end of file
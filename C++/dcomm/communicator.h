@@ -1,16 +1,21 @@
-#include "..\sys\core.h"
+#include "../sys/core.h"
 
 int InstallDriver();
 int UninstallDriver();
 
-#define DRIVER_CONNECTION void*
+#define CAPTURE_DEFAULT_BUFFER 16 // MB
 
-int IsConnectionSuccessful(DRIVER_CONNECTION connection);
-
-DRIVER_CONNECTION ConnectToDriver();
-void StartPacketCapture();
-
-int CallbackMain();
+// Live sources. The driver is Windows only; packet capture with libpcap is
+// also built on Linux with MARK_LIBPCAP defined, as the fallback for
+// afpacket.h. Both return 0 if the source cannot be opened.
+int RegisterDriverSource();
+// interfaces: NULL or "all" for every interface with an address but
+// loopback, else names or list numbers separated by commas, each with an
+// optional @cpu for its capture thread. bufferSize is in MB per interface.
+int RegisterPacketSource(const char* interfaces, int bufferSize);
+void PrintPacketSourceStats();
+// Any capture file libpcap reads, see pcapfile.h for the fast path.
+int RegisterPacketFileSource(const char* path);
 
 int ProcessMessage(PMARK_EVENT event);
 
@@ -20,4 +25,7 @@ extern int g_MonitorConnection;
 int SendMessageToAnalyzer(PMARK_EVENT event);
 int SaveMessageToLog(PMARK_EVENT event);
 
+#define LOG_MESSAGE_SIZE 2048
+int FormatLogMessage(PMARK_EVENT event, char* buffer, int size);
+
 int UniqueProcess();
\ No newline at end of file
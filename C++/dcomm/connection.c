@@ -1,4 +1,5 @@
 #include "communicator.h"
+#include "sources.h"
 
 #include "..\sys\markusermode.h"
 
@@ -12,39 +13,78 @@ typedef struct _DRIVER_MESSAGE
     MARK_EVENT event;
 } DRIVER_MESSAGE, *PDRIVER_MESSAGE;
 
-int IsConnectionSuccessful(DRIVER_CONNECTION connection)
-{
-    HANDLE x = (HANDLE)connection;
-    return (x != NULL && x != INVALID_HANDLE_VALUE);
-}
+static HANDLE s_port = NULL;
+static HANDLE s_stop = NULL;
 
-DWORD WINAPI ProcessDriverMessages(_In_ LPVOID parameter)
+// The port is opened for overlapped I/O so that a pending FilterGetMessage
+// can be abandoned when the source is stopped.
+static int RunDriverSource(void* context)
 {
-    HANDLE port = (HANDLE)parameter;
-
     DRIVER_MESSAGE message = { 0 };
+    OVERLAPPED overlapped = { 0 };
+    HANDLE events[2];
+    DWORD bytes;
+    int result = 1;
+
+    UNREFERENCED_PARAMETER(context);
+
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    events[0] = overlapped.hEvent;
+    events[1] = s_stop;
 
     while (1)
     {
-        HRESULT res = FilterGetMessage((HANDLE)port, &(message.header), sizeof(message), NULL);
+        HRESULT res = FilterGetMessage(s_port, &(message.header), sizeof(message), &overlapped);
+
+        if (HRESULT_FROM_WIN32(ERROR_IO_PENDING) == res)
+        {
+            if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0)
+            {
+                CancelIoEx(s_port, &overlapped);
+                GetOverlappedResult(s_port, &overlapped, &bytes, TRUE);
+                break;
+            }
+            res = GetOverlappedResult(s_port, &overlapped, &bytes, FALSE) ? S_OK : HRESULT_FROM_WIN32(GetLastError());
+        }
 
         if (S_OK == res)
         {
-            ProcessMessage(&(message.event));
+            SubmitEvent(&(message.event));
         }
         else
         {
-            printf("Error 0x%x while receiving the message.\n");
+            printf("Error 0x%x while receiving the message.\n", res);
+            result = 0;
+            break;
         }
     }
+
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(s_port);
+    s_port = NULL;
+
+    return result;
+}
+
+static void StopDriverSource(void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    SetEvent(s_stop);
 }
 
-DRIVER_CONNECTION ConnectToDriver()
+int RegisterDriverSource()
 {
-    HANDLE hPort;
-    FilterConnectCommunicationPort(PORT_NAME, FLT_PORT_FLAG_SYNC_HANDLE, NULL, 0, NULL, &hPort);
+    HRESULT res = FilterConnectCommunicationPort(PORT_NAME, 0, NULL, 0, NULL, &s_port);
+
+    if (S_OK != res)
+    {
+        printf("Cannot connect to the driver, error 0x%x\n", res);
+        s_port = NULL;
+        return 0;
+    }
+
+    s_stop = CreateEvent(NULL, TRUE, FALSE, NULL);
 
-    HANDLE thread = CreateThread(NULL, 0, ProcessDriverMessages, hPort, 0, NULL);
-    WaitForSingleObject(thread, INFINITE);
-    return hPort;
+    return RegisterSource("driver", RunDriverSource, StopDriverSource, NULL, 0);
 }
\ No newline at end of file
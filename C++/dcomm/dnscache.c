@@ -0,0 +1,645 @@
+#include "dnscache.h"
+#include "../sys/core.h"
+#include "platform.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DNS_HEADER_SIZE 12
+#define DNS_FLAG_RESPONSE 0x8000
+#define DNS_FLAG_OPCODE 0x7800
+#define DNS_FLAG_RCODE 0x000F
+#define DNS_POINTER 0xC0
+#define DNS_TYPE_A 1
+#define DNS_TYPE_CNAME 5
+#define DNS_TYPE_AAAA 28
+#define DNS_CLASS_IN 1
+#define DNS_CLASS_MASK 0x7FFF // mDNS takes the top bit for cache flush
+#define DNS_TTL_MAX 0x7FFFFFFF // above it a TTL counts as 0, RFC 2181
+
+typedef struct _DNS_ENTRY
+{
+    unsigned char address[16];
+    unsigned char version;
+    long long expires;
+    PDNS_NAME name;
+    unsigned int next;  // in the bucket or the free list, index + 1
+    unsigned int newer; // index + 1, 0 at either end
+    unsigned int older;
+} DNS_ENTRY, *PDNS_ENTRY;
+
+static PDNS_ENTRY s_entries = NULL;
+static unsigned int* s_buckets = NULL; // index + 1, 0 for an empty bucket
+static unsigned int s_bucketMask = 0;
+static unsigned int s_free = 0;
+static unsigned int s_newest = 0;
+static unsigned int s_oldest = 0;
+static int s_active = 0;
+
+static MARK_LOCK s_lock;
+static DNS_STATS s_stats;
+
+static unsigned short Read16(const unsigned char* data)
+{
+    return (unsigned short)((data[0] << 8) | data[1]);
+}
+
+static unsigned int Read32(const unsigned char* data)
+{
+    return (unsigned int)data[0] << 24 | (unsigned int)data[1] << 16 | (unsigned int)data[2] << 8 | data[3];
+}
+
+// Returns the offset past the name as it is written, 0 if it runs out of
+// the message or has a label type other than a plain one or a pointer.
+static unsigned int SkipName(const unsigned char* message, unsigned int length, unsigned int offset)
+{
+    while (offset < length)
+    {
+        unsigned char label = message[offset];
+
+        if (!label)
+        {
+            return offset + 1;
+        }
+        if ((label & DNS_POINTER) == DNS_POINTER)
+        {
+            return offset + 2 <= length ? offset + 2 : 0;
+        }
+        if (label & DNS_POINTER)
+        {
+            return 0;
+        }
+        offset += 1 + label;
+    }
+
+    return 0;
+}
+
+// Spells the name out in lower case, dotted, the root as "". Each pointer
+// has to point before the one followed last, so a loop of them ends.
+// Returns the length, -1 for a bad name.
+static int ReadName(const unsigned char* message, unsigned int length, unsigned int offset, char* text)
+{
+    unsigned int limit = offset;
+    int size = 0;
+
+    while (offset < length)
+    {
+        unsigned char label = message[offset];
+        unsigned int i;
+
+        if (!label)
+        {
+            text[size] = 0;
+            return size;
+        }
+        if ((label & DNS_POINTER) == DNS_POINTER)
+        {
+            unsigned int target;
+
+            if (offset + 2 > length)
+            {
+                return -1;
+            }
+            target = (label & ~DNS_POINTER) << 8 | message[offset + 1];
+            if (target >= limit)
+            {
+                return -1;
+            }
+            offset = limit = target;
+            continue;
+        }
+        if ((label & DNS_POINTER) || offset + 1 + label > length || size + (size ? 1 : 0) + label > DNS_MAX_NAME)
+        {
+            return -1;
+        }
+
+        if (size)
+        {
+            text[size++] = '.';
+        }
+        for (i = 1; i <= label; i++)
+        {
+            unsigned char c = message[offset + i];
+
+            if (c >= 'A' && c <= 'Z')
+            {
+                c += 'a' - 'A';
+            }
+            text[size++] = c > ' ' && c < 0x7F ? (char)c : '?';
+        }
+        offset += 1 + label;
+    }
+
+    return -1;
+}
+
+typedef struct _DNS_CHAIN
+{
+    const char* names[DNS_MAX_CHAIN];
+    int lengths[DNS_MAX_CHAIN];
+    unsigned int offsets[DNS_MAX_CHAIN]; // where each is written
+    int count;
+    char cnames[DNS_MAX_CHAIN - 1][DNS_MAX_NAME + 1];
+} DNS_CHAIN, *PDNS_CHAIN;
+
+// Whether the owner of a record is a name of the chain. Owners are nearly
+// always a pointer to where the name was first written, which settles it
+// without spelling the name out.
+static int IsChainOwner(const unsigned char* message, unsigned int length, unsigned int owner, PDNS_CHAIN chain)
+{
+    char text[DNS_MAX_NAME + 1];
+    int size;
+    int i;
+
+    if ((message[owner] & DNS_POINTER) == DNS_POINTER)
+    {
+        unsigned int target = (message[owner] & ~DNS_POINTER) << 8 | message[owner + 1];
+
+        for (i = 0; i < chain->count; i++)
+        {
+            if (chain->offsets[i] == target)
+            {
+                return 1;
+            }
+        }
+    }
+
+    size = ReadName(message, length, owner, text);
+    for (i = 0; size >= 0 && i < chain->count; i++)
+    {
+        if (chain->lengths[i] == size && !memcmp(chain->names[i], text, size))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void AddAddress(PDNS_RESPONSE response, unsigned short type, const unsigned char* data, unsigned int ttl)
+{
+    PDNS_ADDRESS address;
+    int size = type == DNS_TYPE_A ? 4 : 16;
+    int version = type == DNS_TYPE_A ? 4 : 6;
+    int i;
+
+    // An A record can match the first bytes of an AAAA one.
+    for (i = 0; i < response->count; i++)
+    {
+        if (response->addresses[i].version == version && !memcmp(response->addresses[i].address, data, size))
+        {
+            return;
+        }
+    }
+    if (response->count == DNS_MAX_ADDRESSES)
+    {
+        return;
+    }
+
+    address = &response->addresses[response->count++];
+    memset(address->address, 0, sizeof(address->address));
+    memcpy(address->address, data, size);
+    address->version = version;
+    address->ttl = ttl > DNS_TTL_MAX ? 0 : ttl;
+}
+
+int ParseDnsResponse(const unsigned char* message, unsigned int length, PDNS_RESPONSE response)
+{
+    DNS_CHAIN chain;
+    unsigned int deferred[DNS_MAX_ADDRESSES]; // owners of addresses met before their CNAME
+    int deferredCount = 0;
+    unsigned int offset;
+    unsigned short flags;
+    unsigned int answers;
+    unsigned int i;
+    int size;
+
+    response->name[0] = 0;
+    response->length = 0;
+    response->cnames = 0;
+    response->count = 0;
+
+    if (length < DNS_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    flags = Read16(message + 2);
+    answers = Read16(message + 6);
+    if (!(flags & DNS_FLAG_RESPONSE) || (flags & (DNS_FLAG_OPCODE | DNS_FLAG_RCODE)) || Read16(message + 4) != 1)
+    {
+        return 1;
+    }
+
+    size = ReadName(message, length, DNS_HEADER_SIZE, response->name);
+    offset = SkipName(message, length, DNS_HEADER_SIZE);
+    if (size <= 0 || !offset || offset + 4 > length)
+    {
+        return 0;
+    }
+    response->length = size;
+    offset += 4;
+
+    chain.names[0] = response->name;
+    chain.lengths[0] = size;
+    chain.offsets[0] = DNS_HEADER_SIZE;
+    chain.count = 1;
+
+    for (i = 0; i < answers; i++)
+    {
+        unsigned int owner = offset;
+        unsigned int end = SkipName(message, length, offset);
+        unsigned short type;
+        unsigned int data;
+        unsigned int dataLength;
+
+        if (!end || end + 10 > length)
+        {
+            return 0;
+        }
+        type = Read16(message + end);
+        data = end + 10;
+        dataLength = Read16(message + end + 8);
+        if (data + dataLength > length)
+        {
+            return 0;
+        }
+        offset = data + dataLength;
+
+        if ((Read16(message + end + 2) & DNS_CLASS_MASK) != DNS_CLASS_IN)
+        {
+            continue;
+        }
+
+        if (type == DNS_TYPE_CNAME && chain.count < DNS_MAX_CHAIN && IsChainOwner(message, length, owner, &chain))
+        {
+            char* target = chain.cnames[chain.count - 1];
+
+            size = ReadName(message, length, data, target);
+            if (size <= 0)
+            {
+                return 0;
+            }
+            chain.names[chain.count] = target;
+            chain.lengths[chain.count] = size;
+            chain.offsets[chain.count] = data;
+            chain.count++;
+            response->cnames++;
+        }
+        else if ((type == DNS_TYPE_A && dataLength == 4) || (type == DNS_TYPE_AAAA && dataLength == 16))
+        {
+            if (IsChainOwner(message, length, owner, &chain))
+            {
+                AddAddress(response, type, message + data, Read32(message + end + 4));
+            }
+            else if (deferredCount < DNS_MAX_ADDRESSES)
+            {
+                deferred[deferredCount++] = owner;
+            }
+        }
+    }
+
+    // A chain given out of order is only known whole at the end.
+    for (i = 0; (int)i < deferredCount && chain.count > 1; i++)
+    {
+        unsigned int end = SkipName(message, length, deferred[i]);
+
+        if (IsChainOwner(message, length, deferred[i], &chain))
+        {
+            AddAddress(response, Read16(message + end), message + end + 10, Read32(message + end + 4));
+        }
+    }
+
+    return 1;
+}
+
+static unsigned int HashAddress(unsigned char version, const unsigned char* address)
+{
+    unsigned int hash = 0x811C9DC5 ^ version;
+    unsigned int word;
+    int i;
+
+    for (i = 0; i < (version == 4 ? 4 : 16); i += 4)
+    {
+        memcpy(&word, address + i, 4);
+        hash = (hash ^ word) * 0x01000193;
+        hash ^= hash >> 15;
+    }
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+static unsigned int* FindSlot(unsigned char version, const unsigned char* address)
+{
+    unsigned int* slot = &s_buckets[HashAddress(version, address) & s_bucketMask];
+
+    while (*slot)
+    {
+        PDNS_ENTRY entry = &s_entries[*slot - 1];
+
+        if (entry->version == version && !memcmp(entry->address, address, sizeof(entry->address)))
+        {
+            break;
+        }
+        slot = &entry->next;
+    }
+
+    return slot;
+}
+
+static void Unlink(unsigned int index)
+{
+    PDNS_ENTRY entry = &s_entries[index - 1];
+
+    if (entry->newer)
+    {
+        s_entries[entry->newer - 1].older = entry->older;
+    }
+    else
+    {
+        s_newest = entry->older;
+    }
+    if (entry->older)
+    {
+        s_entries[entry->older - 1].newer = entry->newer;
+    }
+    else
+    {
+        s_oldest = entry->newer;
+    }
+}
+
+static void LinkNewest(unsigned int index)
+{
+    PDNS_ENTRY entry = &s_entries[index - 1];
+
+    entry->newer = 0;
+    entry->older = s_newest;
+    if (s_newest)
+    {
+        s_entries[s_newest - 1].newer = index;
+    }
+    else
+    {
+        s_oldest = index;
+    }
+    s_newest = index;
+}
+
+// slot is the one FindSlot gave for the entry.
+static void RemoveEntry(unsigned int* slot)
+{
+    unsigned int index = *slot;
+    PDNS_ENTRY entry = &s_entries[index - 1];
+
+    *slot = entry->next;
+    Unlink(index);
+    ReleaseDnsName(entry->name);
+    entry->name = NULL;
+    entry->next = s_free;
+    s_free = index;
+    s_stats.entries--;
+}
+
+static void Insert(PDNS_ADDRESS address, PDNS_NAME name, long long expires)
+{
+    unsigned int* slot = FindSlot(address->version, address->address);
+    unsigned int index = *slot;
+    PDNS_ENTRY entry;
+
+    if (index)
+    {
+        entry = &s_entries[index - 1];
+        Unlink(index);
+        ReleaseDnsName(entry->name);
+    }
+    else
+    {
+        if (!s_free)
+        {
+            PDNS_ENTRY oldest = &s_entries[s_oldest - 1];
+
+            RemoveEntry(FindSlot(oldest->version, oldest->address));
+            s_stats.evicted++;
+            // The chain may have changed under the slot found before.
+            slot = FindSlot(address->version, address->address);
+        }
+
+        index = s_free;
+        entry = &s_entries[index - 1];
+        s_free = entry->next;
+        memcpy(entry->address, address->address, sizeof(entry->address));
+        entry->version = address->version;
+        entry->next = 0;
+        *slot = index;
+        s_stats.entries++;
+    }
+
+    MarkAtomicAdd64(&name->references, 1);
+    entry->name = name;
+    entry->expires = expires;
+    LinkNewest(index);
+}
+
+void AddDnsResponse(const unsigned char* payload, unsigned int length, int tcp, long long now)
+{
+    DNS_RESPONSE response;
+    PDNS_NAME name = NULL;
+    int parsed;
+    int i;
+
+    if (!s_active)
+    {
+        return;
+    }
+
+    // Over TCP the message is behind its length.
+    if (tcp)
+    {
+        if (length < 2 || Read16(payload) + 2u > length)
+        {
+            return;
+        }
+        length = Read16(payload);
+        payload += 2;
+    }
+
+    parsed = ParseDnsResponse(payload, length, &response);
+    if (parsed && response.count)
+    {
+        name = (PDNS_NAME)malloc(offsetof(DNS_NAME, text) + response.length + 1);
+        if (name)
+        {
+            name->references = 1;
+            name->length = response.length;
+            memcpy(name->text, response.name, response.length + 1);
+        }
+    }
+
+    MarkLockAcquire(&s_lock);
+    s_stats.messages++;
+    if (!parsed)
+    {
+        s_stats.malformed++;
+    }
+    if (name)
+    {
+        s_stats.responses++;
+        s_stats.addresses += response.count;
+        for (i = 0; i < response.count; i++)
+        {
+            unsigned int ttl = MIN(MAX(response.addresses[i].ttl, DNS_MIN_TTL), DNS_MAX_TTL);
+
+            Insert(&response.addresses[i], name, now + (long long)ttl * MARK_TIMESTAMP_FREQUENCY);
+        }
+    }
+    MarkLockRelease(&s_lock);
+
+    ReleaseDnsName(name);
+}
+
+PDNS_NAME FindDnsName(unsigned char version, const unsigned char* address, long long now)
+{
+    PDNS_NAME name = NULL;
+    unsigned int* slot;
+
+    if (!s_active)
+    {
+        return NULL;
+    }
+
+    MarkLockAcquire(&s_lock);
+    s_stats.lookups++;
+    slot = FindSlot(version, address);
+    if (*slot)
+    {
+        PDNS_ENTRY entry = &s_entries[*slot - 1];
+
+        if (entry->expires <= now)
+        {
+            RemoveEntry(slot);
+            s_stats.expired++;
+        }
+        else
+        {
+            s_stats.hits++;
+            Unlink(*slot);
+            LinkNewest(*slot);
+            name = entry->name;
+            MarkAtomicAdd64(&name->references, 1);
+        }
+    }
+    MarkLockRelease(&s_lock);
+
+    return name;
+}
+
+void ReleaseDnsName(PDNS_NAME name)
+{
+    if (name && MarkAtomicAdd64(&name->references, -1) == 1)
+    {
+        free(name);
+    }
+}
+
+int StartDnsCache(unsigned int entries)
+{
+    unsigned int buckets = 1024;
+    unsigned int i;
+
+    if (!entries)
+    {
+        entries = DNS_DEFAULT_ENTRIES;
+    }
+    while (buckets < entries && buckets < 0x40000000)
+    {
+        buckets <<= 1;
+    }
+
+    s_entries = (PDNS_ENTRY)calloc(entries, sizeof(DNS_ENTRY));
+    s_buckets = (unsigned int*)calloc(buckets, sizeof(unsigned int));
+    if (!s_entries || !s_buckets)
+    {
+        printf("No memory for a DNS cache of %u entries\n", entries);
+        free(s_entries);
+        free(s_buckets);
+        s_entries = NULL;
+        s_buckets = NULL;
+        return 0;
+    }
+
+    for (i = 0; i < entries; i++)
+    {
+        s_entries[i].next = i + 2 <= entries ? i + 2 : 0;
+    }
+    s_free = 1;
+    s_newest = 0;
+    s_oldest = 0;
+    s_bucketMask = buckets - 1;
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.capacity = entries;
+
+    MarkLockInit(&s_lock);
+    s_active = 1;
+
+    return 1;
+}
+
+void StopDnsCache()
+{
+    unsigned int i;
+
+    if (!s_active)
+    {
+        return;
+    }
+
+    s_active = 0;
+    for (i = 0; i < s_stats.capacity; i++)
+    {
+        ReleaseDnsName(s_entries[i].name);
+    }
+    free(s_entries);
+    free(s_buckets);
+    s_entries = NULL;
+    s_buckets = NULL;
+    MarkLockDelete(&s_lock);
+}
+
+int IsDnsCacheActive()
+{
+    return s_active;
+}
+
+void GetDnsStats(PDNS_STATS stats)
+{
+    if (s_active)
+    {
+        MarkLockAcquire(&s_lock);
+    }
+    *stats = s_stats;
+    if (s_active)
+    {
+        MarkLockRelease(&s_lock);
+    }
+}
+
+void PrintDnsStats()
+{
+    DNS_STATS stats;
+
+    GetDnsStats(&stats);
+    if (!stats.capacity)
+    {
+        return;
+    }
+
+    printf("DNS: %llu messages, %llu responses with %llu addresses, %llu malformed; %llu lookups, %llu named, %llu expired; %u of %u entries, %llu evicted\n",
+        stats.messages, stats.responses, stats.addresses, stats.malformed, stats.lookups, stats.hits, stats.expired,
+        stats.entries, stats.capacity, stats.evicted);
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef _DNSCACHE_H_
+#define _DNSCACHE_H_
+
+// Names the far end of a flow from the DNS answers seen on the wire, with
+// no lookups of its own. The flow tables hand every response from port 53
+// to AddDnsResponse, over UDP, or over TCP when one segment carries the
+// whole message. Its A and AAAA records go into a map from address to name:
+// the name asked for, with the CNAME chain from it to the address followed
+// but not kept. An address is named for the TTL of its record, no less than
+// DNS_MIN_TTL, as the connection a TTL 0 answer was asked for comes after
+// it, and no more than DNS_MAX_TTL. A full map drops the address used least
+// recently. Entries and lookups are under one lock, taken once per answer
+// and once per flow start.
+//
+// A flow keeps the name it started with, whatever the map does after, so
+// its name is counted by references: the map holds one, every flow another.
+//
+// Times are in MarkTimestamp() units on the clock of the packets, as for
+// the flow tables; the tables of a capture file and of a live capture
+// should not share the map.
+
+#define DNS_PORT 53
+#define DNS_DEFAULT_ENTRIES 65536
+#define DNS_MIN_TTL 10       // seconds
+#define DNS_MAX_TTL 86400    // seconds
+#define DNS_MAX_NAME 253     // characters in the dotted form
+#define DNS_MAX_CHAIN 8      // names, the one asked for and the CNAMEs after it
+#define DNS_MAX_ADDRESSES 32 // taken from one response
+
+typedef struct _DNS_NAME
+{
+    volatile long long references;
+    unsigned int length;
+    char text[DNS_MAX_NAME + 1]; // only length + 1 allocated
+} DNS_NAME, *PDNS_NAME;
+
+typedef struct _DNS_ADDRESS
+{
+    unsigned char address[16]; // IPv4 takes the first 4 bytes
+    unsigned char version;
+    unsigned int ttl;          // seconds, as in the record
+} DNS_ADDRESS, *PDNS_ADDRESS;
+
+// What a response says about the name asked for, lower case.
+typedef struct _DNS_RESPONSE
+{
+    char name[DNS_MAX_NAME + 1];
+    unsigned int length;
+    int cnames;
+    int count;
+    DNS_ADDRESS addresses[DNS_MAX_ADDRESSES];
+} DNS_RESPONSE, *PDNS_RESPONSE;
+
+typedef struct _DNS_STATS
+{
+    unsigned long long messages;  // handed over
+    unsigned long long responses; // with addresses for the name asked for
+    unsigned long long malformed;
+    unsigned long long addresses;
+    unsigned long long lookups;
+    unsigned long long hits;
+    unsigned long long expired;   // found but past their TTL
+    unsigned long long evicted;
+    unsigned int entries;
+    unsigned int capacity;
+} DNS_STATS, *PDNS_STATS;
+
+// Takes nothing but the message: no allocation, no lock. Names are followed
+// through compression pointers, which may only point back. Returns 0 for a
+// malformed message; a query, an error, or an answer without addresses
+// returns 1 with no addresses.
+int ParseDnsResponse(const unsigned char* message, unsigned int length, PDNS_RESPONSE response);
+
+// entries is 0 for the default.
+int StartDnsCache(unsigned int entries);
+void StopDnsCache();
+int IsDnsCacheActive();
+
+// The payload of a packet from port 53.
+void AddDnsResponse(const unsigned char* payload, unsigned int length, int tcp, long long now);
+// The name given to the address, with a reference for the caller, or NULL.
+PDNS_NAME FindDnsName(unsigned char version, const unsigned char* address, long long now);
+void ReleaseDnsName(PDNS_NAME name);
+
+void GetDnsStats(PDNS_STATS stats);
+void PrintDnsStats();
+
+#endif
\ No newline at end of file
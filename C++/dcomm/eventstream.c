@@ -0,0 +1,301 @@
+#include "eventstream.h"
+#include "lz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int StreamWriterInit(PSTREAM_WRITER writer, unsigned long capacity)
+{
+    memset(writer, 0, sizeof(*writer));
+
+    if (capacity < sizeof(STREAM_HELLO) + sizeof(STREAM_FRAME) + sizeof(MARK_EVENT))
+    {
+        capacity = sizeof(STREAM_HELLO) + sizeof(STREAM_FRAME) + sizeof(MARK_EVENT);
+    }
+
+    writer->buffer = (unsigned char*)malloc(capacity);
+    if (!writer->buffer)
+    {
+        return 0;
+    }
+    writer->capacity = capacity;
+
+    StreamWriterRestart(writer);
+    return 1;
+}
+
+void StreamWriterFree(PSTREAM_WRITER writer)
+{
+    free(writer->buffer);
+    writer->buffer = NULL;
+}
+
+void StreamWriterRestart(PSTREAM_WRITER writer)
+{
+    writer->hello = 1;
+    writer->sequence = 0;
+    StreamWriterReset(writer);
+}
+
+void StreamWriterReset(PSTREAM_WRITER writer)
+{
+    writer->used = 0;
+
+    if (writer->hello)
+    {
+        PSTREAM_HELLO hello = (PSTREAM_HELLO)writer->buffer;
+
+        hello->magic = STREAM_MAGIC;
+        hello->version = STREAM_VERSION;
+        hello->headerSize = sizeof(STREAM_FRAME);
+        hello->recordSize = sizeof(MARK_EVENT);
+        hello->flags = writer->flags;
+        writer->used = sizeof(STREAM_HELLO);
+    }
+
+    writer->frame = (PSTREAM_FRAME)(writer->buffer + writer->used);
+    writer->frame->length = 0;
+    writer->frame->type = STREAM_FRAME_EVENTS;
+    writer->frame->count = 0;
+    writer->frame->sequence = writer->sequence;
+    writer->used += sizeof(STREAM_FRAME);
+}
+
+int StreamWriterAppend(PSTREAM_WRITER writer, PMARK_EVENT event)
+{
+    if (writer->used + sizeof(MARK_EVENT) > writer->capacity || writer->frame->count == 0xFFFF)
+    {
+        return 0;
+    }
+
+    memcpy(writer->buffer + writer->used, event, sizeof(MARK_EVENT));
+    writer->used += sizeof(MARK_EVENT);
+    writer->frame->length += sizeof(MARK_EVENT);
+    writer->frame->count++;
+    writer->sequence++;
+
+    return 1;
+}
+
+int StreamWriterPending(PSTREAM_WRITER writer)
+{
+    return writer->frame->count;
+}
+
+unsigned long StreamWriterFinish(PSTREAM_WRITER writer)
+{
+    if (!writer->frame->count)
+    {
+        return 0;
+    }
+
+    // Once a frame goes out, the hello has been sent with it.
+    writer->hello = 0;
+    writer->frames++;
+    return writer->used;
+}
+
+unsigned long StreamWriterControl(PSTREAM_WRITER writer, unsigned short type, const void* payload, unsigned long size)
+{
+    return StreamWriterFrame(writer, type, 0, writer->sequence, payload, size);
+}
+
+unsigned long StreamWriterFrame(PSTREAM_WRITER writer, unsigned short type, unsigned short count,
+    unsigned long long sequence, const void* payload, unsigned long size)
+{
+    if (writer->frame->count || writer->used + size > writer->capacity)
+    {
+        return 0;
+    }
+
+    writer->frame->type = type;
+    writer->frame->length = size;
+    writer->frame->count = count;
+    writer->frame->sequence = sequence;
+    if (size)
+    {
+        memcpy(writer->buffer + writer->used, payload, size);
+    }
+    writer->used += size;
+
+    writer->hello = 0;
+    writer->frames++;
+    return writer->used;
+}
+
+int StreamReaderInit(PSTREAM_READER reader, unsigned long capacity)
+{
+    memset(reader, 0, sizeof(*reader));
+
+    reader->buffer = (unsigned char*)malloc(capacity);
+    if (!reader->buffer)
+    {
+        return 0;
+    }
+    reader->capacity = capacity;
+
+    return 1;
+}
+
+void StreamReaderFree(PSTREAM_READER reader)
+{
+    free(reader->buffer);
+    free(reader->inflated);
+    reader->buffer = NULL;
+    reader->inflated = NULL;
+}
+
+unsigned char* StreamReaderSpace(PSTREAM_READER reader, unsigned long* size)
+{
+    if (reader->start == reader->end)
+    {
+        reader->start = reader->end = 0;
+    }
+
+    // Move the partial frame to the front only when the tail runs out, so a
+    // full frame is usually parsed where it landed.
+    if (reader->start && reader->capacity - reader->end < reader->capacity / 4)
+    {
+        memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+
+    *size = reader->capacity - reader->end;
+    return reader->buffer + reader->end;
+}
+
+void StreamReaderCommit(PSTREAM_READER reader, unsigned long size)
+{
+    reader->end += size;
+}
+
+// Makes room for a whole frame of the announced size.
+static int Reserve(PSTREAM_READER reader, unsigned long size)
+{
+    unsigned char* buffer;
+
+    if (size <= reader->capacity)
+    {
+        return 1;
+    }
+
+    buffer = (unsigned char*)malloc(size);
+    if (!buffer)
+    {
+        return 0;
+    }
+
+    memcpy(buffer, reader->buffer + reader->start, reader->end - reader->start);
+    free(reader->buffer);
+    reader->buffer = buffer;
+    reader->capacity = size;
+    reader->end -= reader->start;
+    reader->start = 0;
+
+    return 1;
+}
+
+int StreamReaderNextFrame(PSTREAM_READER reader, PSTREAM_FRAME* frame)
+{
+    unsigned long available = reader->end - reader->start;
+    PSTREAM_FRAME next;
+
+    if (!reader->hello)
+    {
+        if (available < sizeof(STREAM_HELLO))
+        {
+            return STREAM_NEED_MORE;
+        }
+
+        memcpy(&reader->header, reader->buffer + reader->start, sizeof(STREAM_HELLO));
+        if (reader->header.magic != STREAM_MAGIC || reader->header.version != STREAM_VERSION ||
+            reader->header.headerSize != sizeof(STREAM_FRAME) || reader->header.recordSize != sizeof(MARK_EVENT))
+        {
+            return STREAM_ERROR;
+        }
+
+        reader->hello = 1;
+        reader->start += sizeof(STREAM_HELLO);
+        available -= sizeof(STREAM_HELLO);
+    }
+
+    if (available < sizeof(STREAM_FRAME))
+    {
+        return STREAM_NEED_MORE;
+    }
+
+    next = (PSTREAM_FRAME)(reader->buffer + reader->start);
+    if (next->length > STREAM_MAX_FRAME)
+    {
+        return STREAM_ERROR;
+    }
+    if (available < sizeof(STREAM_FRAME) + next->length)
+    {
+        return Reserve(reader, sizeof(STREAM_FRAME) + next->length) ? STREAM_NEED_MORE : STREAM_ERROR;
+    }
+
+    reader->start += sizeof(STREAM_FRAME) + next->length;
+    reader->frames++;
+    *frame = next;
+
+    return STREAM_FRAME_READY;
+}
+
+static int Inflate(PSTREAM_READER reader, PSTREAM_FRAME frame)
+{
+    unsigned long size = frame->count * sizeof(MARK_EVENT);
+
+    if (size > reader->inflatedSize)
+    {
+        unsigned char* inflated = (unsigned char*)realloc(reader->inflated, size);
+
+        if (!inflated)
+        {
+            return 0;
+        }
+        reader->inflated = inflated;
+        reader->inflatedSize = size;
+    }
+
+    return LzDecompress((const unsigned char*)(frame + 1), frame->length, reader->inflated, size) == (int)size;
+}
+
+int StreamReaderNext(PSTREAM_READER reader, PMARK_EVENT* events, int* count)
+{
+    PSTREAM_FRAME frame;
+    int result;
+
+    while ((result = StreamReaderNextFrame(reader, &frame)) == STREAM_FRAME_READY)
+    {
+        if (frame->type == STREAM_FRAME_EVENTS)
+        {
+            if (frame->length != frame->count * sizeof(MARK_EVENT))
+            {
+                return STREAM_ERROR;
+            }
+            *events = (PMARK_EVENT)(frame + 1);
+        }
+        else if (frame->type == STREAM_FRAME_COMPRESSED)
+        {
+            if (!Inflate(reader, frame))
+            {
+                return STREAM_ERROR;
+            }
+            *events = (PMARK_EVENT)reader->inflated;
+        }
+        else
+        {
+            reader->skipped++;
+            continue;
+        }
+
+        *count = frame->count;
+        reader->events += frame->count;
+        reader->sequence = frame->sequence + frame->count;
+
+        return STREAM_EVENTS;
+    }
+
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#ifndef _EVENTSTREAM_H_
+#define _EVENTSTREAM_H_
+
+#include "../sys/core.h"
+
+// Wire format of the event stream from dcomm to its consumers (analyzer,
+// collectors). A stream opens with one STREAM_HELLO and continues with
+// frames, each a STREAM_FRAME header followed by length bytes of payload.
+// Consumers skip frame types they do not know, so new types do not need a
+// version bump; a change to the header layouts or to MARK_EVENT does.
+// Everything is little endian, as written by x86 hosts.
+
+#define STREAM_MAGIC 0x50544B4D // "MKTP"
+#define STREAM_VERSION 1
+
+#define STREAM_FRAME_EVENTS 1     // payload is count whole MARK_EVENT records
+#define STREAM_FRAME_SUBSCRIBE 2  // payload is a STREAM_SUBSCRIPTION, client to broker
+#define STREAM_FRAME_COMPRESSED 3 // payload is count MARK_EVENT records, LZ compressed (lz.h)
+#define STREAM_FRAME_ACK 4        // no payload, sequence is the next one the consumer expects
+#define STREAM_FRAME_ENDPOINT 5   // payload is a STREAM_ENDPOINT, forwarder to collector
+
+// Hello flags. With STREAM_HELLO_ACKS the producer keeps what it sent until
+// the consumer acknowledges it with a STREAM_FRAME_ACK on the same
+// connection, itself a stream with its own hello.
+#define STREAM_HELLO_ACKS 0x1
+
+#define STREAM_DEFAULT_BATCH (256 * 1024) // bytes per frame, header included
+#define STREAM_MAX_FRAME (16 * 1024 * 1024)
+
+typedef struct _STREAM_HELLO
+{
+    unsigned int magic;
+    unsigned short version;
+    unsigned short headerSize; // sizeof(STREAM_FRAME)
+    unsigned int recordSize;   // sizeof(MARK_EVENT)
+    unsigned int flags;
+} STREAM_HELLO, *PSTREAM_HELLO;
+
+typedef struct _STREAM_FRAME
+{
+    unsigned int length; // payload bytes after this header
+    unsigned short type;
+    unsigned short count;
+    unsigned long long sequence; // of the first event, counted from the hello
+} STREAM_FRAME, *PSTREAM_FRAME;
+
+// Who is forwarding, sent once after the hello. Sequences are counted per
+// endpoint and carry on across restarts of its dcomm.
+typedef struct _STREAM_ENDPOINT
+{
+    char name[64];
+} STREAM_ENDPOINT, *PSTREAM_ENDPOINT;
+
+// What a broker client wants to receive (broker.h). An event passes if its
+// opclass and optype bits are set in the masks, a mask of 0 taking every
+// value, and if it passes every predicate that is set. The patterns are
+// case-insensitive and '*' matches any run of characters.
+typedef struct _STREAM_SUBSCRIPTION
+{
+    unsigned int opclasses; // bit (1 << opclass)
+    unsigned int optypes;   // bit (1 << optype)
+    int pid;                // 0 for any
+    unsigned int flags;
+    unsigned short szImagePath[176];
+    unsigned short szOperationPath[256];
+} STREAM_SUBSCRIPTION, *PSTREAM_SUBSCRIPTION;
+
+// Producer side: events are appended to one frame in a flat buffer that is
+// sent as it is. The first frame after StreamWriterInit carries the hello.
+typedef struct _STREAM_WRITER
+{
+    unsigned char* buffer;
+    unsigned long capacity;
+    unsigned long used;
+    PSTREAM_FRAME frame;
+    int hello;
+    unsigned int flags; // of the hello
+    unsigned long long sequence;
+    unsigned long long frames;
+} STREAM_WRITER, *PSTREAM_WRITER;
+
+int StreamWriterInit(PSTREAM_WRITER writer, unsigned long capacity);
+void StreamWriterFree(PSTREAM_WRITER writer);
+// Starts a new stream, hello included, e.g. after a reconnect.
+void StreamWriterRestart(PSTREAM_WRITER writer);
+// Returns 0 if the frame is full; send it, reset and append again.
+int StreamWriterAppend(PSTREAM_WRITER writer, PMARK_EVENT event);
+int StreamWriterPending(PSTREAM_WRITER writer);
+// Closes the frame and returns the bytes to send from writer->buffer, 0 if
+// there is no event to send.
+unsigned long StreamWriterFinish(PSTREAM_WRITER writer);
+void StreamWriterReset(PSTREAM_WRITER writer);
+// Turns the empty frame into one of the given type carrying payload and
+// returns the bytes to send, 0 if events are pending or it does not fit.
+// StreamWriterReset afterwards starts a frame of events again.
+unsigned long StreamWriterControl(PSTREAM_WRITER writer, unsigned short type, const void* payload, unsigned long size);
+// The same with the count and sequence of the frame header given, e.g. for
+// a STREAM_FRAME_COMPRESSED or STREAM_FRAME_ACK.
+unsigned long StreamWriterFrame(PSTREAM_WRITER writer, unsigned short type, unsigned short count,
+    unsigned long long sequence, const void* payload, unsigned long size);
+
+// Consumer side: receive straight into StreamReaderSpace, commit what
+// arrived and take whole frames off with StreamReaderNext. Events are
+// returned in place, valid until the next call; compressed frames are
+// inflated into a buffer of the reader first.
+#define STREAM_NEED_MORE 0
+#define STREAM_EVENTS 1
+#define STREAM_ERROR (-1)
+#define STREAM_FRAME_READY 2
+
+typedef struct _STREAM_READER
+{
+    unsigned char* buffer;
+    unsigned long capacity;
+    unsigned long start;
+    unsigned long end;
+    int hello;
+    STREAM_HELLO header;
+    unsigned char* inflated;
+    unsigned long inflatedSize;
+    unsigned long long sequence; // after the last events returned, what to acknowledge
+    unsigned long long frames;
+    unsigned long long events;
+    unsigned long long skipped; // frames of unknown type
+} STREAM_READER, *PSTREAM_READER;
+
+int StreamReaderInit(PSTREAM_READER reader, unsigned long capacity);
+void StreamReaderFree(PSTREAM_READER reader);
+unsigned char* StreamReaderSpace(PSTREAM_READER reader, unsigned long* size);
+void StreamReaderCommit(PSTREAM_READER reader, unsigned long size);
+int StreamReaderNext(PSTREAM_READER reader, PMARK_EVENT* events, int* count);
+// Takes the next frame of any type; its payload follows the header.
+int StreamReaderNextFrame(PSTREAM_READER reader, PSTREAM_FRAME* frame);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,738 @@
+#include "flowtable.h"
+#include "dnscache.h"
+#include "payloadscan.h"
+#include "platform.h"
+#include "socketowners.h"
+#include "tcpip.h"
+#include "tlshello.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FLOW_FIN_INITIATOR 0x1
+#define FLOW_FIN_RESPONDER 0x2
+
+#define FLOW_HELLO_WAITING 0   // for the initiator's first payload
+#define FLOW_HELLO_GATHERING 1
+#define FLOW_HELLO_DONE 2      // labelled, or not to be
+
+typedef struct _FLOW
+{
+    FLOW_KEY key; // as the initiator sent it
+    long long first;
+    long long last;
+    long long reported; // start or last update
+    unsigned long long packets[2]; // from the initiator, to it
+    unsigned long long bytes[2];
+    unsigned char tcpFlags;
+    unsigned char fins;
+    unsigned char closing;
+    int pid; // owner of the local end, 0 until known
+    PDNS_NAME domain; // referenced
+    unsigned char hello;
+    unsigned int gather; // FLOW_HELLO_GATHER index + 1 while gathering
+    unsigned int label;  // FLOW_LABEL index + 1 once labelled
+    int protocol;        // found by the payload scanner, 0 until then
+    unsigned int inspected[2]; // payload bytes of each direction so far, up to the scan limit
+} FLOW, *PFLOW;
+
+typedef struct _FLOW_HELLO_GATHER
+{
+    unsigned int next; // sequence number of the byte after those held
+    unsigned int length;
+    unsigned char data[FLOW_HELLO_SIZE];
+} FLOW_HELLO_GATHER, *PFLOW_HELLO_GATHER;
+
+typedef struct _FLOW_LABEL
+{
+    char serverName[TLS_MAX_SERVER_NAME + 1];
+    char alpn[TLS_MAX_ALPN + 1];
+} FLOW_LABEL, *PFLOW_LABEL;
+
+// Indexes of the free entries of an array, taken from the top.
+typedef struct _FLOW_POOL
+{
+    unsigned int* free;
+    unsigned int count;
+} FLOW_POOL, *PFLOW_POOL;
+
+struct _FLOW_TABLE
+{
+    unsigned int* hashes; // 0 is a free slot
+    PFLOW flows;
+    unsigned int mask;
+    unsigned int limit; // three quarters of the slots
+    long long idle;
+    long long active;
+    long long close;
+    int owners;
+    int dns;
+    int tls;
+    PFLOW_HELLO_GATHER gathers;
+    FLOW_POOL gatherPool;
+    PFLOW_LABEL labels; // a quarter of the slots
+    FLOW_POOL labelPool;
+    unsigned int inspect;
+    PPAYLOAD_SCANNER scanner;
+    FLOW_EMIT emit;
+    void* context;
+    PFLOW_STATS stats;
+};
+
+FLOW_OPTIONS g_FlowOptions = { FLOW_DEFAULT_CAPACITY, FLOW_DEFAULT_IDLE, FLOW_DEFAULT_ACTIVE, 0, 0, 0, 0 };
+
+#define FLOW_SLOT_UNUSED 0
+#define FLOW_SLOT_TAKEN 1
+#define FLOW_SLOT_RELEASED 2 // the table is gone, its stats are still printed
+
+// Outlive the tables, so the sources can drop theirs when they end. The
+// slot of a destroyed table is taken again once no unused one is left.
+static FLOW_STATS s_stats[MAX_FLOW_TABLES];
+static volatile long long s_slots[MAX_FLOW_TABLES];
+
+static unsigned int Mix(unsigned int hash, unsigned int value)
+{
+    value *= 0xCC9E2D51;
+    value = (value << 15) | (value >> 17);
+    hash ^= value * 0x1B873593;
+    hash = (hash << 13) | (hash >> 19);
+    return hash * 5 + 0xE6546B64;
+}
+
+// The same for both directions of a flow: the lower endpoint goes first.
+static unsigned int HashKey(PFLOW_KEY key)
+{
+    int order = memcmp(key->source, key->destination, sizeof(key->source));
+    int swap = order > 0 || (order == 0 && key->sourcePort > key->destinationPort);
+    const unsigned char* low = swap ? key->destination : key->source;
+    const unsigned char* high = swap ? key->source : key->destination;
+    unsigned int hash = key->protocol;
+    unsigned int word;
+    int i;
+
+    for (i = 0; i < 16; i += 4)
+    {
+        memcpy(&word, low + i, 4);
+        hash = Mix(hash, word);
+        memcpy(&word, high + i, 4);
+        hash = Mix(hash, word);
+    }
+    hash = Mix(hash, swap ? (unsigned int)key->destinationPort << 16 | key->sourcePort
+                          : (unsigned int)key->sourcePort << 16 | key->destinationPort);
+
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35;
+    hash ^= hash >> 16;
+
+    return hash ? hash : 1;
+}
+
+// 0 if the packet goes the way the flow started, 1 the other way, -1 for
+// another flow.
+static int MatchKey(PFLOW_KEY flow, PFLOW_KEY packet)
+{
+    if (flow->protocol != packet->protocol)
+    {
+        return -1;
+    }
+    if (flow->sourcePort == packet->sourcePort && flow->destinationPort == packet->destinationPort &&
+        !memcmp(flow->source, packet->source, sizeof(flow->source)) &&
+        !memcmp(flow->destination, packet->destination, sizeof(flow->destination)))
+    {
+        return 0;
+    }
+    if (flow->sourcePort == packet->destinationPort && flow->destinationPort == packet->sourcePort &&
+        !memcmp(flow->source, packet->destination, sizeof(flow->source)) &&
+        !memcmp(flow->destination, packet->source, sizeof(flow->destination)))
+    {
+        return 1;
+    }
+
+    return -1;
+}
+
+static void FormatAddress(char* buffer, int size, const unsigned char* address, int version, unsigned short port,
+    int withPort)
+{
+    char text[48];
+
+    if (version == 4)
+    {
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "%x:%x:%x:%x:%x:%x:%x:%x",
+            address[0] << 8 | address[1], address[2] << 8 | address[3], address[4] << 8 | address[5],
+            address[6] << 8 | address[7], address[8] << 8 | address[9], address[10] << 8 | address[11],
+            address[12] << 8 | address[13], address[14] << 8 | address[15]);
+    }
+
+    if (!withPort)
+    {
+        snprintf(buffer, size, "%s", text);
+    }
+    else
+    {
+        snprintf(buffer, size, version == 4 ? "%s:%u" : "[%s]:%u", text, port);
+    }
+}
+
+// A socket opened since the last snapshot is missed at the flow start;
+// every later report looks again until the owner is found.
+static void SetOwner(PFLOW flow, PMARK_EVENT evt)
+{
+    MARK_PROCESS process;
+
+    if (!flow->pid)
+    {
+        flow->pid = FindSocketOwner(&flow->key);
+    }
+    if (!flow->pid)
+    {
+        return;
+    }
+
+    evt->pid = flow->pid;
+    if (GetOwnerProcess(flow->pid, &process))
+    {
+        evt->ppid = process.ppid;
+        memcpy(evt->szProcessName, process.szProcessName, sizeof(evt->szProcessName));
+        memcpy(evt->szUserName, process.szUserName, sizeof(evt->szUserName));
+        memcpy(evt->szImagePath, process.szImagePath, sizeof(evt->szImagePath));
+    }
+}
+
+static void Report(PFLOW_TABLE table, PFLOW flow, int optype)
+{
+    MARK_EVENT evt;
+    char text[256];
+    char source[64];
+    char destination[64];
+    const char* protocol;
+    char other[16];
+    int length;
+    int ports = flow->key.protocol != IP_PROTO_ICMP && flow->key.protocol != IP_PROTO_ICMPV6;
+
+    switch (flow->key.protocol)
+    {
+    case IP_PROTO_TCP:
+        protocol = "TCP";
+        break;
+    case IP_PROTO_UDP:
+        protocol = "UDP";
+        break;
+    case IP_PROTO_ICMP:
+    case IP_PROTO_ICMPV6:
+        protocol = "ICMP";
+        break;
+    default:
+        snprintf(other, sizeof(other), "IP%u", flow->key.protocol);
+        protocol = other;
+        break;
+    }
+
+    FormatAddress(source, sizeof(source), flow->key.source, flow->key.version, flow->key.sourcePort, ports);
+    FormatAddress(destination, sizeof(destination), flow->key.destination, flow->key.version, flow->key.destinationPort,
+        ports);
+    length = snprintf(text, sizeof(text), "%s %s -> %s packets %llu/%llu bytes %llu/%llu%s%s", protocol, source,
+        destination, flow->packets[0], flow->packets[1], flow->bytes[0], flow->bytes[1],
+        flow->domain ? " domain " : "", flow->domain ? flow->domain->text : "");
+    if (flow->label && length > 0 && length < (int)sizeof(text))
+    {
+        PFLOW_LABEL label = &table->labels[flow->label - 1];
+
+        length += snprintf(text + length, sizeof(text) - length, "%s%s%s%s", label->serverName[0] ? " sni " : "",
+            label->serverName, label->alpn[0] ? " alpn " : "", label->alpn);
+    }
+    if (flow->protocol && length > 0 && length < (int)sizeof(text))
+    {
+        snprintf(text + length, sizeof(text) - length, " proto %s", GetPayloadProtocolName(flow->protocol));
+    }
+
+    memset(&evt, 0, sizeof(evt));
+    evt.opclass = MARK_OPCLASS_PACKET;
+    evt.optype = optype;
+    evt.flags = flow->tcpFlags;
+    MARK_SET_TEXT(evt.szOperationPath, text);
+    if (table->owners)
+    {
+        SetOwner(flow, &evt);
+    }
+
+    table->emit(&evt, table->context);
+}
+
+static int CreatePool(PFLOW_POOL pool, unsigned int count)
+{
+    pool->free = (unsigned int*)malloc((size_t)count * sizeof(unsigned int));
+    if (!pool->free)
+    {
+        return 0;
+    }
+    for (pool->count = 0; pool->count < count; pool->count++)
+    {
+        pool->free[pool->count] = count - 1 - pool->count;
+    }
+
+    return 1;
+}
+
+// An index + 1, or 0 with none left.
+static unsigned int TakeFromPool(PFLOW_POOL pool)
+{
+    return pool->count ? pool->free[--pool->count] + 1 : 0;
+}
+
+static void ReturnToPool(PFLOW_POOL pool, unsigned int taken)
+{
+    if (taken)
+    {
+        pool->free[pool->count++] = taken - 1;
+    }
+}
+
+static void FreeTable(PFLOW_TABLE table)
+{
+    MarkAlignedFree(table->hashes);
+    free(table->flows);
+    free(table->gathers);
+    free(table->gatherPool.free);
+    free(table->labels);
+    free(table->labelPool.free);
+    DestroyPayloadScanner(table->scanner);
+    free(table);
+}
+
+// Returns -1 with no slot in that state.
+static int TakeSlot(long long state)
+{
+    int i;
+
+    for (i = 0; i < MAX_FLOW_TABLES; i++)
+    {
+        if (MarkAtomicCas64(&s_slots[i], FLOW_SLOT_TAKEN, state) == state)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+PFLOW_TABLE FlowTableCreate(const char* name, PFLOW_OPTIONS options, FLOW_EMIT emit, void* context)
+{
+    PFLOW_TABLE table;
+    unsigned int slots = 1024;
+    int index;
+
+    if (!options)
+    {
+        options = &g_FlowOptions;
+    }
+
+    while (slots < options->capacity && slots < 0x40000000)
+    {
+        slots <<= 1;
+    }
+
+    table = (PFLOW_TABLE)calloc(1, sizeof(FLOW_TABLE));
+    if (!table)
+    {
+        return NULL;
+    }
+    table->hashes = (unsigned int*)MarkAlignedAlloc(slots * sizeof(unsigned int), 64);
+    table->flows = (PFLOW)malloc((size_t)slots * sizeof(FLOW));
+    if (!table->hashes || !table->flows)
+    {
+        printf("No memory for a flow table of %u slots\n", slots);
+        FreeTable(table);
+        return NULL;
+    }
+    if (options->tls)
+    {
+        table->gathers = (PFLOW_HELLO_GATHER)malloc(FLOW_HELLO_BUFFERS * sizeof(FLOW_HELLO_GATHER));
+        table->labels = (PFLOW_LABEL)malloc((size_t)(slots / 4) * sizeof(FLOW_LABEL));
+        if (!table->gathers || !table->labels || !CreatePool(&table->gatherPool, FLOW_HELLO_BUFFERS) ||
+            !CreatePool(&table->labelPool, slots / 4))
+        {
+            printf("No memory for the TLS labels of a flow table of %u slots\n", slots);
+            FreeTable(table);
+            return NULL;
+        }
+    }
+    if (options->inspect && !(table->scanner = CreatePayloadScanner()))
+    {
+        printf("No memory for the payload scanner of a flow table\n");
+        FreeTable(table);
+        return NULL;
+    }
+    index = TakeSlot(FLOW_SLOT_UNUSED);
+    if (index < 0)
+    {
+        index = TakeSlot(FLOW_SLOT_RELEASED);
+    }
+    if (index < 0)
+    {
+        printf("No more than %d flow tables at a time\n", MAX_FLOW_TABLES);
+        FreeTable(table);
+        return NULL;
+    }
+    memset(table->hashes, 0, slots * sizeof(unsigned int));
+
+    table->mask = slots - 1;
+    table->limit = slots - slots / 4;
+    table->idle = (long long)(options->idle > 0 ? options->idle : FLOW_DEFAULT_IDLE) * MARK_TIMESTAMP_FREQUENCY;
+    table->active = (long long)(options->active > 0 ? options->active : FLOW_DEFAULT_ACTIVE) * MARK_TIMESTAMP_FREQUENCY;
+    table->close = MIN((long long)FLOW_CLOSE_TIMEOUT * MARK_TIMESTAMP_FREQUENCY, table->idle);
+    table->owners = options->owners;
+    table->dns = options->dns;
+    table->tls = options->tls;
+    table->inspect = options->inspect;
+    table->emit = emit;
+    table->context = context;
+
+    table->stats = &s_stats[index];
+    memset(table->stats, 0, sizeof(FLOW_STATS));
+    table->stats->name = name;
+    table->stats->capacity = slots;
+
+    return table;
+}
+
+static void ReleaseFlow(PFLOW_TABLE table, PFLOW flow)
+{
+    ReleaseDnsName(flow->domain);
+    if (table->tls)
+    {
+        ReturnToPool(&table->gatherPool, flow->gather);
+        ReturnToPool(&table->labelPool, flow->label);
+    }
+}
+
+static void Remove(PFLOW_TABLE table, unsigned int slot)
+{
+    unsigned int next = slot;
+
+    ReleaseFlow(table, &table->flows[slot]);
+
+    // Backward shift: pull later entries of the probe chain into the hole
+    // unless that would put them before their home slot.
+    while (1)
+    {
+        unsigned int home;
+
+        next = (next + 1) & table->mask;
+        if (!table->hashes[next])
+        {
+            break;
+        }
+
+        home = table->hashes[next] & table->mask;
+        if (((next - home) & table->mask) >= ((next - slot) & table->mask))
+        {
+            table->hashes[slot] = table->hashes[next];
+            table->flows[slot] = table->flows[next];
+            slot = next;
+        }
+    }
+
+    table->hashes[slot] = 0;
+    table->stats->active--;
+}
+
+static void SetLabel(PFLOW_TABLE table, PFLOW flow, PTLS_HELLO hello)
+{
+    PFLOW_LABEL label;
+
+    flow->label = TakeFromPool(&table->labelPool);
+    if (!flow->label)
+    {
+        table->stats->unlabelled++;
+        return;
+    }
+
+    label = &table->labels[flow->label - 1];
+    memcpy(label->serverName, hello->serverName, sizeof(label->serverName));
+    memcpy(label->alpn, hello->alpn, sizeof(label->alpn));
+    table->stats->hellos++;
+}
+
+// The initiator's payload, in sequence from its first byte. A hello in one
+// segment is parsed where it lies; a longer one is copied into a buffer
+// until it is whole. Retransmitted bytes are skipped, a gap gives up.
+static void ReadHello(PFLOW_TABLE table, PFLOW flow, PPACKET_INFO packet)
+{
+    PFLOW_HELLO_GATHER gather;
+    TLS_HELLO hello;
+    unsigned int skip;
+    unsigned int length;
+    int result;
+
+    if (flow->hello == FLOW_HELLO_WAITING)
+    {
+        result = ParseClientHello(packet->payload, packet->payloadLength, &hello);
+        if (result == TLS_HELLO_FOUND)
+        {
+            SetLabel(table, flow, &hello);
+        }
+        else if (result == TLS_HELLO_PARTIAL && hello.needed <= FLOW_HELLO_SIZE &&
+            (flow->gather = TakeFromPool(&table->gatherPool)))
+        {
+            gather = &table->gathers[flow->gather - 1];
+            memcpy(gather->data, packet->payload, packet->payloadLength);
+            gather->length = packet->payloadLength;
+            gather->next = packet->sequence + packet->payloadLength;
+            flow->hello = FLOW_HELLO_GATHERING;
+            return;
+        }
+        else if (result == TLS_HELLO_PARTIAL)
+        {
+            table->stats->unlabelled++;
+        }
+        flow->hello = FLOW_HELLO_DONE;
+        return;
+    }
+
+    gather = &table->gathers[flow->gather - 1];
+    skip = gather->next - packet->sequence;
+    if (skip >= packet->payloadLength)
+    {
+        // Wholly retransmitted, or (as the difference wraps) after a gap.
+        if ((int)skip >= 0)
+        {
+            return;
+        }
+        table->stats->unlabelled++;
+    }
+    else
+    {
+        length = MIN(packet->payloadLength - skip, FLOW_HELLO_SIZE - gather->length);
+        memcpy(gather->data + gather->length, packet->payload + skip, length);
+        gather->length += length;
+        gather->next += length;
+
+        result = ParseClientHello(gather->data, gather->length, &hello);
+        if (result == TLS_HELLO_PARTIAL && hello.needed <= FLOW_HELLO_SIZE)
+        {
+            return;
+        }
+        if (result == TLS_HELLO_FOUND)
+        {
+            SetLabel(table, flow, &hello);
+            table->stats->gathered++;
+        }
+        else
+        {
+            table->stats->unlabelled++;
+        }
+    }
+
+    ReturnToPool(&table->gatherPool, flow->gather);
+    flow->gather = 0;
+    flow->hello = FLOW_HELLO_DONE;
+}
+
+void FlowTableAdd(PFLOW_TABLE table, PPACKET_INFO packet, long long now)
+{
+    unsigned int hash = HashKey(&packet->key);
+    unsigned int slot = hash & table->mask;
+    PFLOW flow;
+    int direction = 0;
+    int created = 0;
+
+    table->stats->packets++;
+    table->stats->bytes += packet->length;
+
+    if (table->dns && packet->key.sourcePort == DNS_PORT && packet->payloadLength &&
+        (packet->key.protocol == IP_PROTO_UDP || packet->key.protocol == IP_PROTO_TCP))
+    {
+        AddDnsResponse(packet->payload, packet->payloadLength, packet->key.protocol == IP_PROTO_TCP, now);
+    }
+
+    while (table->hashes[slot])
+    {
+        if (table->hashes[slot] == hash && (direction = MatchKey(&table->flows[slot].key, &packet->key)) >= 0)
+        {
+            break;
+        }
+        slot = (slot + 1) & table->mask;
+        table->stats->probes++;
+    }
+
+    flow = &table->flows[slot];
+    if (!table->hashes[slot])
+    {
+        if (table->stats->active >= table->limit)
+        {
+            table->stats->untracked++;
+            return;
+        }
+
+        table->hashes[slot] = hash;
+        memset(flow, 0, sizeof(*flow));
+        flow->key = packet->key;
+        flow->first = flow->reported = now;
+        direction = 0;
+        created = 1;
+        if (table->dns)
+        {
+            flow->domain = FindDnsName(flow->key.version, flow->key.destination, now);
+            if (!flow->domain)
+            {
+                flow->domain = FindDnsName(flow->key.version, flow->key.source, now);
+            }
+        }
+
+        table->stats->started++;
+        table->stats->active++;
+        table->stats->maxActive = MAX(table->stats->maxActive, table->stats->active);
+    }
+
+    flow->packets[direction]++;
+    flow->bytes[direction] += packet->length;
+    flow->tcpFlags |= packet->tcpFlags;
+    flow->last = now;
+
+    if (table->tls && flow->hello != FLOW_HELLO_DONE && !direction && packet->payloadLength &&
+        packet->key.protocol == IP_PROTO_TCP)
+    {
+        ReadHello(table, flow, packet);
+    }
+    if (table->inspect && !flow->protocol && flow->inspected[direction] < table->inspect && packet->payloadLength)
+    {
+        flow->protocol = ScanPayload(table->scanner, packet->key.protocol, packet->payload, packet->payloadLength,
+            flow->inspected[direction], table->inspect);
+        flow->inspected[direction] += MIN(packet->payloadLength, table->inspect - flow->inspected[direction]);
+        table->stats->inspected++;
+        if (flow->protocol)
+        {
+            table->stats->identified++;
+        }
+    }
+
+    if (packet->tcpFlags & TCP_FLAG_FIN)
+    {
+        flow->fins |= direction ? FLOW_FIN_RESPONDER : FLOW_FIN_INITIATOR;
+    }
+    if ((packet->tcpFlags & TCP_FLAG_RST) || flow->fins == (FLOW_FIN_INITIATOR | FLOW_FIN_RESPONDER))
+    {
+        flow->closing = 1;
+    }
+
+    if (created)
+    {
+        Report(table, flow, MARK_OPTYPE_CREATE);
+    }
+}
+
+void FlowTableExpire(PFLOW_TABLE table, long long now)
+{
+    unsigned int slot = 0;
+
+    while (slot <= table->mask)
+    {
+        PFLOW flow = &table->flows[slot];
+
+        if (!table->hashes[slot])
+        {
+            slot++;
+            continue;
+        }
+
+        if (now - flow->last >= (flow->closing ? table->close : table->idle))
+        {
+            Report(table, flow, MARK_OPTYPE_DESTROY);
+            table->stats->ended++;
+            // The slot may hold a shifted flow now, look again.
+            Remove(table, slot);
+            continue;
+        }
+
+        if (now - flow->reported >= table->active)
+        {
+            Report(table, flow, MARK_OPTYPE_WRITE);
+            table->stats->updated++;
+            flow->reported = now;
+        }
+        slot++;
+    }
+}
+
+void FlowTableFlush(PFLOW_TABLE table)
+{
+    unsigned int slot;
+
+    for (slot = 0; slot <= table->mask; slot++)
+    {
+        if (table->hashes[slot])
+        {
+            Report(table, &table->flows[slot], MARK_OPTYPE_DESTROY);
+            table->stats->ended++;
+            ReleaseFlow(table, &table->flows[slot]);
+            table->hashes[slot] = 0;
+        }
+    }
+    table->stats->active = 0;
+}
+
+void FlowTableDestroy(PFLOW_TABLE table)
+{
+    if (!table)
+    {
+        return;
+    }
+
+    FlowTableFlush(table);
+    MarkAtomicStore64(&s_slots[table->stats - s_stats], FLOW_SLOT_RELEASED);
+    FreeTable(table);
+}
+
+int IsFlowPayloadWanted(PFLOW_OPTIONS options)
+{
+    if (!options)
+    {
+        options = &g_FlowOptions;
+    }
+
+    return options->dns || options->tls || options->inspect;
+}
+
+void GetFlowStats(PFLOW_TABLE table, PFLOW_STATS stats)
+{
+    *stats = *table->stats;
+}
+
+void PrintFlowStats()
+{
+    int i;
+
+    for (i = 0; i < MAX_FLOW_TABLES; i++)
+    {
+        PFLOW_STATS stats = &s_stats[i];
+
+        if (MarkAtomicLoad64(&s_slots[i]) == FLOW_SLOT_UNUSED)
+        {
+            continue;
+        }
+
+        printf("Flows %s: %llu packets in %llu flows, %llu updates, %llu ended, %u open (max %u of %u), "
+               "%llu untracked, %.2f probes per packet\n",
+            stats->name, stats->packets, stats->started, stats->updated, stats->ended, stats->active,
+            stats->maxActive, stats->capacity, stats->untracked,
+            stats->packets ? (double)stats->probes / stats->packets : 0.0);
+        if (stats->hellos || stats->unlabelled)
+        {
+            printf("Flows %s: %llu ClientHellos labelled, %llu of them gathered, %llu unlabelled\n", stats->name,
+                stats->hellos, stats->gathered, stats->unlabelled);
+        }
+        if (stats->inspected)
+        {
+            printf("Flows %s: %llu payloads scanned, %llu flows identified\n", stats->name, stats->inspected,
+                stats->identified);
+        }
+    }
+}
\ No newline at end of file
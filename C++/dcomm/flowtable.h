@@ -0,0 +1,104 @@
+#ifndef _FLOWTABLE_H_
+#define _FLOWTABLE_H_
+
+#include "packetdecode.h"
+#include "sources.h"
+
+// Folds captured packets into flows, one table per capture thread so no
+// locks are taken. A flow is keyed by its 5-tuple in either direction; the
+// side of its first packet is the initiator. A table reports a flow three
+// ways, all MARK_OPCLASS_PACKET events:
+//   MARK_OPTYPE_CREATE  on its first packet
+//   MARK_OPTYPE_WRITE   every active timeout while it lasts
+//   MARK_OPTYPE_DESTROY after the idle timeout, shortly after a RST or both
+//                       FINs, or when the table is flushed
+// with the TCP flags seen so far in flags and the totals in the path:
+//   TCP 10.0.0.1:1234 -> 1.2.3.4:80 packets 12/10 bytes 1840/9620
+// the first count of each pair being the initiator's. With the DNS cache
+// on, the tables feed it the responses they see, and a flow whose responder
+// (or else initiator) had a name when the flow started carries it after:
+//   TCP 10.0.0.1:1234 -> 1.2.3.4:443 packets 12/10 bytes 1840/9620 domain example.com
+// With TLS labelling on, a TCP flow whose initiator opens with a ClientHello
+// carries the server name and the protocols it offers, see tlshello.h:
+//   ... bytes 1840/9620 sni www.example.com alpn h2,http/1.1
+// A ClientHello longer than its first segment is gathered in one of a few
+// buffers of the table, in sequence; a gap or a hello too long for the
+// buffer, or no buffer free, leave the flow without a label.
+// With payload inspection on, the first bytes of each direction are
+// scanned for protocol signatures, see payloadscan.h, and a flow found to
+// be one carries it after the rest:
+//   UDP 10.0.0.1:6881 -> 5.6.7.8:51413 packets 1/1 bytes 142/373 proto bittorrent-dht
+//
+// Slots are found by linear probing in an array of 32 bit hashes, 16 to a
+// cache line, and only a matching hash touches the flow itself. Removal
+// shifts the following entries back, so there are no tombstones.
+
+#define FLOW_DEFAULT_CAPACITY 65536 // slots, rounded up to a power of two
+#define FLOW_DEFAULT_IDLE 15        // seconds without a packet before a flow ends
+#define FLOW_DEFAULT_ACTIVE 60      // seconds between updates of a long flow
+#define FLOW_CLOSE_TIMEOUT 2        // seconds left to a closed TCP flow for its last ACKs
+#define FLOW_EXPIRE_INTERVAL 1      // seconds between FlowTableExpire calls by the sources
+#define MAX_FLOW_TABLES MAX_SOURCES // at a time, a table belongs to one source
+#define FLOW_HELLO_BUFFERS 64  // ClientHellos gathered at once per table
+#define FLOW_HELLO_SIZE 4096   // bytes a gathered ClientHello may take
+
+typedef struct _FLOW_OPTIONS
+{
+    unsigned int capacity;
+    int idle;   // seconds
+    int active; // seconds
+    int owners; // fill in the process of the local end, see socketowners.h; live captures only
+    int dns;    // name the flows from the DNS responses seen, see dnscache.h
+    int tls;    // label TCP flows with the SNI and ALPN of their ClientHello
+    unsigned int inspect; // bytes of each direction scanned for protocol signatures, 0 for none
+} FLOW_OPTIONS, *PFLOW_OPTIONS;
+
+extern FLOW_OPTIONS g_FlowOptions;
+
+// Finished by the callback, which stamps the event time and submits it.
+typedef void (*FLOW_EMIT)(PMARK_EVENT event, void* context);
+
+typedef struct _FLOW_STATS
+{
+    const char* name;
+    unsigned long long packets;
+    unsigned long long bytes;
+    unsigned long long started;
+    unsigned long long updated;
+    unsigned long long ended;
+    unsigned long long untracked;  // packets of new flows while the table was full
+    unsigned long long probes;     // slots looked at beyond the first
+    unsigned long long hellos;     // ClientHellos read
+    unsigned long long gathered;   // of them, from more than one segment
+    unsigned long long unlabelled; // ClientHellos given up
+    unsigned long long inspected;  // payloads scanned for protocol signatures
+    unsigned long long identified; // flows a signature was found in
+    unsigned int active;
+    unsigned int maxActive;
+    unsigned int capacity;
+} FLOW_STATS, *PFLOW_STATS;
+
+typedef struct _FLOW_TABLE FLOW_TABLE, *PFLOW_TABLE;
+
+// Whether the tables look into payloads, so a source that copies its
+// packets has to keep more than their headers.
+int IsFlowPayloadWanted(PFLOW_OPTIONS options);
+
+// A NULL options pointer takes g_FlowOptions. The name is kept, not copied.
+PFLOW_TABLE FlowTableCreate(const char* name, PFLOW_OPTIONS options, FLOW_EMIT emit, void* context);
+// Ends the flows still open, then frees the table. Its stats stay for
+// PrintFlowStats.
+void FlowTableDestroy(PFLOW_TABLE table);
+
+// now is in MarkTimestamp() units on any clock, as long as the table only
+// ever sees the one.
+void FlowTableAdd(PFLOW_TABLE table, PPACKET_INFO packet, long long now);
+// Ends idle flows and reports long ones. Cheap enough to call every second.
+void FlowTableExpire(PFLOW_TABLE table, long long now);
+void FlowTableFlush(PFLOW_TABLE table);
+
+void GetFlowStats(PFLOW_TABLE table, PFLOW_STATS stats);
+// Every table created so far, destroyed ones included.
+void PrintFlowStats();
+
+#endif
\ No newline at end of file
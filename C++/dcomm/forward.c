@@ -0,0 +1,464 @@
+#include "forward.h"
+#include "eventstream.h"
+#include "platform.h"
+#include "spool.h"
+#include "transport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Events are collected into batches on the sink worker and every batch goes
+// into the disk spool (spool.h) as one compressed block. A sender thread
+// reads the spool in sequence order and sends each block as it is, in a
+// STREAM_FRAME_COMPRESSED frame, keeping up to FORWARD_WINDOW batches ahead
+// of the collector's acknowledgements, which a second thread per connection
+// reads and hands to the spool. After a reconnect the sender starts over at
+// the oldest unacknowledged block, so the spool rides out collector outages
+// and dcomm restarts, and the collector may see a batch more than once.
+
+static const char* s_address = NULL;
+static int s_batch = FORWARD_DEFAULT_BATCH;
+static int s_linger = FORWARD_DEFAULT_LINGER;
+static PSPOOL s_spool = NULL;
+
+// Sink worker
+static PMARK_EVENT s_events = NULL;
+static int s_count = 0;
+static unsigned long long s_oldest = 0;
+static int s_failed = 0;
+
+// Sender. s_lock guards the connection state shared with the ack reader
+// and StopForward; s_wake is signalled on new blocks, acks and errors, and
+// s_generation counts the signals so that none is missed.
+static MARK_LOCK s_lock;
+static MARK_COND s_wake;
+static unsigned long long s_generation = 0;
+static MARK_THREAD s_sender;
+static MARK_THREAD s_reader;
+static PTRANSPORT s_transport = NULL;
+static volatile int s_stopping = 0;
+static int s_broken = 0;
+static unsigned long long s_acked = 0;   // as far as this connection knows
+static unsigned long long s_sent = 0;    // next sequence to send
+static unsigned long long s_highest = 0; // ever sent, to count resends
+static unsigned char* s_frame = NULL;
+static unsigned long s_frameCapacity = 0;
+static STREAM_ENDPOINT s_endpoint;
+
+static FORWARD_STATS s_stats;
+static SPOOL_STATS s_spoolStats; // as the spool was closed
+
+// Under s_lock.
+static void Signal()
+{
+    s_generation++;
+    MarkCondWakeAll(&s_wake);
+}
+
+static MARK_THREAD_PROC(AckThread, parameter)
+{
+    PTRANSPORT transport = (PTRANSPORT)parameter;
+    STREAM_READER reader;
+    PSTREAM_FRAME frame;
+
+    if (!StreamReaderInit(&reader, sizeof(STREAM_HELLO) + 64 * sizeof(STREAM_FRAME)))
+    {
+        MarkLockAcquire(&s_lock);
+        s_broken = 1;
+        Signal();
+        MarkLockRelease(&s_lock);
+        return 0;
+    }
+
+    while (1)
+    {
+        int next = StreamReaderNextFrame(&reader, &frame);
+
+        if (next == STREAM_FRAME_READY)
+        {
+            if (frame->type == STREAM_FRAME_ACK)
+            {
+                SpoolAck(s_spool, frame->sequence);
+
+                MarkLockAcquire(&s_lock);
+                s_stats.acks++;
+                if (frame->sequence > s_acked)
+                {
+                    s_acked = frame->sequence;
+                }
+                Signal();
+                MarkLockRelease(&s_lock);
+            }
+            continue;
+        }
+        if (next == STREAM_ERROR)
+        {
+            printf("Invalid acknowledgement stream from %s\n", s_address);
+            break;
+        }
+
+        unsigned long space;
+        unsigned char* buffer = StreamReaderSpace(&reader, &space);
+        long received = TransportReceive(transport, buffer, space);
+
+        if (received <= 0)
+        {
+            break;
+        }
+        StreamReaderCommit(&reader, (unsigned long)received);
+    }
+
+    StreamReaderFree(&reader);
+
+    MarkLockAcquire(&s_lock);
+    s_broken = 1;
+    Signal();
+    MarkLockRelease(&s_lock);
+
+    return 0;
+}
+
+// Opens the connection with the hello and the endpoint frame and starts
+// over at the oldest block the spool still holds.
+static int Connect()
+{
+    PTRANSPORT transport = TransportConnect(s_address);
+    STREAM_WRITER writer;
+    SPOOL_STATS spool;
+    unsigned long size;
+    int sent;
+
+    if (!transport)
+    {
+        return 0;
+    }
+
+    if (!StreamWriterInit(&writer, sizeof(STREAM_HELLO) + sizeof(STREAM_FRAME) + sizeof(STREAM_ENDPOINT)))
+    {
+        TransportClose(transport);
+        return 0;
+    }
+    writer.flags = STREAM_HELLO_ACKS;
+    StreamWriterRestart(&writer);
+    size = StreamWriterControl(&writer, STREAM_FRAME_ENDPOINT, &s_endpoint, sizeof(s_endpoint));
+    sent = size && TransportSend(transport, writer.buffer, size);
+    StreamWriterFree(&writer);
+
+    GetSpoolStats(s_spool, &spool);
+
+    MarkLockAcquire(&s_lock);
+    s_transport = transport;
+    s_broken = 0;
+    s_acked = spool.acked;
+    s_sent = spool.acked;
+    MarkLockRelease(&s_lock);
+
+    if (!sent || !MarkThreadStart(&s_reader, AckThread, transport))
+    {
+        MarkLockAcquire(&s_lock);
+        s_transport = NULL;
+        MarkLockRelease(&s_lock);
+        TransportClose(transport);
+        return 0;
+    }
+
+    s_stats.connects++;
+    printf("Forwarding to %s from sequence %llu\n", s_address, spool.acked);
+
+    return 1;
+}
+
+static void Disconnect()
+{
+    PTRANSPORT transport = s_transport;
+
+    TransportShutdown(transport);
+    MarkThreadJoin(s_reader);
+
+    MarkLockAcquire(&s_lock);
+    s_transport = NULL;
+    MarkLockRelease(&s_lock);
+
+    TransportClose(transport);
+}
+
+// Sends the next spool block. Returns 0 if there is nothing to send yet or
+// the window is full.
+static int SendBlock()
+{
+    SEGMENT_BLOCK_HEADER header;
+    PSTREAM_FRAME frame;
+    unsigned char* data;
+    unsigned long size;
+
+    MarkLockAcquire(&s_lock);
+    if (s_sent - s_acked >= (unsigned long long)FORWARD_WINDOW * s_batch)
+    {
+        MarkLockRelease(&s_lock);
+        return 0;
+    }
+    MarkLockRelease(&s_lock);
+
+    data = SpoolRead(s_spool, s_sent, &header);
+    if (!data)
+    {
+        return 0;
+    }
+
+    size = sizeof(STREAM_FRAME) + header.compressedSize;
+    if (size > s_frameCapacity)
+    {
+        unsigned char* grown = (unsigned char*)realloc(s_frame, size);
+
+        if (!grown)
+        {
+            return 0;
+        }
+        s_frame = grown;
+        s_frameCapacity = size;
+    }
+
+    frame = (PSTREAM_FRAME)s_frame;
+    frame->length = header.compressedSize;
+    frame->type = STREAM_FRAME_COMPRESSED;
+    frame->count = (unsigned short)header.count;
+    frame->sequence = header.firstSequence;
+    memcpy(frame + 1, data, header.compressedSize);
+
+    if (!TransportSend(s_transport, s_frame, size))
+    {
+        MarkLockAcquire(&s_lock);
+        s_broken = 1;
+        MarkLockRelease(&s_lock);
+        return 0;
+    }
+
+    s_stats.frames++;
+    s_stats.events += header.count;
+    s_stats.bytes += header.compressedSize;
+    if (header.firstSequence < s_highest)
+    {
+        s_stats.resent += MIN(header.count, s_highest - header.firstSequence);
+    }
+    s_highest = MAX(s_highest, header.firstSequence + header.count);
+
+    MarkLockAcquire(&s_lock);
+    s_sent = header.firstSequence + header.count;
+    MarkLockRelease(&s_lock);
+
+    return 1;
+}
+
+static MARK_THREAD_PROC(SenderThread, parameter)
+{
+    UNREFERENCED_PARAMETER(parameter);
+
+    while (!s_stopping)
+    {
+        unsigned long long seen;
+
+        if (!s_transport && !Connect())
+        {
+            MarkLockAcquire(&s_lock);
+            if (!s_stopping)
+            {
+                MarkCondWait(&s_wake, &s_lock, FORWARD_RETRY_INTERVAL);
+            }
+            MarkLockRelease(&s_lock);
+            continue;
+        }
+
+        MarkLockAcquire(&s_lock);
+        seen = s_generation;
+        MarkLockRelease(&s_lock);
+
+        if (SendBlock())
+        {
+            continue;
+        }
+
+        MarkLockAcquire(&s_lock);
+        if (s_broken)
+        {
+            MarkLockRelease(&s_lock);
+            printf("Lost the collector %s, %llu events not acknowledged\n", s_address, s_sent - s_acked);
+            Disconnect();
+            continue;
+        }
+        if (!s_stopping && seen == s_generation)
+        {
+            // New blocks and acks wake us; the timeout is only a safety net.
+            MarkCondWait(&s_wake, &s_lock, FORWARD_RETRY_INTERVAL);
+        }
+        MarkLockRelease(&s_lock);
+    }
+
+    if (s_transport)
+    {
+        Disconnect();
+    }
+
+    return 0;
+}
+
+int StartForward(const char* address, const char* spool, unsigned long long limit, int batch, int linger)
+{
+    SPOOL_STATS stats;
+
+    s_address = address ? address : FORWARD_DEFAULT_ADDRESS;
+    s_batch = batch > 0 ? MIN(batch, FORWARD_MAX_BATCH) : FORWARD_DEFAULT_BATCH;
+    s_linger = linger;
+    spool = spool ? spool : SPOOL_DEFAULT_DIRECTORY;
+
+    s_events = (PMARK_EVENT)malloc(s_batch * sizeof(MARK_EVENT));
+    if (!s_events)
+    {
+        return 0;
+    }
+
+    s_spool = SpoolOpen(spool, (limit ? limit : SPOOL_DEFAULT_LIMIT) * 1024 * 1024);
+    if (!s_spool)
+    {
+        free(s_events);
+        s_events = NULL;
+        return 0;
+    }
+
+    memset(&s_endpoint, 0, sizeof(s_endpoint));
+    if (!MarkHostName(s_endpoint.name, sizeof(s_endpoint.name)))
+    {
+        strcpy(s_endpoint.name, "unknown");
+    }
+
+    MarkLockInit(&s_lock);
+    MarkCondInit(&s_wake);
+    if (!MarkThreadStart(&s_sender, SenderThread, NULL))
+    {
+        SpoolClose(s_spool);
+        s_spool = NULL;
+        return 0;
+    }
+
+    GetSpoolStats(s_spool, &stats);
+    printf("Forwarding to %s as %s, batches of %d events, spool %s with %llu events to resend\n",
+        s_address, s_endpoint.name, s_batch, spool, stats.recovered);
+
+    return 1;
+}
+
+int IsForwardActive()
+{
+    return s_spool != NULL;
+}
+
+static int SpoolBatch()
+{
+    int ok = SpoolAppend(s_spool, s_events, s_count);
+
+    if (!ok && !s_failed)
+    {
+        printf("Cannot write to the forwarding spool, events are lost\n");
+        s_failed = 1;
+    }
+    s_count = 0;
+
+    MarkLockAcquire(&s_lock);
+    Signal();
+    MarkLockRelease(&s_lock);
+
+    return ok;
+}
+
+int WriteForward(PMARK_EVENT event)
+{
+    if (!s_count)
+    {
+        s_oldest = MarkClockMicroseconds();
+    }
+
+    memcpy(&s_events[s_count++], event, sizeof(MARK_EVENT));
+    if (s_count == s_batch)
+    {
+        return SpoolBatch();
+    }
+
+    return 1;
+}
+
+int FlushForward(int force)
+{
+    if (!s_count)
+    {
+        return 0;
+    }
+
+    if (force || MarkClockMicroseconds() - s_oldest >= s_linger * 1000ULL)
+    {
+        SpoolBatch();
+    }
+
+    return s_count != 0;
+}
+
+void StopForward()
+{
+    unsigned long long deadline = MarkClockMicroseconds() + FORWARD_DRAIN_TIMEOUT * 1000ULL;
+    SPOOL_STATS stats;
+
+    if (!s_spool)
+    {
+        return;
+    }
+
+    // The sink has spooled everything by now; give the collector a moment
+    // to acknowledge it.
+    MarkLockAcquire(&s_lock);
+    GetSpoolStats(s_spool, &stats);
+    while (stats.acked < stats.next && s_transport && MarkClockMicroseconds() < deadline)
+    {
+        MarkCondWait(&s_wake, &s_lock, 100);
+        GetSpoolStats(s_spool, &stats);
+    }
+    s_stopping = 1;
+    Signal();
+    if (s_transport)
+    {
+        TransportShutdown(s_transport);
+    }
+    MarkLockRelease(&s_lock);
+
+    MarkThreadJoin(s_sender);
+
+    GetSpoolStats(s_spool, &s_spoolStats);
+    SpoolClose(s_spool);
+    s_spool = NULL;
+
+    MarkCondDelete(&s_wake);
+    MarkLockDelete(&s_lock);
+    free(s_events);
+    free(s_frame);
+    s_events = NULL;
+    s_frame = NULL;
+}
+
+void GetForwardStats(PFORWARD_STATS stats)
+{
+    *stats = s_stats;
+}
+
+void PrintForwardStats()
+{
+    SPOOL_STATS spool = s_spoolStats;
+
+    if (s_spool)
+    {
+        GetSpoolStats(s_spool, &spool);
+    }
+
+    printf("Forward: %llu events in %llu frames, %llu resent, %llu acks, %llu connects, %.1f:1 compression\n",
+        s_stats.events, s_stats.frames, s_stats.resent, s_stats.acks, s_stats.connects,
+        spool.compressedBytes ? (double)spool.rawBytes / spool.compressedBytes : 0.0);
+    printf("Spool: %llu events in %llu blocks, %llu left unacknowledged in %llu files (%llu bytes), %llu lost, %llu failures\n",
+        spool.events, spool.blocks, spool.next - spool.acked, spool.files, spool.bytes, spool.lost, spool.failures);
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+#ifndef _FORWARD_H_
+#define _FORWARD_H_
+
+#include "communicator.h"
+#include "eventstream.h"
+
+// Sink that ships events to a central collector over TCP, see forward.c.
+#define FORWARD_DEFAULT_ADDRESS "tcp:127.0.0.1:7170"
+#define FORWARD_DEFAULT_BATCH 512   // events per compressed frame
+// The most events whose compressed block, however badly it compresses
+// (LzCompressBound), still fits a STREAM_MAX_FRAME payload.
+#define FORWARD_MAX_BATCH ((int)((STREAM_MAX_FRAME - 16) / 256 * 255 / sizeof(MARK_EVENT)))
+#define FORWARD_DEFAULT_LINGER 200  // ms
+#define FORWARD_WINDOW 8            // batches sent ahead of the acknowledgements
+#define FORWARD_RETRY_INTERVAL 1000 // ms
+#define FORWARD_DRAIN_TIMEOUT 5000  // ms dcomm waits at exit for the spool to be acknowledged
+
+typedef struct _FORWARD_STATS
+{
+    unsigned long long connects;
+    unsigned long long frames; // resends included
+    unsigned long long events;
+    unsigned long long resent; // events sent again after a reconnect, see SPOOL_STATS.recovered for a restart
+    unsigned long long acks;
+    unsigned long long bytes;  // compressed payload
+} FORWARD_STATS, *PFORWARD_STATS;
+
+// A NULL address or spool takes the defaults; limit is in MB.
+int StartForward(const char* address, const char* spool, unsigned long long limit, int batch, int linger);
+int IsForwardActive();
+int WriteForward(PMARK_EVENT event);
+// Spools the batch once its oldest event is older than the linger time, or
+// right away with force. Returns 1 while events are still held back.
+int FlushForward(int force);
+// After StopSinks: waits a little for the collector to acknowledge the
+// spool, then disconnects. What is left is sent by the next run.
+void StopForward();
+void GetForwardStats(PFORWARD_STATS stats);
+void PrintForwardStats();
+
+#endif
\ No newline at end of file
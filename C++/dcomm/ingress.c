@@ -0,0 +1,229 @@
+#include "ingress.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CACHE_LINE 64
+
+typedef struct _INGRESS_SLOT
+{
+    volatile long long sequence;
+    MARK_EVENT event;
+} INGRESS_SLOT, *PINGRESS_SLOT;
+
+// Producer and consumer positions live on separate cache lines so the
+// consumer does not bounce the line the producers CAS on.
+struct _INGRESS_QUEUE
+{
+    volatile long long tail;
+    volatile long long dropped;
+    volatile long long waits;
+    char pad0[CACHE_LINE - 3 * sizeof(long long)];
+
+    long long head;
+    long long batches;
+    long long maxDepth;
+    char pad1[CACHE_LINE - 3 * sizeof(long long)];
+
+    // Read by every producer, written only when the consumer goes idle.
+    long long mask;
+    volatile int sleeping;
+    volatile int closed;
+    PINGRESS_SLOT slots;
+
+    MARK_LOCK lock;
+    MARK_COND ready;
+};
+
+PINGRESS_QUEUE IngressCreate(unsigned long capacity)
+{
+    PINGRESS_QUEUE queue;
+    unsigned long size = 2;
+    unsigned long i;
+
+    while (size < capacity)
+    {
+        size <<= 1;
+    }
+
+    queue = (PINGRESS_QUEUE)MarkAlignedAlloc(sizeof(INGRESS_QUEUE), CACHE_LINE);
+    if (!queue)
+    {
+        return NULL;
+    }
+    memset(queue, 0, sizeof(*queue));
+
+    queue->slots = (PINGRESS_SLOT)MarkAlignedAlloc(size * sizeof(INGRESS_SLOT), CACHE_LINE);
+    if (!queue->slots)
+    {
+        printf("Cannot allocate the ingress queue.\n");
+        MarkAlignedFree(queue);
+        return NULL;
+    }
+
+    // A slot is free for the producer at position p when its sequence is p.
+    for (i = 0; i < size; i++)
+    {
+        queue->slots[i].sequence = i;
+    }
+    queue->mask = size - 1;
+
+    MarkLockInit(&queue->lock);
+    MarkCondInit(&queue->ready);
+
+    return queue;
+}
+
+void IngressDelete(PINGRESS_QUEUE queue)
+{
+    if (queue)
+    {
+        MarkCondDelete(&queue->ready);
+        MarkLockDelete(&queue->lock);
+        MarkAlignedFree(queue->slots);
+        MarkAlignedFree(queue);
+    }
+}
+
+static PINGRESS_SLOT ClaimSlot(PINGRESS_QUEUE queue, long long* position)
+{
+    long long pos = MarkAtomicLoad64(&queue->tail);
+
+    while (1)
+    {
+        PINGRESS_SLOT slot = &queue->slots[pos & queue->mask];
+        long long diff = MarkAtomicLoad64(&slot->sequence) - pos;
+
+        if (!diff)
+        {
+            long long seen = MarkAtomicCas64(&queue->tail, pos + 1, pos);
+            if (seen == pos)
+            {
+                *position = pos;
+                return slot;
+            }
+            pos = seen;
+        }
+        else if (diff < 0)
+        {
+            // The consumer has not released this slot from the previous lap.
+            return NULL;
+        }
+        else
+        {
+            pos = MarkAtomicLoad64(&queue->tail);
+        }
+    }
+}
+
+int IngressEnqueue(PINGRESS_QUEUE queue, PMARK_EVENT event, int wait)
+{
+    PINGRESS_SLOT slot;
+    long long pos;
+
+    while (!(slot = ClaimSlot(queue, &pos)))
+    {
+        if (!wait || queue->closed)
+        {
+            MarkAtomicAdd64(&queue->dropped, 1);
+            return 0;
+        }
+        MarkAtomicAdd64(&queue->waits, 1);
+        MarkSleep(0);
+    }
+
+    memcpy(&slot->event, event, sizeof(MARK_EVENT));
+    MarkAtomicStore64(&slot->sequence, pos + 1);
+
+    // Pairs with the barrier in IngressWait: either the consumer sees the
+    // slot before it sleeps or we see it sleeping and wake it.
+    MarkMemoryBarrier();
+    if (queue->sleeping)
+    {
+        MarkLockAcquire(&queue->lock);
+        MarkCondWake(&queue->ready);
+        MarkLockRelease(&queue->lock);
+    }
+
+    return 1;
+}
+
+int IngressDequeue(PINGRESS_QUEUE queue, PMARK_EVENT* events, int max)
+{
+    long long depth;
+    int count;
+
+    for (count = 0; count < max; count++)
+    {
+        long long pos = queue->head + count;
+        PINGRESS_SLOT slot = &queue->slots[pos & queue->mask];
+
+        if (MarkAtomicLoad64(&slot->sequence) != pos + 1)
+        {
+            break;
+        }
+        events[count] = &slot->event;
+    }
+
+    if (count)
+    {
+        queue->batches++;
+        depth = MarkAtomicLoad64(&queue->tail) - queue->head;
+        if (depth > queue->maxDepth)
+        {
+            queue->maxDepth = depth;
+        }
+    }
+
+    return count;
+}
+
+void IngressRelease(PINGRESS_QUEUE queue, int count)
+{
+    int i;
+
+    // Hands the slots to the producers of the next lap.
+    for (i = 0; i < count; i++)
+    {
+        long long pos = queue->head + i;
+        MarkAtomicStore64(&queue->slots[pos & queue->mask].sequence, pos + queue->mask + 1);
+    }
+    queue->head += count;
+}
+
+void IngressWait(PINGRESS_QUEUE queue, int timeout)
+{
+    PINGRESS_SLOT slot = &queue->slots[queue->head & queue->mask];
+
+    MarkLockAcquire(&queue->lock);
+    queue->sleeping = 1;
+    MarkMemoryBarrier();
+    if (MarkAtomicLoad64(&slot->sequence) != queue->head + 1 && !queue->closed)
+    {
+        MarkCondWait(&queue->ready, &queue->lock, timeout);
+    }
+    queue->sleeping = 0;
+    MarkLockRelease(&queue->lock);
+}
+
+void IngressClose(PINGRESS_QUEUE queue)
+{
+    MarkLockAcquire(&queue->lock);
+    queue->closed = 1;
+    MarkCondWakeAll(&queue->ready);
+    MarkLockRelease(&queue->lock);
+}
+
+void GetIngressStats(PINGRESS_QUEUE queue, PINGRESS_STATS stats)
+{
+    long long tail = MarkAtomicLoad64(&queue->tail);
+
+    stats->enqueued = tail;
+    stats->dequeued = queue->head;
+    stats->batches = queue->batches;
+    stats->dropped = queue->dropped;
+    stats->waits = queue->waits;
+    stats->depth = tail - queue->head;
+    stats->maxDepth = queue->maxDepth;
+    stats->capacity = queue->mask + 1;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef _INGRESS_H_
+#define _INGRESS_H_
+
+#include "communicator.h"
+#include "platform.h"
+
+// Bounded multi-producer, single-consumer event queue between the sources
+// and the pipeline. Producers claim a slot with one CAS and copy the event
+// in; the consumer takes runs of ready slots and processes them in place,
+// so an event is copied exactly once on its way through. Each slot carries
+// a sequence number in the style of Vyukov's bounded queue, which tells the
+// producers whether it is free and the consumer whether it is filled.
+
+#define INGRESS_DEFAULT_CAPACITY 4096 // events, rounded up to a power of two
+#define INGRESS_MAX_BATCH 64
+#define INGRESS_WAIT_INTERVAL 10      // ms, upper bound on a missed wakeup
+
+typedef struct _INGRESS_STATS
+{
+    unsigned long long enqueued;
+    unsigned long long dequeued;
+    unsigned long long batches;
+    unsigned long long dropped; // full queue, event discarded
+    unsigned long long waits;   // full queue, producer waited for room
+    unsigned long long depth;
+    unsigned long long maxDepth;
+    unsigned long long capacity;
+} INGRESS_STATS, *PINGRESS_STATS;
+
+typedef struct _INGRESS_QUEUE INGRESS_QUEUE, *PINGRESS_QUEUE;
+
+PINGRESS_QUEUE IngressCreate(unsigned long capacity);
+void IngressDelete(PINGRESS_QUEUE queue);
+
+// Returns 0 when the queue is full; with wait set it retries until there is
+// room instead, unless the queue is closed.
+int IngressEnqueue(PINGRESS_QUEUE queue, PMARK_EVENT event, int wait);
+
+// Consumer side. Points events[] at up to max filled slots, in order, and
+// returns how many. The slots stay owned by the consumer until released.
+int IngressDequeue(PINGRESS_QUEUE queue, PMARK_EVENT* events, int max);
+void IngressRelease(PINGRESS_QUEUE queue, int count);
+// Blocks until something is queued, the queue is closed or timeout ms pass.
+void IngressWait(PINGRESS_QUEUE queue, int timeout);
+
+// Wakes the consumer and makes waiting producers give up.
+void IngressClose(PINGRESS_QUEUE queue);
+
+void GetIngressStats(PINGRESS_QUEUE queue, PINGRESS_STATS stats);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "latency.h"
+#include "../sys/core.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int HighestBit(unsigned long long value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+
+    if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+    {
+        return (int)index + 32;
+    }
+    _BitScanReverse(&index, (unsigned long)value);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+static int BucketIndex(unsigned long long value)
+{
+    int exponent;
+
+    if (value < LATENCY_SUB_BUCKETS)
+    {
+        return (int)value;
+    }
+
+    // value >> exponent is in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+    exponent = HighestBit(value) - LATENCY_SUB_BITS;
+    return (exponent + 1) * LATENCY_SUB_BUCKETS + (int)((value >> exponent) - LATENCY_SUB_BUCKETS);
+}
+
+static unsigned long long BucketLimit(int index)
+{
+    int exponent = index / LATENCY_SUB_BUCKETS - 1;
+    unsigned long long sub = index % LATENCY_SUB_BUCKETS;
+
+    if (exponent < 0)
+    {
+        return sub;
+    }
+
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << exponent) - 1;
+}
+
+void LatencyReset(PLATENCY_HISTOGRAM histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void LatencyAdd(PLATENCY_HISTOGRAM histogram, unsigned long long value)
+{
+    if (!histogram->count || value < histogram->min)
+    {
+        histogram->min = value;
+    }
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+
+    histogram->count++;
+    histogram->total += value;
+    histogram->buckets[BucketIndex(value)]++;
+}
+
+void LatencyMerge(PLATENCY_HISTOGRAM histogram, PLATENCY_HISTOGRAM other)
+{
+    int i;
+
+    if (!other->count)
+    {
+        return;
+    }
+
+    if (!histogram->count || other->min < histogram->min)
+    {
+        histogram->min = other->min;
+    }
+    if (other->max > histogram->max)
+    {
+        histogram->max = other->max;
+    }
+
+    histogram->count += other->count;
+    histogram->total += other->total;
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        histogram->buckets[i] += other->buckets[i];
+    }
+}
+
+unsigned long long LatencyPercentile(PLATENCY_HISTOGRAM histogram, double percentile)
+{
+    unsigned long long rank = (unsigned long long)(histogram->count * percentile / 100.0);
+    unsigned long long seen = 0;
+    int i;
+
+    if (!histogram->count)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen > rank)
+        {
+            return MIN(BucketLimit(i), histogram->max);
+        }
+    }
+
+    return histogram->max;
+}
+
+void PrintLatency(const char* name, PLATENCY_HISTOGRAM histogram)
+{
+    if (!histogram->count)
+    {
+        printf("%-12s no samples\n", name);
+        return;
+    }
+
+    printf("%-12s %10llu samples, us: min %.1f, avg %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+        name,
+        histogram->count,
+        histogram->min / 1000.0,
+        (double)histogram->total / histogram->count / 1000.0,
+        LatencyPercentile(histogram, 50) / 1000.0,
+        LatencyPercentile(histogram, 90) / 1000.0,
+        LatencyPercentile(histogram, 99) / 1000.0,
+        LatencyPercentile(histogram, 99.9) / 1000.0,
+        histogram->max / 1000.0);
+}
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+// Log-linear latency histogram: 8 linear sub-buckets per power of two, which
+// keeps percentiles within 12.5% of the true value at any scale.
+#define LATENCY_SUB_BITS 3
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct _LATENCY_HISTOGRAM
+{
+    unsigned long long count;
+    unsigned long long total;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long buckets[LATENCY_BUCKETS];
+} LATENCY_HISTOGRAM, *PLATENCY_HISTOGRAM;
+
+void LatencyReset(PLATENCY_HISTOGRAM histogram);
+void LatencyAdd(PLATENCY_HISTOGRAM histogram, unsigned long long value);
+void LatencyMerge(PLATENCY_HISTOGRAM histogram, PLATENCY_HISTOGRAM other);
+// percentile is 0..100; returns the upper bound of the bucket it falls into.
+unsigned long long LatencyPercentile(PLATENCY_HISTOGRAM histogram, double percentile);
+// Prints one line: count, min/avg/p50/p90/p99/p99.9/max, values in nanoseconds shown as us.
+void PrintLatency(const char* name, PLATENCY_HISTOGRAM histogram);
+
+#endif
\ No newline at end of file
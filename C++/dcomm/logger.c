@@ -1,9 +1,41 @@
 #include "communicator.h"
 #include <stdio.h>
 
-int SaveMessageToLog(PMARK_EVENT evt)
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+#ifdef _WIN32
+
+#define EVENT_TEXT_FORMAT "%S"
+#define EVENT_TEXT(field, buffer) ((void)(buffer), (field))
+
+#else
+
+// wchar_t is 32 bits here, so the UTF-16 fields are narrowed for printing.
+#define EVENT_TEXT_FORMAT "%s"
+#define EVENT_TEXT(field, buffer) NarrowText(field, sizeof(field) / sizeof(field[0]), buffer)
+
+static const char* NarrowText(const unsigned short* text, int length, char* buffer)
+{
+    int i;
+
+    for (i = 0; i < length && text[i]; i++)
+    {
+        buffer[i] = text[i] < 0x80 ? (char)text[i] : '?';
+    }
+    buffer[i] = 0;
+
+    return buffer;
+}
+
+#endif
+
+int FormatLogMessage(PMARK_EVENT evt, char* buffer, int size)
 {
-    printf("%x: PID:%6x, PPID:%6x, TID:%6x, OPERATION=%s.%s, FLAGS=%8x, USERNAME=%S, PATH=%S, IMAGE=%S, PROCESS=%S\n",
+    char user[32 + 1], path[256 + 1], image[176 + 1], process[32 + 1];
+
+    int length = snprintf(buffer, size, "%llx: PID:%6x, PPID:%6x, TID:%6x, OPERATION=%s.%s, FLAGS=%8x, USERNAME=" EVENT_TEXT_FORMAT ", PATH=" EVENT_TEXT_FORMAT ", IMAGE=" EVENT_TEXT_FORMAT ", PROCESS=" EVENT_TEXT_FORMAT "\n",
         evt->time,
         evt->pid,
         evt->ppid,
@@ -13,11 +45,24 @@ int SaveMessageToLog(PMARK_EVENT evt)
         evt->optype == MARK_OPTYPE_CREATE ? "CREATE " : evt->optype == MARK_OPTYPE_DESTROY ? "DESTROY" :
         evt->optype == MARK_OPTYPE_RENAME ? "RENAME " : evt->optype == MARK_OPTYPE_WRITE ? "WRITE  " : "UNKNOWN",
         evt->flags,
-        evt->szUserName,
-        evt->szOperationPath,
-        evt->szImagePath,
-        evt->szProcessName
+        EVENT_TEXT(evt->szUserName, user),
+        EVENT_TEXT(evt->szOperationPath, path),
+        EVENT_TEXT(evt->szImagePath, image),
+        EVENT_TEXT(evt->szProcessName, process)
         );
 
+    // _snprintf does not terminate a truncated message.
+    buffer[size - 1] = 0;
+
+    return length;
+}
+
+int SaveMessageToLog(PMARK_EVENT evt)
+{
+    char buffer[LOG_MESSAGE_SIZE];
+
+    FormatLogMessage(evt, buffer, sizeof(buffer));
+    fputs(buffer, stdout);
+
     return 1;
 }
\ No newline at end of file
@@ -0,0 +1,706 @@
+#include "logio.h"
+#include "platform.h"
+#include "../sys/core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define LOGIO_SYNC_TAG 0xFFFFFFFFFFFFFFFFULL
+
+#define ALIGN_DOWN(x) ((x) & ~(unsigned long long)(LOGIO_BLOCK_SIZE - 1))
+#define ALIGN_UP(x) ALIGN_DOWN((x) + LOGIO_BLOCK_SIZE - 1)
+
+LOGIO_OPTIONS g_LogIoOptions = { LOGIO_BACKEND_AUTO, 1, LOGIO_DEFAULT_QUEUE_DEPTH, LOGIO_DEFAULT_SYNC_INTERVAL };
+
+#ifdef __linux__
+typedef struct _LOGIO_RING
+{
+    int fd;
+    unsigned inflight;
+
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    struct io_uring_sqe* sqes;
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    void* sqMap;
+    size_t sqMapSize;
+    void* cqMap;
+    size_t cqMapSize;
+    size_t sqesSize;
+} LOGIO_RING, *PLOGIO_RING;
+#endif
+
+struct _LOG_FILE
+{
+    MARK_FILE file;
+    int backend;
+    int direct;
+    int queueDepth;
+    int syncInterval;
+
+    unsigned char* buffers[LOGIO_MAX_QUEUE_DEPTH];
+    unsigned long lengths[LOGIO_MAX_QUEUE_DEPTH];
+    unsigned long long offsets[LOGIO_MAX_QUEUE_DEPTH];
+    int busy[LOGIO_MAX_QUEUE_DEPTH];
+
+    int current;
+    unsigned long used;
+    unsigned long staged;
+    unsigned long long bufferOffset;
+    unsigned long long size;
+
+    int overlap; // the next write rewrites the tail block of an earlier one
+    int dirty;
+    unsigned long long lastSync;
+
+#ifdef __linux__
+    LOGIO_RING ring;
+#endif
+
+    LOGIO_STATS stats;
+};
+
+static int WriteAt(PLOG_FILE log, const void* buffer, unsigned long length, unsigned long long offset)
+{
+#ifdef _WIN32
+    OVERLAPPED ov = { 0 };
+    DWORD written = 0;
+
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+
+    return WriteFile(log->file, buffer, length, &written, &ov) && written == length;
+#else
+    unsigned long done = 0;
+
+    while (done < length)
+    {
+        ssize_t written = pwrite(log->file, (const char*)buffer + done, length - done, (off_t)(offset + done));
+        if (written <= 0)
+        {
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        done += (unsigned long)written;
+    }
+
+    return 1;
+#endif
+}
+
+static int SyncFile(PLOG_FILE log)
+{
+#ifdef _WIN32
+    return FlushFileBuffers(log->file);
+#else
+    return !fdatasync(log->file);
+#endif
+}
+
+#ifdef __linux__
+
+static int RingSetup(PLOGIO_RING ring, unsigned entries)
+{
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = -1;
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sqMapSize = ring->cqMapSize = MAX(ring->sqMapSize, ring->cqMapSize);
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sqMap = mmap(NULL, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == ring->sqMap)
+    {
+        close(fd);
+        return 0;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cqMap = ring->sqMap;
+    }
+    else
+    {
+        ring->cqMap = mmap(NULL, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    }
+
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+    if (MAP_FAILED == ring->cqMap || MAP_FAILED == (void*)ring->sqes)
+    {
+        if (MAP_FAILED != ring->cqMap && ring->cqMap != ring->sqMap)
+        {
+            munmap(ring->cqMap, ring->cqMapSize);
+        }
+        if (MAP_FAILED != (void*)ring->sqes)
+        {
+            munmap(ring->sqes, ring->sqesSize);
+        }
+        munmap(ring->sqMap, ring->sqMapSize);
+        close(fd);
+        return 0;
+    }
+
+    char* sq = (char*)ring->sqMap;
+    char* cq = (char*)ring->cqMap;
+
+    ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+    ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+    ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+    ring->sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    ring->sqEntries = *(unsigned*)(sq + params.sq_off.ring_entries);
+
+    ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    ring->fd = fd;
+    return 1;
+}
+
+static void RingTeardown(PLOGIO_RING ring)
+{
+    if (ring->fd < 0)
+    {
+        return;
+    }
+
+    munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqMap != ring->sqMap)
+    {
+        munmap(ring->cqMap, ring->cqMapSize);
+    }
+    munmap(ring->sqMap, ring->sqMapSize);
+    close(ring->fd);
+    ring->fd = -1;
+}
+
+static void CompleteRequest(PLOG_FILE log, unsigned long long tag, int result)
+{
+    if (LOGIO_SYNC_TAG == tag)
+    {
+        if (result < 0)
+        {
+            log->stats.failures++;
+        }
+        else
+        {
+            log->stats.syncs++;
+        }
+        return;
+    }
+
+    int index = (int)tag;
+    if (result != (int)log->lengths[index])
+    {
+        // The kernel or the filesystem refused the asynchronous write: redo
+        // it synchronously and stay on plain writes from now on.
+        log->backend = LOGIO_BACKEND_WRITE;
+        if (!WriteAt(log, log->buffers[index], log->lengths[index], log->offsets[index]))
+        {
+            log->stats.failures++;
+        }
+    }
+    log->busy[index] = 0;
+}
+
+static void RingReap(PLOG_FILE log, int wait)
+{
+    PLOGIO_RING ring = &log->ring;
+
+    if (wait && ring->inflight)
+    {
+        syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    }
+
+    unsigned head = *ring->cqHead;
+    unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+        struct io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+        CompleteRequest(log, cqe->user_data, cqe->res);
+        ring->inflight--;
+        head++;
+    }
+
+    __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+}
+
+static struct io_uring_sqe* RingNextSqe(PLOG_FILE log)
+{
+    PLOGIO_RING ring = &log->ring;
+
+    while (1)
+    {
+        unsigned tail = *ring->sqTail;
+        unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+
+        if (tail - head < ring->sqEntries)
+        {
+            struct io_uring_sqe* sqe = &ring->sqes[tail & ring->sqMask];
+            memset(sqe, 0, sizeof(*sqe));
+            ring->sqArray[tail & ring->sqMask] = tail & ring->sqMask;
+            return sqe;
+        }
+
+        RingReap(log, 1);
+    }
+}
+
+static int RingCommit(PLOG_FILE log)
+{
+    PLOGIO_RING ring = &log->ring;
+    unsigned tail = *ring->sqTail;
+
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+    ring->inflight++;
+
+    while (syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0) < 0)
+    {
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            // Nothing was submitted. Take the entry back, or the next enter
+            // would submit it behind the caller's fallback.
+            __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+            ring->inflight--;
+            return 0;
+        }
+        RingReap(log, 0);
+    }
+
+    return 1;
+}
+
+// After a failed submission: completes what is still in flight, closes
+// the ring and stays on plain writes from now on.
+static void RingFallBack(PLOG_FILE log)
+{
+    while (log->ring.inflight)
+    {
+        RingReap(log, 1);
+    }
+    RingTeardown(&log->ring);
+    log->backend = LOGIO_BACKEND_WRITE;
+}
+
+#endif
+
+static void Reap(PLOG_FILE log, int wait)
+{
+#ifdef __linux__
+    if (log->ring.fd >= 0)
+    {
+        RingReap(log, wait);
+    }
+#else
+    UNREFERENCED_PARAMETER(log);
+    UNREFERENCED_PARAMETER(wait);
+#endif
+}
+
+static int Inflight(PLOG_FILE log)
+{
+#ifdef __linux__
+    return log->ring.fd >= 0 ? (int)log->ring.inflight : 0;
+#else
+    UNREFERENCED_PARAMETER(log);
+    return 0;
+#endif
+}
+
+static int Submit(PLOG_FILE log)
+{
+    int index = log->current;
+    unsigned long length = log->direct ? (unsigned long)ALIGN_UP(log->used) : log->used;
+
+    if (length > log->used)
+    {
+        memset(log->buffers[index] + log->used, 0, length - log->used);
+    }
+
+    log->lengths[index] = length;
+    log->offsets[index] = log->bufferOffset;
+    log->stats.writes++;
+    log->stats.bytes += log->staged;
+    log->staged = 0;
+    log->dirty = 1;
+
+#ifdef __linux__
+    if (LOGIO_BACKEND_URING == log->backend)
+    {
+        struct io_uring_sqe* sqe = RingNextSqe(log);
+
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = log->file;
+        sqe->addr = (unsigned long long)(size_t)log->buffers[index];
+        sqe->len = length;
+        sqe->off = log->bufferOffset;
+        sqe->flags = log->overlap ? IOSQE_IO_DRAIN : 0;
+        sqe->user_data = index;
+
+        log->busy[index] = 1;
+        log->overlap = 0;
+
+        if (RingCommit(log))
+        {
+            return 1;
+        }
+
+        log->busy[index] = 0;
+        RingFallBack(log);
+    }
+#endif
+
+    log->overlap = 0;
+    if (!WriteAt(log, log->buffers[index], length, log->bufferOffset))
+    {
+        log->stats.failures++;
+        return 0;
+    }
+
+    return 1;
+}
+
+// Moves staging to a buffer that is not in flight, waiting for one if needed.
+static void NextBuffer(PLOG_FILE log)
+{
+    int i;
+
+    Reap(log, 0);
+    while (1)
+    {
+        for (i = 1; i <= log->queueDepth; i++)
+        {
+            int index = (log->current + i) % log->queueDepth;
+            if (!log->busy[index])
+            {
+                log->current = index;
+                return;
+            }
+        }
+
+        log->stats.stalls++;
+        Reap(log, 1);
+    }
+}
+
+static void GroupCommit(PLOG_FILE log, int flushing)
+{
+    unsigned long long now;
+
+    if (log->syncInterval < 0 || !log->dirty)
+    {
+        return;
+    }
+
+    now = MarkClockMicroseconds();
+    if (log->syncInterval == 0 ? !flushing : now - log->lastSync < (unsigned long long)log->syncInterval * 1000)
+    {
+        return;
+    }
+
+    log->dirty = 0;
+    log->lastSync = now;
+
+#ifdef __linux__
+    if (LOGIO_BACKEND_URING == log->backend)
+    {
+        // Drained behind every write submitted so far, so one fdatasync
+        // covers the whole group without blocking the writer.
+        struct io_uring_sqe* sqe = RingNextSqe(log);
+
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = log->file;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->flags = IOSQE_IO_DRAIN;
+        sqe->user_data = LOGIO_SYNC_TAG;
+
+        if (RingCommit(log))
+        {
+            return;
+        }
+        RingFallBack(log);
+    }
+
+    while (Inflight(log))
+    {
+        Reap(log, 1);
+    }
+#endif
+
+    if (SyncFile(log))
+    {
+        log->stats.syncs++;
+    }
+    else
+    {
+        log->stats.failures++;
+    }
+}
+
+int LogFileAppend(PLOG_FILE log, const void* data, unsigned long size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    int ok = 1;
+
+    while (size > 0)
+    {
+        unsigned long chunk = MIN(size, LOGIO_BUFFER_SIZE - log->used);
+
+        memcpy(log->buffers[log->current] + log->used, p, chunk);
+        log->used += chunk;
+        log->staged += chunk;
+        log->size += chunk;
+        p += chunk;
+        size -= chunk;
+
+        if (LOGIO_BUFFER_SIZE == log->used)
+        {
+            ok &= Submit(log);
+            log->bufferOffset += LOGIO_BUFFER_SIZE;
+            log->used = 0;
+            NextBuffer(log);
+        }
+    }
+
+    GroupCommit(log, 0);
+    return ok;
+}
+
+int LogFileFlush(PLOG_FILE log)
+{
+    int ok = 1;
+
+    if (log->staged)
+    {
+        int previous = log->current;
+        unsigned long tail = log->direct ? log->used % LOGIO_BLOCK_SIZE : 0;
+        unsigned long aligned = log->used - tail;
+
+        ok = Submit(log);
+        NextBuffer(log);
+
+        if (tail)
+        {
+            // O_DIRECT writes whole blocks: the partial last block goes out
+            // padded now and is written again once more data arrives.
+            memmove(log->buffers[log->current], log->buffers[previous] + aligned, tail);
+            log->overlap = 1;
+        }
+
+        log->bufferOffset += aligned;
+        log->used = tail;
+    }
+
+    GroupCommit(log, 1);
+    return ok;
+}
+
+unsigned long long LogFileSize(PLOG_FILE log)
+{
+    return log->size;
+}
+
+static MARK_FILE OpenFile(const char* path, int truncate, int* direct)
+{
+#ifdef _WIN32
+    *direct = 0;
+    return CreateFile(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+        truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+#else
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+    int file = -1;
+
+#ifdef O_DIRECT
+    if (*direct)
+    {
+        file = open(path, flags | O_DIRECT, 0640);
+    }
+#endif
+    if (file < 0)
+    {
+        // tmpfs and some network filesystems refuse O_DIRECT.
+        *direct = 0;
+        file = open(path, flags, 0640);
+    }
+
+    return file;
+#endif
+}
+
+PLOG_FILE LogFileOpen(const char* path, int truncate, PLOGIO_OPTIONS options)
+{
+    int i;
+
+    if (!options)
+    {
+        options = &g_LogIoOptions;
+    }
+
+    PLOG_FILE log = (PLOG_FILE)calloc(1, sizeof(LOG_FILE));
+    if (!log)
+    {
+        return NULL;
+    }
+
+#ifdef __linux__
+    log->ring.fd = -1;
+#endif
+    log->direct = options->direct;
+    log->queueDepth = MAX(1, MIN(options->queueDepth, LOGIO_MAX_QUEUE_DEPTH));
+    log->syncInterval = options->syncInterval;
+    log->backend = LOGIO_BACKEND_WRITE;
+    log->lastSync = MarkClockMicroseconds();
+
+    log->file = OpenFile(path, truncate, &log->direct);
+    if (MARK_INVALID_FILE == log->file)
+    {
+        printf("Cannot open the log file %s.\n", path);
+        free(log);
+        return NULL;
+    }
+
+    for (i = 0; i < log->queueDepth; i++)
+    {
+        log->buffers[i] = (unsigned char*)MarkAlignedAlloc(LOGIO_BUFFER_SIZE, LOGIO_BLOCK_SIZE);
+        if (!log->buffers[i])
+        {
+            LogFileClose(log);
+            return NULL;
+        }
+    }
+
+    log->size = MarkFileSize(log->file);
+    log->bufferOffset = log->direct ? ALIGN_DOWN(log->size) : log->size;
+    log->used = (unsigned long)(log->size - log->bufferOffset);
+
+#ifndef _WIN32
+    if (log->used && pread(log->file, log->buffers[0], LOGIO_BLOCK_SIZE, (off_t)log->bufferOffset) < (ssize_t)log->used)
+    {
+        printf("Cannot read the tail of the log file %s.\n", path);
+        LogFileClose(log);
+        return NULL;
+    }
+    log->overlap = log->used != 0;
+#endif
+
+#ifdef __linux__
+    if (LOGIO_BACKEND_WRITE != options->backend)
+    {
+        if (RingSetup(&log->ring, (unsigned)log->queueDepth * 2))
+        {
+            log->backend = LOGIO_BACKEND_URING;
+        }
+        else if (LOGIO_BACKEND_URING == options->backend)
+        {
+            printf("io_uring is not available, falling back to write().\n");
+        }
+    }
+#endif
+
+    return log;
+}
+
+void LogFileClose(PLOG_FILE log)
+{
+    int i;
+
+    if (!log)
+    {
+        return;
+    }
+
+    if (MARK_INVALID_FILE != log->file)
+    {
+        if (log->staged)
+        {
+            Submit(log);
+        }
+
+        while (Inflight(log))
+        {
+            Reap(log, 1);
+        }
+
+        if (log->syncInterval >= 0 && log->dirty)
+        {
+            if (SyncFile(log))
+            {
+                log->stats.syncs++;
+            }
+        }
+
+#ifndef _WIN32
+        if (log->direct && ftruncate(log->file, (off_t)log->size))
+        {
+            log->stats.failures++;
+        }
+#endif
+
+        MarkFileClose(log->file);
+    }
+
+#ifdef __linux__
+    RingTeardown(&log->ring);
+#endif
+
+    for (i = 0; i < LOGIO_MAX_QUEUE_DEPTH; i++)
+    {
+        MarkAlignedFree(log->buffers[i]);
+    }
+    free(log);
+}
+
+const char* LogFileBackendName(PLOG_FILE log)
+{
+    if (LOGIO_BACKEND_URING == log->backend)
+    {
+        return log->direct ? "io_uring, O_DIRECT" : "io_uring";
+    }
+
+    return log->direct ? "write, O_DIRECT" : "write";
+}
+
+void GetLogFileStats(PLOG_FILE log, PLOGIO_STATS stats)
+{
+    *stats = log->stats;
+}
\ No newline at end of file
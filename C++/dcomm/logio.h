@@ -0,0 +1,52 @@
+#ifndef _LOGIO_H_
+#define _LOGIO_H_
+
+// Append-only file writer used by the binary and segmented logs. Data is
+// staged in aligned buffers and written out as large blocks, with several
+// writes in flight on the io_uring backend and fdatasync batched into one
+// group commit per durability interval.
+
+#define LOGIO_BACKEND_AUTO 0
+#define LOGIO_BACKEND_WRITE 1
+#define LOGIO_BACKEND_URING 2
+
+#define LOGIO_BLOCK_SIZE 4096
+#define LOGIO_BUFFER_SIZE (1024 * 1024)
+#define LOGIO_MAX_QUEUE_DEPTH 16
+#define LOGIO_DEFAULT_QUEUE_DEPTH 4
+#define LOGIO_DEFAULT_SYNC_INTERVAL 1000 // ms
+
+typedef struct _LOGIO_OPTIONS
+{
+    int backend;
+    int direct;       // O_DIRECT on Linux; ignored elsewhere
+    int queueDepth;   // writes in flight, 1..LOGIO_MAX_QUEUE_DEPTH
+    int syncInterval; // ms between group commits; 0 syncs on every flush, -1 never
+} LOGIO_OPTIONS, *PLOGIO_OPTIONS;
+
+typedef struct _LOGIO_STATS
+{
+    unsigned long long writes;
+    unsigned long long bytes;
+    unsigned long long syncs;
+    unsigned long long failures;
+    unsigned long long stalls;
+} LOGIO_STATS, *PLOGIO_STATS;
+
+typedef struct _LOG_FILE LOG_FILE, *PLOG_FILE;
+
+extern LOGIO_OPTIONS g_LogIoOptions;
+
+// Opens path for appending; truncate discards existing content. A NULL
+// options pointer takes g_LogIoOptions.
+PLOG_FILE LogFileOpen(const char* path, int truncate, PLOGIO_OPTIONS options);
+int LogFileAppend(PLOG_FILE file, const void* data, unsigned long size);
+// Submits staged data and runs a group commit if the interval has passed.
+int LogFileFlush(PLOG_FILE file);
+unsigned long long LogFileSize(PLOG_FILE file);
+void LogFileClose(PLOG_FILE file);
+
+const char* LogFileBackendName(PLOG_FILE file);
+void GetLogFileStats(PLOG_FILE file, PLOGIO_STATS stats);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "lz.h"
+
+#include <string.h>
+
+#define LZ_LAST_LITERALS 5
+
+static unsigned int LzRead32(const unsigned char* p)
+{
+    unsigned int value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned long long LzRead64(const unsigned char* p)
+{
+    unsigned long long value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static unsigned int LzHash(unsigned int sequence)
+{
+    return (sequence * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+static unsigned char* LzWriteLength(unsigned char* op, int length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+static unsigned char* LzWriteLiterals(unsigned char* op, const unsigned char* anchor, int literals, int matchLength)
+{
+    unsigned char* token = op++;
+
+    *token = (unsigned char)(((literals >= 15 ? 15 : literals) << 4) | (matchLength >= 15 ? 15 : matchLength));
+    if (literals >= 15)
+    {
+        op = LzWriteLength(op, literals - 15);
+    }
+
+    memcpy(op, anchor, literals);
+    return op + literals;
+}
+
+int LzCompress(const unsigned char* src, int srcSize, unsigned char* dst, int dstCapacity)
+{
+    int table[1 << LZ_HASH_LOG];
+
+    const unsigned char* ip = src;
+    const unsigned char* anchor = src;
+    const unsigned char* end = src + srcSize;
+    const unsigned char* matchLimit = end - LZ_LAST_LITERALS;
+    unsigned char* op = dst;
+
+    if (srcSize < 0 || dstCapacity < LzCompressBound(srcSize))
+    {
+        return 0;
+    }
+
+    memset(table, 0xFF, sizeof(table));
+
+    while (srcSize >= LZ_MIN_MATCH + LZ_LAST_LITERALS && ip + LZ_MIN_MATCH <= matchLimit)
+    {
+        unsigned int sequence = LzRead32(ip);
+        unsigned int hash = LzHash(sequence);
+        int candidate = table[hash];
+
+        table[hash] = (int)(ip - src);
+
+        if (candidate < 0 || (ip - src) - candidate > LZ_MAX_OFFSET || LzRead32(src + candidate) != sequence)
+        {
+            // Skip faster through data that does not compress.
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+
+        const unsigned char* match = src + candidate;
+        while (ip > anchor && match > src && ip[-1] == match[-1])
+        {
+            ip--;
+            match--;
+        }
+
+        const unsigned char* p = ip + LZ_MIN_MATCH;
+        const unsigned char* m = match + LZ_MIN_MATCH;
+        while (p + 8 <= matchLimit && LzRead64(p) == LzRead64(m))
+        {
+            p += 8;
+            m += 8;
+        }
+        while (p < matchLimit && *p == *m)
+        {
+            p++;
+            m++;
+        }
+
+        int matchLength = (int)(p - ip) - LZ_MIN_MATCH;
+        int offset = (int)(ip - match);
+
+        op = LzWriteLiterals(op, anchor, (int)(ip - anchor), matchLength);
+        *op++ = (unsigned char)(offset & 0xFF);
+        *op++ = (unsigned char)(offset >> 8);
+        if (matchLength >= 15)
+        {
+            op = LzWriteLength(op, matchLength - 15);
+        }
+
+        ip = p;
+        anchor = ip;
+
+        if (ip + LZ_MIN_MATCH <= matchLimit)
+        {
+            table[LzHash(LzRead32(ip - 2))] = (int)(ip - 2 - src);
+        }
+    }
+
+    op = LzWriteLiterals(op, anchor, (int)(end - anchor), 0);
+
+    return (int)(op - dst);
+}
+
+int LzDecompress(const unsigned char* src, int srcSize, unsigned char* dst, int dstCapacity)
+{
+    const unsigned char* ip = src;
+    const unsigned char* ipEnd = src + srcSize;
+    unsigned char* op = dst;
+    unsigned char* opEnd = dst + dstCapacity;
+
+    while (ip < ipEnd)
+    {
+        unsigned int token = *ip++;
+        int literals = token >> 4;
+        int matchLength = token & 15;
+        int b;
+
+        if (literals == 15)
+        {
+            do
+            {
+                if (ip >= ipEnd)
+                {
+                    return -1;
+                }
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+
+        if (literals > ipEnd - ip || literals > opEnd - op)
+        {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        if (ip == ipEnd)
+        {
+            // The last sequence carries literals only.
+            break;
+        }
+
+        if (ipEnd - ip < 2)
+        {
+            return -1;
+        }
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (matchLength == 15)
+        {
+            do
+            {
+                if (ip >= ipEnd)
+                {
+                    return -1;
+                }
+                b = *ip++;
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += LZ_MIN_MATCH;
+
+        if (!offset || offset > op - dst || matchLength > opEnd - op)
+        {
+            return -1;
+        }
+
+        const unsigned char* match = op - offset;
+        if (offset >= matchLength)
+        {
+            memcpy(op, match, matchLength);
+            op += matchLength;
+        }
+        else
+        {
+            while (matchLength--)
+            {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return (int)(op - dst);
+}
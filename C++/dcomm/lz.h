@@ -0,0 +1,19 @@
+#ifndef _LZ_H_
+#define _LZ_H_
+
+// Byte-oriented LZ77 block codec in the LZ4 style: a token with 4-bit literal
+// and match lengths, 255-run length extensions and 16-bit match offsets.
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_LOG 13
+#define LZ_MAX_OFFSET 65535
+
+#define LzCompressBound(size) ((size) + (size) / 255 + 16)
+
+// Returns the compressed size, or 0 if dstCapacity < LzCompressBound(srcSize).
+int LzCompress(const unsigned char* src, int srcSize, unsigned char* dst, int dstCapacity);
+
+// Returns the decompressed size, or -1 if the input is malformed or does not fit.
+int LzDecompress(const unsigned char* src, int srcSize, unsigned char* dst, int dstCapacity);
+
+#endif
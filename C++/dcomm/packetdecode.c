@@ -0,0 +1,361 @@
+#include "packetdecode.h"
+#include "tcpip.h"
+
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PACKET_BATCH_SSE2
+#endif
+
+// Host order, unlike the ETH_TYPE_ values in tcpip.h.
+#define ETHERTYPE_IPV4 0x0800
+#define ETHERTYPE_IPV6 0x86DD
+#define ETHERTYPE_VLAN 0x8100
+#define ETHERTYPE_QINQ 0x88A8
+
+#define IPV6_HOP_BY_HOP 0
+#define IPV6_ROUTING 43
+#define IPV6_FRAGMENT 44
+#define IPV6_AUTHENTICATION 51
+#define IPV6_DESTINATION 60
+
+#define ETH_HEADER_SIZE 14
+#define IPV4_HEADER_SIZE 20
+#define IPV6_HEADER_SIZE 40
+
+#define PACKET_PREFETCH_DISTANCE 8 // frames
+
+static int CheckProtocol(UINT8 uProtocol)
+{
+    if (uProtocol == IP_PROTO_ICMP)
+        return 1;
+    if (uProtocol == IP_PROTO_TCP)
+        return 1;
+    if (uProtocol == IP_PROTO_UDP)
+        return 1;
+
+    return 0;
+}
+
+int DecodePacket(const unsigned char* data, unsigned int length, PMARK_EVENT evt)
+{
+    if (length < sizeof(ETH_HEADER) + sizeof(IP_HEADER))
+    {
+        return 0;
+    }
+
+    PETH_HEADER pEth = (PETH_HEADER)data;
+    if (pEth->uEthType != ETH_TYPE_IPV4)
+    {
+        return 0;
+    }
+
+    PIP_HEADER pIp = (PIP_HEADER)(pEth + 1);
+
+    if (pIp->bVersion != 4 || pIp->bHeaderLen != 5 || !CheckProtocol(pIp->bProto))
+    {
+        return 0;
+    }
+
+    memset(evt, 0, sizeof(*evt));
+    evt->flags = 0;
+    evt->opclass = MARK_OPCLASS_PACKET;
+    evt->optype = MARK_OPTYPE_WRITE;
+    evt->pid = 0;
+    evt->ppid = 0;
+    evt->tid = 0;
+    evt->time = 0;
+
+    return 1;
+}
+
+static unsigned short Read16(const unsigned char* data)
+{
+    return (unsigned short)((data[0] << 8) | data[1]);
+}
+
+static unsigned int Read32(const unsigned char* data)
+{
+    return (unsigned int)data[0] << 24 | (unsigned int)data[1] << 16 | (unsigned int)data[2] << 8 | data[3];
+}
+
+// The transport header must be whole, a TCP header with its options. end
+// is where the IP datagram ends in the frame, so that the padding of a short
+// Ethernet frame is not taken for payload.
+static void SetPayload(PPACKET_INFO info, unsigned char protocol, const unsigned char* transport,
+    const unsigned char* end)
+{
+    unsigned int remaining = end > transport ? (unsigned int)(end - transport) : 0;
+    unsigned int headerLength = 0;
+
+    if (protocol == IP_PROTO_UDP)
+    {
+        headerLength = 8;
+    }
+    else if (protocol == IP_PROTO_TCP && remaining >= 20)
+    {
+        headerLength = MAX((transport[12] >> 4) * 4, 20);
+    }
+
+    if (headerLength && remaining > headerLength)
+    {
+        info->payload = transport + headerLength;
+        info->payloadLength = remaining - headerLength;
+    }
+}
+
+// Reads the headers byte by byte: the bitfields in tcpip.h assume the host
+// order matches the wire.
+int DecodePacketFlow(const unsigned char* data, unsigned int length, PPACKET_INFO info)
+{
+    const unsigned char* ip = data + sizeof(ETH_HEADER);
+    const unsigned char* transport;
+    unsigned int headerLength;
+    unsigned int remaining;
+
+    if (length < sizeof(ETH_HEADER) + sizeof(IP_HEADER) || Read16(data + 12) != 0x0800)
+    {
+        return 0;
+    }
+
+    headerLength = (ip[0] & 0x0F) * 4;
+    if ((ip[0] >> 4) != 4 || headerLength < sizeof(IP_HEADER) || !CheckProtocol(ip[9]) ||
+        sizeof(ETH_HEADER) + headerLength > length)
+    {
+        return 0;
+    }
+
+    memset(info, 0, sizeof(*info));
+    memcpy(info->key.source, ip + 12, 4);
+    memcpy(info->key.destination, ip + 16, 4);
+    info->key.protocol = ip[9];
+    info->key.version = 4;
+    info->length = Read16(ip + 2);
+
+    // Only the first fragment carries the transport header.
+    if (Read16(ip + 6) & 0x1FFF)
+    {
+        return 1;
+    }
+
+    transport = ip + headerLength;
+    remaining = length - sizeof(ETH_HEADER) - headerLength;
+    if (info->key.protocol != IP_PROTO_ICMP && remaining >= 4)
+    {
+        info->key.sourcePort = Read16(transport);
+        info->key.destinationPort = Read16(transport + 2);
+    }
+    if (info->key.protocol == IP_PROTO_TCP && remaining >= 14)
+    {
+        info->tcpFlags = transport[13] & 0x3F;
+        info->sequence = Read32(transport + 4);
+    }
+    SetPayload(info, info->key.protocol, transport, ip + MIN(info->length, length - sizeof(ETH_HEADER)));
+
+    return 1;
+}
+
+static int IsIpv6Extension(unsigned char type)
+{
+    return type == IPV6_HOP_BY_HOP || type == IPV6_ROUTING || type == IPV6_FRAGMENT ||
+        type == IPV6_AUTHENTICATION || type == IPV6_DESTINATION;
+}
+
+// Walks the extension headers after the fixed IPv6 header and leaves the
+// upper layer type in protocol. Returns the offset of its header, or 0 for
+// a fragment after the first and for a chain cut short.
+static unsigned int SkipIpv6Headers(const unsigned char* frame, unsigned int length, unsigned int offset,
+    unsigned char* protocol)
+{
+    int i;
+
+    for (i = 0; i < PACKET_MAX_IPV6_HEADERS && IsIpv6Extension(*protocol); i++)
+    {
+        const unsigned char* header = frame + offset;
+        unsigned char type = *protocol;
+
+        if (offset + 8 > length)
+        {
+            return 0;
+        }
+
+        *protocol = header[0];
+        if (type == IPV6_FRAGMENT)
+        {
+            if (Read16(header + 2) & 0xFFF8)
+            {
+                return 0;
+            }
+            offset += 8;
+        }
+        else if (type == IPV6_AUTHENTICATION)
+        {
+            offset += (header[1] + 2) * 4;
+        }
+        else
+        {
+            offset += (header[1] + 1) * 8;
+        }
+    }
+
+    return IsIpv6Extension(*protocol) ? 0 : offset;
+}
+
+// Reads every layer of the frame while it is in cache, leaving the
+// classification to run over the columns afterwards.
+static void DecodeFrame(const unsigned char* frame, unsigned int length, PPACKET_BATCH batch, unsigned int i)
+{
+    PPACKET_INFO info = &batch->info[i];
+    unsigned int offset = ETH_HEADER_SIZE;
+    unsigned int transport = 0;
+    unsigned int end = 0; // of the datagram, before any Ethernet padding
+    unsigned short type = length >= ETH_HEADER_SIZE ? Read16(frame + 12) : 0;
+    unsigned short vlan = 0;
+    unsigned char version = 0;
+    unsigned char protocol = 0;
+    const unsigned char* ip;
+    int tags;
+
+    for (tags = 0; tags < PACKET_MAX_VLAN_TAGS && (type == ETHERTYPE_VLAN || type == ETHERTYPE_QINQ) &&
+        offset + 4 <= length; tags++)
+    {
+        if (!tags)
+        {
+            vlan = Read16(frame + offset) & 0x0FFF;
+        }
+        type = Read16(frame + offset + 2);
+        offset += 4;
+    }
+
+    memset(info, 0, sizeof(*info));
+    ip = frame + offset;
+    if (type == ETHERTYPE_IPV4 && offset + IPV4_HEADER_SIZE <= length && (ip[0] >> 4) == 4)
+    {
+        unsigned int headerLength = (ip[0] & 0x0F) * 4;
+
+        if (headerLength >= IPV4_HEADER_SIZE && offset + headerLength <= length)
+        {
+            version = 4;
+            protocol = ip[9];
+            info->length = Read16(ip + 2);
+            end = offset + info->length;
+            memcpy(info->key.source, ip + 12, 4);
+            memcpy(info->key.destination, ip + 16, 4);
+
+            // Only the first fragment carries the transport header.
+            if (!(Read16(ip + 6) & 0x1FFF))
+            {
+                transport = offset + headerLength;
+            }
+        }
+    }
+    else if (type == ETHERTYPE_IPV6 && offset + IPV6_HEADER_SIZE <= length && (ip[0] >> 4) == 6)
+    {
+        version = 6;
+        protocol = ip[6];
+        info->length = Read16(ip + 4) + IPV6_HEADER_SIZE;
+        end = offset + info->length;
+        memcpy(info->key.source, ip + 8, 16);
+        memcpy(info->key.destination, ip + 24, 16);
+        transport = SkipIpv6Headers(frame, length, offset + IPV6_HEADER_SIZE, &protocol);
+    }
+
+    if (transport && protocol != IP_PROTO_ICMP && protocol != IP_PROTO_ICMPV6 && transport + 4 <= length)
+    {
+        unsigned int payload = protocol == IP_PROTO_UDP ? transport + 8 : length;
+
+        info->key.sourcePort = Read16(frame + transport);
+        info->key.destinationPort = Read16(frame + transport + 2);
+        if (protocol == IP_PROTO_TCP && transport + 14 <= length)
+        {
+            info->tcpFlags = frame[transport + 13] & 0x3F;
+            info->sequence = Read32(frame + transport + 4);
+            payload = transport + MAX((frame[transport + 12] >> 4) * 4, 20);
+        }
+        end = MIN(end, length);
+        if (payload < end)
+        {
+            info->payload = frame + payload;
+            info->payloadLength = end - payload;
+        }
+    }
+
+    info->key.protocol = protocol;
+    info->key.version = version;
+    batch->vlan[i] = vlan;
+    batch->version[i] = version;
+    batch->protocol[i] = protocol;
+}
+
+static int IsKnownProtocol(unsigned char version, unsigned char protocol)
+{
+    return version &&
+        (protocol == IP_PROTO_ICMP || protocol == IP_PROTO_TCP || protocol == IP_PROTO_UDP ||
+         (protocol == IP_PROTO_ICMPV6 && version == 6));
+}
+
+// One bit per frame that is IP carrying ICMP, TCP or UDP.
+static unsigned long long ClassifyBatch(const unsigned char* version, const unsigned char* protocol, unsigned int count)
+{
+    unsigned long long mask = 0;
+    unsigned int i = 0;
+
+#ifdef PACKET_BATCH_SSE2
+    const __m128i none = _mm_setzero_si128();
+    const __m128i six = _mm_set1_epi8(6);
+    const __m128i icmp = _mm_set1_epi8(IP_PROTO_ICMP);
+    const __m128i tcp = _mm_set1_epi8(IP_PROTO_TCP);
+    const __m128i udp = _mm_set1_epi8(IP_PROTO_UDP);
+    const __m128i icmp6 = _mm_set1_epi8(IP_PROTO_ICMPV6);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(version + i));
+        __m128i p = _mm_loadu_si128((const __m128i*)(protocol + i));
+        __m128i known = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(p, icmp), _mm_cmpeq_epi8(p, tcp)),
+            _mm_or_si128(_mm_cmpeq_epi8(p, udp), _mm_and_si128(_mm_cmpeq_epi8(p, icmp6), _mm_cmpeq_epi8(v, six))));
+
+        known = _mm_andnot_si128(_mm_cmpeq_epi8(v, none), known);
+        mask |= (unsigned long long)(unsigned int)_mm_movemask_epi8(known) << i;
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        mask |= (unsigned long long)IsKnownProtocol(version[i], protocol[i]) << i;
+    }
+
+    return mask;
+}
+
+int DecodePacketBatch(const unsigned char* const* frames, const unsigned int* lengths, unsigned int count,
+    PPACKET_BATCH batch)
+{
+    unsigned long long mask;
+    unsigned int i;
+    int decoded = 0;
+
+    batch->count = MIN(count, PACKET_BATCH_SIZE);
+    for (i = 0; i < batch->count; i++)
+    {
+#ifdef PACKET_BATCH_SSE2
+        // Frames straight off a ring are rarely cached; asking for one a few
+        // ahead overlaps its miss with the decoding of those before it.
+        if (i + PACKET_PREFETCH_DISTANCE < batch->count)
+        {
+            _mm_prefetch((const char*)frames[i + PACKET_PREFETCH_DISTANCE], _MM_HINT_T0);
+        }
+#endif
+        DecodeFrame(frames[i], lengths[i], batch, i);
+    }
+    batch->decoded = ClassifyBatch(batch->version, batch->protocol, batch->count);
+
+    for (mask = batch->decoded; mask; mask &= mask - 1)
+    {
+        decoded++;
+    }
+
+    return decoded;
+}
\ No newline at end of file
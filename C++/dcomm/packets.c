@@ -1,11 +1,20 @@
-#include "..\sys\markusermode.h"
+#include "../sys/markusermode.h"
 
+#ifdef _WIN32
 #define WIN32
+#endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <pcap.h>
 #include "tcpip.h"
+#include "capturefilter.h"
 #include "communicator.h"
+#include "flowtable.h"
+#include "packetdecode.h"
+#include "platform.h"
+#include "sources.h"
 
 
 
@@ -16,109 +25,576 @@ typedef SOCKADDR_IN * PSOCKADDR_IN;
 
 #define PUCHAR unsigned char *
 
-BOOL CheckProtocol(UINT8 uProtocol)
+// One capture thread per interface, each a source of its own, so every
+// interface gets its own kernel buffer and a CPU to drain it on; the
+// sources all feed the same ingress queue.
+#define MAX_CAPTURE_INTERFACES 8
+#define CAPTURE_SNAPLEN 65536
+#define CAPTURE_TIMEOUT 1000      // ms, how long a read waits for a full buffer
+#define CAPTURE_STATS_INTERVAL 1000000ULL // us between pcap_stats calls
+#define CAPTURE_NAME_SIZE 256
+#define CAPTURE_FILE_BATCH 4096   // packets read from a file between filter checks
+#define CAPTURE_HEADER_SIZE 192   // bytes of each packet kept for the batch decoder
+#define CAPTURE_PAYLOAD_SIZE 2048 // kept instead when the flow tables look into payloads
+
+typedef struct _CAPTURE_INTERFACE
 {
-    if (uProtocol == IP_PROTO_ICMP)
-        return TRUE;
-    if (uProtocol == IP_PROTO_TCP)
-        return TRUE;
-    if (uProtocol == IP_PROTO_UDP)
-        return TRUE;
+    char name[CAPTURE_NAME_SIZE];
+    char description[CAPTURE_NAME_SIZE];
+    int cpu;
+    int bufferSize; // bytes
+    pcap_t* volatile handle;
+    volatile int stop;
+    int offline; // flows go by the capture time of the file
+    PFLOW_TABLE flows;
+    long long lastExpire;
+    long long filter; // generation of the capture filter set
+
+    // libpcap reuses its buffer once the callback returns, so the headers
+    // wait here for a full batch, with their payload if the table wants it.
+    unsigned char headers[PACKET_BATCH_SIZE][CAPTURE_PAYLOAD_SIZE];
+    unsigned int keep; // bytes copied of each packet
+    unsigned int lengths[PACKET_BATCH_SIZE];
+    long long times[PACKET_BATCH_SIZE]; // offline only
+    unsigned int pending;
+
+    unsigned long long packets;
+    unsigned long long decoded;
+    unsigned long long events; // flow events
+    // pcap_stats, widened from the 32 bit counters libpcap keeps
+    unsigned long long received;
+    unsigned long long dropped;   // no room in the kernel buffer
+    unsigned long long ifdropped; // by the interface or its driver
+    struct pcap_stat last;
+    unsigned long long lastPoll;
+} CAPTURE_INTERFACE, *PCAPTURE_INTERFACE;
+
+static CAPTURE_INTERFACE s_interfaces[MAX_CAPTURE_INTERFACES];
+static int s_interfaceCount = 0;
 
-    return FALSE;
+static CAPTURE_INTERFACE s_fileCapture;
+
+// pcap_compile is not thread safe before libpcap 1.8.
+static MARK_LOCK s_compileLock;
+// Held to break a capture loop and to take its handle away before the close.
+static MARK_LOCK s_handleLock;
+static int s_locksReady = 0;
+
+static void EmitFlow(PMARK_EVENT event, void* context)
+{
+    // Stamped here: pcap timestamps are wall clock, not MarkTimestamp.
+    event->time = MarkTimestamp();
+    SubmitEvent(event);
+    ((PCAPTURE_INTERFACE)context)->events++;
 }
 
-/* Callback function invoked by libpcap for every incoming packet */
-VOID HandlePacket(PUCHAR pParam, PPCAP_PKT_HEADER pHeader, PUCHAR pData)
+// Decodes the headers gathered by HandlePacket into the flow table.
+static void FlushPackets(PCAPTURE_INTERFACE capture)
 {
-    PETH_HEADER pEth = (PETH_HEADER)pData;
-    if (pEth->uEthType != ETH_TYPE_IPV4)
+    const unsigned char* frames[PACKET_BATCH_SIZE];
+    PACKET_BATCH batch;
+    long long now;
+    unsigned int i;
+
+    if (!capture->pending)
     {
         return;
     }
 
-    PIP_HEADER pIp = (PIP_HEADER)(pEth + 1);
+    for (i = 0; i < capture->pending; i++)
+    {
+        frames[i] = capture->headers[i];
+    }
+    capture->decoded += DecodePacketBatch(frames, capture->lengths, capture->pending, &batch);
 
-    if (pIp->bVersion != 4 || pIp->bHeaderLen != 5 || !CheckProtocol(pIp->bProto))
+    now = capture->offline ? capture->times[capture->pending - 1] : MarkTimestamp();
+    for (i = 0; i < capture->pending; i++)
+    {
+        if (batch.decoded >> i & 1)
+        {
+            FlowTableAdd(capture->flows, &batch.info[i], capture->offline ? capture->times[i] : now);
+        }
+    }
+    capture->pending = 0;
+
+    if (now - capture->lastExpire >= (long long)FLOW_EXPIRE_INTERVAL * MARK_TIMESTAMP_FREQUENCY)
+    {
+        FlowTableExpire(capture->flows, now);
+        capture->lastExpire = now;
+    }
+}
+
+/* Callback function invoked by libpcap for every incoming packet */
+VOID HandlePacket(PUCHAR pParam, PPCAP_PKT_HEADER pHeader, const unsigned char* pData)
+{
+    PCAPTURE_INTERFACE capture = (PCAPTURE_INTERFACE)pParam;
+    unsigned int size = MIN(pHeader->caplen, capture->keep);
+
+    capture->packets++;
+    memcpy(capture->headers[capture->pending], pData, size);
+    capture->lengths[capture->pending] = size;
+    if (capture->offline)
+    {
+        capture->times[capture->pending] =
+            (long long)pHeader->ts.tv_sec * MARK_TIMESTAMP_FREQUENCY + pHeader->ts.tv_usec * 10;
+    }
+    if (++capture->pending == PACKET_BATCH_SIZE)
+    {
+        FlushPackets(capture);
+    }
+}
+
+static void PollCaptureStats(PCAPTURE_INTERFACE capture, pcap_t* handle)
+{
+    struct pcap_stat stats;
+    unsigned long long dropped;
+
+    if (pcap_stats(handle, &stats) != 0)
     {
         return;
     }
 
-    MARK_EVENT evt = { 0 };
-    evt.flags = 0;
-    evt.opclass = MARK_OPCLASS_PACKET;
-    evt.optype = MARK_OPTYPE_WRITE;
-    evt.pid = 0;
-    evt.ppid = 0;
-    evt.szImagePath[0] = 0;
-    evt.szOperationPath[0] = 0;
-    evt.szProcessName[0] = 0;
-    evt.szUserName[0] = 0;
-    evt.tid = 0;
-    evt.time = 0;
+    // Differences in unsigned int survive the counters wrapping.
+    dropped = (unsigned int)(stats.ps_drop - capture->last.ps_drop);
+    capture->received += (unsigned int)(stats.ps_recv - capture->last.ps_recv);
+    capture->dropped += dropped;
+    capture->ifdropped += (unsigned int)(stats.ps_ifdrop - capture->last.ps_ifdrop);
+    capture->last = stats;
 
-    ProcessMessage(&evt);
+    if (dropped)
+    {
+        printf("Capture %s: %llu packets dropped, %llu in all\n", capture->name, dropped, capture->dropped);
+    }
 }
 
-DWORD WINAPI ProcessNetworkMessages(_In_ LPVOID parameter)
+static void InitLocks()
 {
-    pcap_if_t *alldevs;
-    pcap_if_t *d;
-    int inum;
-    int i = 0;
-    pcap_t *adhandle;
-    char errbuf[PCAP_ERRBUF_SIZE];
+    if (!s_locksReady)
+    {
+        MarkLockInit(&s_compileLock);
+        MarkLockInit(&s_handleLock);
+        s_locksReady = 1;
+    }
+}
 
-    if (pcap_findalldevs(&alldevs, errbuf) == -1)
+// The new filter takes the place of the old one in one step.
+static int SetCaptureFilter(PCAPTURE_INTERFACE capture, pcap_t* handle)
+{
+    CAPTURE_FILTER filter;
+    struct bpf_program program;
+    int result;
+
+    GetCaptureFilter(&filter);
+    capture->filter = filter.generation;
+    if (!filter.generation)
     {
         return 1;
     }
 
-    for (d = alldevs; d; d = d->next, i++) {}
+    MarkLockAcquire(&s_compileLock);
+    result = pcap_compile(handle, &program, filter.expression, 1, PCAP_NETMASK_UNKNOWN);
+    MarkLockRelease(&s_compileLock);
+    if (result != 0)
+    {
+        printf("Cannot compile capture filter %lld for %s: %s\n", filter.generation, capture->name, pcap_geterr(handle));
+        return 0;
+    }
+
+    result = pcap_setfilter(handle, &program);
+    pcap_freecode(&program);
+    if (result != 0)
+    {
+        printf("Cannot set capture filter %lld on %s: %s\n", filter.generation, capture->name, pcap_geterr(handle));
+        return 0;
+    }
+
+    return 1;
+}
+
+static pcap_t* OpenCaptureInterface(PCAPTURE_INTERFACE capture)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t* handle;
+    int result;
+
+    handle = pcap_create(capture->name, errbuf);
+    if (!handle)
+    {
+        printf("Cannot open %s: %s\n", capture->name, errbuf);
+        return NULL;
+    }
+
+    pcap_set_snaplen(handle, CAPTURE_SNAPLEN);
+    pcap_set_promisc(handle, 1);
+    pcap_set_timeout(handle, CAPTURE_TIMEOUT);
+    pcap_set_buffer_size(handle, capture->bufferSize);
+
+    // Warnings (positive results) still leave a working handle.
+    result = pcap_activate(handle);
+    if (result < 0)
+    {
+        printf("Cannot capture on %s: %s\n", capture->name, pcap_geterr(handle));
+        pcap_close(handle);
+        return NULL;
+    }
+
+    if (pcap_datalink(handle) != DLT_EN10MB)
+    {
+        printf("%s is not an Ethernet interface\n", capture->name);
+        pcap_close(handle);
+        return NULL;
+    }
+
+    if (!SetCaptureFilter(capture, handle))
+    {
+        pcap_close(handle);
+        return NULL;
+    }
+
+    return handle;
+}
+
+static void SetCaptureHandle(PCAPTURE_INTERFACE capture, pcap_t* handle)
+{
+    MarkLockAcquire(&s_handleLock);
+    capture->handle = handle;
+    MarkLockRelease(&s_handleLock);
+}
+
+// Under the lock, so the capture thread cannot close the handle in between.
+static void BreakCapture(PCAPTURE_INTERFACE capture, volatile int* stop)
+{
+    MarkLockAcquire(&s_handleLock);
+    *stop = 1;
+    if (capture->handle)
+    {
+        pcap_breakloop(capture->handle);
+    }
+    MarkLockRelease(&s_handleLock);
+}
+
+static int RunPacketSource(void* context)
+{
+    PCAPTURE_INTERFACE capture = (PCAPTURE_INTERFACE)context;
+    pcap_t* handle;
+    int result = 1;
+
+    if (!MarkThreadPin(capture->cpu))
+    {
+        printf("Cannot pin the capture thread of %s to CPU %d\n", capture->name, capture->cpu);
+    }
+
+    handle = OpenCaptureInterface(capture);
+    if (!handle)
+    {
+        FlowTableDestroy(capture->flows);
+        capture->flows = NULL;
+        return 0;
+    }
+
+    // pcap_breakloop from StopPacketSource ends the dispatch
+    SetCaptureHandle(capture, handle);
+    capture->lastPoll = MarkClockMicroseconds();
+    while (!capture->stop)
+    {
+        unsigned long long now;
+
+        if (GetCaptureFilterGeneration() != capture->filter)
+        {
+            SetCaptureFilter(capture, handle);
+        }
+
+        if (pcap_dispatch(handle, -1, HandlePacket, (PUCHAR)capture) < 0)
+        {
+            if (!capture->stop)
+            {
+                printf("Capture on %s failed: %s\n", capture->name, pcap_geterr(handle));
+                result = 0;
+            }
+            break;
+        }
+        FlushPackets(capture);
+
+        now = MarkClockMicroseconds();
+        if (now - capture->lastPoll >= CAPTURE_STATS_INTERVAL)
+        {
+            // Also ends the flows of a quiet interface.
+            PollCaptureStats(capture, handle);
+            capture->lastExpire = MarkTimestamp();
+            FlowTableExpire(capture->flows, capture->lastExpire);
+            capture->lastPoll = now;
+        }
+    }
+    SetCaptureHandle(capture, NULL);
+    FlushPackets(capture);
+
+    PollCaptureStats(capture, handle);
+    pcap_close(handle);
+    FlowTableDestroy(capture->flows);
+    capture->flows = NULL;
+    return result;
+}
+
+static void StopPacketSource(void* context)
+{
+    PCAPTURE_INTERFACE capture = (PCAPTURE_INTERFACE)context;
+
+    BreakCapture(capture, &capture->stop);
+}
+
+static volatile int s_stop = 0;
+
+static void StopPacketFileSource(void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    BreakCapture(&s_fileCapture, &s_stop);
+}
+
+static const char* s_file = NULL;
+
+// Capture files pcapfile.c does not read itself, such as pcapng.
+static int RunPacketFileSource(void* context)
+{
+    char errbuf[PCAP_ERRBUF_SIZE];
+    pcap_t* handle;
+
+    UNREFERENCED_PARAMETER(context);
+
+    handle = pcap_open_offline(s_file, errbuf);
+    if (!handle)
+    {
+        printf("Cannot open %s: %s\n", s_file, errbuf);
+        return 0;
+    }
+    if (pcap_datalink(handle) != DLT_EN10MB)
+    {
+        printf("%s is not an Ethernet capture\n", s_file);
+        pcap_close(handle);
+        return 0;
+    }
+
+    // Read in batches, so a new capture filter applies from the next one.
+    SetCaptureHandle(&s_fileCapture, handle);
+    while (!s_stop)
+    {
+        if (GetCaptureFilterGeneration() != s_fileCapture.filter && !SetCaptureFilter(&s_fileCapture, handle))
+        {
+            break;
+        }
+        if (pcap_dispatch(handle, CAPTURE_FILE_BATCH, HandlePacket, (PUCHAR)&s_fileCapture) <= 0)
+        {
+            break;
+        }
+    }
+    SetCaptureHandle(&s_fileCapture, NULL);
+    FlushPackets(&s_fileCapture);
+
+    pcap_close(handle);
+    FlowTableDestroy(s_fileCapture.flows);
+    s_fileCapture.flows = NULL;
+    return 1;
+}
+
+int RegisterPacketFileSource(const char* path)
+{
+    // The file's sockets are not this host's.
+    FLOW_OPTIONS options = g_FlowOptions;
+
+    options.owners = 0;
+    InitLocks();
+    s_stop = 0;
+    s_file = path;
+
+    memset(&s_fileCapture, 0, sizeof(s_fileCapture));
+    strncpy(s_fileCapture.name, "pcap", sizeof(s_fileCapture.name) - 1);
+    s_fileCapture.offline = 1;
+    s_fileCapture.keep = IsFlowPayloadWanted(&options) ? CAPTURE_PAYLOAD_SIZE : CAPTURE_HEADER_SIZE;
+    s_fileCapture.flows = FlowTableCreate(s_fileCapture.name, &options, EmitFlow, &s_fileCapture);
+    if (!s_fileCapture.flows)
+    {
+        return 0;
+    }
+
+    return RegisterSource("pcap", RunPacketFileSource, StopPacketFileSource, NULL, SOURCE_LOSSLESS);
+}
+
+static void ListCaptureInterfaces(pcap_if_t* devices)
+{
+    pcap_if_t* d;
+    int i = 1;
+
+    for (d = devices; d; d = d->next, i++)
+    {
+        printf("  %d. %s%s%s%s\n", i, d->name, d->description ? " (" : "", d->description ? d->description : "",
+            d->description ? ")" : "");
+    }
+}
+
+static int AddCaptureInterface(pcap_if_t* device, int cpu, int bufferSize)
+{
+    PCAPTURE_INTERFACE capture;
+    int i;
+
+    for (i = 0; i < s_interfaceCount; i++)
+    {
+        if (!strcmp(s_interfaces[i].name, device->name))
+        {
+            return 1;
+        }
+    }
+    if (s_interfaceCount == MAX_CAPTURE_INTERFACES)
+    {
+        printf("Capturing on the first %d interfaces only\n", MAX_CAPTURE_INTERFACES);
+        return 0;
+    }
+
+    capture = &s_interfaces[s_interfaceCount++];
+    memset(capture, 0, sizeof(*capture));
+    strncpy(capture->name, device->name, sizeof(capture->name) - 1);
+    if (device->description)
+    {
+        strncpy(capture->description, device->description, sizeof(capture->description) - 1);
+    }
+    capture->cpu = cpu;
+    capture->bufferSize = bufferSize;
+    return 1;
+}
+
+// A device by name or by its number in the list, counting from 1.
+static pcap_if_t* FindCaptureInterface(pcap_if_t* devices, const char* name)
+{
+    pcap_if_t* d;
+    int number = atoi(name);
+    int i = 1;
 
-    if (i == 0)
+    for (d = devices; d; d = d->next, i++)
     {
-        return -1;
+        if (!strcmp(d->name, name) || (number > 0 && number == i && name[strspn(name, "0123456789")] == 0))
+        {
+            return d;
+        }
     }
-    inum = i-2;
 
-    for (d = alldevs, i = 0; i < inum - 1; d = d->next, i++)
+    return NULL;
+}
+
+// interfaces: NULL or "all" for every interface with an address apart from
+// loopback, or a comma separated list of names or numbers, each with an
+// optional @cpu. Interfaces without a CPU are spread over the CPUs in turn.
+static int SelectCaptureInterfaces(pcap_if_t* devices, const char* interfaces, int bufferSize)
+{
+    char item[CAPTURE_NAME_SIZE];
+    const char* next = interfaces;
+    pcap_if_t* d;
+
+    if (!interfaces || !strcmp(interfaces, "all"))
     {
-        // Open the device
-        if ((adhandle = pcap_open_live(d->name,	
-            65536,			
-            1,				
-            1000,			
-            errbuf			
-            )) == NULL)
+        for (d = devices; d; d = d->next)
         {
-            return -1;
+            if (d->addresses && !(d->flags & PCAP_IF_LOOPBACK) && !AddCaptureInterface(d, -1, bufferSize))
+            {
+                break;
+            }
         }
+        return s_interfaceCount;
+    }
+
+    while (*next)
+    {
+        size_t length = strcspn(next, ",");
+        char* at;
+        int cpu = -1;
 
-        struct pcap_addr * addrs = d->addresses;
-        while (addrs)
+        if (length >= sizeof(item))
+        {
+            length = sizeof(item) - 1;
+        }
+        memcpy(item, next, length);
+        item[length] = 0;
+        next += strcspn(next, ",");
+        if (*next)
         {
-            addrs = addrs->next;
+            next++;
         }
 
-        // start the capture
-        pcap_loop(adhandle, 0, HandlePacket, NULL);
+        at = strrchr(item, '@');
+        if (at)
+        {
+            *at = 0;
+            cpu = atoi(at + 1);
+        }
 
-        pcap_close(adhandle);
+        d = FindCaptureInterface(devices, item);
+        if (!d)
+        {
+            printf("No capture interface %s\n", item);
+            return 0;
+        }
+        if (!AddCaptureInterface(d, cpu, bufferSize))
+        {
+            break;
+        }
+    }
+
+    return s_interfaceCount;
+}
+
+int RegisterPacketSource(const char* interfaces, int bufferSize)
+{
+    pcap_if_t* devices;
+    char errbuf[PCAP_ERRBUF_SIZE];
+    int cpus = MarkCpuCount();
+    int registered = 0;
+    int i;
+
+    InitLocks();
+    if (pcap_findalldevs(&devices, errbuf) == -1)
+    {
+        printf("Cannot list capture devices: %s\n", errbuf);
         return 0;
     }
 
-    pcap_freealldevs(alldevs);
+    s_interfaceCount = 0;
+    if (!SelectCaptureInterfaces(devices, interfaces, (bufferSize > 0 ? bufferSize : CAPTURE_DEFAULT_BUFFER) * 1024 * 1024))
+    {
+        printf("Nothing to capture on, the interfaces are:\n");
+        ListCaptureInterfaces(devices);
+    }
+    pcap_freealldevs(devices);
+
+    for (i = 0; i < s_interfaceCount; i++)
+    {
+        PCAPTURE_INTERFACE capture = &s_interfaces[i];
+
+        if (capture->cpu < 0)
+        {
+            capture->cpu = i % cpus;
+        }
+        capture->keep = IsFlowPayloadWanted(NULL) ? CAPTURE_PAYLOAD_SIZE : CAPTURE_HEADER_SIZE;
+        capture->flows = FlowTableCreate(capture->name, NULL, EmitFlow, capture);
+        if (!capture->flows)
+        {
+            continue;
+        }
+        registered += RegisterSource(capture->name, RunPacketSource, StopPacketSource, capture, 0);
+    }
 
-    return 0;
+    return registered;
 }
 
-void StartPacketCapture()
+void PrintPacketSourceStats()
 {
-    HANDLE thread = CreateThread(NULL, 0, ProcessNetworkMessages, 0, 0, NULL);
+    int i;
 
-    if (!thread)
-        return;
+    for (i = 0; i < s_interfaceCount; i++)
+    {
+        PCAPTURE_INTERFACE capture = &s_interfaces[i];
 
-    WaitForSingleObject(thread, INFINITE);
+        printf("Capture %s%s%s%s: %llu packets, %llu decoded, %llu flow events, %llu received by the filter, "
+               "%llu dropped, %llu dropped by the interface, %d MB buffer on CPU %d\n",
+            capture->name, capture->description[0] ? " (" : "", capture->description,
+            capture->description[0] ? ")" : "", capture->packets, capture->decoded, capture->events, capture->received,
+            capture->dropped, capture->ifdropped, capture->bufferSize / (1024 * 1024), capture->cpu);
+    }
 }
\ No newline at end of file
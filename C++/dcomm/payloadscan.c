@@ -0,0 +1,375 @@
+#include "payloadscan.h"
+#include "../sys/core.h"
+#include "tcpip.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PAYLOAD_SCAN_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define PROTOCOL_BITTORRENT 1
+#define PROTOCOL_BITTORRENT_DHT 2
+#define PROTOCOL_BITTORRENT_TRACKER 3
+#define PROTOCOL_SSH 4
+#define PROTOCOL_HTTP_CONNECT 5
+#define PROTOCOL_SOCKS5 6
+#define PROTOCOL_OPENVPN 7
+#define PROTOCOL_WIREGUARD 8
+#define PROTOCOL_L2TP 9
+
+#define MAX_SCAN_SIGNATURES 32
+#define MAX_SCAN_PAIRS 16
+
+static const char* s_protocols[] =
+{
+    NULL, "bittorrent", "bittorrent-dht", "bittorrent-tracker", "ssh", "http-connect", "socks5", "openvpn",
+    "wireguard", "l2tp"
+};
+
+typedef struct _PAYLOAD_SIGNATURE
+{
+    int protocol;
+    unsigned char transport; // IP_PROTO_TCP or IP_PROTO_UDP, 0 for both
+    const char* pattern;
+    unsigned int length;
+    const char* mask;        // 'x' where the byte counts, NULL for all of them; anchored only
+    int anchored;
+    unsigned int exact;      // payload length the message must have, 0 for any
+    int framed;              // TCP messages behind their 16 bit length
+} PAYLOAD_SIGNATURE, *PPAYLOAD_SIGNATURE;
+
+#define PATTERN(text) text, sizeof(text) - 1
+
+// Hex escapes go on for as long as there are hex digits, hence the split
+// strings.
+static const PAYLOAD_SIGNATURE s_signatures[] =
+{
+    // Peer handshake: 19, then the protocol name.
+    { PROTOCOL_BITTORRENT, IP_PROTO_TCP, PATTERN("\x13" "BitTorrent prot"), NULL, 1, 0, 0 },
+    // KRPC over bencode: a query or a response with the node id first, or
+    // the message type key, which most clients write last.
+    { PROTOCOL_BITTORRENT_DHT, IP_PROTO_UDP, PATTERN("d1:ad2:id20:"), NULL, 1, 0, 0 },
+    { PROTOCOL_BITTORRENT_DHT, IP_PROTO_UDP, PATTERN("d1:rd2:id20:"), NULL, 1, 0, 0 },
+    { PROTOCOL_BITTORRENT_DHT, IP_PROTO_UDP, PATTERN("1:y1:qe"), NULL, 0, 0, 0 },
+    { PROTOCOL_BITTORRENT_DHT, IP_PROTO_UDP, PATTERN("1:y1:re"), NULL, 0, 0, 0 },
+    // HTTP announces and scrapes, and the UDP tracker's connect request
+    // with its magic connection id.
+    { PROTOCOL_BITTORRENT_TRACKER, IP_PROTO_TCP, PATTERN("GET /announce"), NULL, 1, 0, 0 },
+    { PROTOCOL_BITTORRENT_TRACKER, IP_PROTO_TCP, PATTERN("info_hash="), NULL, 0, 0, 0 },
+    { PROTOCOL_BITTORRENT_TRACKER, IP_PROTO_UDP, PATTERN("\x00\x00\x04\x17\x27\x10\x19\x80\x00\x00\x00\x00"), NULL,
+      1, 16, 0 },
+    { PROTOCOL_SSH, IP_PROTO_TCP, PATTERN("SSH-2.0-"), NULL, 1, 0, 0 },
+    { PROTOCOL_SSH, IP_PROTO_TCP, PATTERN("SSH-1.99-"), NULL, 1, 0, 0 },
+    { PROTOCOL_HTTP_CONNECT, IP_PROTO_TCP, PATTERN("CONNECT "), NULL, 1, 0, 0 },
+    // Greeting offering no authentication, or that and a password.
+    { PROTOCOL_SOCKS5, IP_PROTO_TCP, PATTERN("\x05\x01\x00"), NULL, 1, 3, 0 },
+    { PROTOCOL_SOCKS5, IP_PROTO_TCP, PATTERN("\x05\x02\x00\x02"), NULL, 1, 4, 0 },
+    // The client's hard reset: opcode 7, key 0, then the session id, an
+    // empty ack array and packet id 0 when there is no tls-auth in front.
+    { PROTOCOL_OPENVPN, IP_PROTO_TCP, PATTERN("\x00\x00\x38"), "..x", 1, 0, 1 },
+    { PROTOCOL_OPENVPN, IP_PROTO_UDP, PATTERN("\x38\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"),
+      "x........xxxxx", 1, 14, 0 },
+    // Handshake initiation and response, each of a fixed size.
+    { PROTOCOL_WIREGUARD, IP_PROTO_UDP, PATTERN("\x01\x00\x00\x00"), NULL, 1, 148, 0 },
+    { PROTOCOL_WIREGUARD, IP_PROTO_UDP, PATTERN("\x02\x00\x00\x00"), NULL, 1, 92, 0 },
+    // Version 2 control message opening a tunnel: ids and sequence all 0.
+    { PROTOCOL_L2TP, IP_PROTO_UDP, PATTERN("\xC8\x02\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"), "xx..xxxxxxxx", 1, 0,
+      0 },
+};
+
+typedef struct _SCAN_ANCHOR
+{
+    unsigned char bytes[PAYLOAD_SCAN_ANCHOR];
+    unsigned int care; // bit per byte that counts
+    const PAYLOAD_SIGNATURE* signature;
+} SCAN_ANCHOR, *PSCAN_ANCHOR;
+
+// Floating patterns that start with the same two bytes.
+typedef struct _SCAN_PAIR
+{
+    unsigned char first;
+    unsigned char second;
+    int count;
+    const PAYLOAD_SIGNATURE* signatures[MAX_SCAN_SIGNATURES];
+} SCAN_PAIR, *PSCAN_PAIR;
+
+// The signatures of one transport.
+typedef struct _SCAN_LIST
+{
+    SCAN_ANCHOR anchors[MAX_SCAN_SIGNATURES];
+    int anchorCount;
+    SCAN_PAIR pairs[MAX_SCAN_PAIRS];
+    int pairCount;
+} SCAN_LIST, *PSCAN_LIST;
+
+struct _PAYLOAD_SCANNER
+{
+    SCAN_LIST tcp;
+    SCAN_LIST udp;
+};
+
+#ifdef PAYLOAD_SCAN_SSE2
+static unsigned int LowestBit(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+static void AddSignature(PSCAN_LIST list, const PAYLOAD_SIGNATURE* signature)
+{
+    unsigned int i;
+    int j;
+
+    if (signature->anchored)
+    {
+        PSCAN_ANCHOR anchor = &list->anchors[list->anchorCount++];
+
+        memcpy(anchor->bytes, signature->pattern, signature->length);
+        for (i = 0; i < signature->length; i++)
+        {
+            if (!signature->mask || signature->mask[i] == 'x')
+            {
+                anchor->care |= 1u << i;
+            }
+        }
+        anchor->signature = signature;
+        return;
+    }
+
+    for (j = 0; j < list->pairCount; j++)
+    {
+        if (list->pairs[j].first == (unsigned char)signature->pattern[0] &&
+            list->pairs[j].second == (unsigned char)signature->pattern[1])
+        {
+            break;
+        }
+    }
+    if (j == list->pairCount)
+    {
+        list->pairs[j].first = (unsigned char)signature->pattern[0];
+        list->pairs[j].second = (unsigned char)signature->pattern[1];
+        list->pairCount++;
+    }
+    list->pairs[j].signatures[list->pairs[j].count++] = signature;
+}
+
+PPAYLOAD_SCANNER CreatePayloadScanner()
+{
+    PPAYLOAD_SCANNER scanner = (PPAYLOAD_SCANNER)calloc(1, sizeof(PAYLOAD_SCANNER));
+    unsigned int i;
+
+    if (!scanner)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < sizeof(s_signatures) / sizeof(s_signatures[0]); i++)
+    {
+        if (s_signatures[i].transport != IP_PROTO_UDP)
+        {
+            AddSignature(&scanner->tcp, &s_signatures[i]);
+        }
+        if (s_signatures[i].transport != IP_PROTO_TCP)
+        {
+            AddSignature(&scanner->udp, &s_signatures[i]);
+        }
+    }
+
+    return scanner;
+}
+
+void DestroyPayloadScanner(PPAYLOAD_SCANNER scanner)
+{
+    free(scanner);
+}
+
+static int CheckLength(const PAYLOAD_SIGNATURE* signature, const unsigned char* payload, unsigned int length)
+{
+    if (signature->exact && length != signature->exact)
+    {
+        return 0;
+    }
+    if (signature->framed && (length < 2 || ((unsigned int)payload[0] << 8 | payload[1]) != length - 2))
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+static int ScanAnchors(PSCAN_LIST list, const unsigned char* payload, unsigned int length)
+{
+    unsigned char head[PAYLOAD_SCAN_ANCHOR];
+#ifdef PAYLOAD_SCAN_SSE2
+    __m128i bytes;
+#endif
+    int i;
+
+    // A short payload is padded; the length check below keeps the padding
+    // from matching.
+    if (length < PAYLOAD_SCAN_ANCHOR)
+    {
+        memset(head, 0, sizeof(head));
+        memcpy(head, payload, length);
+        payload = head;
+    }
+#ifdef PAYLOAD_SCAN_SSE2
+    bytes = _mm_loadu_si128((const __m128i*)payload);
+#endif
+
+    for (i = 0; i < list->anchorCount; i++)
+    {
+        PSCAN_ANCHOR anchor = &list->anchors[i];
+        unsigned int equal = 0;
+
+#ifdef PAYLOAD_SCAN_SSE2
+        equal = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_loadu_si128((const __m128i*)anchor->bytes)));
+#else
+        unsigned int j;
+
+        for (j = 0; j < PAYLOAD_SCAN_ANCHOR; j++)
+        {
+            equal |= (unsigned int)(payload[j] == anchor->bytes[j]) << j;
+        }
+#endif
+        if ((equal & anchor->care) == anchor->care && length >= anchor->signature->length &&
+            CheckLength(anchor->signature, payload, length))
+        {
+            return anchor->signature->protocol;
+        }
+    }
+
+    return 0;
+}
+
+static int CheckPair(PSCAN_PAIR pair, const unsigned char* payload, unsigned int length, unsigned int offset)
+{
+    int i;
+
+    for (i = 0; i < pair->count; i++)
+    {
+        const PAYLOAD_SIGNATURE* signature = pair->signatures[i];
+
+        if (offset + signature->length <= length &&
+            !memcmp(payload + offset + 2, signature->pattern + 2, signature->length - 2))
+        {
+            return signature->protocol;
+        }
+    }
+
+    return 0;
+}
+
+static int ScanPairs(PSCAN_LIST list, const unsigned char* payload, unsigned int length)
+{
+    unsigned int offset = 0;
+    int protocol;
+    int i;
+
+#ifdef PAYLOAD_SCAN_SSE2
+    __m128i first[MAX_SCAN_PAIRS];
+    __m128i second[MAX_SCAN_PAIRS];
+
+    for (i = 0; i < list->pairCount; i++)
+    {
+        first[i] = _mm_set1_epi8((char)list->pairs[i].first);
+        second[i] = _mm_set1_epi8((char)list->pairs[i].second);
+    }
+
+    // Each pair is looked for at 16 offsets at once, its first byte in one
+    // load and its second in the load a byte on.
+    for (; offset + PAYLOAD_SCAN_ANCHOR + 1 <= length; offset += PAYLOAD_SCAN_ANCHOR)
+    {
+        __m128i here = _mm_loadu_si128((const __m128i*)(payload + offset));
+        __m128i next = _mm_loadu_si128((const __m128i*)(payload + offset + 1));
+
+        for (i = 0; i < list->pairCount; i++)
+        {
+            unsigned int candidates = (unsigned int)_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(here, first[i]), _mm_cmpeq_epi8(next, second[i])));
+
+            for (; candidates; candidates &= candidates - 1)
+            {
+                protocol = CheckPair(&list->pairs[i], payload, length, offset + LowestBit(candidates));
+                if (protocol)
+                {
+                    return protocol;
+                }
+            }
+        }
+    }
+#endif
+
+    for (; offset + 1 < length; offset++)
+    {
+        for (i = 0; i < list->pairCount; i++)
+        {
+            if (payload[offset] == list->pairs[i].first && payload[offset + 1] == list->pairs[i].second &&
+                (protocol = CheckPair(&list->pairs[i], payload, length, offset)) != 0)
+            {
+                return protocol;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int ScanPayload(PPAYLOAD_SCANNER scanner, unsigned char transport, const unsigned char* payload, unsigned int length,
+    unsigned int offset, unsigned int limit)
+{
+    PSCAN_LIST list;
+    int protocol = 0;
+
+    if (transport == IP_PROTO_TCP)
+    {
+        list = &scanner->tcp;
+    }
+    else if (transport == IP_PROTO_UDP)
+    {
+        list = &scanner->udp;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (!length || offset >= limit)
+    {
+        return 0;
+    }
+    if (!offset || transport == IP_PROTO_UDP)
+    {
+        protocol = ScanAnchors(list, payload, length);
+    }
+    if (!protocol && list->pairCount)
+    {
+        protocol = ScanPairs(list, payload, MIN(length, limit - offset));
+    }
+
+    return protocol;
+}
+
+const char* GetPayloadProtocolName(int protocol)
+{
+    if (protocol <= 0 || protocol >= (int)(sizeof(s_protocols) / sizeof(s_protocols[0])))
+    {
+        return "";
+    }
+
+    return s_protocols[protocol];
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef _PAYLOADSCAN_H_
+#define _PAYLOADSCAN_H_
+
+// Tells a flow's protocol from signatures in its first bytes, whatever the
+// ports. A signature is either anchored, a prefix of up to 16 bytes with
+// wildcards that a message starts with, or floating, a string found
+// anywhere in the bytes scanned:
+//   anchored  all of them are compared at once against the first 16 bytes,
+//             one SSE2 compare each, and some also ask for an exact payload
+//             length or a 16 bit length frame in front
+//   floating  candidates are found 16 positions at a time by the first two
+//             bytes of every pattern, and only those are compared in full
+// Anchored signatures are tried on the first payload of each direction of
+// a TCP flow and on every datagram of a UDP one. A floating pattern split
+// between two segments is not found. Without SSE2 the same is done a byte
+// at a time.
+//
+// A scanner is read only once created, one per flow table.
+
+#define PAYLOAD_SCAN_DEFAULT_BYTES 256 // of each direction of a flow
+#define PAYLOAD_SCAN_ANCHOR 16         // bytes an anchored signature may look at
+
+typedef struct _PAYLOAD_SCANNER PAYLOAD_SCANNER, *PPAYLOAD_SCANNER;
+
+PPAYLOAD_SCANNER CreatePayloadScanner();
+void DestroyPayloadScanner(PPAYLOAD_SCANNER scanner);
+
+// transport is IP_PROTO_TCP or IP_PROTO_UDP. offset is how many bytes of
+// the direction came before this payload, and limit how many of them are
+// scanned in all. Returns a protocol, 0 for none.
+int ScanPayload(PPAYLOAD_SCANNER scanner, unsigned char transport, const unsigned char* payload, unsigned int length,
+    unsigned int offset, unsigned int limit);
+// Lower case, such as "bittorrent-dht".
+const char* GetPayloadProtocolName(int protocol);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,688 @@
+#include "pcapfile.h"
+#include "capturefilter.h"
+#include "flowtable.h"
+#include "packetdecode.h"
+#include "platform.h"
+#include "sources.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PCAP_MAGIC_SWAPPED 0xD4C3B2A1
+#define PCAP_MAGIC_NANO_SWAPPED 0x4D3CB2A1
+#define PCAP_SYNC_SPAN (366 * 24 * 3600) // seconds a packet may be away from the first one
+#define PCAP_NO_BOUNDARY (~0ULL)
+
+// A packet kept by a worker, decoded as far as the flow table needs.
+typedef struct _PCAP_PACKET
+{
+    unsigned long long time; // ns since the epoch
+    unsigned long long offset; // in the file, keeps equal times in file order
+    PACKET_INFO info;
+} PCAP_PACKET, *PPCAP_PACKET;
+
+typedef struct _PCAP_CHUNK
+{
+    unsigned long long begin; // where the worker looked for the first record
+    unsigned long long limit; // records starting before this are the chunk's
+    unsigned long long start; // first record found, PCAP_NO_BOUNDARY if none
+    unsigned long long end;   // after the last record
+    int error;
+
+    PPCAP_PACKET packets;
+    unsigned long count;
+    unsigned long capacity;
+    unsigned long long records;
+    unsigned long long skipped;
+    unsigned long next; // merge position
+} PCAP_CHUNK, *PPCAP_CHUNK;
+
+typedef struct _PCAP_WORKER
+{
+    int index;
+    MARK_THREAD thread;
+    unsigned long long generation;
+    LATENCY_HISTOGRAM parse;
+} PCAP_WORKER, *PPCAP_WORKER;
+
+static const char* s_path = NULL;
+static MARK_MAP s_map;
+static int s_swapped = 0;
+static int s_nano = 0;
+static unsigned int s_snaplen = PCAP_MAX_SNAPLEN;
+static unsigned int s_firstSeconds = 0;
+
+// Two sets of chunks: the workers fill one while the other is merged.
+static PCAP_CHUNK s_chunks[2][PCAP_MAX_WORKERS];
+static PCAP_WORKER s_workers[PCAP_MAX_WORKERS];
+static int s_workerCount = 0;
+static MARK_LOCK s_lock;
+static MARK_COND s_wake;
+static MARK_COND s_done;
+static unsigned long long s_generation = 0;
+static int s_set = 0;
+static int s_active = 0;  // chunks in the current window
+static int s_pending = 0; // of them still being parsed
+static volatile int s_stop = 0;
+static int s_exit = 0;
+
+static PCAP_STATS s_stats;
+static PFLOW_TABLE s_flows = NULL;
+static unsigned long long s_lastExpire = 0; // capture time, ns
+static CAPTURE_FILTER s_filter; // rules only, there is no kernel to hand the program to
+
+static unsigned int Swap32(unsigned int value)
+{
+    return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+static void ReadRecordHeader(unsigned long long offset, PPCAP_RECORD_HEADER header)
+{
+    memcpy(header, s_map.base + offset, sizeof(*header));
+
+    if (s_swapped)
+    {
+        header->seconds = Swap32(header->seconds);
+        header->fraction = Swap32(header->fraction);
+        header->captured = Swap32(header->captured);
+        header->length = Swap32(header->length);
+    }
+}
+
+static int IsPlausible(PPCAP_RECORD_HEADER header)
+{
+    return header->captured <= s_snaplen && header->captured <= header->length &&
+        header->length <= PCAP_MAX_SNAPLEN * 4 && header->fraction < (s_nano ? 1000000000u : 1000000u) &&
+        header->seconds + (unsigned long long)PCAP_SYNC_SPAN >= s_firstSeconds &&
+        header->seconds <= s_firstSeconds + (unsigned long long)PCAP_SYNC_SPAN;
+}
+
+// A chunk starts at an arbitrary byte, so the first record is guessed: the
+// first offset from which PCAP_SYNC_RECORDS plausible headers chain up, or
+// chain exactly to the end of the file. The merge checks the guess against
+// where the chunk before it really ended.
+static unsigned long long FindBoundary(unsigned long long from, unsigned long long limit)
+{
+    unsigned long long position;
+
+    for (position = from; position < limit; position++)
+    {
+        unsigned long long next = position;
+        int chained = 0;
+
+        while (chained < PCAP_SYNC_RECORDS && next + sizeof(PCAP_RECORD_HEADER) <= s_map.size)
+        {
+            PCAP_RECORD_HEADER header;
+
+            ReadRecordHeader(next, &header);
+            if (!IsPlausible(&header) || next + sizeof(header) + header.captured > s_map.size)
+            {
+                break;
+            }
+            next += sizeof(header) + header.captured;
+            chained++;
+        }
+
+        if (chained == PCAP_SYNC_RECORDS || (chained && next == s_map.size))
+        {
+            return position;
+        }
+    }
+
+    return PCAP_NO_BOUNDARY;
+}
+
+static int AddPacket(PPCAP_CHUNK chunk, unsigned long long time, unsigned long long offset, PPACKET_INFO info)
+{
+    if (chunk->count == chunk->capacity)
+    {
+        unsigned long capacity = chunk->capacity ? chunk->capacity * 2 : 4096;
+        PPCAP_PACKET packets = (PPCAP_PACKET)realloc(chunk->packets, capacity * sizeof(PCAP_PACKET));
+
+        if (!packets)
+        {
+            return 0;
+        }
+        chunk->packets = packets;
+        chunk->capacity = capacity;
+    }
+
+    chunk->packets[chunk->count].time = time;
+    chunk->packets[chunk->count].offset = offset;
+    chunk->packets[chunk->count].info = *info;
+    chunk->count++;
+
+    return 1;
+}
+
+// Records waiting for the batch decoder.
+typedef struct _PCAP_PENDING
+{
+    const unsigned char* frames[PACKET_BATCH_SIZE];
+    unsigned int lengths[PACKET_BATCH_SIZE];
+    unsigned long long times[PACKET_BATCH_SIZE];
+    unsigned long long offsets[PACKET_BATCH_SIZE];
+    unsigned int count;
+} PCAP_PENDING, *PPCAP_PENDING;
+
+static int DecodePending(PPCAP_CHUNK chunk, PPCAP_PENDING pending)
+{
+    PACKET_BATCH batch;
+    unsigned int i;
+
+    chunk->skipped += pending->count - DecodePacketBatch(pending->frames, pending->lengths, pending->count, &batch);
+    for (i = 0; i < pending->count; i++)
+    {
+        if (batch.decoded >> i & 1)
+        {
+            if (!AddPacket(chunk, pending->times[i], pending->offsets[i], &batch.info[i]))
+            {
+                return 0;
+            }
+        }
+    }
+    pending->count = 0;
+
+    return 1;
+}
+
+// Takes the records that start in [position, limit) and returns where the
+// last one ends. A record that does not fit the file ends the chunk with
+// error set.
+static unsigned long long ParseRange(PPCAP_CHUNK chunk, unsigned long long position, unsigned long long limit)
+{
+    PCAP_PENDING pending;
+
+    chunk->start = position;
+    chunk->count = 0;
+    chunk->records = 0;
+    chunk->skipped = 0;
+    chunk->error = 0;
+    pending.count = 0;
+
+    while (position < limit && position + sizeof(PCAP_RECORD_HEADER) <= s_map.size)
+    {
+        PCAP_RECORD_HEADER header;
+        unsigned long long data = position + sizeof(header);
+
+        ReadRecordHeader(position, &header);
+        if (header.captured > s_snaplen || data + header.captured > s_map.size)
+        {
+            chunk->error = 1;
+            break;
+        }
+
+        chunk->records++;
+        pending.frames[pending.count] = s_map.base + data;
+        pending.lengths[pending.count] = header.captured;
+        pending.times[pending.count] = header.seconds * 1000000000ULL +
+            (s_nano ? header.fraction : header.fraction * 1000ULL);
+        pending.offsets[pending.count] = data;
+        if (++pending.count == PACKET_BATCH_SIZE && !DecodePending(chunk, &pending))
+        {
+            chunk->error = 1;
+            break;
+        }
+
+        position = data + header.captured;
+    }
+
+    if (pending.count && !DecodePending(chunk, &pending))
+    {
+        chunk->error = 1;
+    }
+
+    if (!chunk->error && position < limit && position != s_map.size)
+    {
+        // A partial header at the very end, as left by a capture cut short.
+        chunk->error = 1;
+    }
+
+    chunk->end = position;
+    return position;
+}
+
+static int ComparePackets(const void* a, const void* b)
+{
+    PPCAP_PACKET left = (PPCAP_PACKET)a;
+    PPCAP_PACKET right = (PPCAP_PACKET)b;
+
+    if (left->time != right->time)
+    {
+        return left->time < right->time ? -1 : 1;
+    }
+    return left->offset < right->offset ? -1 : left->offset > right->offset;
+}
+
+// Captures are almost always in order already; only sort when they are not.
+static void SortChunk(PPCAP_CHUNK chunk)
+{
+    unsigned long i;
+
+    for (i = 1; i < chunk->count; i++)
+    {
+        if (chunk->packets[i].time < chunk->packets[i - 1].time)
+        {
+            qsort(chunk->packets, chunk->count, sizeof(PCAP_PACKET), ComparePackets);
+            return;
+        }
+    }
+}
+
+static void ParseChunk(PPCAP_CHUNK chunk, int first)
+{
+    chunk->next = 0;
+    chunk->count = 0;
+    chunk->records = 0;
+    chunk->skipped = 0;
+    chunk->error = 0;
+
+    // The first chunk of a window starts where the last window ended.
+    chunk->start = first ? chunk->begin : FindBoundary(chunk->begin, chunk->limit);
+    if (chunk->start == PCAP_NO_BOUNDARY)
+    {
+        chunk->end = PCAP_NO_BOUNDARY;
+        return;
+    }
+
+    ParseRange(chunk, chunk->start, chunk->limit);
+    SortChunk(chunk);
+}
+
+static MARK_THREAD_PROC(WorkerThread, parameter)
+{
+    PPCAP_WORKER worker = (PPCAP_WORKER)parameter;
+
+    while (1)
+    {
+        unsigned long long start;
+        PPCAP_CHUNK chunk;
+
+        MarkLockAcquire(&s_lock);
+        while (worker->generation == s_generation && !s_exit)
+        {
+            MarkCondWait(&s_wake, &s_lock, -1);
+        }
+        if (s_exit)
+        {
+            MarkLockRelease(&s_lock);
+            break;
+        }
+        worker->generation = s_generation;
+        chunk = worker->index < s_active ? &s_chunks[s_set][worker->index] : NULL;
+        MarkLockRelease(&s_lock);
+
+        if (!chunk)
+        {
+            continue;
+        }
+
+        start = MarkClockNanoseconds();
+        ParseChunk(chunk, worker->index == 0);
+        LatencyAdd(&worker->parse, MarkClockNanoseconds() - start);
+
+        MarkLockAcquire(&s_lock);
+        if (--s_pending == 0)
+        {
+            MarkCondWakeAll(&s_done);
+        }
+        MarkLockRelease(&s_lock);
+    }
+
+    return 0;
+}
+
+// Hands the window starting at position to the workers; returns the number
+// of chunks, 0 at the end of the file.
+static int Dispatch(int set, unsigned long long position)
+{
+    unsigned long long remaining = s_map.size - position;
+    int chunks = 0;
+    int i;
+
+    if (position >= s_map.size || s_stop)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < s_workerCount && remaining; i++)
+    {
+        unsigned long long size = MIN(remaining, (unsigned long long)PCAP_CHUNK_SIZE);
+        PPCAP_CHUNK chunk = &s_chunks[set][i];
+
+        chunk->begin = position;
+        chunk->limit = position + size;
+        position += size;
+        remaining -= size;
+        chunks++;
+    }
+
+    MarkLockAcquire(&s_lock);
+    s_set = set;
+    s_active = chunks;
+    s_pending = chunks;
+    s_generation++;
+    MarkCondWakeAll(&s_wake);
+    MarkLockRelease(&s_lock);
+
+    return chunks;
+}
+
+static void WaitForWorkers()
+{
+    MarkLockAcquire(&s_lock);
+    while (s_pending)
+    {
+        MarkCondWait(&s_done, &s_lock, -1);
+    }
+    MarkLockRelease(&s_lock);
+}
+
+// Checks that every chunk picked up where the one before it ended and parses
+// the ones that did not again from there. Returns where the window ends, or
+// the size of the file if a bad record ends the capture early.
+static unsigned long long Reconcile(int set, int chunks)
+{
+    unsigned long long position = s_chunks[set][0].begin;
+    int i;
+
+    for (i = 0; i < chunks; i++)
+    {
+        PPCAP_CHUNK chunk = &s_chunks[set][i];
+
+        if (chunk->start != position)
+        {
+            s_stats.resyncs++;
+            chunk->next = 0;
+            ParseRange(chunk, position, chunk->limit);
+            SortChunk(chunk);
+        }
+
+        position = chunk->end;
+        s_stats.packets += chunk->records;
+        s_stats.skipped += chunk->skipped;
+
+        if (chunk->error)
+        {
+            printf("Pcap: bad or truncated record at offset %llu, the rest of %s is ignored\n", position, s_path);
+            for (i++; i < chunks; i++)
+            {
+                s_chunks[set][i].count = 0;
+            }
+            return s_map.size;
+        }
+    }
+
+    return position;
+}
+
+static void EmitFlow(PMARK_EVENT event, void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    // Stamped as it enters the pipeline, like replayed events; the capture
+    // time only drives the flow timeouts.
+    event->time = MarkTimestamp();
+    SubmitEvent(event);
+    s_stats.events++;
+}
+
+// k-way merge of the chunks, each in time order already; ties go to the
+// chunk earlier in the file.
+static void Merge(int set, int chunks, unsigned long long* last)
+{
+    if (GetCaptureFilterGeneration() != s_filter.generation)
+    {
+        GetCaptureFilter(&s_filter);
+    }
+
+    while (!s_stop)
+    {
+        PPCAP_CHUNK best = NULL;
+        PPCAP_PACKET packet;
+        int i;
+
+        for (i = 0; i < chunks; i++)
+        {
+            PPCAP_CHUNK chunk = &s_chunks[set][i];
+
+            if (chunk->next < chunk->count &&
+                (!best || chunk->packets[chunk->next].time < best->packets[best->next].time))
+            {
+                best = chunk;
+            }
+        }
+        if (!best)
+        {
+            break;
+        }
+
+        packet = &best->packets[best->next++];
+        if (packet->time < *last)
+        {
+            s_stats.disorder++;
+        }
+        *last = packet->time;
+
+        if (!s_filter.generation || MatchCaptureRules(&s_filter.rules, &packet->info))
+        {
+            FlowTableAdd(s_flows, &packet->info, (long long)(packet->time / 100));
+        }
+        else
+        {
+            s_stats.filtered++;
+        }
+        // A packet out of order across windows may be older than the last expiry.
+        if (packet->time > s_lastExpire && packet->time - s_lastExpire >= FLOW_EXPIRE_INTERVAL * 1000000000ULL)
+        {
+            FlowTableExpire(s_flows, (long long)(packet->time / 100));
+            s_lastExpire = packet->time;
+        }
+    }
+}
+
+static int OpenCapture()
+{
+    PPCAP_FILE_HEADER header;
+    PCAP_RECORD_HEADER first;
+
+    if (!MarkMapOpen(s_path, &s_map))
+    {
+        printf("Pcap: cannot map %s\n", s_path);
+        return 0;
+    }
+
+    header = (PPCAP_FILE_HEADER)s_map.base;
+    if (s_map.size < sizeof(PCAP_FILE_HEADER))
+    {
+        printf("Pcap: %s is not a pcap file\n", s_path);
+        return 0;
+    }
+
+    s_swapped = header->magic == PCAP_MAGIC_SWAPPED || header->magic == PCAP_MAGIC_NANO_SWAPPED;
+    s_nano = header->magic == PCAP_MAGIC_NANO || header->magic == PCAP_MAGIC_NANO_SWAPPED;
+    s_snaplen = s_swapped ? Swap32(header->snaplen) : header->snaplen;
+    if (!s_snaplen || s_snaplen > PCAP_MAX_SNAPLEN)
+    {
+        s_snaplen = PCAP_MAX_SNAPLEN;
+    }
+
+    if ((s_swapped ? Swap32(header->linktype) : header->linktype) != PCAP_LINKTYPE_ETHERNET)
+    {
+        printf("Pcap: %s is not an Ethernet capture\n", s_path);
+        return 0;
+    }
+
+    s_firstSeconds = 0;
+    if (s_map.size >= sizeof(PCAP_FILE_HEADER) + sizeof(PCAP_RECORD_HEADER))
+    {
+        ReadRecordHeader(sizeof(PCAP_FILE_HEADER), &first);
+        s_firstSeconds = first.seconds;
+    }
+
+    return 1;
+}
+
+static int RunPcapFile(void* context)
+{
+    unsigned long long position = sizeof(PCAP_FILE_HEADER);
+    unsigned long long last = 0;
+    unsigned long long start = MarkClockNanoseconds();
+    int started = 0;
+    int set = 0;
+    int chunks;
+    int i;
+
+    UNREFERENCED_PARAMETER(context);
+
+    memset(&s_map, 0, sizeof(s_map));
+    if (!OpenCapture())
+    {
+        MarkMapClose(&s_map);
+        FlowTableDestroy(s_flows);
+        s_flows = NULL;
+        return 0;
+    }
+
+    s_generation = 0;
+    s_exit = 0;
+    for (i = 0; i < s_workerCount; i++)
+    {
+        s_workers[i].index = i;
+        s_workers[i].generation = 0;
+        LatencyReset(&s_workers[i].parse);
+        if (!MarkThreadStart(&s_workers[i].thread, WorkerThread, &s_workers[i]))
+        {
+            break;
+        }
+        started++;
+    }
+    s_workerCount = started;
+
+    chunks = started ? Dispatch(set, position) : 0;
+    while (chunks)
+    {
+        unsigned long long merge;
+        int next;
+
+        WaitForWorkers();
+        position = Reconcile(set, chunks);
+        s_stats.windows++;
+
+        // The next window is parsed while this one is merged.
+        next = Dispatch(set ^ 1, position);
+
+        merge = MarkClockNanoseconds();
+        Merge(set, chunks, &last);
+        LatencyAdd(&s_stats.merge, MarkClockNanoseconds() - merge);
+
+        set ^= 1;
+        chunks = next;
+    }
+    WaitForWorkers();
+
+    MarkLockAcquire(&s_lock);
+    s_exit = 1;
+    MarkCondWakeAll(&s_wake);
+    MarkLockRelease(&s_lock);
+
+    for (i = 0; i < started; i++)
+    {
+        MarkThreadJoin(s_workers[i].thread);
+        LatencyMerge(&s_stats.parse, &s_workers[i].parse);
+    }
+    for (i = 0; i < PCAP_MAX_WORKERS; i++)
+    {
+        free(s_chunks[0][i].packets);
+        free(s_chunks[1][i].packets);
+    }
+    memset(s_chunks, 0, sizeof(s_chunks));
+
+    // The flows still open end with the file.
+    FlowTableDestroy(s_flows);
+    s_flows = NULL;
+
+    s_stats.bytes = MIN(position, s_map.size);
+    s_stats.elapsed = MarkClockNanoseconds() - start;
+    MarkMapClose(&s_map);
+
+    // Being stopped part way through is not a failure of the source.
+    return started > 0 || s_stop;
+}
+
+static void StopPcapFile(void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    s_stop = 1;
+}
+
+int IsPcapFile(const char* path)
+{
+    MARK_FILE file = MarkFileOpenRead(path);
+    unsigned int magic = 0;
+    int ok;
+
+    if (file == MARK_INVALID_FILE)
+    {
+        return 0;
+    }
+
+    ok = MarkFileReadAt(file, 0, &magic, sizeof(magic));
+    MarkFileClose(file);
+
+    return ok && (magic == PCAP_MAGIC || magic == PCAP_MAGIC_NANO ||
+        magic == PCAP_MAGIC_SWAPPED || magic == PCAP_MAGIC_NANO_SWAPPED);
+}
+
+int RegisterPcapFileSource(const char* path, int workers)
+{
+    // The file's sockets are not this host's.
+    FLOW_OPTIONS options = g_FlowOptions;
+
+    options.owners = 0;
+    s_path = path;
+    s_stop = 0;
+    s_workerCount = MAX(1, MIN(workers > 0 ? workers : MarkCpuCount(), PCAP_MAX_WORKERS));
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_stats.workers = s_workerCount;
+    LatencyReset(&s_stats.parse);
+    LatencyReset(&s_stats.merge);
+
+    s_lastExpire = 0;
+    s_flows = FlowTableCreate("pcap", &options, EmitFlow, NULL);
+    if (!s_flows)
+    {
+        return 0;
+    }
+
+    MarkLockInit(&s_lock);
+    MarkCondInit(&s_wake);
+    MarkCondInit(&s_done);
+
+    return RegisterSource("pcap", RunPcapFile, StopPcapFile, NULL, SOURCE_LOSSLESS);
+}
+
+void GetPcapFileStats(PPCAP_STATS stats)
+{
+    *stats = s_stats;
+}
+
+void PrintPcapFileStats()
+{
+    double seconds = s_stats.elapsed / 1000000000.0;
+
+    printf("Pcap: %llu packets, %llu events, %llu skipped, %llu filtered, %llu bytes in %llu windows, %d workers, "
+           "%llu resyncs, %llu out of order%s\n",
+        s_stats.packets, s_stats.events, s_stats.skipped, s_stats.filtered, s_stats.bytes, s_stats.windows, s_stats.workers,
+        s_stats.resyncs, s_stats.disorder, s_stop ? " (interrupted)" : "");
+    printf("Throughput: %.0f packets/s, %.1f MB/s in %.3f s\n",
+        seconds > 0 ? s_stats.packets / seconds : 0.0,
+        seconds > 0 ? s_stats.bytes / seconds / (1024 * 1024) : 0.0,
+        seconds);
+
+    PrintLatency("Chunk parse", &s_stats.parse);
+    PrintLatency("Window merge", &s_stats.merge);
+}
\ No newline at end of file
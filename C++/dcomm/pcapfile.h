@@ -0,0 +1,71 @@
+#ifndef _PCAPFILE_H_
+#define _PCAPFILE_H_
+
+#include "communicator.h"
+#include "latency.h"
+
+// Reads classic pcap capture files (tcpdump, Wireshark's "pcap" format)
+// without libpcap. The file is mapped and taken a window at a time, a
+// window being PCAP_CHUNK_SIZE bytes for every worker. Each worker finds
+// the record boundaries in its chunk, decodes the packets and sorts them
+// by capture time; the source thread merges the chunks of one window in
+// timestamp order into a flow table (flowtable.h) while the workers parse
+// the next window; flows time out by capture time, as they did on the
+// wire. The capture filter (capturefilter.h) is applied by its rules as
+// the packets are merged. Order is exact within a window, and a capture is
+// rarely out of order by more than that. pcapng files go through libpcap instead
+// (RegisterPacketFileSource), on Windows and MARK_LIBPCAP builds only.
+
+#define PCAP_MAGIC 0xA1B2C3D4      // microsecond timestamps
+#define PCAP_MAGIC_NANO 0xA1B23C4D // nanosecond timestamps
+#define PCAP_LINKTYPE_ETHERNET 1
+#define PCAP_MAX_SNAPLEN 262144
+#define PCAP_CHUNK_SIZE (16 * 1024 * 1024)
+#define PCAP_MAX_WORKERS 32
+#define PCAP_SYNC_RECORDS 8 // plausible headers in a row that mark a boundary
+
+typedef struct _PCAP_FILE_HEADER
+{
+    unsigned int magic;
+    unsigned short versionMajor;
+    unsigned short versionMinor;
+    int thiszone;
+    unsigned int sigfigs;
+    unsigned int snaplen;
+    unsigned int linktype;
+} PCAP_FILE_HEADER, *PPCAP_FILE_HEADER;
+
+typedef struct _PCAP_RECORD_HEADER
+{
+    unsigned int seconds;
+    unsigned int fraction; // micro or nanoseconds, see the magic
+    unsigned int captured;
+    unsigned int length;   // on the wire
+} PCAP_RECORD_HEADER, *PPCAP_RECORD_HEADER;
+
+typedef struct _PCAP_STATS
+{
+    unsigned long long bytes;
+    unsigned long long packets;
+    unsigned long long events;   // flow events submitted
+    unsigned long long skipped;  // packets DecodePacketBatch does not take
+    unsigned long long filtered; // packets the capture filter does not take
+    unsigned long long windows;
+    unsigned long long resyncs;  // chunks parsed again after a wrong boundary guess
+    unsigned long long disorder; // events older than one submitted before them
+    unsigned long long elapsed;  // ns
+    int workers;
+
+    LATENCY_HISTOGRAM parse; // per chunk, boundaries, decode and sort
+    LATENCY_HISTOGRAM merge; // per window
+} PCAP_STATS, *PPCAP_STATS;
+
+// Returns 1 for a classic pcap file of any byte order.
+int IsPcapFile(const char* path);
+// workers 0 takes one per CPU.
+int RegisterPcapFileSource(const char* path, int workers);
+
+void GetPcapFileStats(PPCAP_STATS stats);
+void PrintPcapFileStats();
+
+#endif
\ No newline at end of file
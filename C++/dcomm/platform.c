@@ -0,0 +1,569 @@
+#ifndef _WIN32
+#define _GNU_SOURCE // sched_setaffinity
+#endif
+
+#include "platform.h"
+#include "../sys/core.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+
+#include <malloc.h>
+#include <stdio.h>
+
+int MarkThreadStart(PMARK_THREAD thread, MARK_THREAD_ROUTINE routine, void* parameter)
+{
+    *thread = CreateThread(NULL, 0, routine, parameter, 0, NULL);
+    return *thread != NULL;
+}
+
+void MarkThreadJoin(MARK_THREAD thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void MarkLockInit(PMARK_LOCK lock) { InitializeCriticalSection(lock); }
+void MarkLockDelete(PMARK_LOCK lock) { DeleteCriticalSection(lock); }
+void MarkLockAcquire(PMARK_LOCK lock) { EnterCriticalSection(lock); }
+void MarkLockRelease(PMARK_LOCK lock) { LeaveCriticalSection(lock); }
+
+void* MarkAtomicCasPointer(void* volatile* target, void* exchange, void* comparand)
+{
+    return InterlockedCompareExchangePointer(target, exchange, comparand);
+}
+
+long long MarkAtomicCas64(volatile long long* target, long long exchange, long long comparand)
+{
+    return InterlockedCompareExchange64(target, exchange, comparand);
+}
+
+long long MarkAtomicAdd64(volatile long long* target, long long value)
+{
+    return InterlockedExchangeAdd64(target, value);
+}
+
+// Volatile accesses have acquire/release semantics with the MSVC defaults.
+long long MarkAtomicLoad64(volatile long long* source)
+{
+    return *source;
+}
+
+void MarkAtomicStore64(volatile long long* target, long long value)
+{
+    *target = value;
+}
+
+void MarkMemoryBarrier()
+{
+    MemoryBarrier();
+}
+
+void MarkCondInit(PMARK_COND cond) { InitializeConditionVariable(cond); }
+void MarkCondDelete(PMARK_COND cond) { UNREFERENCED_PARAMETER(cond); }
+void MarkCondWake(PMARK_COND cond) { WakeConditionVariable(cond); }
+void MarkCondWakeAll(PMARK_COND cond) { WakeAllConditionVariable(cond); }
+
+int MarkCondWait(PMARK_COND cond, PMARK_LOCK lock, int timeout)
+{
+    return SleepConditionVariableCS(cond, lock, timeout < 0 ? INFINITE : (DWORD)timeout);
+}
+
+unsigned long long MarkClockMicroseconds()
+{
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER now;
+
+    if (!frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+
+    return (unsigned long long)(now.QuadPart / frequency.QuadPart) * 1000000 +
+        (unsigned long long)(now.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+unsigned long long MarkClockNanoseconds()
+{
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER now;
+
+    if (!frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&now);
+
+    return (unsigned long long)(now.QuadPart / frequency.QuadPart) * 1000000000 +
+        (unsigned long long)(now.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+}
+
+// Same counter and conversion as the driver, see MarkTimestamp in sys/util.c.
+long long MarkTimestamp()
+{
+    static LARGE_INTEGER frequency = { 0 };
+    LARGE_INTEGER counter;
+
+    if (!frequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+
+    return counter.QuadPart / frequency.QuadPart * MARK_TIMESTAMP_FREQUENCY +
+        counter.QuadPart % frequency.QuadPart * MARK_TIMESTAMP_FREQUENCY / frequency.QuadPart;
+}
+
+void MarkSleep(int milliseconds)
+{
+    Sleep(milliseconds);
+}
+
+void* MarkAlignedAlloc(unsigned long size, unsigned long alignment)
+{
+    return _aligned_malloc(size, alignment);
+}
+
+void MarkAlignedFree(void* memory)
+{
+    _aligned_free(memory);
+}
+
+MARK_FILE MarkFileOpenRead(const char* path)
+{
+    return CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+}
+
+int MarkFileReadAt(MARK_FILE file, unsigned long long offset, void* buffer, unsigned long size)
+{
+    OVERLAPPED ov = { 0 };
+    DWORD read = 0;
+
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+
+    return ReadFile(file, buffer, size, &read, &ov) && read == size;
+}
+
+unsigned long long MarkFileSize(MARK_FILE file)
+{
+    LARGE_INTEGER size = { 0 };
+    GetFileSizeEx(file, &size);
+    return size.QuadPart;
+}
+
+void MarkFileClose(MARK_FILE file)
+{
+    CloseHandle(file);
+}
+
+int MarkFileDelete(const char* path)
+{
+    return DeleteFile(path);
+}
+
+int MarkFileTruncate(const char* path, unsigned long long size)
+{
+    LARGE_INTEGER position;
+    HANDLE file = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
+    int done;
+
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        return 0;
+    }
+
+    position.QuadPart = (LONGLONG)size;
+    done = SetFilePointerEx(file, position, NULL, FILE_BEGIN) && SetEndOfFile(file);
+    CloseHandle(file);
+    return done;
+}
+
+int MarkCreateDirectory(const char* path)
+{
+    return CreateDirectory(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+int MarkHostName(char* name, unsigned long size)
+{
+    DWORD length = size;
+
+    return GetComputerNameA(name, &length);
+}
+
+int MarkCpuCount()
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+
+int MarkThreadPin(int cpu)
+{
+    if (cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8))
+    {
+        return 0;
+    }
+
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+}
+
+int MarkMapOpen(const char* path, PMARK_MAP map)
+{
+    memset(map, 0, sizeof(*map));
+
+    map->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == map->file)
+    {
+        return 0;
+    }
+
+    map->size = MarkFileSize(map->file);
+    if (map->size)
+    {
+        map->section = CreateFileMapping(map->file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (map->section)
+        {
+            map->base = (unsigned char*)MapViewOfFile(map->section, FILE_MAP_COPY, 0, 0, 0);
+        }
+    }
+
+    if (!map->base)
+    {
+        MarkMapClose(map);
+        return 0;
+    }
+
+    return 1;
+}
+
+void MarkMapClose(PMARK_MAP map)
+{
+    if (map->base)
+    {
+        UnmapViewOfFile(map->base);
+    }
+    if (map->section)
+    {
+        CloseHandle(map->section);
+    }
+    if (map->file && INVALID_HANDLE_VALUE != map->file)
+    {
+        CloseHandle(map->file);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+int MarkEnumerateFiles(const char* directory, const char* prefix, MARK_FILE_CALLBACK callback, void* context)
+{
+    WIN32_FIND_DATA data;
+    char pattern[MAX_PATH];
+
+    _snprintf_s(pattern, MAX_PATH, _TRUNCATE, "%s\\%s*", directory, prefix);
+
+    HANDLE find = FindFirstFile(pattern, &data);
+    if (INVALID_HANDLE_VALUE == find)
+    {
+        return 0;
+    }
+
+    do
+    {
+        callback(data.cFileName, context);
+    } while (FindNextFile(find, &data));
+    FindClose(find);
+
+    return 1;
+}
+
+#else
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+int MarkThreadStart(PMARK_THREAD thread, MARK_THREAD_ROUTINE routine, void* parameter)
+{
+    return !pthread_create(thread, NULL, routine, parameter);
+}
+
+void MarkThreadJoin(MARK_THREAD thread)
+{
+    pthread_join(thread, NULL);
+}
+
+void MarkLockInit(PMARK_LOCK lock) { pthread_mutex_init(lock, NULL); }
+void MarkLockDelete(PMARK_LOCK lock) { pthread_mutex_destroy(lock); }
+void MarkLockAcquire(PMARK_LOCK lock) { pthread_mutex_lock(lock); }
+void MarkLockRelease(PMARK_LOCK lock) { pthread_mutex_unlock(lock); }
+
+void* MarkAtomicCasPointer(void* volatile* target, void* exchange, void* comparand)
+{
+    return __sync_val_compare_and_swap(target, comparand, exchange);
+}
+
+long long MarkAtomicCas64(volatile long long* target, long long exchange, long long comparand)
+{
+    return __sync_val_compare_and_swap(target, comparand, exchange);
+}
+
+long long MarkAtomicAdd64(volatile long long* target, long long value)
+{
+    return __sync_fetch_and_add(target, value);
+}
+
+long long MarkAtomicLoad64(volatile long long* source)
+{
+    return __atomic_load_n(source, __ATOMIC_ACQUIRE);
+}
+
+void MarkAtomicStore64(volatile long long* target, long long value)
+{
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+}
+
+void MarkMemoryBarrier()
+{
+    __sync_synchronize();
+}
+
+void MarkCondInit(PMARK_COND cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void MarkCondDelete(PMARK_COND cond) { pthread_cond_destroy(cond); }
+void MarkCondWake(PMARK_COND cond) { pthread_cond_signal(cond); }
+void MarkCondWakeAll(PMARK_COND cond) { pthread_cond_broadcast(cond); }
+
+int MarkCondWait(PMARK_COND cond, PMARK_LOCK lock, int timeout)
+{
+    struct timespec deadline;
+
+    if (timeout < 0)
+    {
+        return !pthread_cond_wait(cond, lock);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    return pthread_cond_timedwait(cond, lock, &deadline) != ETIMEDOUT;
+}
+
+unsigned long long MarkClockMicroseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+unsigned long long MarkClockNanoseconds()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+long long MarkTimestamp()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * MARK_TIMESTAMP_FREQUENCY + now.tv_nsec / (1000000000 / MARK_TIMESTAMP_FREQUENCY);
+}
+
+void MarkSleep(int milliseconds)
+{
+    struct timespec delay;
+
+    delay.tv_sec = milliseconds / 1000;
+    delay.tv_nsec = (milliseconds % 1000) * 1000000L;
+    while (nanosleep(&delay, &delay) && errno == EINTR)
+    {
+    }
+}
+
+void* MarkAlignedAlloc(unsigned long size, unsigned long alignment)
+{
+    void* memory = NULL;
+    return posix_memalign(&memory, alignment, size) ? NULL : memory;
+}
+
+void MarkAlignedFree(void* memory)
+{
+    free(memory);
+}
+
+MARK_FILE MarkFileOpenRead(const char* path)
+{
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+int MarkFileReadAt(MARK_FILE file, unsigned long long offset, void* buffer, unsigned long size)
+{
+    unsigned long done = 0;
+
+    while (done < size)
+    {
+        ssize_t read = pread(file, (char*)buffer + done, size - done, (off_t)(offset + done));
+        if (read <= 0)
+        {
+            if (read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        done += (unsigned long)read;
+    }
+
+    return 1;
+}
+
+unsigned long long MarkFileSize(MARK_FILE file)
+{
+    struct stat info;
+    return fstat(file, &info) ? 0 : (unsigned long long)info.st_size;
+}
+
+void MarkFileClose(MARK_FILE file)
+{
+    close(file);
+}
+
+int MarkFileDelete(const char* path)
+{
+    return !unlink(path);
+}
+
+int MarkFileTruncate(const char* path, unsigned long long size)
+{
+    return !truncate(path, (off_t)size);
+}
+
+int MarkCreateDirectory(const char* path)
+{
+    return !mkdir(path, 0750) || errno == EEXIST;
+}
+
+int MarkHostName(char* name, unsigned long size)
+{
+    if (gethostname(name, size))
+    {
+        return 0;
+    }
+    name[size - 1] = 0;
+
+    return 1;
+}
+
+int MarkCpuCount()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int)count : 1;
+}
+
+int MarkThreadPin(int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        return 0;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return !sched_setaffinity(0, sizeof(set), &set);
+}
+
+int MarkMapOpen(const char* path, PMARK_MAP map)
+{
+    memset(map, 0, sizeof(*map));
+
+    int file = open(path, O_RDONLY | O_CLOEXEC);
+    if (file < 0)
+    {
+        return 0;
+    }
+
+    map->size = MarkFileSize(file);
+    if (map->size)
+    {
+        void* base = mmap(NULL, (size_t)map->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        if (MAP_FAILED != base)
+        {
+            madvise(base, (size_t)map->size, MADV_SEQUENTIAL);
+            map->base = (unsigned char*)base;
+        }
+    }
+    close(file);
+
+    return map->base != NULL;
+}
+
+void MarkMapClose(PMARK_MAP map)
+{
+    if (map->base)
+    {
+        munmap(map->base, (size_t)map->size);
+    }
+    memset(map, 0, sizeof(*map));
+}
+
+int MarkEnumerateFiles(const char* directory, const char* prefix, MARK_FILE_CALLBACK callback, void* context)
+{
+    struct dirent* entry;
+    size_t length = strlen(prefix);
+
+    DIR* dir = opendir(directory);
+    if (!dir)
+    {
+        return 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (!strncmp(entry->d_name, prefix, length))
+        {
+            callback(entry->d_name, context);
+        }
+    }
+    closedir(dir);
+
+    return 1;
+}
+
+#endif
+
+void MarkSetText(unsigned short* dst, int capacity, const char* text)
+{
+    int i;
+
+    for (i = 0; i < capacity - 1 && text[i]; i++)
+    {
+        dst[i] = (unsigned char)text[i];
+    }
+    dst[i] = 0;
+}
\ No newline at end of file
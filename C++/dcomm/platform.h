@@ -0,0 +1,120 @@
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+// Thin wrappers over the few OS services the collector needs, so that the
+// log, replay and transport code builds both on Windows and on the Linux
+// collector boxes.
+
+#ifdef _WIN32
+
+#include <Windows.h>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+typedef HANDLE MARK_THREAD, *PMARK_THREAD;
+typedef CRITICAL_SECTION MARK_LOCK, *PMARK_LOCK;
+typedef CONDITION_VARIABLE MARK_COND, *PMARK_COND;
+typedef HANDLE MARK_FILE;
+
+typedef struct _MARK_MAP
+{
+    unsigned char* base;
+    unsigned long long size;
+    HANDLE file;
+    HANDLE section;
+} MARK_MAP, *PMARK_MAP;
+
+typedef LPTHREAD_START_ROUTINE MARK_THREAD_ROUTINE;
+
+#define MARK_THREAD_PROC(name, parameter) DWORD WINAPI name(LPVOID parameter)
+#define MARK_INVALID_FILE INVALID_HANDLE_VALUE
+#define MARK_PATH_SEPARATOR "\\"
+#define MARK_MAX_PATH MAX_PATH
+#define MARK_THREAD_LOCAL __declspec(thread)
+
+#else
+
+#include <pthread.h>
+
+typedef pthread_t MARK_THREAD, *PMARK_THREAD;
+typedef pthread_mutex_t MARK_LOCK, *PMARK_LOCK;
+typedef pthread_cond_t MARK_COND, *PMARK_COND;
+typedef int MARK_FILE;
+
+typedef struct _MARK_MAP
+{
+    unsigned char* base;
+    unsigned long long size;
+} MARK_MAP, *PMARK_MAP;
+
+typedef void* (*MARK_THREAD_ROUTINE)(void* parameter);
+
+#define MARK_THREAD_PROC(name, parameter) void* name(void* parameter)
+#define MARK_INVALID_FILE (-1)
+#define MARK_PATH_SEPARATOR "/"
+#define MARK_MAX_PATH 4096
+#define MARK_THREAD_LOCAL __thread
+
+#define UNREFERENCED_PARAMETER(p) (void)(p)
+
+#endif
+
+int MarkThreadStart(PMARK_THREAD thread, MARK_THREAD_ROUTINE routine, void* parameter);
+void MarkThreadJoin(MARK_THREAD thread);
+
+void MarkLockInit(PMARK_LOCK lock);
+void MarkLockDelete(PMARK_LOCK lock);
+void MarkLockAcquire(PMARK_LOCK lock);
+void MarkLockRelease(PMARK_LOCK lock);
+
+void MarkCondInit(PMARK_COND cond);
+void MarkCondDelete(PMARK_COND cond);
+// Returns 0 on timeout. A negative timeout waits forever.
+int MarkCondWait(PMARK_COND cond, PMARK_LOCK lock, int timeout);
+void MarkCondWake(PMARK_COND cond);
+void MarkCondWakeAll(PMARK_COND cond);
+
+// Returns the previous value of *target; the exchange happened if it equals comparand.
+void* MarkAtomicCasPointer(void* volatile* target, void* exchange, void* comparand);
+long long MarkAtomicCas64(volatile long long* target, long long exchange, long long comparand);
+// Returns the value before the addition.
+long long MarkAtomicAdd64(volatile long long* target, long long value);
+// Acquire load and release store, for publishing data through a counter.
+long long MarkAtomicLoad64(volatile long long* source);
+void MarkAtomicStore64(volatile long long* target, long long value);
+void MarkMemoryBarrier();
+
+unsigned long long MarkClockMicroseconds();
+unsigned long long MarkClockNanoseconds();
+void MarkSleep(int milliseconds);
+
+void* MarkAlignedAlloc(unsigned long size, unsigned long alignment);
+void MarkAlignedFree(void* memory);
+
+MARK_FILE MarkFileOpenRead(const char* path);
+int MarkFileReadAt(MARK_FILE file, unsigned long long offset, void* buffer, unsigned long size);
+unsigned long long MarkFileSize(MARK_FILE file);
+void MarkFileClose(MARK_FILE file);
+int MarkFileDelete(const char* path);
+int MarkFileTruncate(const char* path, unsigned long long size);
+int MarkCreateDirectory(const char* path);
+int MarkHostName(char* name, unsigned long size);
+int MarkCpuCount();
+// Keeps the calling thread on one CPU. Returns 0 if the CPU does not exist.
+int MarkThreadPin(int cpu);
+
+// Maps a whole file copy-on-write: readers see the file, writes stay private.
+int MarkMapOpen(const char* path, PMARK_MAP map);
+void MarkMapClose(PMARK_MAP map);
+
+// Calls back with the bare name of every file in directory that starts with prefix.
+typedef void (*MARK_FILE_CALLBACK)(const char* name, void* context);
+int MarkEnumerateFiles(const char* directory, const char* prefix, MARK_FILE_CALLBACK callback, void* context);
+
+// Widens ASCII text into a UTF-16 field of capacity characters, cut to fit.
+void MarkSetText(unsigned short* dst, int capacity, const char* text);
+#define MARK_SET_TEXT(field, text) MarkSetText(field, sizeof(field) / sizeof(field[0]), text)
+
+#endif
\ No newline at end of file
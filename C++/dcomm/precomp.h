@@ -1,4 +1,9 @@
+#ifdef _WIN32
 typedef unsigned long       DWORD;
+#else
+// 32 bits everywhere, so the wire headers in tcpip.h keep their layout.
+typedef unsigned int        DWORD;
+#endif
 typedef int                 BOOL;
 typedef unsigned char       BYTE;
 typedef unsigned short      WORD;
@@ -27,8 +32,8 @@ typedef char CHAR;
 typedef signed char         INT8, *PINT8;
 typedef signed short        INT16, *PINT16;
 typedef signed int          INT32, *PINT32;
-typedef signed __int64      INT64, *PINT64;
+typedef signed long long    INT64, *PINT64;
 typedef unsigned char       UINT8, *PUINT8;
 typedef unsigned short      UINT16, *PUINT16;
 typedef unsigned int        UINT32, *PUINT32;
-typedef unsigned __int64    UINT64, *PUINT64;
\ No newline at end of file
+typedef unsigned long long  UINT64, *PUINT64;
\ No newline at end of file
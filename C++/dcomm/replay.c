@@ -0,0 +1,371 @@
+#include "replay.h"
+#include "binlog.h"
+#include "lz.h"
+#include "platform.h"
+#include "segment.h"
+#include "sources.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static REPLAY_STATS s_stats;
+static volatile int s_stop = 0;
+static volatile int s_active = 0;
+
+static PMARK_EVENT s_block = NULL;
+
+static double s_speed = REPLAY_SPEED_MAX;
+static int s_paced = 0;
+static int s_untimed = 0;
+static long long s_firstTime = 0;
+static unsigned long long s_firstClock = 0;
+
+// Waits until the event is due relative to the first timed event.
+static void Pace(PMARK_EVENT event)
+{
+    unsigned long long due, now;
+    long long ticks;
+
+    if (!event->time)
+    {
+        if (!s_untimed)
+        {
+            printf("Replay: recording has no capture timestamps, replaying at full speed\n");
+            s_untimed = 1;
+        }
+        return;
+    }
+
+    if (!s_paced)
+    {
+        s_firstTime = event->time;
+        s_firstClock = MarkClockNanoseconds();
+        s_paced = 1;
+        return;
+    }
+
+    ticks = event->time - s_firstTime;
+    if (ticks < 0)
+    {
+        return;
+    }
+
+    due = s_firstClock + (unsigned long long)(ticks * (1000000000.0 / REPLAY_TICKS_PER_SECOND) / s_speed);
+    now = MarkClockNanoseconds();
+
+    if (due > now + REPLAY_SPIN_LIMIT)
+    {
+        MarkSleep((int)((due - now - REPLAY_SPIN_LIMIT / 2) / 1000000));
+    }
+    while ((now = MarkClockNanoseconds()) < due && !s_stop)
+    {
+    }
+
+    if (now >= due)
+    {
+        LatencyAdd(&s_stats.lag, now - due);
+    }
+}
+
+static int ReplayEvents(PMARK_EVENT events, unsigned long long count)
+{
+    static MARK_EVENT event;
+    unsigned long long i, start;
+
+    for (i = 0; i < count; i++)
+    {
+        if (s_stop)
+        {
+            return 0;
+        }
+
+        if (s_speed > 0)
+        {
+            Pace(&events[i]);
+        }
+
+        // Injected as if captured now, so stage latencies measure this
+        // pipeline rather than the age of the recording. Copying is cheaper
+        // than letting the stamps fault in private pages of the mapping.
+        memcpy(&event, &events[i], sizeof(event));
+        event.time = MarkTimestamp();
+        memset(event.stages, 0, sizeof(event.stages));
+
+        start = MarkClockNanoseconds();
+        SubmitEvent(&event);
+        LatencyAdd(&s_stats.process, MarkClockNanoseconds() - start);
+
+        s_stats.events++;
+    }
+
+    return 1;
+}
+
+static int ReplayBinaryLog(const char* path, PMARK_MAP map)
+{
+    PBINLOG_HEADER header = (PBINLOG_HEADER)map->base;
+
+    if (map->size < sizeof(BINLOG_HEADER) || header->version != BINLOG_VERSION || header->recordSize != sizeof(MARK_EVENT))
+    {
+        printf("Replay: %s is not a compatible binary log\n", path);
+        return 0;
+    }
+
+    unsigned long long count = (map->size - sizeof(BINLOG_HEADER)) / sizeof(MARK_EVENT);
+    if ((map->size - sizeof(BINLOG_HEADER)) % sizeof(MARK_EVENT))
+    {
+        printf("Replay: %s ends with a partial record, ignored\n", path);
+    }
+
+    return ReplayEvents((PMARK_EVENT)(map->base + sizeof(BINLOG_HEADER)), count);
+}
+
+static int ReplaySegment(const char* path, PMARK_MAP map)
+{
+    SEGMENT_HEADER header;
+    SEGMENT_BLOCK_HEADER block;
+    unsigned long long offset = sizeof(SEGMENT_HEADER);
+
+    memcpy(&header, map->base, MIN(map->size, sizeof(header)));
+    if (map->size < sizeof(header) || header.version != SEGMENT_VERSION || header.recordSize != sizeof(MARK_EVENT))
+    {
+        printf("Replay: %s is not a compatible segment\n", path);
+        return 0;
+    }
+
+    // Walk the block chain rather than the footer index so that segments
+    // that were never finalized replay up to their last complete block.
+    while (offset + sizeof(block) <= map->size)
+    {
+        memcpy(&block, map->base + offset, sizeof(block));
+        if (block.magic != SEGMENT_BLOCK_MAGIC || offset + sizeof(block) + block.compressedSize > map->size)
+        {
+            break;
+        }
+
+        if (block.rawSize > SEGMENT_BLOCK_SIZE || block.rawSize != block.count * sizeof(MARK_EVENT))
+        {
+            printf("Replay: bad block at %llu in %s\n", offset, path);
+            s_stats.failures++;
+            break;
+        }
+
+        unsigned long long start = MarkClockNanoseconds();
+        int size = LzDecompress(map->base + offset + sizeof(block), block.compressedSize, (unsigned char*)s_block, SEGMENT_BLOCK_SIZE);
+        LatencyAdd(&s_stats.decode, MarkClockNanoseconds() - start);
+
+        if (size != (int)block.rawSize)
+        {
+            printf("Replay: corrupt block at %llu in %s\n", offset, path);
+            s_stats.failures++;
+        }
+        else
+        {
+            s_stats.blocks++;
+            if (!ReplayEvents(s_block, block.count))
+            {
+                return 0;
+            }
+        }
+
+        offset += sizeof(block) + block.compressedSize;
+    }
+
+    return 1;
+}
+
+static int ReplayFile(const char* path)
+{
+    MARK_MAP map;
+    unsigned int magic = 0;
+    int result = 0;
+
+    if (!MarkMapOpen(path, &map))
+    {
+        printf("Replay: cannot map %s\n", path);
+        s_stats.failures++;
+        return 0;
+    }
+
+    memcpy(&magic, map.base, MIN(map.size, sizeof(magic)));
+    if (BINLOG_MAGIC == magic)
+    {
+        result = ReplayBinaryLog(path, &map);
+    }
+    else if (SEGMENT_MAGIC == magic)
+    {
+        result = ReplaySegment(path, &map);
+    }
+    else
+    {
+        printf("Replay: unknown file format %s\n", path);
+    }
+
+    if (!result && !s_stop)
+    {
+        s_stats.failures++;
+    }
+
+    s_stats.files++;
+    s_stats.bytes += map.size;
+    MarkMapClose(&map);
+
+    return result;
+}
+
+typedef struct _REPLAY_FILES
+{
+    char** names;
+    int count;
+    int capacity;
+} REPLAY_FILES, *PREPLAY_FILES;
+
+static void FoundFile(const char* name, void* context)
+{
+    PREPLAY_FILES files = (PREPLAY_FILES)context;
+
+    if (files->count == files->capacity)
+    {
+        int capacity = files->capacity ? files->capacity * 2 : 64;
+        char** names = (char**)realloc(files->names, capacity * sizeof(char*));
+        if (!names)
+        {
+            return;
+        }
+        files->names = names;
+        files->capacity = capacity;
+    }
+
+    files->names[files->count] = (char*)malloc(strlen(name) + 1);
+    if (files->names[files->count])
+    {
+        strcpy(files->names[files->count++], name);
+    }
+}
+
+static int CompareNames(const void* a, const void* b)
+{
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+// Segment names carry zero-padded ids, so name order is recording order.
+static int ReplayDirectory(const char* directory, PREPLAY_FILES files)
+{
+    char path[MARK_MAX_PATH];
+    int i;
+
+    qsort(files->names, files->count, sizeof(char*), CompareNames);
+
+    for (i = 0; i < files->count && !s_stop; i++)
+    {
+        snprintf(path, sizeof(path), "%s" MARK_PATH_SEPARATOR "%s", directory, files->names[i]);
+        ReplayFile(path);
+    }
+
+    return s_stats.files > 0;
+}
+
+int RunReplay(const char* path, double speed)
+{
+    REPLAY_FILES files = { 0 };
+    int result, i;
+
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_speed = speed;
+    s_paced = 0;
+    s_untimed = 0;
+    s_stop = 0;
+
+    s_block = (PMARK_EVENT)MarkAlignedAlloc(SEGMENT_BLOCK_SIZE, 64);
+    if (!s_block)
+    {
+        return 0;
+    }
+
+    s_active = 1;
+    unsigned long long start = MarkClockNanoseconds();
+
+    if (MarkEnumerateFiles(path, SEGMENT_FILE_PREFIX, FoundFile, &files) && files.count)
+    {
+        result = ReplayDirectory(path, &files);
+    }
+    else
+    {
+        result = ReplayFile(path);
+    }
+
+    s_stats.elapsed = MarkClockNanoseconds() - start;
+    s_active = 0;
+
+    for (i = 0; i < files.count; i++)
+    {
+        free(files.names[i]);
+    }
+    free(files.names);
+
+    MarkAlignedFree(s_block);
+    s_block = NULL;
+
+    return result;
+}
+
+void StopReplay()
+{
+    s_stop = 1;
+}
+
+static const char* s_sourcePath = NULL;
+static double s_sourceSpeed = REPLAY_SPEED_MAX;
+
+static int RunReplaySource(void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    // Being stopped part way through is not a failure of the source.
+    return RunReplay(s_sourcePath, s_sourceSpeed) || s_stop;
+}
+
+static void StopReplaySource(void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    StopReplay();
+}
+
+int RegisterReplaySource(const char* path, double speed)
+{
+    s_sourcePath = path;
+    s_sourceSpeed = speed;
+
+    return RegisterSource("replay", RunReplaySource, StopReplaySource, NULL, SOURCE_LOSSLESS);
+}
+
+int IsReplayActive()
+{
+    return s_active;
+}
+
+void GetReplayStats(PREPLAY_STATS stats)
+{
+    *stats = s_stats;
+}
+
+void PrintReplayStats()
+{
+    double seconds = s_stats.elapsed / 1000000000.0;
+
+    printf("Replay: %llu files, %llu blocks, %llu events, %llu bytes, %llu failures%s\n",
+        s_stats.files, s_stats.blocks, s_stats.events, s_stats.bytes, s_stats.failures, s_stop ? " (interrupted)" : "");
+    printf("Throughput: %.0f events/s, %.1f MB/s in %.3f s\n",
+        seconds > 0 ? s_stats.events / seconds : 0.0,
+        seconds > 0 ? s_stats.events * sizeof(MARK_EVENT) / seconds / (1024 * 1024) : 0.0,
+        seconds);
+
+    PrintLatency("Decode", &s_stats.decode);
+    PrintLatency("Process", &s_stats.process);
+    if (s_stats.lag.count)
+    {
+        PrintLatency("Schedule lag", &s_stats.lag);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#ifndef _REPLAY_H_
+#define _REPLAY_H_
+
+#include "communicator.h"
+#include "latency.h"
+
+// Replays recorded events into the pipeline without a driver. Accepts a
+// binary log, a single segment file or a directory of segments. Files are
+// memory mapped; each event is copied out and re-stamped with the current
+// time as it enters the pipeline.
+//
+// Linux build (no driver; live capture through afpacket.c):
+//   gcc -O2 -pthread -o dcomm communicator.c replay.c binlog.c segment.c logio.c lz.c
+//       latency.c stages.c ingress.c sources.c sinks.c synthetic.c platform.c logger.c
+//       analyzer.c installation.c userutil.c eventstream.c transport.c shmring.c broker.c
+//       subscription.c spool.c forward.c packetdecode.c flowtable.c pcapfile.c afpacket.c
+//       capturefilter.c socketowners.c dnscache.c tlshello.c payloadscan.c
+//       ../usermodesimulation/generator.c -lm
+// Add -DMARK_LIBPCAP packets.c -lpcap for the libpcap fallback and pcapng files.
+
+#define REPLAY_SPEED_MAX 0.0
+#define REPLAY_TICKS_PER_SECOND MARK_TIMESTAMP_FREQUENCY
+#define REPLAY_SPIN_LIMIT 2000000        // ns; longer waits sleep first
+
+typedef struct _REPLAY_STATS
+{
+    unsigned long long files;
+    unsigned long long events;
+    unsigned long long blocks;
+    unsigned long long bytes;
+    unsigned long long failures;
+    unsigned long long elapsed; // ns
+
+    LATENCY_HISTOGRAM decode;  // per segment block
+    LATENCY_HISTOGRAM process; // per event, time to hand it to the pipeline
+    LATENCY_HISTOGRAM lag;     // per event, delivery behind schedule when paced
+} REPLAY_STATS, *PREPLAY_STATS;
+
+// speed is REPLAY_SPEED_MAX for as fast as possible, 1.0 for the original
+// timing and N for N times the original rate.
+int RunReplay(const char* path, double speed);
+void StopReplay();
+int IsReplayActive();
+
+// Runs RunReplay on a source thread.
+int RegisterReplaySource(const char* path, double speed);
+
+void GetReplayStats(PREPLAY_STATS stats);
+void PrintReplayStats();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,546 @@
+#include "segment.h"
+#include "logio.h"
+#include "lz.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SEGMENT_EVENTS_PER_BLOCK (SEGMENT_BLOCK_SIZE / sizeof(MARK_EVENT))
+#define SEGMENT_COMPRESSED_SIZE (sizeof(SEGMENT_BLOCK_HEADER) + LzCompressBound(SEGMENT_BLOCK_SIZE))
+
+struct _SEGMENT_LOG
+{
+    char directory[MARK_MAX_PATH];
+    unsigned long long maxSegmentSize;
+    int maxSegments;
+
+    PLOG_FILE file;
+    char backend[32];
+    unsigned long long segmentId;
+    unsigned long long oldestId;
+    unsigned long long offset;
+    unsigned long long sequence;
+
+    MARK_EVENT block[SEGMENT_EVENTS_PER_BLOCK];
+    unsigned long blockCount;
+    unsigned char compressed[SEGMENT_COMPRESSED_SIZE];
+
+    PSEGMENT_INDEX_ENTRY index;
+    unsigned long indexCount;
+    unsigned long indexCapacity;
+
+    SEGMENT_STATS stats;
+    LOGIO_STATS ioStats;
+};
+
+struct _SEGMENT_READER
+{
+    MARK_FILE file;
+    SEGMENT_HEADER header;
+    PSEGMENT_INDEX_ENTRY index;
+    unsigned long blockCount;
+    unsigned char compressed[SEGMENT_COMPRESSED_SIZE];
+};
+
+static int WriteAll(PSEGMENT_LOG log, const void* buffer, unsigned long size)
+{
+    if (!LogFileAppend(log->file, buffer, size))
+    {
+        log->stats.failures++;
+        return 0;
+    }
+
+    log->offset += size;
+    return 1;
+}
+
+// Returns 0 if the directory leaves no room for the name.
+static int SegmentPath(char* path, const char* directory, unsigned long long id)
+{
+    int length = snprintf(path, MARK_MAX_PATH, SEGMENT_FILE_FORMAT, directory, id);
+
+    return length > 0 && length < MARK_MAX_PATH;
+}
+
+static int FinishSegment(PSEGMENT_LOG log)
+{
+    SEGMENT_FOOTER footer = { 0 };
+    LOGIO_STATS io;
+
+    if (!log->file)
+    {
+        return 1;
+    }
+
+    footer.indexOffset = log->offset;
+    footer.blockCount = log->indexCount;
+    footer.magic = SEGMENT_FOOTER_MAGIC;
+
+    int ok = WriteAll(log, log->index, log->indexCount * sizeof(SEGMENT_INDEX_ENTRY)) &&
+        WriteAll(log, &footer, sizeof(footer));
+
+    LogFileFlush(log->file);
+    GetLogFileStats(log->file, &io);
+    log->ioStats.writes += io.writes;
+    log->ioStats.bytes += io.bytes;
+    log->ioStats.syncs += io.syncs;
+    log->ioStats.failures += io.failures;
+    log->ioStats.stalls += io.stalls;
+    strncpy(log->backend, LogFileBackendName(log->file), sizeof(log->backend) - 1);
+
+    LogFileClose(log->file);
+    log->file = NULL;
+    log->indexCount = 0;
+
+    return ok;
+}
+
+static void ApplyRetention(PSEGMENT_LOG log)
+{
+    char path[MARK_MAX_PATH];
+
+    while (log->maxSegments > 0 && log->segmentId - log->oldestId + 1 > (unsigned long long)log->maxSegments)
+    {
+        if (SegmentPath(path, log->directory, log->oldestId))
+        {
+            MarkFileDelete(path);
+        }
+        log->oldestId++;
+    }
+}
+
+static int StartSegment(PSEGMENT_LOG log)
+{
+    SEGMENT_HEADER header = { 0 };
+    char path[MARK_MAX_PATH];
+
+    log->segmentId++;
+    if (!SegmentPath(path, log->directory, log->segmentId))
+    {
+        printf("The log directory %s is too long.\n", log->directory);
+        log->stats.failures++;
+        return 0;
+    }
+
+    log->file = LogFileOpen(path, 1, NULL);
+    if (!log->file)
+    {
+        log->stats.failures++;
+        return 0;
+    }
+
+    log->offset = 0;
+    log->indexCount = 0;
+    log->stats.segments++;
+
+    header.magic = SEGMENT_MAGIC;
+    header.version = SEGMENT_VERSION;
+    header.recordSize = sizeof(MARK_EVENT);
+    header.blockSize = SEGMENT_BLOCK_SIZE;
+    header.segmentId = log->segmentId;
+
+    ApplyRetention(log);
+
+    return WriteAll(log, &header, sizeof(header));
+}
+
+static int AddIndexEntry(PSEGMENT_LOG log, PSEGMENT_INDEX_ENTRY entry)
+{
+    if (log->indexCount == log->indexCapacity)
+    {
+        unsigned long capacity = log->indexCapacity ? log->indexCapacity * 2 : 256;
+        PSEGMENT_INDEX_ENTRY index = (PSEGMENT_INDEX_ENTRY)realloc(log->index, capacity * sizeof(SEGMENT_INDEX_ENTRY));
+        if (!index)
+        {
+            return 0;
+        }
+        log->index = index;
+        log->indexCapacity = capacity;
+    }
+
+    log->index[log->indexCount++] = *entry;
+    return 1;
+}
+
+int SegmentLogFlush(PSEGMENT_LOG log)
+{
+    SEGMENT_INDEX_ENTRY entry = { 0 };
+    PSEGMENT_BLOCK_HEADER header = (PSEGMENT_BLOCK_HEADER)log->compressed;
+    unsigned long rawSize = log->blockCount * sizeof(MARK_EVENT);
+    unsigned long i;
+
+    if (!log->blockCount)
+    {
+        return 1;
+    }
+
+    if (!log->file && !StartSegment(log))
+    {
+        return 0;
+    }
+
+    int compressedSize = LzCompress((unsigned char*)log->block, rawSize,
+        log->compressed + sizeof(SEGMENT_BLOCK_HEADER), LzCompressBound(SEGMENT_BLOCK_SIZE));
+
+    header->magic = SEGMENT_BLOCK_MAGIC;
+    header->count = log->blockCount;
+    header->rawSize = rawSize;
+    header->compressedSize = compressedSize;
+    header->firstSequence = log->sequence;
+
+    entry.firstSequence = log->sequence;
+    entry.offset = log->offset;
+    entry.timeFirst = entry.timeLast = log->block[0].time;
+    for (i = 1; i < log->blockCount; i++)
+    {
+        entry.timeFirst = MIN(entry.timeFirst, log->block[i].time);
+        entry.timeLast = MAX(entry.timeLast, log->block[i].time);
+    }
+    entry.count = log->blockCount;
+    entry.compressedSize = compressedSize;
+
+    if (!AddIndexEntry(log, &entry) || !WriteAll(log, log->compressed, sizeof(SEGMENT_BLOCK_HEADER) + compressedSize))
+    {
+        return 0;
+    }
+
+    log->sequence += log->blockCount;
+    log->stats.events += log->blockCount;
+    log->stats.blocks++;
+    log->stats.rawBytes += rawSize;
+    log->stats.compressedBytes += sizeof(SEGMENT_BLOCK_HEADER) + compressedSize;
+    log->blockCount = 0;
+
+    if (log->offset >= log->maxSegmentSize)
+    {
+        return FinishSegment(log);
+    }
+
+    return 1;
+}
+
+int SegmentLogAppend(PSEGMENT_LOG log, PMARK_EVENT events, int count)
+{
+    int ok = 1;
+
+    while (count > 0)
+    {
+        int chunk = MIN(count, (int)(SEGMENT_EVENTS_PER_BLOCK - log->blockCount));
+
+        memcpy(&log->block[log->blockCount], events, chunk * sizeof(MARK_EVENT));
+        log->blockCount += chunk;
+        events += chunk;
+        count -= chunk;
+
+        if (log->blockCount == SEGMENT_EVENTS_PER_BLOCK)
+        {
+            ok &= SegmentLogFlush(log);
+        }
+    }
+
+    return ok;
+}
+
+static void FoundSegment(const char* name, void* context)
+{
+    PSEGMENT_LOG log = (PSEGMENT_LOG)context;
+    unsigned long long id;
+
+    if (sscanf(name, SEGMENT_FILE_PREFIX "%llu", &id) == 1)
+    {
+        log->segmentId = MAX(log->segmentId, id);
+        log->oldestId = MIN(log->oldestId, id);
+    }
+}
+
+// Picks up numbering where an earlier run left off so that ids and
+// sequence numbers keep increasing across restarts. The newest segment may
+// hold no whole block, as after a crash right after rotation; the sequence
+// then goes on from the newest one that does.
+static void RecoverState(PSEGMENT_LOG log)
+{
+    char path[MARK_MAX_PATH];
+    unsigned long long id;
+
+    log->oldestId = (unsigned long long)-1;
+    MarkEnumerateFiles(log->directory, SEGMENT_FILE_PREFIX, FoundSegment, log);
+
+    if (!log->segmentId)
+    {
+        log->oldestId = 1;
+        return;
+    }
+
+    for (id = log->segmentId; id >= log->oldestId && id && !log->sequence; id--)
+    {
+        PSEGMENT_READER reader;
+
+        if (!SegmentPath(path, log->directory, id) || !(reader = SegmentReaderOpen(path)))
+        {
+            continue;
+        }
+        if (reader->blockCount)
+        {
+            PSEGMENT_INDEX_ENTRY last = &reader->index[reader->blockCount - 1];
+            log->sequence = last->firstSequence + last->count;
+        }
+        SegmentReaderClose(reader);
+    }
+}
+
+unsigned long long SegmentLogSequence(PSEGMENT_LOG log)
+{
+    return log->sequence + log->blockCount;
+}
+
+PSEGMENT_LOG SegmentLogOpen(const char* directory, unsigned long long maxSegmentSize, int maxSegments)
+{
+    PSEGMENT_LOG log = (PSEGMENT_LOG)calloc(1, sizeof(SEGMENT_LOG));
+    if (!log)
+    {
+        return NULL;
+    }
+
+    strncpy(log->directory, directory, MARK_MAX_PATH - 1);
+    log->maxSegmentSize = maxSegmentSize ? maxSegmentSize : SEGMENT_DEFAULT_SIZE;
+    log->maxSegments = maxSegments;
+    log->oldestId = 1;
+
+    if (!MarkCreateDirectory(directory))
+    {
+        printf("Cannot create the log directory %s.\n", directory);
+        free(log);
+        return NULL;
+    }
+    RecoverState(log);
+
+    return log;
+}
+
+void SegmentLogClose(PSEGMENT_LOG log)
+{
+    if (!log)
+    {
+        return;
+    }
+
+    SegmentLogFlush(log);
+    FinishSegment(log);
+
+    free(log->index);
+    free(log);
+}
+
+void GetSegmentLogStats(PSEGMENT_LOG log, PSEGMENT_STATS stats)
+{
+    *stats = log->stats;
+}
+
+void GetSegmentLogIoStats(PSEGMENT_LOG log, PLOGIO_STATS stats)
+{
+    LOGIO_STATS io = { 0 };
+
+    *stats = log->ioStats;
+    if (log->file)
+    {
+        GetLogFileStats(log->file, &io);
+        stats->writes += io.writes;
+        stats->bytes += io.bytes;
+        stats->syncs += io.syncs;
+        stats->failures += io.failures;
+        stats->stalls += io.stalls;
+    }
+}
+
+const char* SegmentLogBackendName(PSEGMENT_LOG log)
+{
+    return log->file ? LogFileBackendName(log->file) : log->backend;
+}
+
+static int ScanBlocks(PSEGMENT_READER reader, unsigned long long size)
+{
+    SEGMENT_BLOCK_HEADER header;
+    SEGMENT_INDEX_ENTRY entry;
+    unsigned long long offset = sizeof(SEGMENT_HEADER);
+    unsigned long capacity = 0;
+
+    while (offset + sizeof(header) <= size && MarkFileReadAt(reader->file, offset, &header, sizeof(header)))
+    {
+        if (header.magic != SEGMENT_BLOCK_MAGIC || offset + sizeof(header) + header.compressedSize > size)
+        {
+            break;
+        }
+
+        if (reader->blockCount == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            PSEGMENT_INDEX_ENTRY index = (PSEGMENT_INDEX_ENTRY)realloc(reader->index, capacity * sizeof(SEGMENT_INDEX_ENTRY));
+            if (!index)
+            {
+                return 0;
+            }
+            reader->index = index;
+        }
+
+        // Times are unknown without decompressing; keep the range open.
+        entry.firstSequence = header.firstSequence;
+        entry.offset = offset;
+        entry.timeFirst = 0;
+        entry.timeLast = 0x7FFFFFFFFFFFFFFFLL;
+        entry.count = header.count;
+        entry.compressedSize = header.compressedSize;
+        reader->index[reader->blockCount++] = entry;
+
+        offset += sizeof(header) + header.compressedSize;
+    }
+
+    return 1;
+}
+
+PSEGMENT_READER SegmentReaderOpen(const char* path)
+{
+    SEGMENT_FOOTER footer;
+    unsigned long long size;
+
+    PSEGMENT_READER reader = (PSEGMENT_READER)calloc(1, sizeof(SEGMENT_READER));
+    if (!reader)
+    {
+        return NULL;
+    }
+
+    reader->file = MarkFileOpenRead(path);
+    if (MARK_INVALID_FILE == reader->file)
+    {
+        free(reader);
+        return NULL;
+    }
+
+    size = MarkFileSize(reader->file);
+    if (!MarkFileReadAt(reader->file, 0, &reader->header, sizeof(reader->header)) ||
+        reader->header.magic != SEGMENT_MAGIC ||
+        reader->header.recordSize != sizeof(MARK_EVENT))
+    {
+        SegmentReaderClose(reader);
+        return NULL;
+    }
+
+    if (size >= sizeof(SEGMENT_HEADER) + sizeof(footer) &&
+        MarkFileReadAt(reader->file, size - sizeof(footer), &footer, sizeof(footer)) &&
+        footer.magic == SEGMENT_FOOTER_MAGIC &&
+        footer.indexOffset + footer.blockCount * sizeof(SEGMENT_INDEX_ENTRY) + sizeof(footer) == size)
+    {
+        reader->index = (PSEGMENT_INDEX_ENTRY)malloc(footer.blockCount * sizeof(SEGMENT_INDEX_ENTRY) + 1);
+        if (reader->index && MarkFileReadAt(reader->file, footer.indexOffset, reader->index, footer.blockCount * sizeof(SEGMENT_INDEX_ENTRY)))
+        {
+            reader->blockCount = footer.blockCount;
+            return reader;
+        }
+    }
+
+    if (!ScanBlocks(reader, size))
+    {
+        SegmentReaderClose(reader);
+        return NULL;
+    }
+
+    return reader;
+}
+
+int SegmentReaderBlockCount(PSEGMENT_READER reader)
+{
+    return reader->blockCount;
+}
+
+PSEGMENT_INDEX_ENTRY SegmentReaderIndex(PSEGMENT_READER reader, int block)
+{
+    return (block >= 0 && (unsigned long)block < reader->blockCount) ? &reader->index[block] : NULL;
+}
+
+int SegmentReaderFindSequence(PSEGMENT_READER reader, unsigned long long sequence)
+{
+    int low = 0;
+    int high = (int)reader->blockCount - 1;
+
+    while (low <= high)
+    {
+        int middle = (low + high) / 2;
+        PSEGMENT_INDEX_ENTRY entry = &reader->index[middle];
+
+        if (sequence < entry->firstSequence)
+        {
+            high = middle - 1;
+        }
+        else if (sequence >= entry->firstSequence + entry->count)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            return middle;
+        }
+    }
+
+    return -1;
+}
+
+int SegmentReaderFindTime(PSEGMENT_READER reader, long long time)
+{
+    unsigned long i;
+
+    for (i = 0; i < reader->blockCount; i++)
+    {
+        if (reader->index[i].timeLast >= time)
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+int SegmentReaderReadBlock(PSEGMENT_READER reader, int block, PMARK_EVENT events, int capacity)
+{
+    PSEGMENT_INDEX_ENTRY entry = SegmentReaderIndex(reader, block);
+    PSEGMENT_BLOCK_HEADER header = (PSEGMENT_BLOCK_HEADER)reader->compressed;
+
+    if (!entry || entry->compressedSize > LzCompressBound(SEGMENT_BLOCK_SIZE) || (int)entry->count > capacity)
+    {
+        return -1;
+    }
+
+    // Only the index entry's bytes were read, so a block header that
+    // disagrees with it is not to be trusted.
+    if (!MarkFileReadAt(reader->file, entry->offset, reader->compressed, sizeof(SEGMENT_BLOCK_HEADER) + entry->compressedSize) ||
+        header->magic != SEGMENT_BLOCK_MAGIC || header->compressedSize != entry->compressedSize ||
+        header->count != entry->count)
+    {
+        return -1;
+    }
+
+    int size = LzDecompress(reader->compressed + sizeof(SEGMENT_BLOCK_HEADER), entry->compressedSize,
+        (unsigned char*)events, capacity * sizeof(MARK_EVENT));
+    if (size != (int)(entry->count * sizeof(MARK_EVENT)))
+    {
+        return -1;
+    }
+
+    return entry->count;
+}
+
+void SegmentReaderClose(PSEGMENT_READER reader)
+{
+    if (!reader)
+    {
+        return;
+    }
+
+    if (MARK_INVALID_FILE != reader->file)
+    {
+        MarkFileClose(reader->file);
+    }
+
+    free(reader->index);
+    free(reader);
+}
\ No newline at end of file
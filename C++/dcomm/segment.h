@@ -0,0 +1,92 @@
+#ifndef _SEGMENT_H_
+#define _SEGMENT_H_
+
+#include "communicator.h"
+#include "logio.h"
+#include "platform.h"
+
+// A segment file is a SEGMENT_HEADER, a run of LZ-compressed blocks of whole
+// MARK_EVENT records, the block index and a SEGMENT_FOOTER at the very end.
+// Each block starts with its own SEGMENT_BLOCK_HEADER, so segments that were
+// never finalized can still be read by scanning.
+#define SEGMENT_MAGIC 0x47534B4D        // "MKSG"
+#define SEGMENT_BLOCK_MAGIC 0x4B4C424D  // "MBLK"
+#define SEGMENT_FOOTER_MAGIC 0x5844494D // "MIDX"
+#define SEGMENT_VERSION 2
+
+#define SEGMENT_BLOCK_SIZE (64 * 1024)
+#define SEGMENT_DEFAULT_SIZE (64 * 1024 * 1024)
+#define SEGMENT_DEFAULT_COUNT 16
+
+#define SEGMENT_FILE_PREFIX "segment-"
+#define SEGMENT_FILE_FORMAT "%s" MARK_PATH_SEPARATOR SEGMENT_FILE_PREFIX "%016llu.mseg"
+
+typedef struct _SEGMENT_HEADER
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int recordSize;
+    unsigned int blockSize;
+    unsigned long long segmentId;
+} SEGMENT_HEADER, *PSEGMENT_HEADER;
+
+typedef struct _SEGMENT_BLOCK_HEADER
+{
+    unsigned int magic;
+    unsigned int count;
+    unsigned int rawSize;
+    unsigned int compressedSize;
+    unsigned long long firstSequence;
+} SEGMENT_BLOCK_HEADER, *PSEGMENT_BLOCK_HEADER;
+
+typedef struct _SEGMENT_INDEX_ENTRY
+{
+    unsigned long long firstSequence;
+    unsigned long long offset;
+    long long timeFirst;
+    long long timeLast;
+    unsigned int count;
+    unsigned int compressedSize;
+} SEGMENT_INDEX_ENTRY, *PSEGMENT_INDEX_ENTRY;
+
+typedef struct _SEGMENT_FOOTER
+{
+    unsigned long long indexOffset;
+    unsigned int blockCount;
+    unsigned int magic;
+} SEGMENT_FOOTER, *PSEGMENT_FOOTER;
+
+typedef struct _SEGMENT_STATS
+{
+    unsigned long long events;
+    unsigned long long blocks;
+    unsigned long long segments;
+    unsigned long long rawBytes;
+    unsigned long long compressedBytes;
+    unsigned long long failures;
+} SEGMENT_STATS, *PSEGMENT_STATS;
+
+typedef struct _SEGMENT_LOG SEGMENT_LOG, *PSEGMENT_LOG;
+typedef struct _SEGMENT_READER SEGMENT_READER, *PSEGMENT_READER;
+
+// Writer. Not thread safe: a log belongs to the thread that appends to it.
+PSEGMENT_LOG SegmentLogOpen(const char* directory, unsigned long long maxSegmentSize, int maxSegments);
+int SegmentLogAppend(PSEGMENT_LOG log, PMARK_EVENT events, int count);
+int SegmentLogFlush(PSEGMENT_LOG log);
+// Sequence the next appended event gets.
+unsigned long long SegmentLogSequence(PSEGMENT_LOG log);
+void SegmentLogClose(PSEGMENT_LOG log);
+void GetSegmentLogStats(PSEGMENT_LOG log, PSEGMENT_STATS stats);
+void GetSegmentLogIoStats(PSEGMENT_LOG log, PLOGIO_STATS stats);
+const char* SegmentLogBackendName(PSEGMENT_LOG log);
+
+// Reader. Uses the footer index when present and falls back to a block scan.
+PSEGMENT_READER SegmentReaderOpen(const char* path);
+int SegmentReaderBlockCount(PSEGMENT_READER reader);
+PSEGMENT_INDEX_ENTRY SegmentReaderIndex(PSEGMENT_READER reader, int block);
+int SegmentReaderFindSequence(PSEGMENT_READER reader, unsigned long long sequence);
+int SegmentReaderFindTime(PSEGMENT_READER reader, long long time);
+int SegmentReaderReadBlock(PSEGMENT_READER reader, int block, PMARK_EVENT events, int capacity);
+void SegmentReaderClose(PSEGMENT_READER reader);
+
+#endif
\ No newline at end of file
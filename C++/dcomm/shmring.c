@@ -0,0 +1,815 @@
+#include "shmring.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+#define SLOT_FREE 0
+#define SLOT_ACTIVE 1
+#define SLOT_CLAIMING 2 // taken, ACTIVE once the reader's pid is in
+
+// Ring header layout, shared by every process that maps the ring. The
+// counters that the writer and the readers update go to cache lines of
+// their own.
+typedef struct _SHMRING_SLOT
+{
+    volatile long long state;
+    volatile long long pid;
+    volatile long long cursor; // next sequence the reader takes
+    volatile long long events;
+    volatile long long lost;
+    volatile long long maxLag;
+    volatile long long waiting;
+    long long reserved;
+} SHMRING_SLOT, *PSHMRING_SLOT;
+
+typedef struct _SHMRING_HEADER
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int recordSize;
+    unsigned int capacity;
+    unsigned int headerSize;
+    unsigned int maxReaders;
+    volatile unsigned int doorbell; // futex word, Linux
+    unsigned int reserved1;
+    volatile long long closed;
+    long long reserved2[3];
+
+    // Records below claimed - capacity may be overwritten at any time.
+    volatile long long claimed;
+    long long reserved3[7];
+    volatile long long published;
+    long long reserved4[7];
+
+    SHMRING_SLOT readers[SHMRING_MAX_READERS];
+} SHMRING_HEADER, *PSHMRING_HEADER;
+
+#define SHMRING_HEADER_SIZE 4096
+
+typedef struct _SHMRING_MAPPING
+{
+    PSHMRING_HEADER header;
+    PMARK_EVENT records;
+    unsigned long long size;
+    char name[MARK_MAX_PATH];
+#ifdef _WIN32
+    HANDLE section;
+#endif
+} SHMRING_MAPPING, *PSHMRING_MAPPING;
+
+struct _SHMRING
+{
+    SHMRING_MAPPING mapping;
+    long long mask;
+    long long next;
+    long long claimed;
+    long long published;
+    SHMRING_STATS stats;
+#ifdef _WIN32
+    HANDLE doorbells[SHMRING_MAX_READERS];
+#endif
+};
+
+struct _SHMRING_READER
+{
+    SHMRING_MAPPING mapping;
+    PSHMRING_SLOT slot;
+    long long capacity;
+    long long mask;
+    long long cursor;
+    int taken;
+    SHMRING_READER_STATS stats;
+#ifdef _WIN32
+    HANDLE doorbell;
+#endif
+};
+
+#ifdef _WIN32
+
+static void MappingName(const char* name, char* buffer, int size)
+{
+    snprintf(buffer, size, "Local\\%s", name);
+}
+
+static void DoorbellName(const char* name, int slot, char* buffer, int size)
+{
+    snprintf(buffer, size, "Local\\%s-reader-%d", name, slot);
+}
+
+static int MapCreate(PSHMRING_MAPPING mapping, unsigned long long size)
+{
+    mapping->section = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+        (DWORD)(size >> 32), (DWORD)size, mapping->name);
+    if (!mapping->section)
+    {
+        printf("Cannot create shared memory %s, error %u\n", mapping->name, GetLastError());
+        return 0;
+    }
+
+    mapping->header = (PSHMRING_HEADER)MapViewOfFile(mapping->section, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!mapping->header)
+    {
+        CloseHandle(mapping->section);
+        return 0;
+    }
+    mapping->size = size;
+
+    return 1;
+}
+
+static int MapOpen(PSHMRING_MAPPING mapping)
+{
+    MEMORY_BASIC_INFORMATION info;
+
+    mapping->section = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, mapping->name);
+    if (!mapping->section)
+    {
+        return 0;
+    }
+
+    mapping->header = (PSHMRING_HEADER)MapViewOfFile(mapping->section, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!mapping->header)
+    {
+        CloseHandle(mapping->section);
+        return 0;
+    }
+    VirtualQuery(mapping->header, &info, sizeof(info));
+    mapping->size = info.RegionSize;
+
+    return 1;
+}
+
+static void MapClose(PSHMRING_MAPPING mapping, int owner)
+{
+    UNREFERENCED_PARAMETER(owner);
+
+    UnmapViewOfFile(mapping->header);
+    CloseHandle(mapping->section);
+}
+
+static int ProcessAlive(long long pid)
+{
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    int alive;
+
+    if (!process)
+    {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+
+    return alive;
+}
+
+static long long CurrentProcess()
+{
+    return GetCurrentProcessId();
+}
+
+// Every reader has an auto-reset event of its own; the writer opens it the
+// first time it has to ring that slot and keeps it for later readers.
+static int WakeReaders(PSHMRING ring, int all)
+{
+    PSHMRING_HEADER header = ring->mapping.header;
+    int rung = 0;
+    int i;
+
+    for (i = 0; i < SHMRING_MAX_READERS; i++)
+    {
+        if (header->readers[i].state != SLOT_ACTIVE || !(all || header->readers[i].waiting))
+        {
+            continue;
+        }
+
+        if (!ring->doorbells[i])
+        {
+            char name[MARK_MAX_PATH];
+
+            DoorbellName(ring->mapping.name + strlen("Local\\"), i, name, sizeof(name));
+            ring->doorbells[i] = OpenEventA(EVENT_MODIFY_STATE, FALSE, name);
+        }
+        if (ring->doorbells[i])
+        {
+            SetEvent(ring->doorbells[i]);
+            rung = 1;
+        }
+    }
+
+    return rung;
+}
+
+static void CloseDoorbells(PSHMRING ring)
+{
+    int i;
+
+    for (i = 0; i < SHMRING_MAX_READERS; i++)
+    {
+        if (ring->doorbells[i])
+        {
+            CloseHandle(ring->doorbells[i]);
+        }
+    }
+}
+
+static int ReaderDoorbellOpen(PSHMRING_READER reader, const char* name, int slot)
+{
+    char doorbell[MARK_MAX_PATH];
+
+    DoorbellName(name, slot, doorbell, sizeof(doorbell));
+    reader->doorbell = CreateEventA(NULL, FALSE, FALSE, doorbell);
+
+    return reader->doorbell != NULL;
+}
+
+static void ReaderDoorbellClose(PSHMRING_READER reader)
+{
+    CloseHandle(reader->doorbell);
+}
+
+static void ReaderDoorbellWait(PSHMRING_READER reader, unsigned int value, int timeout)
+{
+    UNREFERENCED_PARAMETER(value);
+
+    WaitForSingleObject(reader->doorbell, timeout);
+}
+
+#else
+
+static void MappingName(const char* name, char* buffer, int size)
+{
+    snprintf(buffer, size, "/%s", name);
+}
+
+static int MapCreate(PSHMRING_MAPPING mapping, unsigned long long size)
+{
+    int fd;
+
+    // A ring left behind by a collector that crashed is replaced.
+    shm_unlink(mapping->name);
+    fd = shm_open(mapping->name, O_RDWR | O_CREAT | O_EXCL, 0660);
+    if (fd < 0)
+    {
+        printf("Cannot create shared memory %s, error %d\n", mapping->name, errno);
+        return 0;
+    }
+
+    if (ftruncate(fd, (off_t)size) < 0)
+    {
+        printf("Cannot size shared memory %s, error %d\n", mapping->name, errno);
+        close(fd);
+        shm_unlink(mapping->name);
+        return 0;
+    }
+
+    mapping->header = (PSHMRING_HEADER)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == (void*)mapping->header)
+    {
+        shm_unlink(mapping->name);
+        return 0;
+    }
+    mapping->size = size;
+
+    return 1;
+}
+
+static int MapOpen(PSHMRING_MAPPING mapping)
+{
+    struct stat info;
+    int fd = shm_open(mapping->name, O_RDWR, 0);
+
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    if (fstat(fd, &info) < 0 || (unsigned long long)info.st_size < SHMRING_HEADER_SIZE)
+    {
+        close(fd);
+        return 0;
+    }
+
+    mapping->header = (PSHMRING_HEADER)mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == (void*)mapping->header)
+    {
+        return 0;
+    }
+    mapping->size = info.st_size;
+
+    return 1;
+}
+
+// Readers that still have the ring mapped keep it alive after the unlink.
+static void MapClose(PSHMRING_MAPPING mapping, int owner)
+{
+    munmap(mapping->header, mapping->size);
+    if (owner)
+    {
+        shm_unlink(mapping->name);
+    }
+}
+
+static int ProcessAlive(long long pid)
+{
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+static long long CurrentProcess()
+{
+    return getpid();
+}
+
+static void Futex(volatile unsigned int* word, int operation, unsigned int value, int timeout)
+{
+    struct timespec wait;
+
+    wait.tv_sec = timeout / 1000;
+    wait.tv_nsec = (timeout % 1000) * 1000000L;
+    syscall(SYS_futex, word, operation, value, timeout < 0 ? NULL : &wait, NULL, 0);
+}
+
+// One futex for all readers: the writer bumps it and wakes everybody.
+static int WakeReaders(PSHMRING ring, int all)
+{
+    PSHMRING_HEADER header = ring->mapping.header;
+    int i;
+
+    for (i = 0; i < SHMRING_MAX_READERS && !all; i++)
+    {
+        all = header->readers[i].state == SLOT_ACTIVE && header->readers[i].waiting;
+    }
+    if (all)
+    {
+        __sync_fetch_and_add(&header->doorbell, 1);
+        Futex(&header->doorbell, FUTEX_WAKE, INT_MAX, -1);
+    }
+
+    return all;
+}
+
+static void CloseDoorbells(PSHMRING ring)
+{
+    UNREFERENCED_PARAMETER(ring);
+}
+
+static int ReaderDoorbellOpen(PSHMRING_READER reader, const char* name, int slot)
+{
+    UNREFERENCED_PARAMETER(reader);
+    UNREFERENCED_PARAMETER(name);
+    UNREFERENCED_PARAMETER(slot);
+
+    return 1;
+}
+
+static void ReaderDoorbellClose(PSHMRING_READER reader)
+{
+    UNREFERENCED_PARAMETER(reader);
+}
+
+static void ReaderDoorbellWait(PSHMRING_READER reader, unsigned int value, int timeout)
+{
+    Futex(&reader->mapping.header->doorbell, FUTEX_WAIT, value, timeout);
+}
+
+#endif
+
+static unsigned long RoundCapacity(unsigned long capacity)
+{
+    unsigned long rounded = SHMRING_PUBLISH_BATCH * 2;
+
+    while (rounded < capacity && rounded < SHMRING_MAX_CAPACITY)
+    {
+        rounded <<= 1;
+    }
+
+    return rounded;
+}
+
+PSHMRING ShmRingCreate(const char* name, unsigned long capacity)
+{
+    PSHMRING ring = (PSHMRING)calloc(1, sizeof(SHMRING));
+    PSHMRING_HEADER header;
+
+    if (!ring)
+    {
+        return NULL;
+    }
+
+    capacity = RoundCapacity(capacity);
+    MappingName(name, ring->mapping.name, sizeof(ring->mapping.name));
+    if (!MapCreate(&ring->mapping, SHMRING_HEADER_SIZE + (unsigned long long)capacity * sizeof(MARK_EVENT)))
+    {
+        free(ring);
+        return NULL;
+    }
+
+    header = ring->mapping.header;
+    ring->mapping.records = (PMARK_EVENT)((unsigned char*)header + SHMRING_HEADER_SIZE);
+    ring->mask = capacity - 1;
+    ring->stats.capacity = capacity;
+
+    memset(header, 0, SHMRING_HEADER_SIZE);
+    header->version = SHMRING_VERSION;
+    header->recordSize = sizeof(MARK_EVENT);
+    header->capacity = capacity;
+    header->headerSize = SHMRING_HEADER_SIZE;
+    header->maxReaders = SHMRING_MAX_READERS;
+
+    // Readers check the magic, so it goes in last.
+    MarkMemoryBarrier();
+    header->magic = SHMRING_MAGIC;
+
+    return ring;
+}
+
+void ShmRingWrite(PSHMRING ring, PMARK_EVENT event)
+{
+    // Readers must learn that a record is about to change before it does.
+    if (ring->next == ring->claimed)
+    {
+        ring->claimed += SHMRING_PUBLISH_BATCH;
+        MarkAtomicStore64(&ring->mapping.header->claimed, ring->claimed);
+        MarkMemoryBarrier();
+    }
+
+    memcpy(&ring->mapping.records[ring->next & ring->mask], event, sizeof(MARK_EVENT));
+    ring->next++;
+    ring->stats.events++;
+
+    if (ring->next - ring->published >= SHMRING_PUBLISH_BATCH)
+    {
+        ShmRingPublish(ring);
+    }
+}
+
+int ShmRingPublish(PSHMRING ring)
+{
+    PSHMRING_HEADER header = ring->mapping.header;
+
+    if (ring->next == ring->published)
+    {
+        return 0;
+    }
+
+    ring->published = ring->next;
+    MarkAtomicStore64(&header->published, ring->published);
+    ring->stats.batches++;
+
+    // Pairs with the barrier in ShmReaderWait: either the reader sees the
+    // new events or we see it waiting.
+    MarkMemoryBarrier();
+    if (WakeReaders(ring, 0))
+    {
+        ring->stats.doorbells++;
+    }
+
+    return 1;
+}
+
+void ShmRingClose(PSHMRING ring)
+{
+    ShmRingPublish(ring);
+
+    MarkAtomicStore64(&ring->mapping.header->closed, 1);
+    MarkMemoryBarrier();
+    WakeReaders(ring, 1);
+
+    CloseDoorbells(ring);
+    MapClose(&ring->mapping, 1);
+    free(ring);
+}
+
+void GetShmRingStats(PSHMRING ring, PSHMRING_STATS stats)
+{
+    *stats = ring->stats;
+}
+
+int GetShmRingReaderStats(PSHMRING ring, int slot, PSHMRING_READER_STATS stats)
+{
+    PSHMRING_SLOT reader = &ring->mapping.header->readers[slot];
+    long long lag;
+
+    memset(stats, 0, sizeof(*stats));
+    if (reader->state != SLOT_ACTIVE)
+    {
+        return 0;
+    }
+
+    lag = ring->published - MarkAtomicLoad64(&reader->cursor);
+    stats->pid = reader->pid;
+    stats->events = reader->events;
+    stats->lost = reader->lost;
+    stats->lag = lag > 0 ? lag : 0;
+    stats->maxLag = reader->maxLag;
+
+    return 1;
+}
+
+static int ClaimSlot(PSHMRING_HEADER header)
+{
+    int i;
+
+    for (i = 0; i < SHMRING_MAX_READERS; i++)
+    {
+        if (MarkAtomicCas64(&header->readers[i].state, SLOT_CLAIMING, SLOT_FREE) == SLOT_FREE)
+        {
+            return i;
+        }
+    }
+
+    // None free: take over the slot of a reader that died without closing
+    // it. A slot turns ACTIVE only after its pid is set, so one claimed anew
+    // since the pid was read shows a different pid and is handed back.
+    for (i = 0; i < SHMRING_MAX_READERS; i++)
+    {
+        PSHMRING_SLOT slot = &header->readers[i];
+        long long pid;
+
+        if (MarkAtomicLoad64(&slot->state) != SLOT_ACTIVE)
+        {
+            continue;
+        }
+        pid = slot->pid;
+        if (ProcessAlive(pid) || MarkAtomicCas64(&slot->state, SLOT_CLAIMING, SLOT_ACTIVE) != SLOT_ACTIVE)
+        {
+            continue;
+        }
+        if (slot->pid == pid)
+        {
+            return i;
+        }
+        MarkAtomicStore64(&slot->state, SLOT_ACTIVE);
+    }
+
+    return -1;
+}
+
+PSHMRING_READER ShmReaderOpen(const char* name, int oldest)
+{
+    PSHMRING_READER reader = (PSHMRING_READER)calloc(1, sizeof(SHMRING_READER));
+    PSHMRING_HEADER header;
+    long long claimed;
+    int slot;
+
+    if (!reader)
+    {
+        return NULL;
+    }
+
+    MappingName(name, reader->mapping.name, sizeof(reader->mapping.name));
+    if (!MapOpen(&reader->mapping))
+    {
+        free(reader);
+        return NULL;
+    }
+
+    header = reader->mapping.header;
+    MarkMemoryBarrier();
+    if (header->magic != SHMRING_MAGIC || header->version != SHMRING_VERSION || header->recordSize != sizeof(MARK_EVENT) ||
+        header->headerSize != SHMRING_HEADER_SIZE || reader->mapping.size < SHMRING_HEADER_SIZE + (unsigned long long)header->capacity * sizeof(MARK_EVENT))
+    {
+        printf("Shared memory %s is not an event ring of this version\n", name);
+        MapClose(&reader->mapping, 0);
+        free(reader);
+        return NULL;
+    }
+
+    slot = ClaimSlot(header);
+    if (slot < 0)
+    {
+        printf("All %d reader slots of %s are taken\n", SHMRING_MAX_READERS, name);
+        MapClose(&reader->mapping, 0);
+        free(reader);
+        return NULL;
+    }
+
+    reader->mapping.records = (PMARK_EVENT)((unsigned char*)header + SHMRING_HEADER_SIZE);
+    reader->capacity = header->capacity;
+    reader->mask = header->capacity - 1;
+    reader->slot = &header->readers[slot];
+
+    if (!ReaderDoorbellOpen(reader, name, slot))
+    {
+        MarkAtomicStore64(&reader->slot->state, SLOT_FREE);
+        MapClose(&reader->mapping, 0);
+        free(reader);
+        return NULL;
+    }
+
+    claimed = MarkAtomicLoad64(&header->claimed);
+    reader->cursor = MarkAtomicLoad64(&header->published);
+    if (oldest)
+    {
+        reader->cursor = claimed > reader->capacity ? claimed - reader->capacity : 0;
+    }
+    reader->stats.pid = CurrentProcess();
+
+    reader->slot->pid = reader->stats.pid;
+    reader->slot->events = 0;
+    reader->slot->lost = 0;
+    reader->slot->maxLag = 0;
+    reader->slot->waiting = 0;
+    MarkAtomicStore64(&reader->slot->cursor, reader->cursor);
+    MarkAtomicStore64(&reader->slot->state, SLOT_ACTIVE);
+
+    return reader;
+}
+
+int ShmReaderPeek(PSHMRING_READER reader, PMARK_EVENT* events, int max)
+{
+    PSHMRING_HEADER header = reader->mapping.header;
+    long long published = MarkAtomicLoad64(&header->published);
+    long long oldest = MarkAtomicLoad64(&header->claimed) - reader->capacity;
+    long long available, contiguous;
+
+    if (reader->cursor < oldest)
+    {
+        reader->stats.lost += oldest - reader->cursor;
+        reader->cursor = oldest;
+    }
+
+    available = published - reader->cursor;
+    if (available <= 0)
+    {
+        reader->taken = 0;
+        return 0;
+    }
+
+    if ((unsigned long long)available > reader->stats.maxLag)
+    {
+        reader->stats.maxLag = available;
+    }
+
+    contiguous = reader->capacity - (reader->cursor & reader->mask);
+    reader->taken = (int)MIN(available, MIN(contiguous, (long long)max));
+    *events = &reader->mapping.records[reader->cursor & reader->mask];
+
+    return reader->taken;
+}
+
+int ShmReaderRelease(PSHMRING_READER reader)
+{
+    long long torn;
+
+    // Everything read from the records happened before the writer's claim
+    // is checked.
+    MarkMemoryBarrier();
+    torn = MarkAtomicLoad64(&reader->mapping.header->claimed) - reader->capacity - reader->cursor;
+    torn = MAX(0, MIN(torn, (long long)reader->taken));
+
+    reader->stats.events += reader->taken - torn;
+    reader->stats.lost += torn;
+    reader->cursor += reader->taken;
+    reader->taken = 0;
+
+    reader->slot->events = reader->stats.events;
+    reader->slot->lost = reader->stats.lost;
+    reader->slot->maxLag = reader->stats.maxLag;
+    MarkAtomicStore64(&reader->slot->cursor, reader->cursor);
+
+    return torn == 0;
+}
+
+static int ReaderReady(PSHMRING_READER reader)
+{
+    PSHMRING_HEADER header = reader->mapping.header;
+
+    return MarkAtomicLoad64(&header->published) > reader->cursor || MarkAtomicLoad64(&header->closed);
+}
+
+int ShmReaderWait(PSHMRING_READER reader, int timeout)
+{
+    unsigned int value = reader->mapping.header->doorbell;
+
+    if (ReaderReady(reader))
+    {
+        return 1;
+    }
+
+    MarkAtomicStore64(&reader->slot->waiting, 1);
+    MarkMemoryBarrier();
+    if (!ReaderReady(reader))
+    {
+        reader->stats.waits++;
+        ReaderDoorbellWait(reader, value, timeout);
+    }
+    MarkAtomicStore64(&reader->slot->waiting, 0);
+
+    return MarkAtomicLoad64(&reader->mapping.header->published) > reader->cursor;
+}
+
+int ShmReaderClosed(PSHMRING_READER reader)
+{
+    return MarkAtomicLoad64(&reader->mapping.header->closed) != 0;
+}
+
+void ShmReaderClose(PSHMRING_READER reader)
+{
+    if (reader)
+    {
+        MarkAtomicStore64(&reader->slot->state, SLOT_FREE);
+        ReaderDoorbellClose(reader);
+        MapClose(&reader->mapping, 0);
+        free(reader);
+    }
+}
+
+void GetShmReaderStats(PSHMRING_READER reader, PSHMRING_READER_STATS stats)
+{
+    long long lag = MarkAtomicLoad64(&reader->mapping.header->published) - reader->cursor;
+
+    *stats = reader->stats;
+    stats->lag = lag > 0 ? lag : 0;
+}
+
+// The sink: the worker thread writes every event, and publishes the rest of
+// a batch once its queue runs dry.
+
+static PSHMRING s_ring = NULL;
+static char s_name[MARK_MAX_PATH];
+static SHMRING_STATS s_stats;
+static SHMRING_READER_STATS s_readers[SHMRING_MAX_READERS];
+
+int StartSharedRing(const char* name, unsigned long capacity)
+{
+    strncpy(s_name, name ? name : SHMRING_DEFAULT_NAME, sizeof(s_name) - 1);
+    s_ring = ShmRingCreate(s_name, capacity ? capacity : SHMRING_DEFAULT_CAPACITY);
+
+    return s_ring != NULL;
+}
+
+int IsSharedRingActive()
+{
+    return s_ring != NULL;
+}
+
+int WriteSharedRing(PMARK_EVENT event)
+{
+    ShmRingWrite(s_ring, event);
+
+    return 1;
+}
+
+int FlushSharedRing(int force)
+{
+    UNREFERENCED_PARAMETER(force);
+
+    ShmRingPublish(s_ring);
+
+    return 0;
+}
+
+// The reader slots go away with the mapping, so keep what they said last.
+void StopSharedRing()
+{
+    int i;
+
+    if (!s_ring)
+    {
+        return;
+    }
+
+    for (i = 0; i < SHMRING_MAX_READERS; i++)
+    {
+        GetShmRingReaderStats(s_ring, i, &s_readers[i]);
+    }
+    ShmRingPublish(s_ring);
+    GetShmRingStats(s_ring, &s_stats);
+    ShmRingClose(s_ring);
+    s_ring = NULL;
+}
+
+void PrintSharedRingStats()
+{
+    int i;
+
+    printf("Shared ring %s: %llu events in %llu batches (%.1f per batch), %llu doorbells, capacity %llu\n",
+        s_name, s_stats.events, s_stats.batches, s_stats.batches ? (double)s_stats.events / s_stats.batches : 0.0,
+        s_stats.doorbells, s_stats.capacity);
+
+    for (i = 0; i < SHMRING_MAX_READERS; i++)
+    {
+        if (s_readers[i].pid)
+        {
+            printf("  reader %d (pid %llu): %llu events, lag %llu, max lag %llu, %llu lost\n",
+                i, s_readers[i].pid, s_readers[i].events, s_readers[i].lag, s_readers[i].maxLag, s_readers[i].lost);
+        }
+    }
+}
\ No newline at end of file
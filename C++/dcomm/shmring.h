@@ -0,0 +1,82 @@
+#ifndef _SHMRING_H_
+#define _SHMRING_H_
+
+#include "communicator.h"
+
+// Event channel to consumers on the same host through shared memory. dcomm
+// copies events into a ring of MARK_EVENT records and publishes them a batch
+// at a time; every reader maps the ring, takes events in place and keeps its
+// own cursor in a slot of the ring header, so dcomm can report how far each
+// one lags behind. The writer never waits for a reader: a reader that falls
+// more than the ring capacity behind loses the oldest events and counts them.
+//
+// A reader with nothing to do sleeps on a doorbell: a futex in the ring
+// header on Linux, a named event per reader on Windows. The writer only
+// rings it for readers that said they are waiting.
+
+#define SHMRING_MAGIC 0x4853524D // "MRSH"
+#define SHMRING_VERSION 1
+
+#define SHMRING_DEFAULT_NAME "mark-events"
+#define SHMRING_DEFAULT_CAPACITY 16384 // events, rounded up to a power of two
+#define SHMRING_MAX_CAPACITY (1UL << 24) // events, about 17 GB of them
+#define SHMRING_MAX_READERS 16
+#define SHMRING_PUBLISH_BATCH 64       // events written before they are published
+#define SHMRING_WAIT_INTERVAL 100      // ms
+
+typedef struct _SHMRING_STATS
+{
+    unsigned long long events;
+    unsigned long long batches;   // publishes
+    unsigned long long doorbells; // publishes that had to wake a reader
+    unsigned long long capacity;
+} SHMRING_STATS, *PSHMRING_STATS;
+
+typedef struct _SHMRING_READER_STATS
+{
+    unsigned long long pid;
+    unsigned long long events;
+    unsigned long long lost;   // overwritten before the reader got to them
+    unsigned long long lag;    // published events the reader has not taken
+    unsigned long long maxLag;
+    unsigned long long waits;  // doorbell waits, reader side only
+} SHMRING_READER_STATS, *PSHMRING_READER_STATS;
+
+typedef struct _SHMRING SHMRING, *PSHMRING;
+typedef struct _SHMRING_READER SHMRING_READER, *PSHMRING_READER;
+
+// Writer. One per ring name; not thread safe.
+PSHMRING ShmRingCreate(const char* name, unsigned long capacity);
+void ShmRingWrite(PSHMRING ring, PMARK_EVENT event);
+// Publishes what has been written so far; returns 0 if there was nothing.
+int ShmRingPublish(PSHMRING ring);
+// Publishes, tells the readers the ring is closed and unmaps it.
+void ShmRingClose(PSHMRING ring);
+void GetShmRingStats(PSHMRING ring, PSHMRING_STATS stats);
+// Returns 0 if no reader holds the slot.
+int GetShmRingReaderStats(PSHMRING ring, int slot, PSHMRING_READER_STATS stats);
+
+// Reader. Starts at the next published event, or with oldest at the oldest
+// one still in the ring. Slots of readers that died are reclaimed.
+PSHMRING_READER ShmReaderOpen(const char* name, int oldest);
+// Points *events at up to max published events, in place, and returns how
+// many. They stay valid until ShmReaderRelease, unless the writer laps the
+// reader meanwhile; ShmReaderRelease returns 0 in that case.
+int ShmReaderPeek(PSHMRING_READER reader, PMARK_EVENT* events, int max);
+int ShmReaderRelease(PSHMRING_READER reader);
+// Waits for the doorbell. Returns 1 if there are events to take.
+int ShmReaderWait(PSHMRING_READER reader, int timeout);
+// The writer has closed the ring; what was published can still be taken.
+int ShmReaderClosed(PSHMRING_READER reader);
+void ShmReaderClose(PSHMRING_READER reader);
+void GetShmReaderStats(PSHMRING_READER reader, PSHMRING_READER_STATS stats);
+
+// dcomm's shared ring sink, see RegisterSinks.
+int StartSharedRing(const char* name, unsigned long capacity);
+int WriteSharedRing(PMARK_EVENT event);
+int FlushSharedRing(int force);
+int IsSharedRingActive();
+void StopSharedRing();
+void PrintSharedRingStats();
+
+#endif
\ No newline at end of file
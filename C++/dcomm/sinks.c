@@ -0,0 +1,394 @@
+#include "sinks.h"
+#include "platform.h"
+#include "stages.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _SINK
+{
+    const char* name;
+    int stage;
+    SINK_WRITE write;
+    SINK_FLUSH flush;
+    int policy;
+    unsigned long capacity;
+
+    PINGRESS_QUEUE queue;
+    MARK_THREAD thread;
+    int started;
+    volatile int draining;
+
+    // Spill file, SINK_SPILL only. The pipeline appends through out and the
+    // worker reads back through in; spilled and read count records.
+    MARK_LOCK lock;
+    FILE* out;
+    MARK_FILE in;
+    PMARK_EVENT buffer;
+    volatile int spilling;
+    unsigned long long spilled;
+    unsigned long long read;
+
+    unsigned long long written;
+    unsigned long long failures;
+    unsigned long long dropped;
+    unsigned long long spills;
+    INGRESS_STATS queueStats; // kept when the queue goes away
+} SINK, *PSINK;
+
+static SINK s_sinks[MAX_SINKS];
+static int s_count = 0;
+static const char* s_spillDirectory = ".";
+
+static const char* s_policies[] = { "block", "drop", "spill" };
+
+static void Deliver(PSINK sink, PMARK_EVENT event)
+{
+    if (sink->stage >= 0)
+    {
+        StampStage(event, sink->stage);
+    }
+    if (!sink->write(event))
+    {
+        sink->failures++;
+    }
+    sink->written++;
+}
+
+static void Spill(PSINK sink, PMARK_EVENT event)
+{
+    MarkLockAcquire(&sink->lock);
+    sink->spilling = 1;
+    if (fwrite(event, sizeof(MARK_EVENT), 1, sink->out) == 1 && !fflush(sink->out))
+    {
+        sink->spilled++;
+        sink->spills++;
+    }
+    else
+    {
+        sink->dropped++;
+    }
+    MarkLockRelease(&sink->lock);
+}
+
+// Delivers the next run of spilled events. Once the file is drained it is
+// rewound and the pipeline goes back to the queue.
+static int DrainSpill(PSINK sink)
+{
+    unsigned long long available;
+    int count, i;
+
+    MarkLockAcquire(&sink->lock);
+    available = sink->spilled - sink->read;
+    if (!available && sink->spilling)
+    {
+        sink->spilling = 0;
+        sink->spilled = sink->read = 0;
+        fseek(sink->out, 0, SEEK_SET);
+    }
+    MarkLockRelease(&sink->lock);
+
+    if (!available)
+    {
+        return 0;
+    }
+
+    count = (int)MIN(available, SINK_SPILL_BATCH);
+    if (!MarkFileReadAt(sink->in, sink->read * sizeof(MARK_EVENT), sink->buffer, count * sizeof(MARK_EVENT)))
+    {
+        printf("Cannot read back the %s spill file\n", sink->name);
+        MarkLockAcquire(&sink->lock);
+        sink->dropped += available;
+        sink->read = sink->spilled;
+        MarkLockRelease(&sink->lock);
+        return 1;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        Deliver(sink, &sink->buffer[i]);
+    }
+
+    MarkLockAcquire(&sink->lock);
+    sink->read += count;
+    MarkLockRelease(&sink->lock);
+
+    return count;
+}
+
+static MARK_THREAD_PROC(SinkWorker, parameter)
+{
+    PSINK sink = (PSINK)parameter;
+    PMARK_EVENT events[INGRESS_MAX_BATCH];
+    int count, draining, i;
+
+    while (1)
+    {
+        draining = sink->draining;
+
+        count = IngressDequeue(sink->queue, events, INGRESS_MAX_BATCH);
+        if (count)
+        {
+            for (i = 0; i < count; i++)
+            {
+                Deliver(sink, events[i]);
+            }
+            IngressRelease(sink->queue, count);
+            continue;
+        }
+
+        // The queue only holds events older than the spill file.
+        if (sink->policy == SINK_SPILL && DrainSpill(sink))
+        {
+            continue;
+        }
+
+        if (draining)
+        {
+            if (sink->flush)
+            {
+                sink->flush(1);
+            }
+            break;
+        }
+        IngressWait(sink->queue, sink->flush && sink->flush(0) ? SINK_FLUSH_INTERVAL : INGRESS_WAIT_INTERVAL);
+    }
+
+    return 0;
+}
+
+static PSINK FindSink(const char* name)
+{
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        if (!strcmp(s_sinks[i].name, name))
+        {
+            return &s_sinks[i];
+        }
+    }
+
+    return NULL;
+}
+
+int RegisterSink(const char* name, int stage, SINK_WRITE write, SINK_FLUSH flush, int policy, unsigned long capacity)
+{
+    PSINK sink;
+
+    if (s_count == MAX_SINKS)
+    {
+        printf("Too many sinks, %s not registered\n", name);
+        return 0;
+    }
+
+    sink = &s_sinks[s_count++];
+    memset(sink, 0, sizeof(*sink));
+    sink->name = name;
+    sink->stage = stage;
+    sink->write = write;
+    sink->flush = flush;
+    sink->policy = policy;
+    sink->capacity = capacity;
+    sink->in = MARK_INVALID_FILE;
+
+    return 1;
+}
+
+int SetSinkPolicy(const char* name, int policy)
+{
+    PSINK sink = FindSink(name);
+
+    if (!sink || sink->started)
+    {
+        return 0;
+    }
+
+    sink->policy = policy;
+    return 1;
+}
+
+void SetSinkSpillDirectory(const char* directory)
+{
+    s_spillDirectory = directory;
+}
+
+int GetSinkCount()
+{
+    return s_count;
+}
+
+static int OpenSpill(PSINK sink)
+{
+    char path[MARK_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s" MARK_PATH_SEPARATOR "%s.spill", s_spillDirectory, sink->name);
+
+    sink->out = fopen(path, "wb");
+    sink->in = sink->out ? MarkFileOpenRead(path) : MARK_INVALID_FILE;
+    sink->buffer = (PMARK_EVENT)malloc(SINK_SPILL_BATCH * sizeof(MARK_EVENT));
+    if (!sink->out || MARK_INVALID_FILE == sink->in || !sink->buffer)
+    {
+        printf("Cannot open the spill file %s\n", path);
+        return 0;
+    }
+
+    MarkLockInit(&sink->lock);
+    return 1;
+}
+
+static void CloseSpill(PSINK sink)
+{
+    char path[MARK_MAX_PATH];
+
+    if (sink->out)
+    {
+        fclose(sink->out);
+        sink->out = NULL;
+        MarkLockDelete(&sink->lock);
+
+        snprintf(path, sizeof(path), "%s" MARK_PATH_SEPARATOR "%s.spill", s_spillDirectory, sink->name);
+        MarkFileDelete(path);
+    }
+    if (MARK_INVALID_FILE != sink->in)
+    {
+        MarkFileClose(sink->in);
+        sink->in = MARK_INVALID_FILE;
+    }
+    free(sink->buffer);
+    sink->buffer = NULL;
+}
+
+int StartSinks()
+{
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSINK sink = &s_sinks[i];
+
+        if (sink->policy == SINK_SPILL && !OpenSpill(sink))
+        {
+            return 0;
+        }
+
+        sink->queue = IngressCreate(sink->capacity);
+        if (!sink->queue)
+        {
+            return 0;
+        }
+
+        sink->draining = 0;
+        if (!MarkThreadStart(&sink->thread, SinkWorker, sink))
+        {
+            printf("Cannot start sink %s\n", sink->name);
+            return 0;
+        }
+        sink->started = 1;
+    }
+
+    return 1;
+}
+
+void StopSinks()
+{
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSINK sink = &s_sinks[i];
+
+        if (sink->started)
+        {
+            sink->draining = 1;
+            IngressClose(sink->queue);
+            MarkThreadJoin(sink->thread);
+            sink->started = 0;
+        }
+    }
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSINK sink = &s_sinks[i];
+
+        if (sink->queue)
+        {
+            GetIngressStats(sink->queue, &sink->queueStats);
+            IngressDelete(sink->queue);
+            sink->queue = NULL;
+        }
+        CloseSpill(sink);
+    }
+}
+
+void DispatchEvent(PMARK_EVENT event)
+{
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSINK sink = &s_sinks[i];
+
+        if (!sink->started)
+        {
+            continue;
+        }
+
+        switch (sink->policy)
+        {
+        case SINK_BLOCK:
+            IngressEnqueue(sink->queue, event, 1);
+            break;
+        case SINK_DROP:
+            if (!IngressEnqueue(sink->queue, event, 0))
+            {
+                sink->dropped++;
+            }
+            break;
+        default:
+            // Once spilling, keep spilling until the worker has caught up,
+            // or events would overtake the ones in the file.
+            if (sink->spilling || !IngressEnqueue(sink->queue, event, 0))
+            {
+                Spill(sink, event);
+            }
+            break;
+        }
+    }
+}
+
+void GetSinkStats(int sink, PSINK_STATS stats)
+{
+    PSINK s = &s_sinks[sink];
+    INGRESS_STATS queue = s->queueStats;
+
+    if (s->queue)
+    {
+        GetIngressStats(s->queue, &queue);
+    }
+
+    stats->name = s->name;
+    stats->policy = s->policy;
+    stats->written = s->written;
+    stats->failures = s->failures;
+    stats->dropped = s->dropped;
+    stats->spilled = s->spills;
+    stats->waits = queue.waits;
+    stats->maxDepth = queue.maxDepth;
+    stats->capacity = queue.capacity;
+}
+
+void PrintSinkStats()
+{
+    SINK_STATS stats;
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        GetSinkStats(i, &stats);
+        printf("Sink %s (%s): %llu written, %llu failures, %llu dropped, %llu spilled, %llu waits, max depth %llu of %llu\n",
+            stats.name, s_policies[stats.policy], stats.written, stats.failures, stats.dropped,
+            stats.spilled, stats.waits, stats.maxDepth, stats.capacity);
+    }
+}
\ No newline at end of file
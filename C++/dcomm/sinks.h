@@ -0,0 +1,61 @@
+#ifndef _SINKS_H_
+#define _SINKS_H_
+
+#include "communicator.h"
+#include "ingress.h"
+
+// Fan-out stage behind the pipeline. Every sink (binary log, text log,
+// analyzer pipe, ...) has its own bounded queue and worker thread, and the
+// pipeline only copies each event into the queues. What happens when a
+// queue is full is up to the sink's overflow policy, so a stalled consumer
+// holds up itself and nothing else.
+
+#define MAX_SINKS 8
+#define SINK_DEFAULT_CAPACITY 4096 // events
+#define SINK_SPILL_BATCH 64
+#define SINK_FLUSH_INTERVAL 1 // ms between flush calls while a sink holds events back
+
+// Overflow policies.
+#define SINK_BLOCK 0 // the pipeline waits for room; nothing is lost
+#define SINK_DROP 1  // the event is discarded and counted
+#define SINK_SPILL 2 // the event goes to a spill file and is delivered later, in order
+
+// Delivers one event. Called on the sink's own worker thread only.
+typedef int (*SINK_WRITE)(PMARK_EVENT event);
+// Optional, for sinks that batch: called whenever the queue runs empty, and
+// with force set before the worker exits. Returns 1 while it still holds
+// events back, and is then called again soon.
+typedef int (*SINK_FLUSH)(int force);
+
+typedef struct _SINK_STATS
+{
+    const char* name;
+    int policy;
+    unsigned long long written;
+    unsigned long long failures; // write returned 0
+    unsigned long long dropped;
+    unsigned long long spilled;
+    unsigned long long waits;
+    unsigned long long maxDepth;
+    unsigned long long capacity;
+} SINK_STATS, *PSINK_STATS;
+
+// stage is the MARK_STAGE_* stamped when the worker picks the event up, or -1.
+int RegisterSink(const char* name, int stage, SINK_WRITE write, SINK_FLUSH flush, int policy, unsigned long capacity);
+int SetSinkPolicy(const char* name, int policy);
+// Directory for spill files, the current one by default.
+void SetSinkSpillDirectory(const char* directory);
+int GetSinkCount();
+
+int StartSinks();
+// Waits for every queue and spill file to drain, then stops the workers.
+// The pipeline must not dispatch any more events by then.
+void StopSinks();
+
+// Pipeline side: copies the event to every sink.
+void DispatchEvent(PMARK_EVENT event);
+
+void GetSinkStats(int sink, PSINK_STATS stats);
+void PrintSinkStats();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,1179 @@
+#ifdef _WIN32
+// Winsock 2 has to come before Windows.h pulls in the old winsock.h.
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <iphlpapi.h>
+#include <tlhelp32.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "iphlpapi.lib")
+#endif
+#else
+#include <pwd.h>
+#include <unistd.h>
+#endif
+
+#include "socketowners.h"
+#include "platform.h"
+#include "tcpip.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OWNER_MIN_SLOTS 1024
+#define OWNER_NO_PID (-1) // a socket whose owner is out of sight, not looked for again
+
+typedef struct _OWNED_SOCKET
+{
+    unsigned char address[16]; // all 0 when bound to any address
+    unsigned short port;       // 0, with protocol 0, marks a local address
+    unsigned char protocol;
+    unsigned char version;
+    int pid;
+    unsigned long long inode;  // Linux only
+} OWNED_SOCKET, *POWNED_SOCKET;
+
+typedef struct _OWNER_PROCESS
+{
+    MARK_PROCESS process;
+    unsigned long long seen; // MarkClockMicroseconds of the last snapshot it owned a socket in
+} OWNER_PROCESS, *POWNER_PROCESS;
+
+// Lookups read the current snapshot under s_lock while the refresh thread
+// fills the other one on its own, then swaps the two.
+typedef struct _OWNER_SNAPSHOT
+{
+    unsigned long long time;
+    POWNED_SOCKET sockets;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int* bySocket; // index + 1, 0 for a free slot
+    unsigned int socketMask;
+    unsigned int* byInode;  // Linux only
+    unsigned int inodeMask;
+    POWNER_PROCESS processes;
+    unsigned int processCount;
+    unsigned int processCapacity;
+    unsigned int* byPid;
+    unsigned int pidMask;
+    // Work done to fill it, added to s_stats when it is published.
+    unsigned int scans;
+    unsigned int read;
+} OWNER_SNAPSHOT, *POWNER_SNAPSHOT;
+
+static OWNER_SNAPSHOT s_snapshots[2];
+static POWNER_SNAPSHOT s_current = NULL;
+static POWNER_SNAPSHOT s_next = NULL;
+static int s_interval = SOCKET_OWNERS_DEFAULT_INTERVAL;
+static int s_active = 0;
+
+static MARK_LOCK s_lock;
+static MARK_COND s_wake;
+static MARK_THREAD s_thread;
+static volatile int s_stopping = 0;
+static int s_wanted = 0; // a lookup missed since the last snapshot
+static SOCKET_OWNER_STATS s_stats;
+
+static const unsigned char s_any[16] = { 0 };
+static const unsigned char s_loopback4[16] = { 127, 0, 0, 1 };
+static const unsigned char s_loopback6[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1 };
+static const unsigned char s_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+static unsigned int Mix(unsigned int hash, unsigned int value)
+{
+    hash = (hash ^ value) * 0x9E3779B1;
+    return hash ^ (hash >> 15);
+}
+
+static unsigned int HashSocket(unsigned char protocol, unsigned char version, const unsigned char* address,
+    unsigned short port)
+{
+    unsigned int hash = (unsigned int)protocol << 24 | (unsigned int)version << 16 | port;
+    unsigned int word;
+    int i;
+
+    for (i = 0; i < 16; i += 4)
+    {
+        memcpy(&word, address + i, 4);
+        hash = Mix(hash, word);
+    }
+
+    return Mix(hash, 0);
+}
+
+static int Grow(void** items, unsigned int* capacity, unsigned int count, size_t size)
+{
+    unsigned int larger;
+    void* grown;
+
+    if (count < *capacity)
+    {
+        return 1;
+    }
+
+    larger = *capacity ? *capacity * 2 : 256;
+    grown = realloc(*items, larger * size);
+    if (!grown)
+    {
+        return 0;
+    }
+    *items = grown;
+    *capacity = larger;
+
+    return 1;
+}
+
+// A power of two, at least twice count.
+static unsigned int SlotsFor(unsigned int count)
+{
+    unsigned int slots = OWNER_MIN_SLOTS;
+
+    while (slots < count * 2)
+    {
+        slots <<= 1;
+    }
+
+    return slots;
+}
+
+static POWNED_SOCKET FindSocket(POWNER_SNAPSHOT snapshot, unsigned char protocol, unsigned char version,
+    const unsigned char* address, unsigned short port)
+{
+    unsigned int slot;
+
+    if (!snapshot->bySocket)
+    {
+        return NULL;
+    }
+
+    slot = HashSocket(protocol, version, address, port) & snapshot->socketMask;
+    while (snapshot->bySocket[slot])
+    {
+        POWNED_SOCKET socket = &snapshot->sockets[snapshot->bySocket[slot] - 1];
+
+        if (socket->port == port && socket->protocol == protocol && socket->version == version &&
+            !memcmp(socket->address, address, sizeof(socket->address)))
+        {
+            return socket;
+        }
+        slot = (slot + 1) & snapshot->socketMask;
+    }
+
+    return NULL;
+}
+
+static POWNER_PROCESS FindProcess(POWNER_SNAPSHOT snapshot, int pid)
+{
+    unsigned int slot;
+
+    if (!snapshot->byPid)
+    {
+        return NULL;
+    }
+
+    slot = Mix(0, (unsigned int)pid) & snapshot->pidMask;
+    while (snapshot->byPid[slot])
+    {
+        POWNER_PROCESS process = &snapshot->processes[snapshot->byPid[slot] - 1];
+
+        if (process->process.pid == pid)
+        {
+            return process;
+        }
+        slot = (slot + 1) & snapshot->pidMask;
+    }
+
+    return NULL;
+}
+
+static int AddSocket(POWNER_SNAPSHOT snapshot, unsigned char protocol, unsigned char version,
+    const unsigned char* address, unsigned short port, int pid, unsigned long long inode)
+{
+    POWNED_SOCKET socket;
+
+    if (!Grow((void**)&snapshot->sockets, &snapshot->capacity, snapshot->count, sizeof(OWNED_SOCKET)))
+    {
+        return 0;
+    }
+
+    socket = &snapshot->sockets[snapshot->count++];
+    memset(socket, 0, sizeof(*socket));
+    memcpy(socket->address, address, version == 4 ? 4 : 16);
+    socket->port = port;
+    socket->protocol = protocol;
+    socket->version = version;
+    socket->pid = pid;
+    socket->inode = inode;
+
+    return 1;
+}
+
+// IPv4 on a dual stack socket shows up as ::ffff:a.b.c.d, and one bound to
+// :: takes IPv4 too.
+static int AddSocket6(POWNER_SNAPSHOT snapshot, unsigned char protocol, const unsigned char* address,
+    unsigned short port, int pid, unsigned long long inode)
+{
+    if (!memcmp(address, s_mapped, sizeof(s_mapped)))
+    {
+        return AddSocket(snapshot, protocol, 4, address + 12, port, pid, inode);
+    }
+    if (!memcmp(address, s_any, sizeof(s_any)) && !AddSocket(snapshot, protocol, 4, s_any, port, pid, inode))
+    {
+        return 0;
+    }
+
+    return AddSocket(snapshot, protocol, 6, address, port, pid, inode);
+}
+
+// Also marks every address a socket is bound to as local, for the lookups
+// that fall back on sockets bound to any address.
+static int IndexSockets(POWNER_SNAPSHOT snapshot)
+{
+    unsigned int count = snapshot->count;
+    unsigned int slots = SlotsFor(count * 2);
+    unsigned int i;
+
+    if (snapshot->socketMask + 1 != slots || !snapshot->bySocket)
+    {
+        free(snapshot->bySocket);
+        snapshot->bySocket = (unsigned int*)malloc(slots * sizeof(unsigned int));
+        if (!snapshot->bySocket)
+        {
+            return 0;
+        }
+        snapshot->socketMask = slots - 1;
+    }
+    memset(snapshot->bySocket, 0, slots * sizeof(unsigned int));
+
+    for (i = 0; i < count; i++)
+    {
+        POWNED_SOCKET socket = &snapshot->sockets[i];
+        unsigned int slot;
+
+        if (!socket->pid)
+        {
+            continue;
+        }
+        if (memcmp(socket->address, s_any, sizeof(s_any)) &&
+            !FindSocket(snapshot, 0, socket->version, socket->address, 0))
+        {
+            if (!AddSocket(snapshot, 0, socket->version, socket->address, 0, OWNER_NO_PID, 0))
+            {
+                return 0;
+            }
+            socket = &snapshot->sockets[i];
+            slot = HashSocket(0, socket->version, socket->address, 0) & snapshot->socketMask;
+            while (snapshot->bySocket[slot])
+            {
+                slot = (slot + 1) & snapshot->socketMask;
+            }
+            snapshot->bySocket[slot] = snapshot->count;
+        }
+
+        // The first socket on an address and port stands for the rest.
+        if (FindSocket(snapshot, socket->protocol, socket->version, socket->address, socket->port))
+        {
+            continue;
+        }
+        slot = HashSocket(socket->protocol, socket->version, socket->address, socket->port) & snapshot->socketMask;
+        while (snapshot->bySocket[slot])
+        {
+            slot = (slot + 1) & snapshot->socketMask;
+        }
+        snapshot->bySocket[slot] = i + 1;
+    }
+
+    return 1;
+}
+
+static int AddProcess(POWNER_SNAPSHOT snapshot, int pid, POWNER_PROCESS from, unsigned long long seen)
+{
+    POWNER_PROCESS process;
+    unsigned int slot;
+
+    if (!Grow((void**)&snapshot->processes, &snapshot->processCapacity, snapshot->processCount,
+        sizeof(OWNER_PROCESS)))
+    {
+        return 0;
+    }
+
+    process = &snapshot->processes[snapshot->processCount++];
+    if (from)
+    {
+        *process = *from;
+    }
+    else
+    {
+        memset(process, 0, sizeof(*process));
+        process->process.pid = pid;
+    }
+    process->seen = seen;
+
+    slot = Mix(0, (unsigned int)pid) & snapshot->pidMask;
+    while (snapshot->byPid[slot])
+    {
+        slot = (slot + 1) & snapshot->pidMask;
+    }
+    snapshot->byPid[slot] = snapshot->processCount;
+
+    return 1;
+}
+
+#ifdef _WIN32
+
+static void CopyWide(unsigned short* dst, int capacity, const WCHAR* text)
+{
+    int i;
+
+    for (i = 0; i < capacity - 1 && text[i]; i++)
+    {
+        dst[i] = text[i];
+    }
+    dst[i] = 0;
+}
+
+// The tables come back in network order, ports in the low 16 bits.
+static unsigned short TablePort(DWORD port)
+{
+    return ntohs((unsigned short)port);
+}
+
+static void* ReadTable(int tcp, ULONG family)
+{
+    DWORD size = 0;
+    void* table = NULL;
+    DWORD result;
+    int tries;
+
+    // The table can grow between asking for its size and reading it.
+    for (tries = 0; tries < 4; tries++)
+    {
+        result = tcp ? GetExtendedTcpTable(table, &size, FALSE, family, TCP_TABLE_OWNER_PID_ALL, 0)
+                     : GetExtendedUdpTable(table, &size, FALSE, family, UDP_TABLE_OWNER_PID, 0);
+        if (result == NO_ERROR)
+        {
+            return table;
+        }
+        if (result != ERROR_INSUFFICIENT_BUFFER)
+        {
+            break;
+        }
+        free(table);
+        table = malloc(size);
+        if (!table)
+        {
+            return NULL;
+        }
+    }
+
+    free(table);
+    return NULL;
+}
+
+static int ReadSockets(POWNER_SNAPSHOT snapshot)
+{
+    PMIB_TCPTABLE_OWNER_PID tcp4 = (PMIB_TCPTABLE_OWNER_PID)ReadTable(1, AF_INET);
+    PMIB_TCP6TABLE_OWNER_PID tcp6 = (PMIB_TCP6TABLE_OWNER_PID)ReadTable(1, AF_INET6);
+    PMIB_UDPTABLE_OWNER_PID udp4 = (PMIB_UDPTABLE_OWNER_PID)ReadTable(0, AF_INET);
+    PMIB_UDP6TABLE_OWNER_PID udp6 = (PMIB_UDP6TABLE_OWNER_PID)ReadTable(0, AF_INET6);
+    int result = 1;
+    DWORD i;
+
+    for (i = 0; tcp4 && result && i < tcp4->dwNumEntries; i++)
+    {
+        // A TIME_WAIT connection belongs to nobody any more.
+        if (tcp4->table[i].dwOwningPid)
+        {
+            result = AddSocket(snapshot, IP_PROTO_TCP, 4, (const unsigned char*)&tcp4->table[i].dwLocalAddr,
+                TablePort(tcp4->table[i].dwLocalPort), (int)tcp4->table[i].dwOwningPid, 0);
+        }
+    }
+    for (i = 0; tcp6 && result && i < tcp6->dwNumEntries; i++)
+    {
+        if (tcp6->table[i].dwOwningPid)
+        {
+            result = AddSocket6(snapshot, IP_PROTO_TCP, tcp6->table[i].ucLocalAddr,
+                TablePort(tcp6->table[i].dwLocalPort), (int)tcp6->table[i].dwOwningPid, 0);
+        }
+    }
+    for (i = 0; udp4 && result && i < udp4->dwNumEntries; i++)
+    {
+        result = AddSocket(snapshot, IP_PROTO_UDP, 4, (const unsigned char*)&udp4->table[i].dwLocalAddr,
+            TablePort(udp4->table[i].dwLocalPort), (int)udp4->table[i].dwOwningPid, 0);
+    }
+    for (i = 0; udp6 && result && i < udp6->dwNumEntries; i++)
+    {
+        result = AddSocket6(snapshot, IP_PROTO_UDP, udp6->table[i].ucLocalAddr,
+            TablePort(udp6->table[i].dwLocalPort), (int)udp6->table[i].dwOwningPid, 0);
+    }
+
+    free(tcp4);
+    free(tcp6);
+    free(udp4);
+    free(udp6);
+
+    return result && (tcp4 || tcp6 || udp4 || udp6);
+}
+
+static void ReadImageAndUser(PMARK_PROCESS process)
+{
+    HANDLE handle = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)process->pid);
+    HANDLE token;
+    WCHAR image[MAX_PATH];
+    DWORD size = MAX_PATH;
+
+    if (!handle)
+    {
+        return;
+    }
+
+    if (QueryFullProcessImageNameW(handle, 0, image, &size))
+    {
+        CopyWide(process->szImagePath, sizeof(process->szImagePath) / sizeof(process->szImagePath[0]), image);
+    }
+
+    if (OpenProcessToken(handle, TOKEN_QUERY, &token))
+    {
+        unsigned char buffer[256];
+        PTOKEN_USER user = (PTOKEN_USER)buffer;
+        WCHAR name[64];
+        WCHAR domain[64];
+        DWORD nameSize = sizeof(name) / sizeof(name[0]);
+        DWORD domainSize = sizeof(domain) / sizeof(domain[0]);
+        SID_NAME_USE use;
+
+        if (GetTokenInformation(token, TokenUser, buffer, sizeof(buffer), &size) &&
+            LookupAccountSidW(NULL, user->User.Sid, name, &nameSize, domain, &domainSize, &use))
+        {
+            CopyWide(process->szUserName, sizeof(process->szUserName) / sizeof(process->szUserName[0]), name);
+        }
+        CloseHandle(token);
+    }
+
+    CloseHandle(handle);
+}
+
+// One process list for all the new owners: it has their names and parents.
+static void ReadProcesses(POWNER_SNAPSHOT snapshot, unsigned int first)
+{
+    HANDLE list;
+    PROCESSENTRY32W entry;
+    unsigned int i;
+
+    if (first == snapshot->processCount)
+    {
+        return;
+    }
+
+    list = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0);
+    entry.dwSize = sizeof(entry);
+    if (list != INVALID_HANDLE_VALUE && Process32FirstW(list, &entry))
+    {
+        do
+        {
+            POWNER_PROCESS process = FindProcess(snapshot, (int)entry.th32ProcessID);
+
+            if (process && process >= &snapshot->processes[first])
+            {
+                process->process.ppid = (int)entry.th32ParentProcessID;
+                CopyWide(process->process.szProcessName,
+                    sizeof(process->process.szProcessName) / sizeof(process->process.szProcessName[0]),
+                    entry.szExeFile);
+            }
+        } while (Process32NextW(list, &entry));
+    }
+    if (list != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(list);
+    }
+
+    for (i = first; i < snapshot->processCount; i++)
+    {
+        ReadImageAndUser(&snapshot->processes[i].process);
+        snapshot->read++;
+    }
+}
+
+// The tables name the owners already.
+static void FindOwners(POWNER_SNAPSHOT snapshot, POWNER_SNAPSHOT previous)
+{
+    UNREFERENCED_PARAMETER(snapshot);
+    UNREFERENCED_PARAMETER(previous);
+}
+
+#else
+
+#define PROC_NET_LINE 512
+
+static unsigned int ParseHexWord(const char* text)
+{
+    unsigned int value = 0;
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        char c = text[i];
+
+        value = value << 4 | (unsigned int)(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+    }
+
+    return value;
+}
+
+// Lines of /proc/net/tcp and friends:
+//   sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode
+// The addresses are the kernel's 32 bit words printed in hex, so reading
+// them back into words gives the bytes as on the wire.
+static int ReadSocketFile(POWNER_SNAPSHOT snapshot, const char* path, unsigned char protocol, int version)
+{
+    char line[PROC_NET_LINE];
+    char address[33];
+    unsigned int port;
+    unsigned long long inode;
+    FILE* file = fopen(path, "r");
+    int words = version == 4 ? 1 : 4;
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    // The header line.
+    if (!fgets(line, sizeof(line), file))
+    {
+        fclose(file);
+        return 0;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned char bytes[16] = { 0 };
+        int i;
+
+        if (sscanf(line, " %*u: %32[0-9A-Fa-f]:%x %*s %*s %*s %*s %*s %*s %*s %llu", address, &port, &inode) != 3 ||
+            (int)strlen(address) != words * 8 || !inode)
+        {
+            continue;
+        }
+
+        for (i = 0; i < words; i++)
+        {
+            unsigned int word = ParseHexWord(address + i * 8);
+
+            memcpy(bytes + i * 4, &word, 4);
+        }
+
+        if (!(version == 4 ? AddSocket(snapshot, protocol, 4, bytes, (unsigned short)port, 0, inode)
+                           : AddSocket6(snapshot, protocol, bytes, (unsigned short)port, 0, inode)))
+        {
+            fclose(file);
+            return 0;
+        }
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static int ReadSockets(POWNER_SNAPSHOT snapshot)
+{
+    int found = 0;
+
+    found += ReadSocketFile(snapshot, "/proc/net/tcp", IP_PROTO_TCP, 4);
+    found += ReadSocketFile(snapshot, "/proc/net/tcp6", IP_PROTO_TCP, 6);
+    found += ReadSocketFile(snapshot, "/proc/net/udp", IP_PROTO_UDP, 4);
+    found += ReadSocketFile(snapshot, "/proc/net/udp6", IP_PROTO_UDP, 6);
+
+    return found > 0;
+}
+
+static unsigned int FindInode(POWNER_SNAPSHOT snapshot, unsigned long long inode)
+{
+    unsigned int slot = Mix((unsigned int)(inode >> 32), (unsigned int)inode) & snapshot->inodeMask;
+
+    while (snapshot->byInode[slot])
+    {
+        if (snapshot->sockets[snapshot->byInode[slot] - 1].inode == inode)
+        {
+            return snapshot->byInode[slot];
+        }
+        slot = (slot + 1) & snapshot->inodeMask;
+    }
+
+    return 0;
+}
+
+static int IndexInodes(POWNER_SNAPSHOT snapshot)
+{
+    unsigned int slots = SlotsFor(snapshot->count);
+    unsigned int i;
+
+    if (snapshot->inodeMask + 1 != slots || !snapshot->byInode)
+    {
+        free(snapshot->byInode);
+        snapshot->byInode = (unsigned int*)malloc(slots * sizeof(unsigned int));
+        if (!snapshot->byInode)
+        {
+            return 0;
+        }
+        snapshot->inodeMask = slots - 1;
+    }
+    memset(snapshot->byInode, 0, slots * sizeof(unsigned int));
+
+    for (i = 0; i < snapshot->count; i++)
+    {
+        unsigned long long inode = snapshot->sockets[i].inode;
+        unsigned int slot = Mix((unsigned int)(inode >> 32), (unsigned int)inode) & snapshot->inodeMask;
+
+        // A dual stack socket is in twice; the first stands for both.
+        if (FindInode(snapshot, inode))
+        {
+            continue;
+        }
+        while (snapshot->byInode[slot])
+        {
+            slot = (slot + 1) & snapshot->inodeMask;
+        }
+        snapshot->byInode[slot] = i + 1;
+    }
+
+    return 1;
+}
+
+typedef struct _FD_SCAN
+{
+    POWNER_SNAPSHOT snapshot;
+    POWNER_SNAPSHOT previous;
+    int pid;
+    unsigned int unknown;
+    int* pids; // of the processes left to scan
+    unsigned int pidCount;
+    unsigned int pidCapacity;
+} FD_SCAN, *PFD_SCAN;
+
+static void SetOwner(POWNER_SNAPSHOT snapshot, unsigned int index, int pid)
+{
+    unsigned long long inode = snapshot->sockets[index - 1].inode;
+    unsigned int i;
+
+    // Both entries of a dual stack socket.
+    for (i = index - 1; i < snapshot->count && snapshot->sockets[i].inode == inode; i++)
+    {
+        snapshot->sockets[i].pid = pid;
+    }
+}
+
+static void ScanDescriptor(const char* name, void* context)
+{
+    PFD_SCAN scan = (PFD_SCAN)context;
+    char path[64];
+    char link[64];
+    unsigned long long inode;
+    unsigned int index;
+    ssize_t length;
+
+    if (!scan->unknown || name[0] == '.')
+    {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/fd/%s", scan->pid, name);
+    length = readlink(path, link, sizeof(link) - 1);
+    if (length <= 0)
+    {
+        return;
+    }
+    link[length] = 0;
+
+    if (sscanf(link, "socket:[%llu]", &inode) == 1 && (index = FindInode(scan->snapshot, inode)) &&
+        !scan->snapshot->sockets[index - 1].pid)
+    {
+        SetOwner(scan->snapshot, index, scan->pid);
+        scan->unknown--;
+    }
+}
+
+static void ScanProcess(PFD_SCAN scan, int pid)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+    scan->pid = pid;
+    MarkEnumerateFiles(path, "", ScanDescriptor, scan);
+    scan->snapshot->scans++;
+}
+
+static void ListProcess(const char* name, void* context)
+{
+    PFD_SCAN scan = (PFD_SCAN)context;
+    POWNER_PROCESS owner;
+    int pid = atoi(name);
+
+    // The last owners were read first.
+    owner = pid > 0 ? FindProcess(scan->previous, pid) : NULL;
+    if (pid > 0 && !(owner && owner->seen == scan->previous->time) &&
+        Grow((void**)&scan->pids, &scan->pidCapacity, scan->pidCount, sizeof(int)))
+    {
+        scan->pids[scan->pidCount++] = pid;
+    }
+}
+
+static int ComparePidsDescending(const void* left, const void* right)
+{
+    return *(const int*)right - *(const int*)left;
+}
+
+// Sockets the last snapshot had keep their owners. New ones are looked for
+// in the fds of the last owners, then of every process, newest first, until
+// all are found; what is still missing then belongs to a process out of
+// sight.
+static void FindOwners(POWNER_SNAPSHOT snapshot, POWNER_SNAPSHOT previous)
+{
+    FD_SCAN scan;
+    unsigned int i;
+
+    memset(&scan, 0, sizeof(scan));
+    scan.snapshot = snapshot;
+    scan.previous = previous;
+
+    for (i = 0; i < snapshot->count; i++)
+    {
+        POWNED_SOCKET socket = &snapshot->sockets[i];
+        unsigned int index = previous->byInode ? FindInode(previous, socket->inode) : 0;
+
+        if (socket->pid)
+        {
+            continue;
+        }
+        if (index)
+        {
+            SetOwner(snapshot, i + 1, previous->sockets[index - 1].pid);
+        }
+        else if (FindInode(snapshot, socket->inode) == i + 1)
+        {
+            scan.unknown++;
+        }
+    }
+
+    for (i = 0; scan.unknown && i < previous->processCount; i++)
+    {
+        if (previous->processes[i].seen == previous->time)
+        {
+            ScanProcess(&scan, previous->processes[i].process.pid);
+        }
+    }
+    if (scan.unknown)
+    {
+        MarkEnumerateFiles("/proc", "", ListProcess, &scan);
+        qsort(scan.pids, scan.pidCount, sizeof(int), ComparePidsDescending);
+        for (i = 0; scan.unknown && i < scan.pidCount; i++)
+        {
+            ScanProcess(&scan, scan.pids[i]);
+        }
+        free(scan.pids);
+    }
+
+    for (i = 0; i < snapshot->count; i++)
+    {
+        if (!snapshot->sockets[i].pid)
+        {
+            snapshot->sockets[i].pid = OWNER_NO_PID;
+        }
+    }
+}
+
+static int ReadFirstLine(const char* path, char* text, int size)
+{
+    FILE* file = fopen(path, "r");
+    int read;
+
+    text[0] = 0;
+    if (!file)
+    {
+        return 0;
+    }
+    read = fgets(text, size, file) != NULL;
+    fclose(file);
+    text[strcspn(text, "\n")] = 0;
+
+    return read;
+}
+
+static void ReadProcess(PMARK_PROCESS process)
+{
+    char path[64];
+    char text[MARK_MAX_PATH];
+    char line[256];
+    FILE* file;
+    ssize_t length;
+    int uid = -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/comm", process->pid);
+    if (ReadFirstLine(path, text, sizeof(text)))
+    {
+        MARK_SET_TEXT(process->szProcessName, text);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/exe", process->pid);
+    length = readlink(path, text, sizeof(text) - 1);
+    if (length > 0)
+    {
+        text[length] = 0;
+        MARK_SET_TEXT(process->szImagePath, text);
+    }
+
+    snprintf(path, sizeof(path), "/proc/%d/status", process->pid);
+    file = fopen(path, "r");
+    while (file && fgets(line, sizeof(line), file))
+    {
+        if (!strncmp(line, "PPid:", 5))
+        {
+            process->ppid = atoi(line + 5);
+        }
+        else if (!strncmp(line, "Uid:", 4))
+        {
+            uid = atoi(line + 4);
+            break;
+        }
+    }
+    if (file)
+    {
+        fclose(file);
+    }
+
+    if (uid >= 0)
+    {
+        struct passwd entry;
+        struct passwd* found = NULL;
+        char buffer[1024];
+
+        if (!getpwuid_r((uid_t)uid, &entry, buffer, sizeof(buffer), &found) && found)
+        {
+            MARK_SET_TEXT(process->szUserName, found->pw_name);
+        }
+        else
+        {
+            snprintf(text, sizeof(text), "%d", uid);
+            MARK_SET_TEXT(process->szUserName, text);
+        }
+    }
+}
+
+static void ReadProcesses(POWNER_SNAPSHOT snapshot, unsigned int first)
+{
+    unsigned int i;
+
+    for (i = first; i < snapshot->processCount; i++)
+    {
+        ReadProcess(&snapshot->processes[i].process);
+        snapshot->read++;
+    }
+}
+
+#endif
+
+// Owners of this snapshot's sockets first, those of the last one as they
+// were, then the new ones read, then processes that owned a socket not long
+// ago, so late flow events still find them.
+static int CollectProcesses(POWNER_SNAPSHOT snapshot, POWNER_SNAPSHOT previous)
+{
+    unsigned long long linger = SOCKET_OWNERS_LINGER * 1000000ULL;
+    unsigned int slots = SlotsFor(snapshot->count + previous->processCount);
+    unsigned int first;
+    unsigned int i;
+
+    if (snapshot->pidMask + 1 != slots || !snapshot->byPid)
+    {
+        free(snapshot->byPid);
+        snapshot->byPid = (unsigned int*)malloc(slots * sizeof(unsigned int));
+        if (!snapshot->byPid)
+        {
+            return 0;
+        }
+        snapshot->pidMask = slots - 1;
+    }
+    memset(snapshot->byPid, 0, slots * sizeof(unsigned int));
+    snapshot->processCount = 0;
+
+    for (i = 0; i < snapshot->count; i++)
+    {
+        int pid = snapshot->sockets[i].pid;
+        POWNER_PROCESS from = pid > 0 ? FindProcess(previous, pid) : NULL;
+
+        if (from && !FindProcess(snapshot, pid) && !AddProcess(snapshot, pid, from, snapshot->time))
+        {
+            return 0;
+        }
+    }
+
+    first = snapshot->processCount;
+    for (i = 0; i < snapshot->count; i++)
+    {
+        int pid = snapshot->sockets[i].pid;
+
+        if (pid > 0 && !FindProcess(snapshot, pid) && !AddProcess(snapshot, pid, NULL, snapshot->time))
+        {
+            return 0;
+        }
+    }
+    ReadProcesses(snapshot, first);
+
+    for (i = 0; i < previous->processCount; i++)
+    {
+        POWNER_PROCESS process = &previous->processes[i];
+
+        if (snapshot->time - process->seen < linger && !FindProcess(snapshot, process->process.pid) &&
+            !AddProcess(snapshot, process->process.pid, process, process->seen))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+static int Refresh()
+{
+    POWNER_SNAPSHOT snapshot = s_next;
+    POWNER_SNAPSHOT previous = s_current;
+    unsigned long long start = MarkClockMicroseconds();
+
+    snapshot->time = start;
+    snapshot->count = 0;
+    snapshot->scans = 0;
+    snapshot->read = 0;
+    if (!ReadSockets(snapshot))
+    {
+        return 0;
+    }
+#ifndef _WIN32
+    if (!IndexInodes(snapshot))
+    {
+        return 0;
+    }
+#endif
+    FindOwners(snapshot, previous);
+    if (!CollectProcesses(snapshot, previous) || !IndexSockets(snapshot))
+    {
+        return 0;
+    }
+
+    MarkLockAcquire(&s_lock);
+    s_current = snapshot;
+    s_next = previous;
+    s_stats.snapshots++;
+    s_stats.scans += snapshot->scans;
+    s_stats.processes += snapshot->read;
+    s_stats.sockets = snapshot->count;
+    s_stats.owners = snapshot->processCount;
+    s_stats.microseconds += MarkClockMicroseconds() - start;
+    MarkLockRelease(&s_lock);
+
+    return 1;
+}
+
+static MARK_THREAD_PROC(RefreshThread, parameter)
+{
+    unsigned long long last = MarkClockMicroseconds();
+
+    UNREFERENCED_PARAMETER(parameter);
+
+    MarkLockAcquire(&s_lock);
+    while (!s_stopping)
+    {
+        unsigned long long now = MarkClockMicroseconds();
+        unsigned long long due = last + (unsigned long long)(s_wanted ? SOCKET_OWNERS_MIN_INTERVAL : s_interval) * 1000;
+
+        if (now < due)
+        {
+            MarkCondWait(&s_wake, &s_lock, (int)((due - now + 999) / 1000));
+            continue;
+        }
+
+        s_wanted = 0;
+        MarkLockRelease(&s_lock);
+        last = now;
+        if (!Refresh())
+        {
+            printf("Could not read the socket tables\n");
+        }
+        MarkLockAcquire(&s_lock);
+    }
+    MarkLockRelease(&s_lock);
+
+    return 0;
+}
+
+int StartSocketOwners(int interval)
+{
+    s_interval = interval > 0 ? interval : SOCKET_OWNERS_DEFAULT_INTERVAL;
+    memset(s_snapshots, 0, sizeof(s_snapshots));
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_current = &s_snapshots[0];
+    s_next = &s_snapshots[1];
+    s_stopping = 0;
+    s_wanted = 0;
+
+    MarkLockInit(&s_lock);
+    MarkCondInit(&s_wake);
+    if (!Refresh())
+    {
+        printf("Could not read the socket tables, flows are not attributed to processes\n");
+        MarkCondDelete(&s_wake);
+        MarkLockDelete(&s_lock);
+        return 0;
+    }
+    if (!MarkThreadStart(&s_thread, RefreshThread, NULL))
+    {
+        MarkCondDelete(&s_wake);
+        MarkLockDelete(&s_lock);
+        return 0;
+    }
+    s_active = 1;
+
+    printf("Socket owners: %u sockets of %u processes, refreshed every %d ms\n", s_stats.sockets, s_stats.owners,
+        s_interval);
+
+    return 1;
+}
+
+void StopSocketOwners()
+{
+    int i;
+
+    if (!s_active)
+    {
+        return;
+    }
+
+    MarkLockAcquire(&s_lock);
+    s_stopping = 1;
+    MarkCondWakeAll(&s_wake);
+    MarkLockRelease(&s_lock);
+    MarkThreadJoin(s_thread);
+
+    s_active = 0;
+    MarkCondDelete(&s_wake);
+    MarkLockDelete(&s_lock);
+    for (i = 0; i < 2; i++)
+    {
+        free(s_snapshots[i].sockets);
+        free(s_snapshots[i].bySocket);
+        free(s_snapshots[i].byInode);
+        free(s_snapshots[i].processes);
+        free(s_snapshots[i].byPid);
+    }
+    memset(s_snapshots, 0, sizeof(s_snapshots));
+}
+
+int IsSocketOwnersActive()
+{
+    return s_active;
+}
+
+static int IsLocal(POWNER_SNAPSHOT snapshot, unsigned char version, const unsigned char* address)
+{
+    return !memcmp(address, version == 4 ? s_loopback4 : s_loopback6, 16) ||
+        FindSocket(snapshot, 0, version, address, 0) != NULL;
+}
+
+// Connected sockets first, either end, then sockets bound to any address
+// on an end that is this host's.
+int FindSocketOwner(PFLOW_KEY key)
+{
+    POWNED_SOCKET socket;
+    int local = 0;
+    int pid = 0;
+
+    if (!s_active || (key->protocol != IP_PROTO_TCP && key->protocol != IP_PROTO_UDP))
+    {
+        return 0;
+    }
+
+    MarkLockAcquire(&s_lock);
+    s_stats.lookups++;
+    socket = FindSocket(s_current, key->protocol, key->version, key->source, key->sourcePort);
+    if (!socket)
+    {
+        socket = FindSocket(s_current, key->protocol, key->version, key->destination, key->destinationPort);
+    }
+    if (!socket)
+    {
+        local = IsLocal(s_current, key->version, key->source) |
+            IsLocal(s_current, key->version, key->destination) << 1;
+        if (local & 1)
+        {
+            socket = FindSocket(s_current, key->protocol, key->version, s_any, key->sourcePort);
+        }
+        if (!socket && (local & 2))
+        {
+            socket = FindSocket(s_current, key->protocol, key->version, s_any, key->destinationPort);
+        }
+    }
+
+    if (socket)
+    {
+        s_stats.hits++;
+        pid = MAX(socket->pid, 0);
+    }
+    else if (local)
+    {
+        s_stats.misses++;
+        if (!s_wanted)
+        {
+            s_wanted = 1;
+            MarkCondWake(&s_wake);
+        }
+    }
+    MarkLockRelease(&s_lock);
+
+    return pid;
+}
+
+int GetOwnerProcess(int pid, PMARK_PROCESS process)
+{
+    POWNER_PROCESS found;
+
+    if (!s_active)
+    {
+        return 0;
+    }
+
+    MarkLockAcquire(&s_lock);
+    found = FindProcess(s_current, pid);
+    if (found)
+    {
+        *process = found->process;
+    }
+    MarkLockRelease(&s_lock);
+
+    return found != NULL;
+}
+
+void GetSocketOwnerStats(PSOCKET_OWNER_STATS stats)
+{
+    if (s_active)
+    {
+        MarkLockAcquire(&s_lock);
+    }
+    *stats = s_stats;
+    if (s_active)
+    {
+        MarkLockRelease(&s_lock);
+    }
+}
+
+void PrintSocketOwnerStats()
+{
+    SOCKET_OWNER_STATS stats;
+
+    GetSocketOwnerStats(&stats);
+    if (!stats.snapshots)
+    {
+        return;
+    }
+
+    printf("Socket owners: %llu lookups, %llu found, %llu missed; %llu snapshots, %.0f us each, %u sockets of %u processes, %llu fd scans, %llu processes read\n",
+        stats.lookups, stats.hits, stats.misses, stats.snapshots, (double)stats.microseconds / stats.snapshots,
+        stats.sockets, stats.owners, stats.scans, stats.processes);
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifndef _SOCKETOWNERS_H_
+#define _SOCKETOWNERS_H_
+
+#include "packetdecode.h"
+
+// Tells which process owns the local end of a flow. A refresh thread takes
+// a snapshot of the host's sockets, keyed by protocol, local address and
+// local port, each with its owning pid:
+//   Linux    /proc/net/tcp, tcp6, udp and udp6 give the socket inodes, and
+//            the socket:[inode] links in /proc/<pid>/fd give their owners
+//   Windows  GetExtendedTcpTable and GetExtendedUdpTable give both at once
+// The snapshots are incremental: a socket already seen keeps its owner, so
+// only new inodes send the refresh into /proc/<pid>/fd, the pids that owned
+// sockets last time first, and only new pids have their name, image and
+// user read. A lookup is a probe in the current snapshot under a lock, cheap
+// enough for every flow start. A miss on a flow with a local end wakes the
+// refresh thread early, so a socket opened since the last snapshot shows up
+// within SOCKET_OWNERS_MIN_INTERVAL; the flow's later events carry it.
+// On loopback both ends are this host's: a connected socket wins over a
+// listening one, the initiator's over the responder's.
+//
+// Only live captures ask: the sockets of a capture file are not this host's.
+
+#define SOCKET_OWNERS_DEFAULT_INTERVAL 1000 // ms between snapshots
+#define SOCKET_OWNERS_MIN_INTERVAL 100      // ms, at the least, between snapshots a miss asks for
+#define SOCKET_OWNERS_LINGER 300            // seconds a process is remembered after its last socket
+
+typedef struct _SOCKET_OWNER_STATS
+{
+    unsigned long long snapshots;
+    unsigned long long lookups;
+    unsigned long long hits;
+    unsigned long long misses;    // with a local end, so a refresh was asked for
+    unsigned long long scans;     // /proc/<pid>/fd directories read
+    unsigned long long processes; // process details read
+    unsigned long long microseconds; // spent in snapshots
+    unsigned int sockets;         // in the last snapshot
+    unsigned int owners;          // processes remembered
+} SOCKET_OWNER_STATS, *PSOCKET_OWNER_STATS;
+
+// Takes the first snapshot before returning. interval is in ms, 0 for the
+// default.
+int StartSocketOwners(int interval);
+void StopSocketOwners();
+int IsSocketOwnersActive();
+
+// The pid that owns either end of the flow, 0 if none is known.
+int FindSocketOwner(PFLOW_KEY key);
+// Returns 0 if the process is not remembered.
+int GetOwnerProcess(int pid, PMARK_PROCESS process);
+
+void GetSocketOwnerStats(PSOCKET_OWNER_STATS stats);
+void PrintSocketOwnerStats();
+
+#endif
\ No newline at end of file
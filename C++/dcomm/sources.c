@@ -0,0 +1,274 @@
+#include "sources.h"
+#include "platform.h"
+#include "stages.h"
+
+#include <stdio.h>
+
+typedef struct _SOURCE
+{
+    const char* name;
+    SOURCE_RUN run;
+    SOURCE_STOP stop;
+    void* context;
+    int flags;
+
+    MARK_THREAD thread;
+    int started;
+    volatile int running;
+    int result;
+
+    unsigned long long events;
+    unsigned long long dropped;
+    unsigned long long elapsed;
+} SOURCE, *PSOURCE;
+
+static SOURCE s_sources[MAX_SOURCES];
+static int s_count = 0;
+
+// The source the calling thread belongs to, so SubmitEvent can count per
+// source without taking a lock.
+static MARK_THREAD_LOCAL PSOURCE s_current = NULL;
+
+static PINGRESS_QUEUE s_ingress = NULL;
+static MARK_THREAD s_pipeline;
+static int s_pipelineStarted = 0;
+static volatile int s_draining = 0;
+static INGRESS_STATS s_ingressStats;
+
+static MARK_THREAD_PROC(PipelineThread, parameter)
+{
+    PMARK_EVENT events[INGRESS_MAX_BATCH];
+    int count, draining, i;
+
+    UNREFERENCED_PARAMETER(parameter);
+
+    while (1)
+    {
+        // Read before dequeueing: once draining is set no source is left,
+        // so an empty queue after that means everything has been processed.
+        draining = s_draining;
+
+        count = IngressDequeue(s_ingress, events, INGRESS_MAX_BATCH);
+        if (!count)
+        {
+            if (draining)
+            {
+                break;
+            }
+            IngressWait(s_ingress, INGRESS_WAIT_INTERVAL);
+            continue;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            ProcessMessage(events[i]);
+        }
+        IngressRelease(s_ingress, count);
+    }
+
+    return 0;
+}
+
+static MARK_THREAD_PROC(SourceThread, parameter)
+{
+    PSOURCE source = (PSOURCE)parameter;
+    unsigned long long start = MarkClockNanoseconds();
+
+    s_current = source;
+    source->result = source->run(source->context);
+    source->elapsed = MarkClockNanoseconds() - start;
+    source->running = 0;
+
+    if (!source->result)
+    {
+        printf("Source %s failed\n", source->name);
+    }
+
+    return 0;
+}
+
+int RegisterSource(const char* name, SOURCE_RUN run, SOURCE_STOP stop, void* context, int flags)
+{
+    PSOURCE source;
+
+    if (s_count == MAX_SOURCES)
+    {
+        printf("Too many sources, %s not registered\n", name);
+        return 0;
+    }
+
+    source = &s_sources[s_count++];
+    source->name = name;
+    source->run = run;
+    source->stop = stop;
+    source->context = context;
+    source->flags = flags;
+    source->started = 0;
+    source->running = 0;
+    source->result = 0;
+    source->events = 0;
+    source->dropped = 0;
+    source->elapsed = 0;
+
+    return 1;
+}
+
+int GetSourceCount()
+{
+    return s_count;
+}
+
+int StartSources(unsigned long capacity)
+{
+    int i;
+
+    s_ingress = IngressCreate(capacity);
+    if (!s_ingress)
+    {
+        return 0;
+    }
+
+    s_draining = 0;
+    if (!MarkThreadStart(&s_pipeline, PipelineThread, NULL))
+    {
+        printf("Cannot start the pipeline\n");
+        return 0;
+    }
+    s_pipelineStarted = 1;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSOURCE source = &s_sources[i];
+
+        source->running = 1;
+        if (!MarkThreadStart(&source->thread, SourceThread, source))
+        {
+            printf("Cannot start source %s\n", source->name);
+            source->running = 0;
+            return 0;
+        }
+        source->started = 1;
+    }
+
+    return s_count > 0;
+}
+
+int RunningSources()
+{
+    int i, running = 0;
+
+    for (i = 0; i < s_count; i++)
+    {
+        running += s_sources[i].running;
+    }
+
+    return running;
+}
+
+void StopSources()
+{
+    int i;
+
+    // Ask everybody first so the sources wind down in parallel.
+    for (i = 0; i < s_count; i++)
+    {
+        if (s_sources[i].running && s_sources[i].stop)
+        {
+            s_sources[i].stop(s_sources[i].context);
+        }
+    }
+
+    for (i = 0; i < s_count; i++)
+    {
+        if (s_sources[i].started)
+        {
+            MarkThreadJoin(s_sources[i].thread);
+            s_sources[i].started = 0;
+        }
+    }
+
+    if (s_pipelineStarted)
+    {
+        s_draining = 1;
+        IngressClose(s_ingress);
+        MarkThreadJoin(s_pipeline);
+        s_pipelineStarted = 0;
+    }
+
+    if (s_ingress)
+    {
+        GetIngressStats(s_ingress, &s_ingressStats);
+        IngressDelete(s_ingress);
+        s_ingress = NULL;
+    }
+}
+
+int SubmitEvent(PMARK_EVENT event)
+{
+    PSOURCE source = s_current;
+
+    StampStage(event, MARK_STAGE_RECEIVE);
+
+    if (!IngressEnqueue(s_ingress, event, source && (source->flags & SOURCE_LOSSLESS)))
+    {
+        if (source)
+        {
+            source->dropped++;
+        }
+        return 0;
+    }
+
+    if (source)
+    {
+        source->events++;
+    }
+
+    return 1;
+}
+
+void GetSourceStats(int source, PSOURCE_STATS stats)
+{
+    PSOURCE s = &s_sources[source];
+
+    stats->name = s->name;
+    stats->events = s->events;
+    stats->dropped = s->dropped;
+    stats->elapsed = s->elapsed;
+    stats->running = s->running;
+    stats->result = s->result;
+}
+
+void GetPipelineStats(PINGRESS_STATS stats)
+{
+    if (s_ingress)
+    {
+        GetIngressStats(s_ingress, stats);
+    }
+    else
+    {
+        *stats = s_ingressStats;
+    }
+}
+
+void PrintSourceStats()
+{
+    INGRESS_STATS ingress;
+    int i;
+
+    for (i = 0; i < s_count; i++)
+    {
+        PSOURCE source = &s_sources[i];
+        double seconds = source->elapsed / 1000000000.0;
+
+        printf("Source %s: %llu events, %llu dropped in %.3f s, %.0f events/s%s\n",
+            source->name, source->events, source->dropped, seconds,
+            seconds > 0 ? source->events / seconds : 0.0,
+            source->running ? " (running)" : source->result ? "" : " (failed)");
+    }
+
+    GetPipelineStats(&ingress);
+    printf("Ingress: %llu events in %llu batches (%.1f per batch), %llu dropped, %llu waits, depth %llu, max %llu of %llu\n",
+        ingress.dequeued, ingress.batches,
+        ingress.batches ? (double)ingress.dequeued / ingress.batches : 0.0,
+        ingress.dropped, ingress.waits, ingress.depth, ingress.maxDepth, ingress.capacity);
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef _SOURCES_H_
+#define _SOURCES_H_
+
+#include "communicator.h"
+#include "ingress.h"
+
+// Everything that produces events - the driver port, packet capture, replay
+// and synthetic load - is registered as a source and runs on its own thread.
+// Sources hand their events to SubmitEvent, which queues them on the ingress
+// queue; a single pipeline thread takes them off in batches and runs
+// ProcessMessage, which fans them out to the sinks (sinks.h). Capture never
+// waits on processing except where a source asks for it.
+
+#define MAX_SOURCES 16
+#define SOURCE_POLL_INTERVAL 100 // ms
+
+// Wait for room in a full ingress queue instead of dropping the event. For
+// sources that can be slowed down without losing anything, like replay.
+#define SOURCE_LOSSLESS 0x1
+
+// Produces events until the source is exhausted or asked to stop. Returns 1
+// on success.
+typedef int (*SOURCE_RUN)(void* context);
+// Asks a running source to return soon. Called from another thread, so it
+// must not block.
+typedef void (*SOURCE_STOP)(void* context);
+
+typedef struct _SOURCE_STATS
+{
+    const char* name;
+    unsigned long long events;
+    unsigned long long dropped;
+    unsigned long long elapsed; // ns
+    int running;
+    int result;
+} SOURCE_STATS, *PSOURCE_STATS;
+
+int RegisterSource(const char* name, SOURCE_RUN run, SOURCE_STOP stop, void* context, int flags);
+int GetSourceCount();
+
+// Starts the pipeline thread with an ingress queue of the given capacity,
+// then a thread per registered source.
+int StartSources(unsigned long capacity);
+// Number of sources that are still producing.
+int RunningSources();
+// Stops every source that is still running, waits for all of them and then
+// for the pipeline to drain what they queued.
+void StopSources();
+
+// Entry point of the common pipeline for every source. Returns 0 if the
+// event was dropped.
+int SubmitEvent(PMARK_EVENT event);
+
+void GetSourceStats(int source, PSOURCE_STATS stats);
+void GetPipelineStats(PINGRESS_STATS stats);
+void PrintSourceStats();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,535 @@
+#include "spool.h"
+#include "logio.h"
+#include "lz.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _SPOOL_FILE
+{
+    unsigned long long id;
+    unsigned long long first; // sequence of its first event
+    unsigned long long end;   // after its last event
+    unsigned long long size;  // bytes of whole blocks, what readers may see
+} SPOOL_FILE, *PSPOOL_FILE;
+
+struct _SPOOL
+{
+    char directory[SPOOL_MAX_DIRECTORY];
+    unsigned long long limit;
+
+    // The file table is shared by the writer and the reader. The writer
+    // appends to the newest file outside the lock and publishes its size
+    // under it; only older files are ever deleted.
+    MARK_LOCK lock;
+    SPOOL_FILE files[SPOOL_MAX_FILES]; // a ring, oldest first
+    int head;
+    int count;
+    unsigned long long bytes;
+    unsigned long long acked;
+    unsigned long long next;
+    SPOOL_STATS stats;
+
+    // Writer
+    PLOG_FILE file;
+    unsigned long long nextId;
+    unsigned char* block;
+    unsigned long blockCapacity;
+
+    // Reader, under the lock
+    MARK_FILE readFile;
+    unsigned long long readId;
+    unsigned long long readOffset;   // of the block after the last one read
+    unsigned long long readSequence; // its first sequence
+    unsigned char* data;
+    unsigned long dataCapacity;
+};
+
+static void SpoolPath(char* path, const char* directory, unsigned long long id)
+{
+    snprintf(path, MARK_MAX_PATH, SPOOL_FILE_FORMAT, directory, id);
+}
+
+static PSPOOL_FILE FileAt(PSPOOL spool, int i)
+{
+    return &spool->files[(spool->head + i) % SPOOL_MAX_FILES];
+}
+
+static void SaveState(PSPOOL spool)
+{
+    char path[MARK_MAX_PATH];
+    FILE* out;
+
+    snprintf(path, sizeof(path), "%s" MARK_PATH_SEPARATOR SPOOL_STATE_FILE, spool->directory);
+    out = fopen(path, "w");
+    if (out)
+    {
+        fprintf(out, "%llu\n", spool->acked);
+        fclose(out);
+    }
+}
+
+static void LoadState(PSPOOL spool)
+{
+    char path[MARK_MAX_PATH];
+    FILE* in;
+
+    snprintf(path, sizeof(path), "%s" MARK_PATH_SEPARATOR SPOOL_STATE_FILE, spool->directory);
+    in = fopen(path, "r");
+    if (in)
+    {
+        if (fscanf(in, "%llu", &spool->acked) != 1)
+        {
+            spool->acked = 0;
+        }
+        fclose(in);
+    }
+}
+
+static void CloseReadFile(PSPOOL spool)
+{
+    if (MARK_INVALID_FILE != spool->readFile)
+    {
+        MarkFileClose(spool->readFile);
+        spool->readFile = MARK_INVALID_FILE;
+    }
+    spool->readId = 0;
+}
+
+// Under the lock. Unacknowledged events in the file are counted as lost.
+static void DeleteOldest(PSPOOL spool)
+{
+    PSPOOL_FILE oldest = FileAt(spool, 0);
+    char path[MARK_MAX_PATH];
+
+    if (oldest->end > MAX(oldest->first, spool->acked))
+    {
+        spool->stats.lost += oldest->end - MAX(oldest->first, spool->acked);
+    }
+
+    if (spool->readId == oldest->id)
+    {
+        CloseReadFile(spool);
+    }
+    SpoolPath(path, spool->directory, oldest->id);
+    MarkFileDelete(path);
+
+    spool->bytes -= oldest->size;
+    spool->head = (spool->head + 1) % SPOOL_MAX_FILES;
+    spool->count--;
+}
+
+// Reads the block headers of a file left by an earlier run; the file ends
+// at the first one that is torn or does not make sense.
+static int ScanFile(PSPOOL spool, unsigned long long id, PSPOOL_FILE file)
+{
+    char path[MARK_MAX_PATH];
+    SEGMENT_BLOCK_HEADER header;
+    unsigned long long size;
+    MARK_FILE in;
+
+    SpoolPath(path, spool->directory, id);
+    in = MarkFileOpenRead(path);
+    if (MARK_INVALID_FILE == in)
+    {
+        return 0;
+    }
+
+    memset(file, 0, sizeof(*file));
+    file->id = id;
+    size = MarkFileSize(in);
+
+    while (file->size + sizeof(header) <= size && MarkFileReadAt(in, file->size, &header, sizeof(header)))
+    {
+        if (header.magic != SEGMENT_BLOCK_MAGIC || !header.count || header.rawSize != header.count * sizeof(MARK_EVENT) ||
+            file->size + sizeof(header) + header.compressedSize > size)
+        {
+            break;
+        }
+
+        if (!file->size)
+        {
+            file->first = header.firstSequence;
+        }
+        file->end = header.firstSequence + header.count;
+        file->size += sizeof(header) + header.compressedSize;
+    }
+
+    MarkFileClose(in);
+    return file->size != 0;
+}
+
+static int CompareIds(const void* a, const void* b)
+{
+    unsigned long long x = *(const unsigned long long*)a;
+    unsigned long long y = *(const unsigned long long*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+typedef struct _SPOOL_IDS
+{
+    unsigned long long* ids;
+    int count;
+} SPOOL_IDS, *PSPOOL_IDS;
+
+static void FoundSpoolFile(const char* name, void* context)
+{
+    PSPOOL_IDS found = (PSPOOL_IDS)context;
+    unsigned long long id;
+
+    if (found->count < SPOOL_MAX_FILES && sscanf(name, SPOOL_FILE_PREFIX "%llu", &id) == 1)
+    {
+        found->ids[found->count++] = id;
+    }
+}
+
+// Takes back what an earlier run did not get acknowledged and continues its
+// sequence numbers.
+static void RecoverState(PSPOOL spool)
+{
+    SPOOL_IDS found;
+    int i;
+
+    LoadState(spool);
+    spool->next = spool->acked;
+    spool->nextId = 1;
+
+    found.ids = (unsigned long long*)malloc(SPOOL_MAX_FILES * sizeof(unsigned long long));
+    found.count = 0;
+    if (!found.ids)
+    {
+        return;
+    }
+    MarkEnumerateFiles(spool->directory, SPOOL_FILE_PREFIX, FoundSpoolFile, &found);
+    qsort(found.ids, found.count, sizeof(unsigned long long), CompareIds);
+
+    for (i = 0; i < found.count; i++)
+    {
+        SPOOL_FILE file;
+        char path[MARK_MAX_PATH];
+
+        spool->nextId = found.ids[i] + 1;
+        if (ScanFile(spool, found.ids[i], &file))
+        {
+            spool->next = MAX(spool->next, file.end);
+            if (file.end > spool->acked)
+            {
+                *FileAt(spool, spool->count++) = file;
+                spool->bytes += file.size;
+                spool->stats.recovered += file.end - MAX(file.first, spool->acked);
+                continue;
+            }
+        }
+
+        SpoolPath(path, spool->directory, found.ids[i]);
+        MarkFileDelete(path);
+    }
+
+    free(found.ids);
+}
+
+PSPOOL SpoolOpen(const char* directory, unsigned long long limit)
+{
+    PSPOOL spool;
+
+    if (strlen(directory) >= SPOOL_MAX_DIRECTORY)
+    {
+        printf("The spool directory %s is too long.\n", directory);
+        return NULL;
+    }
+
+    spool = (PSPOOL)calloc(1, sizeof(SPOOL));
+    if (!spool)
+    {
+        return NULL;
+    }
+
+    strcpy(spool->directory, directory);
+    spool->limit = limit;
+    spool->readFile = MARK_INVALID_FILE;
+
+    if (!MarkCreateDirectory(directory))
+    {
+        printf("Cannot create the spool directory %s.\n", directory);
+        free(spool);
+        return NULL;
+    }
+
+    MarkLockInit(&spool->lock);
+    RecoverState(spool);
+
+    return spool;
+}
+
+// Writer. Opens the next spool file and adds it to the table.
+static int StartFile(PSPOOL spool)
+{
+    LOGIO_OPTIONS options = { LOGIO_BACKEND_WRITE, 0, 1, 0 };
+    char path[MARK_MAX_PATH];
+    PSPOOL_FILE file;
+
+    // Durable once per sync interval, like the other logs.
+    options.syncInterval = g_LogIoOptions.syncInterval;
+
+    SpoolPath(path, spool->directory, spool->nextId);
+    spool->file = LogFileOpen(path, 1, &options);
+    if (!spool->file)
+    {
+        printf("Cannot create the spool file %s.\n", path);
+        return 0;
+    }
+
+    MarkLockAcquire(&spool->lock);
+    if (spool->count == SPOOL_MAX_FILES)
+    {
+        DeleteOldest(spool);
+    }
+    file = FileAt(spool, spool->count++);
+    file->id = spool->nextId++;
+    file->first = file->end = spool->next;
+    file->size = 0;
+    MarkLockRelease(&spool->lock);
+
+    return 1;
+}
+
+int SpoolAppend(PSPOOL spool, PMARK_EVENT events, int count)
+{
+    unsigned long rawSize = count * sizeof(MARK_EVENT);
+    unsigned long bound = sizeof(SEGMENT_BLOCK_HEADER) + LzCompressBound(rawSize);
+    PSEGMENT_BLOCK_HEADER header;
+    PSPOOL_FILE newest;
+    unsigned long size;
+
+    if (bound > spool->blockCapacity)
+    {
+        unsigned char* block = (unsigned char*)realloc(spool->block, bound);
+
+        if (!block)
+        {
+            spool->stats.failures++;
+            return 0;
+        }
+        spool->block = block;
+        spool->blockCapacity = bound;
+    }
+
+    header = (PSEGMENT_BLOCK_HEADER)spool->block;
+    header->magic = SEGMENT_BLOCK_MAGIC;
+    header->count = count;
+    header->rawSize = rawSize;
+    header->compressedSize = LzCompress((unsigned char*)events, rawSize,
+        spool->block + sizeof(SEGMENT_BLOCK_HEADER), LzCompressBound(rawSize));
+    header->firstSequence = spool->next;
+    size = sizeof(SEGMENT_BLOCK_HEADER) + header->compressedSize;
+
+    if (spool->file && FileAt(spool, spool->count - 1)->size + size > SPOOL_FILE_SIZE)
+    {
+        LogFileClose(spool->file);
+        spool->file = NULL;
+    }
+    if (!spool->file && !StartFile(spool))
+    {
+        spool->stats.failures++;
+        return 0;
+    }
+
+    // A failed write may leave part of the block behind; the file is not
+    // written to again and readers stop at its published size.
+    if (!LogFileAppend(spool->file, spool->block, size) || !LogFileFlush(spool->file))
+    {
+        LogFileClose(spool->file);
+        spool->file = NULL;
+        spool->stats.failures++;
+        return 0;
+    }
+
+    MarkLockAcquire(&spool->lock);
+    newest = FileAt(spool, spool->count - 1);
+    newest->size += size;
+    newest->end = header->firstSequence + count;
+    spool->next += count;
+    spool->bytes += size;
+
+    spool->stats.events += count;
+    spool->stats.blocks++;
+    spool->stats.rawBytes += rawSize;
+    spool->stats.compressedBytes += size;
+
+    while (spool->bytes > spool->limit && spool->count > 1)
+    {
+        DeleteOldest(spool);
+    }
+    MarkLockRelease(&spool->lock);
+
+    return 1;
+}
+
+// Under the lock. Positions the reader on the block holding sequence, or
+// the first one after it.
+static int Seek(PSPOOL spool, unsigned long long sequence)
+{
+    SEGMENT_BLOCK_HEADER header;
+    PSPOOL_FILE file = NULL;
+    char path[MARK_MAX_PATH];
+    int i;
+
+    for (i = 0; i < spool->count; i++)
+    {
+        if (FileAt(spool, i)->end > sequence)
+        {
+            file = FileAt(spool, i);
+            break;
+        }
+    }
+    if (!file)
+    {
+        return 0;
+    }
+
+    if (spool->readId != file->id)
+    {
+        CloseReadFile(spool);
+        SpoolPath(path, spool->directory, file->id);
+        spool->readFile = MarkFileOpenRead(path);
+        if (MARK_INVALID_FILE == spool->readFile)
+        {
+            return 0;
+        }
+        spool->readId = file->id;
+    }
+
+    spool->readOffset = 0;
+    spool->readSequence = file->first;
+    while (spool->readOffset < file->size && spool->readSequence < sequence)
+    {
+        if (!MarkFileReadAt(spool->readFile, spool->readOffset, &header, sizeof(header)) ||
+            header.firstSequence + header.count > sequence)
+        {
+            break;
+        }
+        spool->readOffset += sizeof(header) + header.compressedSize;
+        spool->readSequence = header.firstSequence + header.count;
+    }
+
+    return 1;
+}
+
+unsigned char* SpoolRead(PSPOOL spool, unsigned long long sequence, PSEGMENT_BLOCK_HEADER header)
+{
+    unsigned char* data = NULL;
+    PSPOOL_FILE file = NULL;
+    int i;
+
+    MarkLockAcquire(&spool->lock);
+
+    // Sequential reads carry on where the last one stopped.
+    for (i = 0; i < spool->count && spool->readId; i++)
+    {
+        if (FileAt(spool, i)->id == spool->readId)
+        {
+            file = FileAt(spool, i);
+            break;
+        }
+    }
+    if (!file || sequence != spool->readSequence || spool->readOffset >= file->size)
+    {
+        file = NULL;
+        if (Seek(spool, sequence))
+        {
+            for (i = 0; i < spool->count; i++)
+            {
+                if (FileAt(spool, i)->id == spool->readId)
+                {
+                    file = FileAt(spool, i);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (file && spool->readOffset < file->size &&
+        MarkFileReadAt(spool->readFile, spool->readOffset, header, sizeof(*header)) &&
+        header->magic == SEGMENT_BLOCK_MAGIC &&
+        spool->readOffset + sizeof(*header) + header->compressedSize <= file->size)
+    {
+        if (header->compressedSize > spool->dataCapacity)
+        {
+            unsigned char* grown = (unsigned char*)realloc(spool->data, header->compressedSize);
+
+            if (grown)
+            {
+                spool->data = grown;
+                spool->dataCapacity = header->compressedSize;
+            }
+        }
+
+        if (header->compressedSize <= spool->dataCapacity &&
+            MarkFileReadAt(spool->readFile, spool->readOffset + sizeof(*header), spool->data, header->compressedSize))
+        {
+            spool->readOffset += sizeof(*header) + header->compressedSize;
+            spool->readSequence = header->firstSequence + header->count;
+            data = spool->data;
+        }
+    }
+
+    MarkLockRelease(&spool->lock);
+    return data;
+}
+
+void SpoolAck(PSPOOL spool, unsigned long long sequence)
+{
+    int deleted = 0;
+
+    MarkLockAcquire(&spool->lock);
+    if (sequence > spool->acked)
+    {
+        spool->acked = sequence;
+
+        // The newest file stays; the writer may still be appending to it.
+        while (spool->count > 1 && FileAt(spool, 0)->end <= spool->acked)
+        {
+            DeleteOldest(spool);
+            deleted++;
+        }
+        if (deleted)
+        {
+            SaveState(spool);
+        }
+    }
+    MarkLockRelease(&spool->lock);
+}
+
+void SpoolClose(PSPOOL spool)
+{
+    if (!spool)
+    {
+        return;
+    }
+
+    if (spool->file)
+    {
+        LogFileClose(spool->file);
+    }
+    CloseReadFile(spool);
+    SaveState(spool);
+
+    MarkLockDelete(&spool->lock);
+    free(spool->block);
+    free(spool->data);
+    free(spool);
+}
+
+void GetSpoolStats(PSPOOL spool, PSPOOL_STATS stats)
+{
+    MarkLockAcquire(&spool->lock);
+    *stats = spool->stats;
+    stats->acked = spool->acked;
+    stats->next = spool->next;
+    stats->files = spool->count;
+    stats->bytes = spool->bytes;
+    MarkLockRelease(&spool->lock);
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef _SPOOL_H_
+#define _SPOOL_H_
+
+#include "communicator.h"
+#include "segment.h"
+
+// Disk queue between the forwarding sink and the collector connection.
+// Batches are appended as compressed blocks, a SEGMENT_BLOCK_HEADER and the
+// LZ data as in a segment, to a run of spool files in one directory. The
+// sender reads them back in sequence order and a file is deleted once the
+// collector has acknowledged every event in it. Whatever is not
+// acknowledged when dcomm stops is sent again by the next run, so delivery
+// is at least once and a collector may see a batch twice. Sequences carry
+// on from the spool left behind; the acknowledged one is kept in a small
+// state file next to the spool files.
+
+#define SPOOL_FILE_PREFIX "spool-"
+#define SPOOL_FILE_FORMAT "%s" MARK_PATH_SEPARATOR SPOOL_FILE_PREFIX "%016llu.mspl"
+#define SPOOL_STATE_FILE "spool.ack"
+// Room left in a path for the longest file name and its separator.
+#define SPOOL_MAX_DIRECTORY (MARK_MAX_PATH - sizeof(MARK_PATH_SEPARATOR SPOOL_FILE_PREFIX "18446744073709551615.mspl") + 1)
+
+#define SPOOL_DEFAULT_DIRECTORY "spool"
+#define SPOOL_FILE_SIZE (4 * 1024 * 1024)
+#define SPOOL_DEFAULT_LIMIT 1024 // MB on disk, the oldest files go beyond that
+#define SPOOL_MAX_FILES 4096
+
+typedef struct _SPOOL_STATS
+{
+    unsigned long long events; // appended by this run
+    unsigned long long blocks;
+    unsigned long long rawBytes;
+    unsigned long long compressedBytes;
+    unsigned long long recovered; // unacknowledged events found at open
+    unsigned long long lost;      // deleted unacknowledged to stay in the limit
+    unsigned long long failures;  // blocks that could not be written
+    unsigned long long acked;     // every event before this sequence is acknowledged
+    unsigned long long next;      // sequence of the next event appended
+    unsigned long long files;
+    unsigned long long bytes;     // on disk
+} SPOOL_STATS, *PSPOOL_STATS;
+
+typedef struct _SPOOL SPOOL, *PSPOOL;
+
+// Takes over the spool files in directory, creating it if needed. limit is
+// in bytes.
+PSPOOL SpoolOpen(const char* directory, unsigned long long limit);
+// Writer: compresses count events into one block and appends it.
+int SpoolAppend(PSPOOL spool, PMARK_EVENT events, int count);
+// Reader, safe against the writer: finds the block holding sequence, or the
+// first one after it, and returns its compressed data, valid until the next
+// call. NULL if there is no such block yet.
+unsigned char* SpoolRead(PSPOOL spool, unsigned long long sequence, PSEGMENT_BLOCK_HEADER header);
+// Every event before sequence has been delivered.
+void SpoolAck(PSPOOL spool, unsigned long long sequence);
+void SpoolClose(PSPOOL spool);
+void GetSpoolStats(PSPOOL spool, PSPOOL_STATS stats);
+
+#endif
\ No newline at end of file
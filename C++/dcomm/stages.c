@@ -0,0 +1,111 @@
+#include "stages.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _STAGE_SET
+{
+    LATENCY_HISTOGRAM stages[STAGE_HISTOGRAMS];
+    struct _STAGE_SET* next;
+} STAGE_SET, *PSTAGE_SET;
+
+static const char* s_names[STAGE_HISTOGRAMS] =
+{
+    "Receive", "Process", "Text log", "Binary log", "Analyzer", "Shared ring", "Broker", "Forward", "Written"
+};
+
+// Sets are never freed: a thread that exits leaves its counts behind for
+// the final printout.
+static PSTAGE_SET volatile s_sets = NULL;
+static MARK_THREAD_LOCAL PSTAGE_SET t_set = NULL;
+
+static PSTAGE_SET GetThreadSet()
+{
+    PSTAGE_SET set = t_set;
+
+    if (!set)
+    {
+        set = (PSTAGE_SET)calloc(1, sizeof(STAGE_SET));
+        if (!set)
+        {
+            return NULL;
+        }
+
+        do
+        {
+            set->next = s_sets;
+        } while (MarkAtomicCasPointer((void* volatile*)&s_sets, set, set->next) != set->next);
+
+        t_set = set;
+    }
+
+    return set;
+}
+
+void RecordStageLatency(int stage, long long captureTime)
+{
+    PSTAGE_SET set;
+    long long elapsed;
+
+    if (!captureTime || stage < 0 || stage >= STAGE_HISTOGRAMS || !(set = GetThreadSet()))
+    {
+        return;
+    }
+
+    elapsed = MarkTimestamp() - captureTime;
+    LatencyAdd(&set->stages[stage], elapsed > 0 ? elapsed * (1000000000 / MARK_TIMESTAMP_FREQUENCY) : 0);
+}
+
+void StampStage(PMARK_EVENT event, int stage)
+{
+    long long elapsed;
+    PSTAGE_SET set;
+
+    // Old recordings and sources without a clock carry no capture time.
+    if (!event->time || stage < 0 || stage >= MARK_STAGE_COUNT)
+    {
+        return;
+    }
+
+    elapsed = MarkTimestamp() - event->time;
+    elapsed = MAX(elapsed, 1);
+    event->stages[stage] = elapsed > 0xFFFFFFFFLL ? 0xFFFFFFFF : (unsigned int)elapsed;
+
+    if ((set = GetThreadSet()) != NULL)
+    {
+        LatencyAdd(&set->stages[stage], elapsed * (1000000000 / MARK_TIMESTAMP_FREQUENCY));
+    }
+}
+
+void GetStageLatency(int stage, PLATENCY_HISTOGRAM histogram)
+{
+    PSTAGE_SET set;
+
+    LatencyReset(histogram);
+    for (set = s_sets; set; set = set->next)
+    {
+        LatencyMerge(histogram, &set->stages[stage]);
+    }
+}
+
+void PrintStageLatency()
+{
+    static LATENCY_HISTOGRAM histogram;
+    int printed = 0;
+    int stage;
+
+    for (stage = 0; stage < STAGE_HISTOGRAMS; stage++)
+    {
+        GetStageLatency(stage, &histogram);
+        if (histogram.count)
+        {
+            if (!printed++)
+            {
+                printf("Latency since capture:\n");
+            }
+            PrintLatency(s_names[stage], &histogram);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,24 @@
+#ifndef _STAGES_H_
+#define _STAGES_H_
+
+#include "communicator.h"
+#include "latency.h"
+
+// Per-stage latency since capture. Every stamp also lands in a histogram of
+// the calling thread, so the event path never takes a lock; the printout
+// merges all threads.
+
+// Stages that happen after the event has left ProcessMessage and are only
+// measured, not stamped into the event.
+#define STAGE_WRITTEN MARK_STAGE_COUNT
+#define STAGE_HISTOGRAMS (MARK_STAGE_COUNT + 1)
+
+// Sets event->stages[stage] to the time since capture and records it.
+void StampStage(PMARK_EVENT event, int stage);
+// Records the time since capture for a stage that does not own the event.
+void RecordStageLatency(int stage, long long captureTime);
+
+void GetStageLatency(int stage, PLATENCY_HISTOGRAM histogram);
+void PrintStageLatency();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include "subscription.h"
+
+#include <string.h>
+
+static unsigned short Lower(unsigned short c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+// Copies a zero-terminated string of at most size characters in lower case
+// and returns its length.
+static int LowerCopy(unsigned short* dst, const unsigned short* src, int size)
+{
+    int i;
+
+    for (i = 0; i < size && src[i]; i++)
+    {
+        dst[i] = Lower(src[i]);
+    }
+
+    return i;
+}
+
+static int CompilePattern(PSUBSCRIPTION_PATTERN pattern, const unsigned short* text, int size)
+{
+    int length = LowerCopy(pattern->text, text, MIN(size, (int)(sizeof(pattern->text) / sizeof(pattern->text[0]))));
+    int start = 0;
+    int i;
+
+    pattern->count = 0;
+    pattern->anchorStart = length && pattern->text[0] != '*';
+    pattern->anchorEnd = length && pattern->text[length - 1] != '*';
+
+    for (i = 0; i <= length; i++)
+    {
+        if (i < length && pattern->text[i] != '*')
+        {
+            continue;
+        }
+
+        if (i > start)
+        {
+            if (pattern->count == SUBSCRIPTION_SEGMENTS)
+            {
+                return 0;
+            }
+            pattern->offsets[pattern->count] = (unsigned short)start;
+            pattern->lengths[pattern->count] = (unsigned short)(i - start);
+            pattern->count++;
+        }
+        start = i + 1;
+    }
+
+    return 1;
+}
+
+static int Find(const unsigned short* text, int length, int from, const unsigned short* part, int size)
+{
+    int i;
+
+    for (i = from; i + size <= length; i++)
+    {
+        if (text[i] == part[0] && !memcmp(text + i, part, size * sizeof(unsigned short)))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int MatchPattern(PSUBSCRIPTION_PATTERN pattern, const unsigned short* text, int length)
+{
+    int position = 0;
+    int i;
+
+    for (i = 0; i < pattern->count; i++)
+    {
+        const unsigned short* part = pattern->text + pattern->offsets[i];
+        int size = pattern->lengths[i];
+
+        if (i == pattern->count - 1 && pattern->anchorEnd)
+        {
+            // The last part sits at the very end, and with a single part
+            // anchored at both ends it is the whole text.
+            if (length - size < position || memcmp(text + length - size, part, size * sizeof(unsigned short)) ||
+                (i == 0 && pattern->anchorStart && length != size))
+            {
+                return 0;
+            }
+            position = length;
+        }
+        else if (i == 0 && pattern->anchorStart)
+        {
+            if (size > length || memcmp(text, part, size * sizeof(unsigned short)))
+            {
+                return 0;
+            }
+            position = size;
+        }
+        else
+        {
+            int found = Find(text, length, position, part, size);
+
+            if (found < 0)
+            {
+                return 0;
+            }
+            position = found + size;
+        }
+    }
+
+    return 1;
+}
+
+void MatcherInit(PSUBSCRIPTION_MATCHER matcher)
+{
+    memset(matcher, 0, sizeof(*matcher));
+}
+
+int MatcherAdd(PSUBSCRIPTION_MATCHER matcher, int subscriber, PSTREAM_SUBSCRIPTION subscription)
+{
+    PSUBSCRIPTION_FILTER filter = &matcher->filters[subscriber];
+    SUBSCRIBER_SET bit = 1U << subscriber;
+    int opclass, optype;
+
+    MatcherRemove(matcher, subscriber);
+
+    if (!CompilePattern(&filter->image, subscription->szImagePath, sizeof(subscription->szImagePath) / sizeof(unsigned short)) ||
+        !CompilePattern(&filter->path, subscription->szOperationPath, sizeof(subscription->szOperationPath) / sizeof(unsigned short)))
+    {
+        return 0;
+    }
+    filter->pid = subscription->pid;
+
+    for (opclass = 0; opclass < SUBSCRIPTION_VALUES; opclass++)
+    {
+        for (optype = 0; optype < SUBSCRIPTION_VALUES; optype++)
+        {
+            if ((!subscription->opclasses || (subscription->opclasses & (1U << opclass))) &&
+                (!subscription->optypes || (subscription->optypes & (1U << optype))))
+            {
+                matcher->cells[opclass][optype] |= bit;
+            }
+        }
+    }
+
+    if (!subscription->opclasses && !subscription->optypes)
+    {
+        matcher->any |= bit;
+    }
+    if (filter->image.count)
+    {
+        matcher->images |= bit;
+    }
+    if (filter->path.count)
+    {
+        matcher->paths |= bit;
+    }
+    if (filter->pid || filter->image.count || filter->path.count)
+    {
+        matcher->filtered |= bit;
+    }
+
+    return 1;
+}
+
+void MatcherRemove(PSUBSCRIPTION_MATCHER matcher, int subscriber)
+{
+    SUBSCRIBER_SET keep = ~(1U << subscriber);
+    int opclass, optype;
+
+    for (opclass = 0; opclass < SUBSCRIPTION_VALUES; opclass++)
+    {
+        for (optype = 0; optype < SUBSCRIPTION_VALUES; optype++)
+        {
+            matcher->cells[opclass][optype] &= keep;
+        }
+    }
+
+    matcher->any &= keep;
+    matcher->filtered &= keep;
+    matcher->images &= keep;
+    matcher->paths &= keep;
+}
+
+SUBSCRIBER_SET MatcherMatch(PSUBSCRIPTION_MATCHER matcher, PMARK_EVENT event)
+{
+    unsigned short image[sizeof(event->szImagePath) / sizeof(unsigned short)];
+    unsigned short path[sizeof(event->szOperationPath) / sizeof(unsigned short)];
+    int imageLength = 0, pathLength = 0;
+    SUBSCRIBER_SET matched, check;
+    int i;
+
+    if ((unsigned int)event->opclass < SUBSCRIPTION_VALUES && (unsigned int)event->optype < SUBSCRIPTION_VALUES)
+    {
+        matched = matcher->cells[event->opclass][event->optype];
+    }
+    else
+    {
+        matched = matcher->any;
+    }
+
+    check = matched & matcher->filtered;
+    if (!check)
+    {
+        return matched;
+    }
+
+    if (check & matcher->images)
+    {
+        imageLength = LowerCopy(image, event->szImagePath, sizeof(image) / sizeof(image[0]));
+    }
+    if (check & matcher->paths)
+    {
+        pathLength = LowerCopy(path, event->szOperationPath, sizeof(path) / sizeof(path[0]));
+    }
+
+    for (i = 0; check; i++, check >>= 1)
+    {
+        PSUBSCRIPTION_FILTER filter = &matcher->filters[i];
+
+        if (!(check & 1))
+        {
+            continue;
+        }
+
+        if ((filter->pid && filter->pid != event->pid) ||
+            (filter->image.count && !MatchPattern(&filter->image, image, imageLength)) ||
+            (filter->path.count && !MatchPattern(&filter->path, path, pathLength)))
+        {
+            matched &= ~(1U << i);
+        }
+    }
+
+    return matched;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef _SUBSCRIPTION_H_
+#define _SUBSCRIPTION_H_
+
+#include "eventstream.h"
+
+// Matches one event against the subscriptions of every broker client at
+// once. The opclass and optype masks are folded into a table with a bit per
+// subscriber for each (opclass, optype) pair, so most events are settled by
+// one lookup. Only the subscribers found there that also filter on pid,
+// image or path are checked further, against text lower-cased once per
+// event. Case folding covers ASCII only, which is what paths are matched
+// against in practice.
+
+#define MAX_SUBSCRIBERS 32
+#define SUBSCRIPTION_VALUES 8      // opclass and optype values with a cell of their own
+#define SUBSCRIPTION_SEGMENTS 16   // '*'-separated parts of a pattern
+
+typedef unsigned int SUBSCRIBER_SET; // bit per subscriber
+
+typedef struct _SUBSCRIPTION_PATTERN
+{
+    unsigned short text[256];
+    unsigned short offsets[SUBSCRIPTION_SEGMENTS];
+    unsigned short lengths[SUBSCRIPTION_SEGMENTS];
+    int count;
+    int anchorStart;
+    int anchorEnd;
+} SUBSCRIPTION_PATTERN, *PSUBSCRIPTION_PATTERN;
+
+typedef struct _SUBSCRIPTION_FILTER
+{
+    int pid;
+    SUBSCRIPTION_PATTERN image;
+    SUBSCRIPTION_PATTERN path;
+} SUBSCRIPTION_FILTER, *PSUBSCRIPTION_FILTER;
+
+typedef struct _SUBSCRIPTION_MATCHER
+{
+    SUBSCRIBER_SET cells[SUBSCRIPTION_VALUES][SUBSCRIPTION_VALUES];
+    SUBSCRIBER_SET any;      // want every opclass and optype, also those without a cell
+    SUBSCRIBER_SET filtered; // have a pid, image or path predicate
+    SUBSCRIBER_SET images;
+    SUBSCRIBER_SET paths;
+    SUBSCRIPTION_FILTER filters[MAX_SUBSCRIBERS];
+} SUBSCRIPTION_MATCHER, *PSUBSCRIPTION_MATCHER;
+
+void MatcherInit(PSUBSCRIPTION_MATCHER matcher);
+// Returns 0 if a pattern has more than SUBSCRIPTION_SEGMENTS parts.
+int MatcherAdd(PSUBSCRIPTION_MATCHER matcher, int subscriber, PSTREAM_SUBSCRIPTION subscription);
+void MatcherRemove(PSUBSCRIPTION_MATCHER matcher, int subscriber);
+SUBSCRIBER_SET MatcherMatch(PSUBSCRIPTION_MATCHER matcher, PMARK_EVENT event);
+
+#endif
\ No newline at end of file
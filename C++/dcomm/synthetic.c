@@ -0,0 +1,101 @@
+#include "synthetic.h"
+#include "platform.h"
+#include "sources.h"
+#include "../usermodesimulation/generator.h"
+
+#include <stdio.h>
+
+static double s_rate = SYNTHETIC_RATE_MAX;
+static double s_duration = 0;
+static volatile int s_stop = 0;
+
+static unsigned long long s_start = 0;
+static unsigned long long s_end = 0;
+static unsigned long long s_sent = 0;
+static int s_done = 0;
+
+// Paces the generator's events at the source's rate rather than its
+// virtual clock, and stamps them as they enter the pipeline.
+static void SubmitGenerated(PMARK_EVENT evt, void* context)
+{
+    unsigned long long now, due;
+
+    UNREFERENCED_PARAMETER(context);
+
+    if (s_stop || s_done)
+    {
+        return;
+    }
+
+    if (s_rate > 0)
+    {
+        due = s_start + (unsigned long long)(s_sent * 1000000000.0 / s_rate);
+        now = MarkClockNanoseconds();
+        if (due > now + SYNTHETIC_SPIN_LIMIT)
+        {
+            MarkSleep((int)((due - now - SYNTHETIC_SPIN_LIMIT / 2) / 1000000));
+        }
+        while ((now = MarkClockNanoseconds()) < due && !s_stop)
+        {
+        }
+    }
+    else
+    {
+        now = MarkClockNanoseconds();
+    }
+
+    if (s_end && now >= s_end)
+    {
+        s_done = 1;
+        return;
+    }
+
+    evt->time = MarkTimestamp();
+    SubmitEvent(evt);
+    s_sent++;
+}
+
+static int RunSyntheticSource(void* context)
+{
+    GENERATOR_OPTIONS options;
+    GENERATOR_STATS stats;
+
+    UNREFERENCED_PARAMETER(context);
+
+    // The generator's own duration is simulated time; ours is wall clock.
+    GetDefaultGeneratorOptions(&options);
+    options.duration = 0;
+
+    s_start = MarkClockNanoseconds();
+    s_end = s_duration > 0 ? s_start + (unsigned long long)(s_duration * 1000000000.0) : 0;
+    s_sent = 0;
+    s_done = 0;
+
+    if (!StartGenerator(&options, SubmitGenerated, NULL, &stats))
+    {
+        printf("Cannot start the synthetic workload\n");
+        return 0;
+    }
+    while (!s_stop && !s_done && StepGenerator())
+    {
+    }
+    StopGenerator(NULL);
+
+    return 1;
+}
+
+static void StopSyntheticSource(void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    s_stop = 1;
+}
+
+int RegisterSyntheticSource(double rate, double duration)
+{
+    s_rate = rate;
+    s_duration = duration;
+    s_stop = 0;
+
+    return RegisterSource("synthetic", RunSyntheticSource, StopSyntheticSource, NULL, SOURCE_LOSSLESS);
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef _SYNTHETIC_H_
+#define _SYNTHETIC_H_
+
+#include "communicator.h"
+
+// Synthetic load for exercising the collector pipeline without a driver or
+// a recording: the usermodesimulation generator's default workload, sent at
+// a given rate. Its build adds ../usermodesimulation/generator.c and -lm.
+
+#define SYNTHETIC_RATE_MAX 0.0
+#define SYNTHETIC_SPIN_LIMIT 2000000 // ns; longer waits sleep first
+
+// rate is in events per second, SYNTHETIC_RATE_MAX for as fast as possible.
+// A duration of 0 runs until the source is stopped.
+int RegisterSyntheticSource(double rate, double duration);
+
+#endif
\ No newline at end of file
@@ -7,6 +7,7 @@
 #define IP_PROTO_IGMP 0x02
 #define IP_PROTO_TCP  0x06
 #define IP_PROTO_UDP  0x11
+#define IP_PROTO_ICMPV6 0x3A
 
 typedef struct _ETH_HDR
 {
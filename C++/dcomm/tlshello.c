@@ -0,0 +1,183 @@
+#include "tlshello.h"
+
+#include <string.h>
+
+#define TLS_RECORD_HEADER 5
+#define TLS_HANDSHAKE_HEADER 4
+#define TLS_CONTENT_HANDSHAKE 22
+#define TLS_HANDSHAKE_CLIENT_HELLO 1
+#define TLS_MAX_RECORD 18432 // 2^14 plus the most expansion a record may have
+#define TLS_RANDOM_SIZE 32
+#define TLS_EXTENSION_SERVER_NAME 0
+#define TLS_EXTENSION_ALPN 16
+#define TLS_SERVER_NAME_HOST 0
+
+static unsigned int Read16(const unsigned char* data)
+{
+    return (unsigned int)data[0] << 8 | data[1];
+}
+
+static unsigned int Read24(const unsigned char* data)
+{
+    return (unsigned int)data[0] << 16 | (unsigned int)data[1] << 8 | data[2];
+}
+
+// The first host name of the list. Names with anything but printable ASCII
+// in them are left out.
+static void ReadServerName(const unsigned char* data, unsigned int length, PTLS_HELLO hello)
+{
+    unsigned int end;
+    unsigned int i;
+
+    if (length < 2 || (end = 2 + Read16(data)) > length)
+    {
+        return;
+    }
+
+    for (i = 2; i + 3 <= end;)
+    {
+        unsigned int size = Read16(data + i + 1);
+        unsigned int j;
+
+        if (i + 3 + size > end)
+        {
+            return;
+        }
+        if (data[i] == TLS_SERVER_NAME_HOST && size && size <= TLS_MAX_SERVER_NAME)
+        {
+            for (j = 0; j < size; j++)
+            {
+                unsigned char c = data[i + 3 + j];
+
+                if (c <= ' ' || c >= 0x7F)
+                {
+                    hello->serverName[0] = 0;
+                    return;
+                }
+                hello->serverName[j] = (char)(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+            }
+            hello->serverName[size] = 0;
+            return;
+        }
+        i += 3 + size;
+    }
+}
+
+static void ReadAlpn(const unsigned char* data, unsigned int length, PTLS_HELLO hello)
+{
+    unsigned int written = 0;
+    unsigned int end;
+    unsigned int i;
+
+    if (length < 2 || (end = 2 + Read16(data)) > length)
+    {
+        return;
+    }
+
+    for (i = 2; i < end;)
+    {
+        unsigned int size = data[i];
+        unsigned int j;
+
+        if (!size || i + 1 + size > end || written + (written ? 1 : 0) + size > TLS_MAX_ALPN)
+        {
+            break;
+        }
+        for (j = 0; j < size; j++)
+        {
+            if (data[i + 1 + j] <= ' ' || data[i + 1 + j] >= 0x7F || data[i + 1 + j] == ',')
+            {
+                break;
+            }
+        }
+        if (j == size)
+        {
+            if (written)
+            {
+                hello->alpn[written++] = ',';
+            }
+            memcpy(hello->alpn + written, data + i + 1, size);
+            written += size;
+        }
+        i += 1 + size;
+    }
+    hello->alpn[written] = 0;
+}
+
+int ParseClientHello(const unsigned char* data, unsigned int length, PTLS_HELLO hello)
+{
+    unsigned int record;
+    unsigned int end;
+    unsigned int offset;
+
+    hello->needed = 0;
+    hello->serverName[0] = 0;
+    hello->alpn[0] = 0;
+
+    // What the first bytes give away settles it early: a handshake record
+    // of a known major version, then the ClientHello type.
+    if (!length || data[0] != TLS_CONTENT_HANDSHAKE || (length > 1 && data[1] != 3) ||
+        (length > 2 && data[2] > 4) || (length > 5 && data[5] != TLS_HANDSHAKE_CLIENT_HELLO))
+    {
+        return TLS_HELLO_NONE;
+    }
+    if (length < TLS_RECORD_HEADER + TLS_HANDSHAKE_HEADER)
+    {
+        hello->needed = TLS_RECORD_HEADER + TLS_HANDSHAKE_HEADER;
+        return TLS_HELLO_PARTIAL;
+    }
+
+    record = Read16(data + 3);
+    end = TLS_RECORD_HEADER + TLS_HANDSHAKE_HEADER + Read24(data + 6);
+    if (record > TLS_MAX_RECORD || end > TLS_RECORD_HEADER + record)
+    {
+        return TLS_HELLO_NONE;
+    }
+    hello->needed = end;
+    if (length < end)
+    {
+        return TLS_HELLO_PARTIAL;
+    }
+
+    // Version and random, then the session id, cipher suites and
+    // compression methods, each behind its length.
+    offset = TLS_RECORD_HEADER + TLS_HANDSHAKE_HEADER + 2 + TLS_RANDOM_SIZE;
+    if (offset + 1 > end || (offset += 1 + data[offset]) + 2 > end ||
+        (offset += 2 + Read16(data + offset)) + 1 > end || (offset += 1 + data[offset]) > end)
+    {
+        return TLS_HELLO_NONE;
+    }
+
+    // SSL 3.0 hellos may end here, without extensions.
+    if (offset + 2 <= end)
+    {
+        unsigned int extensions = offset + 2 + Read16(data + offset);
+
+        if (extensions > end)
+        {
+            return TLS_HELLO_NONE;
+        }
+        for (offset += 2; offset + 4 <= extensions;)
+        {
+            unsigned int type = Read16(data + offset);
+            unsigned int size = Read16(data + offset + 2);
+
+            offset += 4;
+            if (offset + size > extensions)
+            {
+                return TLS_HELLO_NONE;
+            }
+            if (type == TLS_EXTENSION_SERVER_NAME)
+            {
+                ReadServerName(data + offset, size, hello);
+            }
+            else if (type == TLS_EXTENSION_ALPN)
+            {
+                ReadAlpn(data + offset, size, hello);
+            }
+            offset += size;
+        }
+    }
+
+    return TLS_HELLO_FOUND;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef _TLSHELLO_H_
+#define _TLSHELLO_H_
+
+// Reads the server name (SNI) and the offered application protocols (ALPN)
+// out of a TLS ClientHello, SSL 3.0 up to TLS 1.3, as a client sends it at
+// the start of its stream. Nothing is allocated and nothing is copied but
+// the two results; the caller gathers the bytes, and learns from a partial
+// answer how many the hello takes. A hello split over several TLS records
+// is not taken, nor one behind anything else on the stream, such as a
+// STARTTLS exchange. With Encrypted Client Hello the name read is the outer,
+// public one.
+
+#define TLS_MAX_SERVER_NAME 253 // characters, as for a DNS name
+#define TLS_MAX_ALPN 63         // characters of the protocols, comma separated
+
+#define TLS_HELLO_NONE 0    // not a ClientHello, or not one this parser takes
+#define TLS_HELLO_PARTIAL 1 // a ClientHello so far, needed bytes in all
+#define TLS_HELLO_FOUND 2
+
+typedef struct _TLS_HELLO
+{
+    unsigned int needed;                     // from the start of the record
+    char serverName[TLS_MAX_SERVER_NAME + 1]; // lower case, "" without SNI
+    char alpn[TLS_MAX_ALPN + 1];             // "" without ALPN; cut at a whole protocol
+} TLS_HELLO, *PTLS_HELLO;
+
+int ParseClientHello(const unsigned char* data, unsigned int length, PTLS_HELLO hello);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,655 @@
+#ifdef _WIN32
+// Winsock 2 has to come before Windows.h pulls in the old winsock.h.
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+#else
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define closesocket close
+#endif
+
+#include "transport.h"
+#include "platform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TCP_BACKLOG 128
+
+static int IsTcpAddress(const char* address)
+{
+    return !strncmp(address, TRANSPORT_TCP_PREFIX, sizeof(TRANSPORT_TCP_PREFIX) - 1);
+}
+
+// "tcp:host:port", "tcp:[v6 address]:port" or "tcp::port" for any local
+// address when listening.
+static struct addrinfo* ResolveTcp(const char* address, int passive)
+{
+    const char* name = address + sizeof(TRANSPORT_TCP_PREFIX) - 1;
+    const char* port = strrchr(name, ':');
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    char host[256];
+    size_t length;
+    int error;
+
+#ifdef _WIN32
+    static volatile LONG started = 0;
+    WSADATA data;
+
+    if (!InterlockedExchange(&started, 1))
+    {
+        WSAStartup(MAKEWORD(2, 2), &data);
+    }
+#endif
+
+    if (!port || (size_t)(port - name) >= sizeof(host))
+    {
+        printf("Bad TCP address %s, expected tcp:host:port\n", address);
+        return NULL;
+    }
+
+    length = port - name;
+    if (length >= 2 && name[0] == '[' && name[length - 1] == ']')
+    {
+        name++;
+        length -= 2;
+    }
+    memcpy(host, name, length);
+    host[length] = 0;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    error = getaddrinfo(length ? host : NULL, port + 1, &hints, &result);
+    if (error)
+    {
+        printf("Cannot resolve %s: %s\n", address, gai_strerror(error));
+        return NULL;
+    }
+
+    return result;
+}
+
+// Frames go out whole; small ones such as acks should not wait.
+static void SetNoDelay(SOCKET s)
+{
+    int on = 1;
+
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+static SOCKET ConnectTcp(const char* address)
+{
+    struct addrinfo* addresses = ResolveTcp(address, 0);
+    struct addrinfo* next;
+    SOCKET s = INVALID_SOCKET;
+
+    for (next = addresses; next; next = next->ai_next)
+    {
+        s = socket(next->ai_family, next->ai_socktype, next->ai_protocol);
+        if (s == INVALID_SOCKET)
+        {
+            continue;
+        }
+        if (!connect(s, next->ai_addr, (int)next->ai_addrlen))
+        {
+            SetNoDelay(s);
+            break;
+        }
+        closesocket(s);
+        s = INVALID_SOCKET;
+    }
+
+    if (addresses)
+    {
+        freeaddrinfo(addresses);
+    }
+    return s;
+}
+
+static SOCKET ListenTcp(const char* address)
+{
+    struct addrinfo* addresses = ResolveTcp(address, 1);
+    struct addrinfo* next;
+    SOCKET s = INVALID_SOCKET;
+
+    for (next = addresses; next; next = next->ai_next)
+    {
+        int on = 1;
+
+        s = socket(next->ai_family, next->ai_socktype, next->ai_protocol);
+        if (s == INVALID_SOCKET)
+        {
+            continue;
+        }
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+        if (!bind(s, next->ai_addr, (int)next->ai_addrlen) && !listen(s, TCP_BACKLOG))
+        {
+            break;
+        }
+        closesocket(s);
+        s = INVALID_SOCKET;
+    }
+
+    if (addresses)
+    {
+        freeaddrinfo(addresses);
+        if (s == INVALID_SOCKET)
+        {
+            printf("Cannot listen on %s\n", address);
+        }
+    }
+    return s;
+}
+
+#ifdef _WIN32
+
+struct _TRANSPORT
+{
+    HANDLE pipe;   // INVALID_HANDLE_VALUE for TCP
+    SOCKET socket;
+    TRANSPORT_STATS stats;
+};
+
+struct _TRANSPORT_LISTENER
+{
+    char name[MARK_MAX_PATH];
+    SOCKET socket; // INVALID_SOCKET for a pipe
+    volatile int closed;
+};
+
+static PTRANSPORT NewTransport(HANDLE pipe, SOCKET s)
+{
+    PTRANSPORT transport = (PTRANSPORT)calloc(1, sizeof(TRANSPORT));
+
+    if (!transport)
+    {
+        if (INVALID_HANDLE_VALUE != pipe)
+        {
+            CloseHandle(pipe);
+        }
+        if (INVALID_SOCKET != s)
+        {
+            closesocket(s);
+        }
+        return NULL;
+    }
+    transport->pipe = pipe;
+    transport->socket = s;
+
+    return transport;
+}
+
+PTRANSPORT TransportConnect(const char* address)
+{
+    HANDLE pipe;
+
+    if (IsTcpAddress(address))
+    {
+        SOCKET s = ConnectTcp(address);
+
+        return INVALID_SOCKET == s ? NULL : NewTransport(INVALID_HANDLE_VALUE, s);
+    }
+
+    pipe = CreateFile(address, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (INVALID_HANDLE_VALUE == pipe)
+    {
+        return NULL;
+    }
+
+    return NewTransport(pipe, INVALID_SOCKET);
+}
+
+PTRANSPORT_LISTENER TransportListen(const char* address)
+{
+    PTRANSPORT_LISTENER listener;
+    SOCKET s = INVALID_SOCKET;
+
+    if (IsTcpAddress(address))
+    {
+        s = ListenTcp(address);
+        if (INVALID_SOCKET == s)
+        {
+            return NULL;
+        }
+    }
+
+    listener = (PTRANSPORT_LISTENER)calloc(1, sizeof(TRANSPORT_LISTENER));
+    if (!listener)
+    {
+        if (INVALID_SOCKET != s)
+        {
+            closesocket(s);
+        }
+        return NULL;
+    }
+    strncpy(listener->name, address, sizeof(listener->name) - 1);
+    listener->socket = s;
+
+    return listener;
+}
+
+// Every producer gets its own pipe instance, created when we start waiting.
+PTRANSPORT TransportAccept(PTRANSPORT_LISTENER listener)
+{
+    HANDLE pipe;
+
+    if (listener->closed)
+    {
+        return NULL;
+    }
+
+    if (INVALID_SOCKET != listener->socket)
+    {
+        SOCKET s = accept(listener->socket, NULL, NULL);
+
+        if (INVALID_SOCKET == s)
+        {
+            return NULL;
+        }
+        SetNoDelay(s);
+        return NewTransport(INVALID_HANDLE_VALUE, s);
+    }
+
+    pipe = CreateNamedPipe(listener->name, PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT,
+        PIPE_UNLIMITED_INSTANCES, TRANSPORT_BUFFER_SIZE, TRANSPORT_BUFFER_SIZE, 0, NULL);
+    if (INVALID_HANDLE_VALUE == pipe)
+    {
+        printf("Cannot create pipe %s, error %u\n", listener->name, GetLastError());
+        return NULL;
+    }
+
+    if (!ConnectNamedPipe(pipe, NULL) && GetLastError() != ERROR_PIPE_CONNECTED)
+    {
+        CloseHandle(pipe);
+        return NULL;
+    }
+
+    if (listener->closed)
+    {
+        CloseHandle(pipe);
+        return NULL;
+    }
+
+    return NewTransport(pipe, INVALID_SOCKET);
+}
+
+void TransportListenerStop(PTRANSPORT_LISTENER listener)
+{
+    HANDLE pipe;
+
+    listener->closed = 1;
+
+    // Closing the socket fails a pending accept.
+    if (INVALID_SOCKET != listener->socket)
+    {
+        closesocket(listener->socket);
+        return;
+    }
+
+    // A pending ConnectNamedPipe returns once somebody connects, so connect.
+    pipe = CreateFile(listener->name, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if (INVALID_HANDLE_VALUE != pipe)
+    {
+        CloseHandle(pipe);
+    }
+}
+
+void TransportListenerClose(PTRANSPORT_LISTENER listener)
+{
+    if (INVALID_SOCKET != listener->socket && !listener->closed)
+    {
+        closesocket(listener->socket);
+    }
+    free(listener);
+}
+
+int TransportSend(PTRANSPORT transport, const void* data, unsigned long size)
+{
+    unsigned long done = 0;
+
+    while (done < size)
+    {
+        DWORD written = 0;
+
+        transport->stats.sends++;
+        if (INVALID_SOCKET != transport->socket)
+        {
+            int sent = send(transport->socket, (const char*)data + done, (int)MIN(size - done, 0x40000000UL), 0);
+
+            if (sent == SOCKET_ERROR)
+            {
+                return 0;
+            }
+            written = (DWORD)sent;
+        }
+        else if (!WriteFile(transport->pipe, (const char*)data + done, size - done, &written, NULL))
+        {
+            return 0;
+        }
+        done += written;
+    }
+    transport->stats.bytesSent += size;
+
+    return 1;
+}
+
+long TransportReceive(PTRANSPORT transport, void* buffer, unsigned long size)
+{
+    DWORD read = 0;
+
+    transport->stats.receives++;
+    if (INVALID_SOCKET != transport->socket)
+    {
+        int received = recv(transport->socket, (char*)buffer, (int)MIN(size, 0x40000000UL), 0);
+
+        if (received == SOCKET_ERROR)
+        {
+            return -1;
+        }
+        read = (DWORD)received;
+    }
+    else if (!ReadFile(transport->pipe, buffer, size, &read, NULL))
+    {
+        return GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1;
+    }
+    transport->stats.bytesReceived += read;
+
+    return (long)read;
+}
+
+int TransportPeerClosed(PTRANSPORT transport)
+{
+    if (INVALID_SOCKET != transport->socket)
+    {
+        fd_set readable;
+        struct timeval now = { 0, 0 };
+        char byte;
+
+        FD_ZERO(&readable);
+        FD_SET(transport->socket, &readable);
+        return select(0, &readable, NULL, NULL, &now) > 0 && recv(transport->socket, &byte, 1, MSG_PEEK) <= 0;
+    }
+
+    return !PeekNamedPipe(transport->pipe, NULL, 0, NULL, NULL, NULL) && GetLastError() == ERROR_BROKEN_PIPE;
+}
+
+void TransportShutdown(PTRANSPORT transport)
+{
+    if (INVALID_SOCKET != transport->socket)
+    {
+        shutdown(transport->socket, SD_BOTH);
+        return;
+    }
+
+    CancelIoEx(transport->pipe, NULL);
+    DisconnectNamedPipe(transport->pipe);
+}
+
+void TransportClose(PTRANSPORT transport)
+{
+    if (transport)
+    {
+        if (INVALID_SOCKET != transport->socket)
+        {
+            closesocket(transport->socket);
+        }
+        else
+        {
+            CloseHandle(transport->pipe);
+        }
+        free(transport);
+    }
+}
+
+#else
+
+struct _TRANSPORT
+{
+    int socket;
+    TRANSPORT_STATS stats;
+};
+
+struct _TRANSPORT_LISTENER
+{
+    int socket;
+    int tcp;
+    char path[MARK_MAX_PATH];
+};
+
+static int SocketAddress(const char* path, struct sockaddr_un* address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path))
+    {
+        printf("Socket path %s is too long\n", path);
+        return 0;
+    }
+    strcpy(address->sun_path, path);
+
+    return 1;
+}
+
+static PTRANSPORT NewTransport(int s)
+{
+    PTRANSPORT transport = (PTRANSPORT)calloc(1, sizeof(TRANSPORT));
+
+    if (!transport)
+    {
+        close(s);
+        return NULL;
+    }
+    transport->socket = s;
+
+    return transport;
+}
+
+PTRANSPORT TransportConnect(const char* address)
+{
+    struct sockaddr_un name;
+    int s;
+
+    if (IsTcpAddress(address))
+    {
+        s = ConnectTcp(address);
+        return s < 0 ? NULL : NewTransport(s);
+    }
+
+    if (!SocketAddress(address, &name))
+    {
+        return NULL;
+    }
+
+    s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (s < 0)
+    {
+        return NULL;
+    }
+    if (connect(s, (struct sockaddr*)&name, sizeof(name)))
+    {
+        close(s);
+        return NULL;
+    }
+
+    return NewTransport(s);
+}
+
+PTRANSPORT_LISTENER TransportListen(const char* address)
+{
+    PTRANSPORT_LISTENER listener;
+    struct sockaddr_un name;
+    int tcp = IsTcpAddress(address);
+    int s;
+
+    if (tcp)
+    {
+        s = ListenTcp(address);
+        if (s < 0)
+        {
+            return NULL;
+        }
+    }
+    else
+    {
+        if (!SocketAddress(address, &name))
+        {
+            return NULL;
+        }
+
+        s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (s < 0)
+        {
+            return NULL;
+        }
+
+        // A socket file left behind by a previous run would make bind fail.
+        unlink(address);
+        if (bind(s, (struct sockaddr*)&name, sizeof(name)) || listen(s, 16))
+        {
+            printf("Cannot listen on %s: %s\n", address, strerror(errno));
+            close(s);
+            return NULL;
+        }
+    }
+
+    listener = (PTRANSPORT_LISTENER)calloc(1, sizeof(TRANSPORT_LISTENER));
+    if (!listener)
+    {
+        close(s);
+        return NULL;
+    }
+    listener->socket = s;
+    listener->tcp = tcp;
+    strncpy(listener->path, address, sizeof(listener->path) - 1);
+
+    return listener;
+}
+
+PTRANSPORT TransportAccept(PTRANSPORT_LISTENER listener)
+{
+    int s;
+
+    do
+    {
+        s = accept(listener->socket, NULL, NULL);
+    } while (s < 0 && errno == EINTR);
+
+    if (s >= 0 && listener->tcp)
+    {
+        SetNoDelay(s);
+    }
+
+    return s < 0 ? NULL : NewTransport(s);
+}
+
+void TransportListenerStop(PTRANSPORT_LISTENER listener)
+{
+    // shutdown wakes a thread blocked in accept, close alone does not.
+    shutdown(listener->socket, SHUT_RDWR);
+}
+
+void TransportListenerClose(PTRANSPORT_LISTENER listener)
+{
+    close(listener->socket);
+    if (!listener->tcp)
+    {
+        unlink(listener->path);
+    }
+    free(listener);
+}
+
+int TransportSend(PTRANSPORT transport, const void* data, unsigned long size)
+{
+    unsigned long done = 0;
+
+    while (done < size)
+    {
+        ssize_t sent;
+
+        transport->stats.sends++;
+        sent = send(transport->socket, (const char*)data + done, size - done, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return 0;
+        }
+        done += (unsigned long)sent;
+    }
+    transport->stats.bytesSent += size;
+
+    return 1;
+}
+
+long TransportReceive(PTRANSPORT transport, void* buffer, unsigned long size)
+{
+    ssize_t received;
+
+    do
+    {
+        transport->stats.receives++;
+        received = recv(transport->socket, buffer, size, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received > 0)
+    {
+        transport->stats.bytesReceived += received;
+    }
+
+    return (long)received;
+}
+
+int TransportPeerClosed(PTRANSPORT transport)
+{
+    struct pollfd wait;
+    char byte;
+
+    wait.fd = transport->socket;
+    wait.events = POLLIN;
+    if (poll(&wait, 1, 0) <= 0)
+    {
+        return 0;
+    }
+
+    return (wait.revents & (POLLHUP | POLLERR)) || recv(transport->socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+void TransportShutdown(PTRANSPORT transport)
+{
+    shutdown(transport->socket, SHUT_RDWR);
+}
+
+void TransportClose(PTRANSPORT transport)
+{
+    if (transport)
+    {
+        close(transport->socket);
+        free(transport);
+    }
+}
+
+#endif
+
+void GetTransportStats(PTRANSPORT transport, PTRANSPORT_STATS stats)
+{
+    *stats = transport->stats;
+}
\ No newline at end of file
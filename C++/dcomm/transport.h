@@ -0,0 +1,53 @@
+#ifndef _TRANSPORT_H_
+#define _TRANSPORT_H_
+
+// Byte stream between dcomm and the processes that consume its events.
+// Named pipes on Windows, Unix domain sockets elsewhere; the address is the
+// pipe name or the socket path. Connections carry data both ways. For the
+// analyzer the consumer listens and dcomm connects, the way it has always
+// been; broker clients connect to dcomm instead. An address of the form
+// tcp:host:port is a TCP connection, for collectors on other hosts.
+
+#ifdef _WIN32
+#define TRANSPORT_DEFAULT_ADDRESS "\\\\.\\pipe\\dcommconnection"
+#else
+#define TRANSPORT_DEFAULT_ADDRESS "/tmp/dcomm.sock"
+#endif
+
+#define TRANSPORT_TCP_PREFIX "tcp:"
+
+#define TRANSPORT_BUFFER_SIZE (256 * 1024) // pipe buffer, Windows
+
+typedef struct _TRANSPORT_STATS
+{
+    unsigned long long sends;    // write calls
+    unsigned long long receives; // read calls
+    unsigned long long bytesSent;
+    unsigned long long bytesReceived;
+} TRANSPORT_STATS, *PTRANSPORT_STATS;
+
+typedef struct _TRANSPORT TRANSPORT, *PTRANSPORT;
+typedef struct _TRANSPORT_LISTENER TRANSPORT_LISTENER, *PTRANSPORT_LISTENER;
+
+PTRANSPORT TransportConnect(const char* address);
+
+PTRANSPORT_LISTENER TransportListen(const char* address);
+// Waits for the next producer. Returns NULL on error or once stopped.
+PTRANSPORT TransportAccept(PTRANSPORT_LISTENER listener);
+// Makes a blocked TransportAccept return; safe from another thread.
+void TransportListenerStop(PTRANSPORT_LISTENER listener);
+void TransportListenerClose(PTRANSPORT_LISTENER listener);
+
+// Sends all of data; returns 0 if the connection broke.
+int TransportSend(PTRANSPORT transport, const void* data, unsigned long size);
+// Returns the bytes received, 0 once the peer has closed and -1 on error.
+long TransportReceive(PTRANSPORT transport, void* buffer, unsigned long size);
+// Whether the peer has hung up, without waiting or taking what it sent.
+int TransportPeerClosed(PTRANSPORT transport);
+// Makes a blocked TransportReceive return; safe from another thread.
+void TransportShutdown(PTRANSPORT transport);
+void TransportClose(PTRANSPORT transport);
+
+void GetTransportStats(PTRANSPORT transport, PTRANSPORT_STATS stats);
+
+#endif
\ No newline at end of file
@@ -11,7 +11,20 @@
 #define MARK_OPTYPE_WRITE 0x3
 #define MARK_OPTYPE_RENAME 0x4
 
+#define MARK_STAGE_RECEIVE 0
+#define MARK_STAGE_PROCESS 1
+#define MARK_STAGE_TEXTLOG 2
+#define MARK_STAGE_BINLOG 3
+#define MARK_STAGE_ANALYZER 4
+#define MARK_STAGE_SHMRING 5
+#define MARK_STAGE_BROKER 6
+#define MARK_STAGE_FORWARD 7
+#define MARK_STAGE_COUNT 8
+
+#define MARK_TIMESTAMP_FREQUENCY 10000000 // 100 ns
+
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
 typedef struct _MARK_EVENT
 {
@@ -21,16 +34,21 @@ typedef struct _MARK_EVENT
 
     unsigned short szOperationPath[256];
 
-    long time;
-    long flags;
+    // Fixed-width fields keep the layout identical in the driver, in the
+    // Windows collector and in Linux builds that replay recorded logs.
+    long long time; // capture, MarkTimestamp() units
+    int flags;
+
+    int pid;
+    int ppid;
+    int tid;
 
-    long pid;
-    long ppid;
-    long tid;
+    int opclass;
+    int optype;
 
-    long opclass;
-    long optype;
-    long reserved3;
+    // When each pipeline stage picked the event up, relative to capture, in
+    // the same 100 ns units. 0 means the stage has not run.
+    unsigned int stages[MARK_STAGE_COUNT];
 } MARK_EVENT, *PMARK_EVENT;
 
 typedef struct _MARK_MESSAGE
@@ -48,8 +66,8 @@ typedef struct _MARK_PROCESS
     unsigned short szUserName[32];
     unsigned short szImagePath[176];
 
-    long pid;
-    long ppid;
+    int pid;
+    int ppid;
 } MARK_PROCESS, *PMARK_PROCESS;
 
 int HandleControlNotification(PMARK_MESSAGE msg);
@@ -65,6 +83,9 @@ int SendEvent(PMARK_EVENT evt);
 PMARK_PROCESS FindLoadProcess(int pid);
 
 void MarkCopyMemory(void* dst, void* src, int bytecount);
+// Monotonic, in 100 ns units. The driver and the collector read the same
+// performance counter, so their timestamps can be subtracted.
+long long MarkTimestamp();
 void* MarkMalloc(int bytecount);
 void MarkFree(void* memory);
 
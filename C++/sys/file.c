@@ -62,7 +62,7 @@ _Out_ PVOID *CompletionContext
 
                 NewEvent.flags = FileObject->Flags;
 
-                NewEvent.time = 0;// time(0);
+                NewEvent.time = MarkTimestamp();
                 NewEvent.pid = (long)pid;
                 NewEvent.ppid = pProc ? pProc->ppid : 0;
                 NewEvent.tid = (long)Data->Thread;
@@ -2,8 +2,6 @@
 #include "core.h"
 #include "processtable.h"
 
-//#include <time.h>
-
 int DeleteProcess(int pid);
 int AddProcess(PMARK_PROCESS pproc);
 
@@ -32,7 +30,7 @@ VOID ProcessCreationCallback(
         RtlCopyMemory(NewEvent.szUserName, pProc ? pProc->szUserName : L"Unknown", sizeof(NewEvent.szUserName));
 
         NewEvent.flags = 0;
-        NewEvent.time = 0;// time(0);
+        NewEvent.time = MarkTimestamp();
         NewEvent.pid = (long)ProcessId;
         NewEvent.ppid = pProc ? pProc->ppid : 0;
         NewEvent.tid = -1;
@@ -67,7 +65,7 @@ VOID ProcessCreationCallback(
     RtlCopyMemory(NewEvent.szUserName, NewProc.szUserName, sizeof(NewEvent.szUserName));
 
     NewEvent.flags = CreateInfo->Flags;
-    NewEvent.time = 0; // time(0);
+    NewEvent.time = MarkTimestamp();
     NewEvent.pid = NewProc.pid;
     NewEvent.ppid = NewProc.ppid;
     NewEvent.tid = -1;
@@ -87,6 +87,17 @@ int DeleteKey(int key)
     return 0;
 }
 
+void ClearProcessTable()
+{
+    int i;
+
+    for (i = 0; i < PROC_TABLE_SIZE; i++)
+    {
+        s_table[i].state = FREE;
+    }
+    s_load = 0;
+}
+
 int DeleteProcess(int pid)
 {
     return DeleteKey(pid);
@@ -5,4 +5,9 @@
 
 PMARK_PROCESS FindLoadProcess(int pid);
 
+PMARK_PROCESS FindKey(int key);
+int InsertValue(int key, PMARK_PROCESS pProc);
+int DeleteKey(int key);
+void ClearProcessTable();
+
 #endif
\ No newline at end of file
@@ -29,7 +29,7 @@ VOID HandleDeleteKeyEvent(PREG_DELETE_KEY_INFORMATION pDelInfo)
     RtlCopyMemory(NewEvent.szUserName, pProc ? pProc->szUserName : L"Unknown", sizeof(NewEvent.szUserName));
 
     NewEvent.flags = 0;
-    NewEvent.time = 0;// time(0);
+    NewEvent.time = MarkTimestamp();
     NewEvent.pid = (long)pid;
     NewEvent.ppid = pProc ? pProc->ppid : 0;
     NewEvent.tid = -1;
@@ -69,7 +69,7 @@ VOID HandleDeleteKeyValueEvent(PREG_DELETE_VALUE_KEY_INFORMATION pDelInfo)
     RtlCopyMemory(NewEvent.szUserName, pProc ? pProc->szUserName : L"Unknown", sizeof(NewEvent.szUserName));
 
     NewEvent.flags = 0;
-    NewEvent.time = 0;// time(0);
+    NewEvent.time = MarkTimestamp();
     NewEvent.pid = (long)pid;
     NewEvent.ppid = pProc ? pProc->ppid : 0;
     NewEvent.tid = -1;
@@ -99,7 +99,7 @@ VOID HandleSetValueEvent(PREG_SET_VALUE_KEY_INFORMATION pSetInfo)
     RtlCopyMemory(NewEvent.szUserName, pProc ? pProc->szUserName : L"Unknown", sizeof(NewEvent.szUserName));
 
     NewEvent.flags = 0;
-    NewEvent.time = 0;// time(0);
+    NewEvent.time = MarkTimestamp();
     NewEvent.pid = (long)pid;
     NewEvent.ppid = pProc ? pProc->ppid : 0;
     NewEvent.tid = -1;
@@ -128,7 +128,7 @@ VOID HandleRenameEvent(PREG_RENAME_KEY_INFORMATION pRenameInfo)
     RtlCopyMemory(NewEvent.szUserName, pProc ? pProc->szUserName : L"Unknown", sizeof(NewEvent.szUserName));
 
     NewEvent.flags = 0;
-    NewEvent.time = 0;// time(0);
+    NewEvent.time = MarkTimestamp();
     NewEvent.pid = (long)pid;
     NewEvent.ppid = pProc ? pProc->ppid : 0;
     NewEvent.tid = -1;
@@ -163,7 +163,7 @@ VOID HandleCreateKeyEvent(PREG_CREATE_KEY_INFORMATION_V1 pCreateInfo)
     RtlCopyMemory(NewEvent.szUserName, pProc ? pProc->szUserName : L"Unknown", sizeof(NewEvent.szUserName));
 
     NewEvent.flags = 0;
-    NewEvent.time = 0;// time(0);
+    NewEvent.time = MarkTimestamp();
     NewEvent.pid = (long)pid;
     NewEvent.ppid = pProc ? pProc->ppid : 0;
     NewEvent.tid = -1;
@@ -11,6 +11,16 @@ void MarkCopyMemory(void* dst, void* src, int bytecount)
 {
     RtlCopyMemory(dst, src, bytecount);
 }
+
+long long MarkTimestamp()
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter = KeQueryPerformanceCounter(&frequency);
+
+    return counter.QuadPart / frequency.QuadPart * MARK_TIMESTAMP_FREQUENCY +
+        counter.QuadPart % frequency.QuadPart * MARK_TIMESTAMP_FREQUENCY / frequency.QuadPart;
+}
+
 void* MarkMalloc(int bytecount)
 {
     return ExAllocatePoolWithTag(PagedPool, bytecount, POOL_TAG);
@@ -0,0 +1,500 @@
+#include "generator.h"
+#include "../dcomm/platform.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define snprintf _snprintf
+#endif
+
+#define NEVER 0x7FFFFFFFFFFFFFFFLL
+#define MAX_PID 0x3FFFC
+
+typedef enum _STREAM
+{
+    STREAM_CHURN,
+    STREAM_FILE,
+    STREAM_STORM,
+    STREAM_STORM_WRITE,
+    STREAM_BURST,
+    STREAM_BURST_OP,
+    STREAM_PACKET,
+    STREAM_COUNT
+} STREAM;
+
+typedef struct _SIM_IMAGE
+{
+    const char* path;
+    const char* commandLine;
+    const char* directory;
+    int weight;
+    int threads;
+} SIM_IMAGE, *PSIM_IMAGE;
+
+typedef struct _SIM_PROCESS
+{
+    int pid;
+    int ppid;
+    int image;
+} SIM_PROCESS, *PSIM_PROCESS;
+
+// Rough mix of a desktop session: a lot of service and browser activity,
+// short-lived shells and a few document and download heavy applications.
+static const SIM_IMAGE s_images[] =
+{
+    { "\\Device\\HarddiskVolume2\\Windows\\System32\\svchost.exe", "svchost.exe -k netsvcs", "\\Windows\\System32\\LogFiles\\WMI", 30, 24 },
+    { "\\Device\\HarddiskVolume2\\Program Files (x86)\\Google\\Chrome\\Application\\chrome.exe", "chrome.exe --type=renderer", "\\Users\\user\\AppData\\Local\\Google\\Chrome\\User Data\\Default\\Cache", 25, 16 },
+    { "\\Device\\HarddiskVolume2\\Windows\\System32\\cmd.exe", "cmd.exe /c", "\\Users\\user\\AppData\\Local\\Temp", 10, 1 },
+    { "\\Device\\HarddiskVolume2\\Windows\\System32\\conhost.exe", "conhost.exe 0xffffffff", "\\Users\\user\\AppData\\Local\\Temp", 10, 2 },
+    { "\\Device\\HarddiskVolume2\\Windows\\explorer.exe", "explorer.exe", "\\Users\\user\\AppData\\Roaming\\Microsoft\\Windows\\Recent", 5, 40 },
+    { "\\Device\\HarddiskVolume2\\Program Files\\Microsoft Office\\root\\Office16\\WINWORD.EXE", "WINWORD.EXE /n", "\\Users\\user\\Documents", 5, 20 },
+    { "\\Device\\HarddiskVolume2\\Windows\\System32\\SearchIndexer.exe", "SearchIndexer.exe /Embedding", "\\ProgramData\\Microsoft\\Search\\Data\\Applications\\Windows", 5, 12 },
+    { "\\Device\\HarddiskVolume2\\ProgramData\\Microsoft\\Windows Defender\\Platform\\MsMpEng.exe", "MsMpEng.exe", "\\ProgramData\\Microsoft\\Windows Defender\\Scans\\History", 4, 30 },
+    { "\\Device\\HarddiskVolume2\\Users\\user\\AppData\\Roaming\\uTorrent\\uTorrent.exe", "uTorrent.exe /MINIMIZED", "\\Users\\user\\Downloads", 3, 10 },
+    { "\\Device\\HarddiskVolume2\\Windows\\System32\\WindowsPowerShell\\v1.0\\powershell.exe", "powershell.exe -NoProfile", "\\Users\\user\\AppData\\Local\\Temp", 3, 8 },
+};
+
+static const char* s_registryKeys[] =
+{
+    "\\REGISTRY\\MACHINE\\SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Run",
+    "\\REGISTRY\\MACHINE\\SYSTEM\\CurrentControlSet\\Services\\bam\\State\\UserSettings",
+    "\\REGISTRY\\USER\\S-1-5-21-1004336348-1177238915-682003330-1001\\Software\\Microsoft\\Windows\\CurrentVersion\\Explorer\\RecentDocs",
+    "\\REGISTRY\\USER\\S-1-5-21-1004336348-1177238915-682003330-1001\\Software\\Microsoft\\Windows\\CurrentVersion\\Internet Settings",
+    "\\REGISTRY\\MACHINE\\SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\Winlogon",
+};
+
+#define IMAGE_COUNT (sizeof(s_images) / sizeof(s_images[0]))
+#define REGISTRY_KEY_COUNT (sizeof(s_registryKeys) / sizeof(s_registryKeys[0]))
+
+static unsigned long long s_random = 0;
+static long long s_now = 0;
+static int s_nextPid = GENERATOR_FIRST_PID;
+static int s_imageWeight = 0;
+
+static PSIM_PROCESS s_live = NULL;
+static int s_liveCount = 0;
+
+static int s_stormProcess = 0;
+static int s_stormLeft = 0;
+static unsigned long long s_stormId = 0;
+static int s_burstProcess = 0;
+static int s_burstLeft = 0;
+static const char* s_burstKey = NULL;
+
+static PGENERATOR_OPTIONS s_options = NULL;
+static PGENERATOR_STATS s_stats = NULL;
+static GENERATOR_EMIT s_emit = NULL;
+static void* s_context = NULL;
+static long long s_next[STREAM_COUNT];
+static long long s_end = 0;
+
+// xorshift64*: small, fast and identical on every platform.
+static unsigned long long NextRandom()
+{
+    s_random ^= s_random >> 12;
+    s_random ^= s_random << 25;
+    s_random ^= s_random >> 27;
+    return s_random * 0x2545F4914F6CDD1DULL;
+}
+
+static int RandomBelow(int limit)
+{
+    return (int)((NextRandom() >> 32) % (unsigned long long)limit);
+}
+
+static double RandomUniform()
+{
+    return (NextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static long long NextArrival(double rate)
+{
+    if (rate <= 0)
+    {
+        return NEVER;
+    }
+    return s_now + 1 + (long long)(-log(1.0 - RandomUniform()) / rate * GENERATOR_TICKS_PER_SECOND);
+}
+
+static int PickImage()
+{
+    int value = RandomBelow(s_imageWeight);
+    int i;
+
+    for (i = 0; i < (int)IMAGE_COUNT - 1; i++)
+    {
+        value -= s_images[i].weight;
+        if (value < 0)
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+static int IsLive(int pid)
+{
+    int i;
+
+    for (i = 0; i < s_liveCount; i++)
+    {
+        if (s_live[i].pid == pid)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Windows hands out pids in steps of 4 and reuses them after a while.
+static int AllocatePid()
+{
+    do
+    {
+        s_nextPid += 4;
+        if (s_nextPid > MAX_PID)
+        {
+            s_nextPid = GENERATOR_FIRST_PID;
+        }
+    } while (IsLive(s_nextPid));
+
+    return s_nextPid;
+}
+
+static int PickThread(PSIM_PROCESS process)
+{
+    return process->pid * 16 + RandomBelow(s_images[process->image].threads) * 4;
+}
+
+// Fills the process part of an event the way the driver callbacks do.
+static void FillProcess(PMARK_EVENT evt, PSIM_PROCESS process)
+{
+    const SIM_IMAGE* image = &s_images[process->image];
+
+    MARK_SET_TEXT(evt->szImagePath, image->path);
+    MARK_SET_TEXT(evt->szProcessName, image->commandLine);
+    MARK_SET_TEXT(evt->szUserName, "Unknown");
+
+    evt->time = s_now;
+    evt->pid = process->pid;
+    evt->ppid = process->ppid;
+}
+
+// Same event as ProcessCreationCallback sends for a new process.
+static void StartSimProcess(PSIM_PROCESS process, int ppid)
+{
+    MARK_EVENT NewEvent = { 0 };
+
+    process->pid = AllocatePid();
+    process->ppid = ppid;
+    process->image = PickImage();
+
+    FillProcess(&NewEvent, process);
+    memcpy(NewEvent.szOperationPath, NewEvent.szImagePath, sizeof(NewEvent.szImagePath));
+
+    NewEvent.flags = 0;
+    NewEvent.tid = -1;
+
+    NewEvent.opclass = MARK_OPCLASS_PROCESS;
+    NewEvent.optype = MARK_OPTYPE_CREATE;
+
+    s_emit(&NewEvent, s_context);
+
+    s_stats->processCreates++;
+    s_stats->events++;
+}
+
+static void ExitSimProcess(PSIM_PROCESS process)
+{
+    MARK_EVENT NewEvent = { 0 };
+
+    FillProcess(&NewEvent, process);
+    memcpy(NewEvent.szOperationPath, NewEvent.szImagePath, sizeof(NewEvent.szImagePath));
+
+    NewEvent.flags = 0;
+    NewEvent.tid = -1;
+
+    NewEvent.opclass = MARK_OPCLASS_PROCESS;
+    NewEvent.optype = MARK_OPTYPE_DESTROY;
+
+    s_emit(&NewEvent, s_context);
+
+    s_stats->processExits++;
+    s_stats->events++;
+}
+
+static void WriteSimFile(PSIM_PROCESS process, const char* name)
+{
+    MARK_EVENT NewEvent = { 0 };
+
+    FillProcess(&NewEvent, process);
+    MARK_SET_TEXT(NewEvent.szOperationPath, name);
+
+    NewEvent.flags = 0x00040002; // FO_SYNCHRONOUS_IO | FO_HANDLE_CREATED
+    NewEvent.tid = PickThread(process);
+
+    NewEvent.opclass = MARK_OPCLASS_FILE;
+    NewEvent.optype = MARK_OPTYPE_WRITE;
+
+    s_emit(&NewEvent, s_context);
+
+    s_stats->fileWrites++;
+    s_stats->events++;
+}
+
+static void TouchSimRegistry(PSIM_PROCESS process, const char* key)
+{
+    static const int optypes[] = { MARK_OPTYPE_WRITE, MARK_OPTYPE_WRITE, MARK_OPTYPE_WRITE, MARK_OPTYPE_CREATE, MARK_OPTYPE_DESTROY, MARK_OPTYPE_RENAME };
+    MARK_EVENT NewEvent = { 0 };
+
+    FillProcess(&NewEvent, process);
+    MARK_SET_TEXT(NewEvent.szOperationPath, key);
+
+    NewEvent.flags = 0;
+    NewEvent.tid = -1;
+
+    NewEvent.opclass = MARK_OPCLASS_REGISTRY;
+    NewEvent.optype = optypes[RandomBelow(sizeof(optypes) / sizeof(optypes[0]))];
+
+    s_emit(&NewEvent, s_context);
+
+    s_stats->registryOps++;
+    s_stats->events++;
+}
+
+// Same shape as the events HandlePacket builds in the collector.
+static void SendSimPacket()
+{
+    MARK_EVENT evt = { 0 };
+
+    evt.opclass = MARK_OPCLASS_PACKET;
+    evt.optype = MARK_OPTYPE_WRITE;
+    evt.time = s_now;
+
+    s_emit(&evt, s_context);
+
+    s_stats->packets++;
+    s_stats->events++;
+}
+
+static PSIM_PROCESS FindLive(int pid)
+{
+    int i;
+
+    for (i = 0; i < s_liveCount; i++)
+    {
+        if (s_live[i].pid == pid)
+        {
+            return &s_live[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void RunStream(STREAM stream, long long* next, PGENERATOR_OPTIONS options)
+{
+    char name[256];
+    PSIM_PROCESS process = s_liveCount ? &s_live[RandomBelow(s_liveCount)] : NULL;
+
+    switch (stream)
+    {
+    case STREAM_CHURN:
+        if (process)
+        {
+            int ppid = s_live[RandomBelow(s_liveCount)].pid;
+            ExitSimProcess(process);
+            StartSimProcess(process, ppid == process->pid ? 4 : ppid);
+        }
+        next[stream] = NextArrival(options->churn);
+        break;
+
+    case STREAM_FILE:
+        if (process)
+        {
+            snprintf(name, sizeof(name), "%s\\f%05d.tmp", s_images[process->image].directory, RandomBelow(100000));
+            WriteSimFile(process, name);
+        }
+        next[stream] = NextArrival(options->fileRate);
+        break;
+
+    case STREAM_STORM:
+        // A storm that is still running absorbs the next one.
+        if (process && !s_stormLeft && options->stormSize > 0)
+        {
+            s_stormProcess = process->pid;
+            s_stormLeft = options->stormSize;
+            s_stormId++;
+            s_stats->storms++;
+            next[STREAM_STORM_WRITE] = s_now + 1;
+        }
+        next[stream] = NextArrival(options->stormRate);
+        break;
+
+    case STREAM_STORM_WRITE:
+        process = FindLive(s_stormProcess);
+        if (process && s_stormLeft > 0)
+        {
+            snprintf(name, sizeof(name), "%s\\batch%llu\\doc%05d.docx", s_images[process->image].directory,
+                s_stormId, options->stormSize - s_stormLeft);
+            WriteSimFile(process, name);
+            s_stormLeft--;
+        }
+        else
+        {
+            s_stormLeft = 0;
+        }
+        next[stream] = s_stormLeft ? s_now + GENERATOR_BURST_SPACING : NEVER;
+        break;
+
+    case STREAM_BURST:
+        if (process && !s_burstLeft && options->registrySize > 0)
+        {
+            s_burstProcess = process->pid;
+            s_burstLeft = options->registrySize;
+            s_burstKey = s_registryKeys[RandomBelow(REGISTRY_KEY_COUNT)];
+            s_stats->bursts++;
+            next[STREAM_BURST_OP] = s_now + 1;
+        }
+        next[stream] = NextArrival(options->registryRate);
+        break;
+
+    case STREAM_BURST_OP:
+        process = FindLive(s_burstProcess);
+        if (process && s_burstLeft > 0)
+        {
+            snprintf(name, sizeof(name), "%s\\Value%d", s_burstKey, RandomBelow(64));
+            TouchSimRegistry(process, name);
+            s_burstLeft--;
+        }
+        else
+        {
+            s_burstLeft = 0;
+        }
+        next[stream] = s_burstLeft ? s_now + GENERATOR_BURST_SPACING : NEVER;
+        break;
+
+    case STREAM_PACKET:
+        SendSimPacket();
+        next[stream] = NextArrival(options->packetRate);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void GetDefaultGeneratorOptions(PGENERATOR_OPTIONS options)
+{
+    memset(options, 0, sizeof(*options));
+
+    options->seed = 1;
+    options->duration = 10;
+    options->processes = 120;
+    options->churn = 2;
+    options->fileRate = 2000;
+    options->stormRate = 0.2;
+    options->stormSize = 5000;
+    options->registryRate = 1;
+    options->registrySize = 200;
+    options->packetRate = 5000;
+}
+
+int StartGenerator(PGENERATOR_OPTIONS options, GENERATOR_EMIT emit, void* context, PGENERATOR_STATS stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    s_options = options;
+    s_stats = stats;
+    s_emit = emit;
+    s_context = context;
+
+    if (options->processes <= 0)
+    {
+        return 0;
+    }
+
+    s_live = (PSIM_PROCESS)malloc(options->processes * sizeof(SIM_PROCESS));
+    if (!s_live)
+    {
+        return 0;
+    }
+
+    // A zero state would make xorshift emit zeros forever.
+    s_random = options->seed ? options->seed : 0x9E3779B97F4A7C15ULL;
+    // The clock starts at one tick so that every event carries a timestamp.
+    s_now = 1;
+    s_end = options->duration > 0 ? (long long)(options->duration * GENERATOR_TICKS_PER_SECOND) : NEVER;
+    s_nextPid = GENERATOR_FIRST_PID;
+    s_liveCount = 0;
+    s_stormLeft = 0;
+    s_burstLeft = 0;
+    s_stormId = 0;
+
+    s_imageWeight = 0;
+    for (i = 0; i < (int)IMAGE_COUNT; i++)
+    {
+        s_imageWeight += s_images[i].weight;
+    }
+
+    // Boot: the initial population starts one after another.
+    for (i = 0; i < options->processes; i++)
+    {
+        StartSimProcess(&s_live[i], i ? s_live[RandomBelow(i)].pid : 4);
+        s_liveCount++;
+        s_now += GENERATOR_BURST_SPACING;
+    }
+
+    s_next[STREAM_CHURN] = NextArrival(options->churn);
+    s_next[STREAM_FILE] = NextArrival(options->fileRate);
+    s_next[STREAM_STORM] = NextArrival(options->stormRate);
+    s_next[STREAM_STORM_WRITE] = NEVER;
+    s_next[STREAM_BURST] = NextArrival(options->registryRate);
+    s_next[STREAM_BURST_OP] = NEVER;
+    s_next[STREAM_PACKET] = NextArrival(options->packetRate);
+
+    return 1;
+}
+
+int StepGenerator()
+{
+    int stream = 0;
+    int i;
+
+    for (i = 1; i < STREAM_COUNT; i++)
+    {
+        if (s_next[i] < s_next[stream])
+        {
+            stream = i;
+        }
+    }
+
+    if (s_next[stream] > s_end)
+    {
+        return 0;
+    }
+
+    s_now = s_next[stream];
+    RunStream((STREAM)stream, s_next, s_options);
+    return 1;
+}
+
+void StopGenerator(GENERATOR_FORGET forget)
+{
+    int i;
+
+    for (i = 0; forget && i < s_liveCount; i++)
+    {
+        forget(s_live[i].pid, s_context);
+    }
+
+    free(s_live);
+    s_live = NULL;
+    s_liveCount = 0;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#ifndef _GENERATOR_H_
+#define _GENERATOR_H_
+
+#include "../sys/core.h"
+
+// Synthetic workload: processes start, write files, touch the registry and
+// exit the way the kernel callbacks would report them. Arrivals are Poisson
+// on a virtual clock, so the same seed always produces the same stream
+// regardless of host speed. RunGenerator in umimpl.h drives the driver's
+// event path with it; dcomm's synthetic source feeds the collector.
+
+#define GENERATOR_TICKS_PER_SECOND MARK_TIMESTAMP_FREQUENCY
+#define GENERATOR_BURST_SPACING 200        // ticks between events of a storm or burst
+#define GENERATOR_FIRST_PID 1000
+
+typedef struct _GENERATOR_OPTIONS
+{
+    unsigned long long seed;
+    double duration;     // simulated seconds, 0 to run until stopped
+
+    int processes;       // live processes in steady state
+    double churn;        // process exits per second, each replaced by a new process
+
+    double fileRate;     // background file writes per second
+    double stormRate;    // write storms per second
+    int stormSize;       // writes per storm, all from one process into one directory
+
+    double registryRate; // registry bursts per second
+    int registrySize;    // operations per burst
+
+    double packetRate;   // packets per second
+} GENERATOR_OPTIONS, *PGENERATOR_OPTIONS;
+
+typedef struct _GENERATOR_STATS
+{
+    unsigned long long processCreates;
+    unsigned long long processExits;
+    unsigned long long fileWrites;
+    unsigned long long storms;
+    unsigned long long registryOps;
+    unsigned long long bursts;
+    unsigned long long packets;
+    unsigned long long events;
+} GENERATOR_STATS, *PGENERATOR_STATS;
+
+// Takes every event as it is made, stamped with the virtual clock.
+typedef void (*GENERATOR_EMIT)(PMARK_EVENT evt, void* context);
+// Told of each process still alive when the generator stops.
+typedef void (*GENERATOR_FORGET)(int pid, void* context);
+
+void GetDefaultGeneratorOptions(PGENERATOR_OPTIONS options);
+// Starts the initial processes. One generator runs at a time.
+int StartGenerator(PGENERATOR_OPTIONS options, GENERATOR_EMIT emit, void* context, PGENERATOR_STATS stats);
+// Runs the next arrival; 0 once the duration is over.
+int StepGenerator();
+// forget may be NULL.
+void StopGenerator(GENERATOR_FORGET forget);
+
+#endif
\ No newline at end of file
@@ -1,9 +1,134 @@
+// Runs the synthetic workload through the driver's event path in user mode
+// and optionally records it as a binary log for dcomm -replay.
+//
+// Linux build, from this directory:
+//   gcc -O2 -pthread -o ums main.c umimpl.c generator.c ../sys/core.c ../sys/processtable.c
+//       ../dcomm/platform.c -lm
+
 #include <stdio.h>
-#include "..\sys\core.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../sys/core.h"
+#include "generator.h"
+#include "umimpl.h"
+
+static void PrintUsage()
+{
+    printf("ums [-seed n] [-duration s] [-processes n] [-churn per s]\n"
+           "    [-files per s] [-storms per s] [-stormsize n]\n"
+           "    [-registry per s] [-burstsize n] [-packets per s]\n"
+           "    [-out binlog] [-echo] [-sizes]\n");
+}
 
-int main() 
+int main(int argc, char* argv[])
 {
-    printf("%d\n", sizeof(MARK_EVENT));
-    printf("%d\n", sizeof(MARK_MESSAGE));
-    printf("%d\n", sizeof(MARK_PROCESS));
+    GENERATOR_OPTIONS options;
+    GENERATOR_STATS stats;
+    const char* output = NULL;
+    int i;
+
+    GetDefaultGeneratorOptions(&options);
+
+    for (i = 1; i < argc; i++)
+    {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (!strcmp(argv[i], "-sizes"))
+        {
+            printf("%d\n", (int)sizeof(MARK_EVENT));
+            printf("%d\n", (int)sizeof(MARK_MESSAGE));
+            printf("%d\n", (int)sizeof(MARK_PROCESS));
+            return 0;
+        }
+        else if (!strcmp(argv[i], "-echo"))
+        {
+            SetEventEcho(1);
+            continue;
+        }
+        else if (!value)
+        {
+            PrintUsage();
+            return 1;
+        }
+        else if (!strcmp(argv[i], "-seed"))
+        {
+            options.seed = strtoull(value, NULL, 10);
+        }
+        else if (!strcmp(argv[i], "-duration"))
+        {
+            options.duration = atof(value);
+        }
+        else if (!strcmp(argv[i], "-processes"))
+        {
+            options.processes = atoi(value);
+        }
+        else if (!strcmp(argv[i], "-churn"))
+        {
+            options.churn = atof(value);
+        }
+        else if (!strcmp(argv[i], "-files"))
+        {
+            options.fileRate = atof(value);
+        }
+        else if (!strcmp(argv[i], "-storms"))
+        {
+            options.stormRate = atof(value);
+        }
+        else if (!strcmp(argv[i], "-stormsize"))
+        {
+            options.stormSize = atoi(value);
+        }
+        else if (!strcmp(argv[i], "-registry"))
+        {
+            options.registryRate = atof(value);
+        }
+        else if (!strcmp(argv[i], "-burstsize"))
+        {
+            options.registrySize = atoi(value);
+        }
+        else if (!strcmp(argv[i], "-packets"))
+        {
+            options.packetRate = atof(value);
+        }
+        else if (!strcmp(argv[i], "-out"))
+        {
+            output = value;
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+        i++;
+    }
+
+    if (output && !OpenEventOutput(output))
+    {
+        return 1;
+    }
+
+    clock_t start = clock();
+    int result = RunGenerator(&options, &stats);
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    CloseEventOutput();
+
+    if (!result)
+    {
+        printf("Generator failed\n");
+        return 1;
+    }
+
+    printf("Seed %llu, %.1f simulated s: %llu events in %.3f s (%.0f events/s)\n",
+        options.seed, options.duration, stats.events, seconds, seconds > 0 ? stats.events / seconds : 0.0);
+    printf("Processes: %llu started, %llu exited\n", stats.processCreates, stats.processExits);
+    printf("Files: %llu writes, %llu storms\n", stats.fileWrites, stats.storms);
+    printf("Registry: %llu operations, %llu bursts\n", stats.registryOps, stats.bursts);
+    printf("Packets: %llu\n", stats.packets);
+    printf("Sent: process %llu, file %llu, registry %llu, packet %llu\n",
+        GetSentEvents(MARK_OPCLASS_PROCESS), GetSentEvents(MARK_OPCLASS_FILE),
+        GetSentEvents(MARK_OPCLASS_REGISTRY), GetSentEvents(MARK_OPCLASS_PACKET));
+
+    return 0;
 }
\ No newline at end of file
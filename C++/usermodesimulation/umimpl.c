@@ -1,8 +1,182 @@
-#include "..\sys\core.h"
+#include "umimpl.h"
+#include "../dcomm/binlog.h"
+#include "../dcomm/platform.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OUTPUT_BUFFER_SIZE (1024 * 1024)
+
+static FILE* s_output = NULL;
+static int s_echo = 0;
+static unsigned long long s_sent[MARK_OPCLASS_PACKET + 1] = { 0 };
+
+static const char* Narrow(const unsigned short* text, int length, char* buffer)
+{
+    int i;
+
+    for (i = 0; i < length && text[i]; i++)
+    {
+        buffer[i] = text[i] < 0x80 ? (char)text[i] : '?';
+    }
+    buffer[i] = 0;
+
+    return buffer;
+}
 
 int SendEvent(PMARK_EVENT evt)
 {
-    printf("%S (%S) => %x%x : %S\n\n", evt->szProcessName, evt->szUserName, evt->opclass, evt->optype, evt->szOperationPath);
+    s_sent[evt->opclass > 0 && evt->opclass <= MARK_OPCLASS_PACKET ? evt->opclass : 0]++;
+
+    if (s_output)
+    {
+        fwrite(evt, sizeof(MARK_EVENT), 1, s_output);
+    }
+
+    if (s_echo)
+    {
+        char process[32 + 1], user[32 + 1], path[256 + 1];
+
+        printf("%s (%s) => %x%x : %s\n\n",
+            Narrow(evt->szProcessName, 32, process),
+            Narrow(evt->szUserName, 32, user),
+            evt->opclass,
+            evt->optype,
+            Narrow(evt->szOperationPath, 256, path));
+    }
+
     return 0;
+}
+
+int OpenEventOutput(const char* path)
+{
+    BINLOG_HEADER header = { BINLOG_MAGIC, BINLOG_VERSION, sizeof(MARK_EVENT), 0 };
+
+    s_output = fopen(path, "wb");
+    if (!s_output)
+    {
+        printf("Cannot create %s\n", path);
+        return 0;
+    }
+
+    setvbuf(s_output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    return fwrite(&header, sizeof(header), 1, s_output) == 1;
+}
+
+void CloseEventOutput()
+{
+    if (s_output)
+    {
+        fclose(s_output);
+        s_output = NULL;
+    }
+}
+
+void SetEventEcho(int echo)
+{
+    s_echo = echo;
+}
+
+unsigned long long GetSentEvents(int opclass)
+{
+    return opclass >= 0 && opclass <= MARK_OPCLASS_PACKET ? s_sent[opclass] : 0;
+}
+
+// Kernel services the core expects from util.c.
+int AddProcess(PMARK_PROCESS pproc);
+int DeleteProcess(int pid);
+
+void MarkCopyMemory(void* dst, void* src, int bytecount)
+{
+    memcpy(dst, src, bytecount);
+}
+
+void* MarkMalloc(int bytecount)
+{
+    return malloc(bytecount);
+}
+
+void MarkFree(void* memory)
+{
+    free(memory);
+}
+
+// No process to look up in user mode, so unknown pids get a placeholder.
+int LoadProcess(int pid)
+{
+    static unsigned short unknown[176] = { 'U', 'n', 'k', 'n', 'o', 'w', 'n', 0 };
+    MARK_PROCESS Proc = { 0 };
+
+    Proc.pid = pid;
+    Proc.ppid = 0;
+
+    MarkCopyMemory(Proc.szImagePath, unknown, sizeof(Proc.szImagePath));
+    MarkCopyMemory(Proc.szUserName, unknown, sizeof(Proc.szUserName));
+    MarkCopyMemory(Proc.szProcessName, unknown, sizeof(Proc.szProcessName));
+
+    return AddProcess(&Proc);
+}
+
+// Same steps as the driver callbacks: a new process joins the process table
+// before its event, an exiting one leaves it after.
+static void HandleGeneratedEvent(PMARK_EVENT evt, void* context)
+{
+    MARK_PROCESS NewProc = { 0 };
+
+    UNREFERENCED_PARAMETER(context);
+
+    switch (evt->opclass)
+    {
+    case MARK_OPCLASS_PROCESS:
+        if (evt->optype == MARK_OPTYPE_CREATE)
+        {
+            MarkCopyMemory(NewProc.szImagePath, evt->szImagePath, sizeof(NewProc.szImagePath));
+            MarkCopyMemory(NewProc.szProcessName, evt->szProcessName, sizeof(NewProc.szProcessName));
+            MarkCopyMemory(NewProc.szUserName, evt->szUserName, sizeof(NewProc.szUserName));
+            NewProc.pid = evt->pid;
+            NewProc.ppid = evt->ppid;
+
+            AddProcess(&NewProc);
+            HandleProcessEvent(evt);
+        }
+        else
+        {
+            HandleProcessEvent(evt);
+            DeleteProcess(evt->pid);
+        }
+        break;
+    case MARK_OPCLASS_FILE:
+        HandleFileEvent(evt);
+        break;
+    case MARK_OPCLASS_REGISTRY:
+        HandleRegistryEvent(evt);
+        break;
+    default:
+        HandlePacketEvent(evt);
+        break;
+    }
+}
+
+static void ForgetProcess(int pid, void* context)
+{
+    UNREFERENCED_PARAMETER(context);
+
+    DeleteProcess(pid);
+}
+
+int RunGenerator(PGENERATOR_OPTIONS options, PGENERATOR_STATS stats)
+{
+    if (!StartGenerator(options, HandleGeneratedEvent, NULL, stats))
+    {
+        return 0;
+    }
+
+    while (StepGenerator())
+    {
+    }
+
+    // Leave the process table as we found it for the next run.
+    StopGenerator(ForgetProcess);
+    return 1;
 }
\ No newline at end of file
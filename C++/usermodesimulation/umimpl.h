@@ -0,0 +1,18 @@
+#ifndef _UMIMPL_H_
+#define _UMIMPL_H_
+
+#include "../sys/core.h"
+#include "generator.h"
+
+// Where SendEvent delivers in the simulation: counted always, optionally
+// echoed to the console and recorded as a binary log for dcomm -replay.
+int OpenEventOutput(const char* path);
+void CloseEventOutput();
+void SetEventEcho(int echo);
+unsigned long long GetSentEvents(int opclass);
+
+// One whole generator run through the driver's handlers and on to SendEvent,
+// with the processes in the process table while they live.
+int RunGenerator(PGENERATOR_OPTIONS options, PGENERATOR_STATS stats);
+
+#endif
\ No newline at end of file